@@ -1467,6 +1467,7 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
     add_opt(common_arg(
         {"--kv-unified", "-kvu"},
         string_format("use single unified KV buffer for the KV cache of all sequences (default: %s)\n"
+            "in the server, each slot can then use the entire context instead of ctx-size / parallel\n"
             "[(more info)](https://github.com/ggml-org/llama.cpp/pull/14363)", params.kv_unified ? "true" : "false"),
         [](common_params & params) {
             params.kv_unified = true;
@@ -1515,6 +1516,20 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.sampling.no_perf = true;
         }
     ).set_env("LLAMA_ARG_NO_PERF"));
+    add_opt(common_arg(
+        {"--profile"}, "N",
+        string_format("profile the nodes computed on the CPU during the first N decode calls, including the warmup, and print a summary by op (default: %d, 0 = disabled)", params.n_profile),
+        [](common_params & params, int value) {
+            params.n_profile = value;
+        }
+    ).set_env("LLAMA_ARG_PROFILE"));
+    add_opt(common_arg(
+        {"--profile-file"}, "FNAME",
+        "write the profile of the decode calls to FNAME in the Chrome trace format (chrome://tracing, https://ui.perfetto.dev)",
+        [](common_params & params, const std::string & value) {
+            params.profile_file = value;
+        }
+    ).set_env("LLAMA_ARG_PROFILE_FILE"));
     add_opt(common_arg(
         {"-f", "--file"}, "FNAME",
         "a file containing the prompt (default: none)",
@@ -2194,6 +2209,26 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.defrag_thold = std::stof(value);
         }
     ).set_env("LLAMA_ARG_DEFRAG_THOLD"));
+    add_opt(common_arg(
+        {"--kv-block-size"}, "N",
+        string_format("allocate the KV cache of each sequence in blocks of N cells, requires LLAMA_SET_ROWS=1 (default: %d, 0 = disabled)", params.kv_block_size),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.kv_block_size = value;
+        }
+    ).set_env("LLAMA_ARG_KV_BLOCK_SIZE"));
+    add_opt(common_arg(
+        {"--top-k-logits"}, "N",
+        string_format("output only the N largest logits of each token from the graph, the samplers only see those (default: %d, 0 = all logits)", params.n_top_k_logits),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_top_k_logits = value;
+        }
+    ).set_env("LLAMA_ARG_TOP_K_LOGITS"));
     add_opt(common_arg(
         {"-np", "--parallel"}, "N",
         string_format("number of parallel sequences to decode (default: %d)", params.n_parallel),
@@ -2288,12 +2323,14 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
         "- distribute: spread execution evenly over all nodes\n"
         "- isolate: only spawn threads on CPUs on the node that execution started on\n"
         "- numactl: use the CPU map provided by numactl\n"
+        "- split: like distribute, and place the rows of the weights on the nodes of the threads that use them\n"
         "if run without this previously, it is recommended to drop the system page cache before using this\n"
         "see https://github.com/ggml-org/llama.cpp/issues/1437",
         [](common_params & params, const std::string & value) {
             /**/ if (value == "distribute" || value == "") { params.numa = GGML_NUMA_STRATEGY_DISTRIBUTE; }
             else if (value == "isolate") { params.numa = GGML_NUMA_STRATEGY_ISOLATE; }
             else if (value == "numactl") { params.numa = GGML_NUMA_STRATEGY_NUMACTL; }
+            else if (value == "split") { params.numa = GGML_NUMA_STRATEGY_SPLIT; }
             else { throw std::invalid_argument("invalid value"); }
         }
     ).set_env("LLAMA_ARG_NUMA"));
@@ -2447,6 +2484,30 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.check_tensors = true;
         }
     ));
+    add_opt(common_arg(
+        {"--repack-cache"},
+        string_format("store the weights repacked for the CPU in a file next to the model (<model>.<buffer type>.cache) and mmap it on later loads (default: %s)", params.repack_cache ? "true" : "false"),
+        [](common_params & params) {
+            params.repack_cache = true;
+        }
+    ).set_env("LLAMA_ARG_REPACK_CACHE"));
+    add_opt(common_arg(
+        {"--fuse-weights"},
+        string_format("concatenate the Q/K/V and the gate/up weights of each layer at load time, so that they are computed with one matrix multiplication each; the affected weights are not mmap-ed and LoRA adapters for them cannot be used (default: %s)", params.fuse_weights ? "true" : "false"),
+        [](common_params & params) {
+            params.fuse_weights = true;
+        }
+    ).set_env("LLAMA_ARG_FUSE_WEIGHTS"));
+    add_opt(common_arg(
+        {"--load-threads"}, "N",
+        string_format("number of threads that load the tensors stored in CPU buffers, 0 = from the number of cores (at most 8), 1 = on the main thread (default: %d)", params.n_load_threads),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_load_threads = value;
+        }
+    ).set_env("LLAMA_ARG_LOAD_THREADS"));
     add_opt(common_arg(
         {"--override-kv"}, "KEY=TYPE:VALUE",
         "advanced option to override model metadata by key. may be specified multiple times.\n"
@@ -2844,6 +2905,57 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.n_cache_reuse = value;
         }
     ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_CACHE_REUSE"));
+    add_opt(common_arg(
+        {"--cache-ram"}, "N",
+        string_format(
+            "max host memory in MiB for caching the KV states of prompts that were evicted from the slots (default: %d, 0 = disabled)",
+            params.cache_ram_mib
+        ),
+        [](common_params & params, int value) {
+            params.cache_ram_mib = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_CACHE_RAM"));
+    add_opt(common_arg(
+        {"--grammar-cache"}, "N",
+        string_format(
+            "max number of compiled grammars and converted JSON schemas kept for the next requests (default: %d, 0 = disabled)\n"
+            "the allowed tokens of the grammar states are cached with them, up to 256 MiB for all the grammars",
+            params.n_grammar_cache
+        ),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_grammar_cache = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_GRAMMAR_CACHE"));
+    add_opt(common_arg(
+        {"--sched-budget"}, "N",
+        string_format(
+            "max number of tokens processed per decode step, long prompts are split in chunks that are interleaved with the generation of the other slots (default: %d, 0 = n_batch)",
+            params.n_sched_budget
+        ),
+        [](common_params & params, int value) {
+            if (value < 0) {
+                throw std::invalid_argument("invalid value");
+            }
+            params.n_sched_budget = value;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_SCHED_BUDGET"));
+    add_opt(common_arg(
+        {"--no-sched-decode-first"},
+        "do not count the generated tokens towards the budget of the decode step, prompt chunks always get the full budget",
+        [](common_params & params) {
+            params.sched_decode_first = false;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_NO_SCHED_DECODE_FIRST"));
+    add_opt(common_arg(
+        {"--sched-preempt"},
+        string_format("with a unified KV cache (-kvu), each slot can use the entire context instead of ctx-size / parallel, and when the cache is full the slots with lower priority are swapped out to host memory (default: %s)", params.sched_preempt ? "enabled" : "disabled"),
+        [](common_params & params) {
+            params.sched_preempt = true;
+        }
+    ).set_examples({LLAMA_EXAMPLE_SERVER}).set_env("LLAMA_ARG_SCHED_PREEMPT"));
     add_opt(common_arg(
         {"--metrics"},
         string_format("enable prometheus compatible metrics endpoint (default: %s)", params.endpoint_metrics ? "enabled" : "disabled"),
@@ -3,6 +3,7 @@
 #include "log.h"
 #include "regex-partial.h"
 
+#include <algorithm>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -10,18 +11,64 @@
 
 using json = nlohmann::ordered_json;
 
-common_chat_msg_parser::common_chat_msg_parser(const std::string & input, bool is_partial, const common_chat_syntax & syntax)
+common_chat_msg_parser::common_chat_msg_parser(const std::string & input, bool is_partial, const common_chat_syntax & syntax, common_chat_parse_state * state)
     : input_(input), is_partial_(is_partial), syntax_(syntax)
 {
     result_.role = "assistant";
 
-    while (true) {
+    if (state) {
+        if (input.size() < state->input.size() || input.compare(0, state->input.size(), state->input) != 0) {
+            state->reset();
+        }
+
+        // the marker of the previous input is still valid if it does not appear in the new text
+        const auto & marker = state->healing_marker;
+        if (!marker.empty()) {
+            const size_t from = state->input.size() >= marker.size() ? state->input.size() - marker.size() + 1 : 0;
+            if (input.find(marker, from) == std::string::npos) {
+                healing_marker_ = marker;
+            }
+        }
+
+        state->input.append(input, state->input.size(), std::string::npos);
+
+        // the results of the previous searches are only reused while parsing partial input, so that the final
+        // result is always the same as the one of a non-incremental parse
+        if (is_partial) {
+            state_ = state;
+        }
+    }
+
+    while (healing_marker_.empty()) {
         std::string id = std::to_string(std::rand());
         if (input.find(id) == std::string::npos) {
             healing_marker_ = id;
-            break;
         }
     }
+
+    if (state) {
+        state->healing_marker = healing_marker_;
+    }
+}
+
+size_t common_chat_msg_parser::search_start(char type, const std::string & pattern, size_t pos, size_t overlap) const {
+    if (!state_) {
+        return pos;
+    }
+
+    const auto it = state_->searched.find({type, pattern, pos});
+    if (it == state_->searched.end()) {
+        return pos;
+    }
+
+    // a match can still start in the last (overlap) bytes of the input that has been searched
+    return std::max(pos, it->second > overlap ? it->second - overlap : 0);
+}
+
+void common_chat_msg_parser::search_done(char type, const std::string & pattern, size_t pos) {
+    if (state_) {
+        state_->searched[{type, pattern, pos}] = input_.size();
+    }
 }
 
 std::string common_chat_msg_parser::str(const common_string_range & rng) const {
@@ -99,7 +146,10 @@ bool common_chat_msg_parser::try_consume_literal(const std::string & literal) {
 }
 
 std::optional<common_chat_msg_parser::find_regex_result>  common_chat_msg_parser::try_find_literal(const std::string & literal) {
-    auto idx = input_.find(literal, pos_);
+    auto idx = input_.find(literal, search_start('l', literal, pos_, literal.empty() ? 0 : literal.size() - 1));
+    if (idx == std::string::npos) {
+        search_done('l', literal, pos_);
+    }
     if (idx != std::string::npos) {
         find_regex_result res;
         res.prelude = input_.substr(pos_, idx - pos_);
@@ -173,8 +223,13 @@ std::string common_chat_msg_parser::consume_rest() {
 
 // Tries to find the regex, consumes it (pos right after it) and gives the prelude (right before it) and the groups to the callback.
 std::optional<common_chat_msg_parser::find_regex_result> common_chat_msg_parser::try_find_regex(const common_regex & regex, size_t from, bool add_prelude_to_content) {
-    auto m = regex.search(input_, from == std::string::npos ? pos_ : from);
+    if (from == std::string::npos) {
+        from = pos_;
+    }
+    // if the previous input had no full or partial match, a match cannot start before the end of the previous input
+    auto m = regex.search(input_, search_start('r', regex.str(), from, 0));
     if (m.type == COMMON_REGEX_MATCH_TYPE_NONE) {
+        search_done('r', regex.str(), from);
         return std::nullopt;
     }
     auto prelude = input_.substr(pos_, m.groups[0].begin - pos_);
@@ -24,8 +24,15 @@ class common_chat_msg_parser {
     size_t pos_ = 0;
     common_chat_msg result_;
 
+    // optional state of an incremental parse, only used while the input is partial
+    common_chat_parse_state * state_ = nullptr;
+
+    // start position of a search that has already been done up to some point of the previous input
+    size_t search_start(char type, const std::string & pattern, size_t pos, size_t overlap) const;
+    void   search_done (char type, const std::string & pattern, size_t pos);
+
   public:
-    common_chat_msg_parser(const std::string & input, bool is_partial, const common_chat_syntax & syntax);
+    common_chat_msg_parser(const std::string & input, bool is_partial, const common_chat_syntax & syntax, common_chat_parse_state * state = nullptr);
     const std::string & input() const { return input_; }
     size_t pos() const { return pos_; }
     const std::string & healing_marker() const { return healing_marker_; }
@@ -1931,8 +1931,8 @@ static void common_chat_parse(common_chat_msg_parser & builder) {
     builder.finish();
 }
 
-common_chat_msg common_chat_parse(const std::string & input, bool is_partial, const common_chat_syntax & syntax) {
-    common_chat_msg_parser builder(input, is_partial, syntax);
+common_chat_msg common_chat_parse(const std::string & input, bool is_partial, const common_chat_syntax & syntax, common_chat_parse_state * state) {
+    common_chat_msg_parser builder(input, is_partial, syntax, state);
     try {
         common_chat_parse(builder);
     } catch (const common_chat_msg_partial_exception & ex) {
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <tuple>
 
 struct common_chat_templates;
 
@@ -149,6 +150,23 @@ struct common_chat_syntax {
     bool                     parse_tool_calls      = true;
 };
 
+// State of an incremental common_chat_parse() of a growing input (e.g. the text generated while streaming).
+// The searches for literals and regexes that found nothing are resumed from the end of the previous input, so each
+// call only scans the new text. If the input does not start with the previous input, the state is reset.
+struct common_chat_parse_state {
+    std::string input;
+    std::string healing_marker;
+
+    // (type, pattern, start position) -> size of the input that has been searched without a match
+    std::map<std::tuple<char, std::string, size_t>, size_t> searched;
+
+    void reset() {
+        input.clear();
+        healing_marker.clear();
+        searched.clear();
+    }
+};
+
 // Check if the template supplied via "--chat-template" is supported or not. Returns true if it's valid
 bool common_chat_verify_template(const std::string & tmpl, bool use_jinja);
 
@@ -187,7 +205,7 @@ std::string common_chat_format_example(
 
 const char*               common_chat_format_name(common_chat_format format);
 const char*               common_reasoning_format_name(common_reasoning_format format);
-common_chat_msg           common_chat_parse(const std::string & input, bool is_partial, const common_chat_syntax & syntax);
+common_chat_msg           common_chat_parse(const std::string & input, bool is_partial, const common_chat_syntax & syntax, common_chat_parse_state * state = nullptr);
 
 common_chat_tool_choice common_chat_tool_choice_parse_oaicompat(const std::string & tool_choice);
 
@@ -1113,6 +1113,9 @@ struct llama_model_params common_model_params_to_llama(common_params & params) {
     mparams.use_mmap        = params.use_mmap;
     mparams.use_mlock       = params.use_mlock;
     mparams.check_tensors   = params.check_tensors;
+    mparams.repack_cache    = params.repack_cache;
+    mparams.fuse_weights    = params.fuse_weights;
+    mparams.n_load_threads  = params.n_load_threads;
 
     if (params.kv_overrides.empty()) {
         mparams.kv_overrides = NULL;
@@ -1156,6 +1159,10 @@ struct llama_context_params common_context_params_to_llama(const common_params &
     cparams.pooling_type      = params.pooling_type;
     cparams.attention_type    = params.attention_type;
     cparams.defrag_thold      = params.defrag_thold;
+    cparams.kv_block_size     = params.kv_block_size;
+    cparams.n_top_k_logits    = params.n_top_k_logits;
+    cparams.profile_n_decode  = params.n_profile;
+    cparams.profile_path      = params.profile_file.empty() ? nullptr : params.profile_file.c_str();
     cparams.cb_eval           = params.cb_eval;
     cparams.cb_eval_user_data = params.cb_eval_user_data;
     cparams.offload_kqv       = !params.no_kv_offload;
@@ -253,12 +253,16 @@ struct common_params {
     float   yarn_beta_slow        =  1.0f; // YaRN high correction dim
     int32_t yarn_orig_ctx         =     0; // YaRN original context length
     float   defrag_thold          =  0.1f; // KV cache defragmentation threshold
+    int32_t kv_block_size         =     0; // KV cache block size for paged allocation (0 = disabled)
+    int32_t n_top_k_logits        =     0; // output only the top-k logits of each row (0 = full rows)
+    int32_t n_profile             =     0; // number of decode calls to profile on the CPU backend (0 = disabled)
 
     // offload params
     std::vector<ggml_backend_dev_t> devices; // devices to use for offloading
 
     int32_t n_gpu_layers      = -1;  // number of layers to store in VRAM (-1 - use default)
     int32_t main_gpu          = 0;   // the GPU that is used for scratch and small tensors
+    int32_t n_load_threads    = 0;   // threads that load the tensors in CPU buffers (0 = from the hardware concurrency)
     float   tensor_split[128] = {0}; // how split tensors should be distributed across GPUs
 
     enum llama_split_mode split_mode = LLAMA_SPLIT_MODE_LAYER; // how to split the model across GPUs
@@ -293,6 +297,7 @@ struct common_params {
     std::string lookup_cache_static  = ""; // path of static ngram cache file for lookup decoding           // NOLINT
     std::string lookup_cache_dynamic = ""; // path of dynamic ngram cache file for lookup decoding          // NOLINT
     std::string logits_file          = ""; // file for saving *all* logits                                  // NOLINT
+    std::string profile_file         = ""; // file for saving the Chrome trace of the profiled decode calls  // NOLINT
 
     std::vector<std::string> in_files;   // all input files
     std::vector<std::string> antiprompt; // strings upon which more user input is prompted (a.k.a. reverse prompts)
@@ -351,6 +356,8 @@ struct common_params {
     bool no_kv_offload     = false; // disable KV offloading
     bool warmup            = true;  // warmup run
     bool check_tensors     = false; // validate tensor data
+    bool repack_cache      = false; // cache the repacked CPU weights in a file next to the model
+    bool fuse_weights      = false; // concatenate the Q/K/V and gate/up weights at load time
     bool no_op_offload     = false; // globally disable offload host tensor operations to device
 
     bool single_turn       = false; // single turn chat conversation
@@ -379,6 +386,11 @@ struct common_params {
     int32_t timeout_write  = timeout_read; // http write timeout in seconds
     int32_t n_threads_http = -1;           // number of threads to process HTTP requests (TODO: support threadpool)
     int32_t n_cache_reuse  = 0;            // min chunk size to reuse from the cache via KV shifting
+    int32_t cache_ram_mib  = 0;            // host memory for the prompt cache of the server in MiB (0 = disabled)
+    int32_t n_sched_budget = 0;            // max number of tokens per decode step of the server (0 = n_batch)
+    int32_t n_grammar_cache = 32;          // compiled grammars and converted JSON schemas cached by the server (0 = disabled)
+    bool sched_decode_first = true;        // the generated tokens count towards the budget of the decode step
+    bool sched_preempt      = false;       // with a unified KV cache, each slot can use the entire context and lower priority slots are preempted
 
     std::string hostname      = "127.0.0.1";
     std::string public_path   = "";                                                                         // NOLINT
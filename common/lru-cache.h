@@ -0,0 +1,72 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// thread-safe cache of the n_max most recently used values
+// the values are copied in and out under the lock, use a shared_ptr for values that are expensive to copy
+template <typename Key, typename Value>
+struct common_lru_cache {
+    explicit common_lru_cache(size_t n_max = 0) : n_max(n_max) {}
+
+    // 0 disables the cache
+    void set_max(size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        n_max = n;
+        evict();
+    }
+
+    // returns false if the key is not cached
+    bool get(const Key & key, Value & value) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        value = it->second->second;
+
+        return true;
+    }
+
+    // the value of a key that is already cached is kept
+    void put(const Key & key, Value value) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (n_max == 0 || index.find(key) != index.end()) {
+            return;
+        }
+
+        entries.emplace_front(key, std::move(value));
+        index[entries.front().first] = entries.begin();
+
+        evict();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return entries.size();
+    }
+
+private:
+    void evict() {
+        while (entries.size() > n_max) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    std::mutex mutex;
+
+    size_t n_max;
+
+    // most recently used first
+    std::list<std::pair<Key, Value>> entries;
+    std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator> index;
+};
@@ -2,8 +2,16 @@
 
 #include "common.h"
 #include "log.h"
+#include "lru-cache.h"
 
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <algorithm>
 
@@ -112,18 +120,17 @@ struct common_sampler {
 
     llama_token_data_array cur_p;
 
-    void set_logits(struct llama_context * ctx, int idx) {
-        const auto * logits = llama_get_logits_ith(ctx, idx);
-
-        const llama_model * model = llama_get_model(ctx);
-        const llama_vocab * vocab = llama_model_get_vocab(model);
-
-        const int n_vocab = llama_vocab_n_tokens(vocab);
+    // sample from the logits with the chain alone, without the array of all the tokens when the chain allows it
+    bool apply_chain_logits(const float * logits, const llama_token * tokens, int n) {
+        return tokens == nullptr && llama_sampler_chain_apply_logits(chain, logits, n, &cur_p);
+    }
 
-        cur.resize(n_vocab);
+    // tokens is nullptr for the full rows of logits, otherwise the tokens of the top-k logits
+    void set_logits(const float * logits, const llama_token * tokens, int n) {
+        cur.resize(n);
 
-        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
-            cur[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+        for (int i = 0; i < n; i++) {
+            cur[i] = llama_token_data{tokens ? tokens[i] : i, logits[i], 0.0f};
         }
 
         cur_p = { cur.data(), cur.size(), -1, false };
@@ -146,14 +153,37 @@ std::string common_params_sampling::print() const {
     return std::string(result);
 }
 
-struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params) {
-    const llama_vocab * vocab = llama_model_get_vocab(model);
+// the samplers are kept in their initial state and only cloned
+struct common_grammar_cache {
+    common_lru_cache<std::string, std::shared_ptr<llama_sampler>> samplers;
+};
 
-    llama_sampler_chain_params lparams = llama_sampler_chain_default_params();
+struct common_grammar_cache * common_grammar_cache_init(int32_t n_max) {
+    auto * result = new common_grammar_cache;
 
-    lparams.no_perf = params.no_perf;
+    result->samplers.set_max(std::max(1, n_max));
 
-    struct llama_sampler * grmr;
+    return result;
+}
+
+void common_grammar_cache_free(struct common_grammar_cache * gcache) {
+    delete gcache;
+}
+
+// the grammar and everything that changes how the grammar sampler is initialized
+static std::string common_grammar_cache_key(const struct common_params_sampling & params) {
+    std::string key = params.grammar_lazy ? "lazy\n" : "\n";
+
+    for (const auto & trigger : params.grammar_triggers) {
+        key += std::to_string(trigger.type) + " " + std::to_string(trigger.token) + " " + trigger.value + '\0';
+    }
+    key += "\n" + params.grammar;
+
+    return key;
+}
+
+static struct llama_sampler * common_sampler_init_grammar(const struct llama_vocab * vocab, const struct common_params_sampling & params) {
+    struct llama_sampler * grmr = nullptr;
     if (params.grammar.compare(0, 11, "%llguidance") == 0) {
 #ifdef LLAMA_USE_LLGUIDANCE
         grmr = llama_sampler_init_llg(vocab, "lark", params.grammar.c_str());
@@ -208,9 +238,36 @@ struct common_sampler * common_sampler_init(const struct llama_model * model, co
                                                         trigger_patterns_c.data(), trigger_patterns_c.size(),
                                                         trigger_tokens.data(), trigger_tokens.size())
              :      llama_sampler_init_grammar(vocab, params.grammar.c_str(), "root");
-        if (!grmr) {
-            return nullptr;
+    }
+
+    return grmr;
+}
+
+struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params, struct common_grammar_cache * gcache) {
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+
+    llama_sampler_chain_params lparams = llama_sampler_chain_default_params();
+
+    lparams.no_perf = params.no_perf;
+
+    struct llama_sampler * grmr = nullptr;
+    if (gcache && !params.grammar.empty()) {
+        const std::string key = common_grammar_cache_key(params);
+
+        std::shared_ptr<llama_sampler> cached;
+        if (gcache->samplers.get(key, cached)) {
+            grmr = llama_sampler_clone(cached.get());
+        } else {
+            grmr = common_sampler_init_grammar(vocab, params);
+            if (grmr) {
+                gcache->samplers.put(key, std::shared_ptr<llama_sampler>(llama_sampler_clone(grmr), llama_sampler_free));
+            }
         }
+    } else {
+        grmr = common_sampler_init_grammar(vocab, params);
+    }
+    if (!grmr) {
+        return nullptr;
     }
 
     auto * result = new common_sampler {
@@ -335,18 +392,46 @@ void common_perf_print(const struct llama_context * ctx, const struct common_sam
     }
 }
 
-llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_context * ctx, int idx, bool grammar_first) {
-    gsmpl->set_logits(ctx, idx);
+// the logits of the output idx: the full row, or the top-k logits and their tokens when the context only outputs those
+struct common_sampler_logits {
+    const float       * logits;
+    const llama_token * tokens; // nullptr for the full row
+    int                 n;
+};
+
+static common_sampler_logits common_sampler_get_logits(struct llama_context * ctx, int idx) {
+    common_sampler_logits res = { nullptr, nullptr, 0 };
+
+    if (llama_n_top_k_logits(ctx) > 0) {
+        res.n = llama_get_logits_top_k_ith(ctx, idx, &res.tokens, &res.logits);
+    } else {
+        const llama_model * model = llama_get_model(ctx);
+        const llama_vocab * vocab = llama_model_get_vocab(model);
+
+        res.logits = llama_get_logits_ith(ctx, idx);
+        res.n      = llama_vocab_n_tokens(vocab);
+    }
+
+    return res;
+}
 
+static llama_token common_sampler_sample_logits(struct common_sampler * gsmpl, const common_sampler_logits & lg, bool grammar_first) {
     auto & grmr  = gsmpl->grmr;
     auto & chain = gsmpl->chain;
-    auto & cur_p = gsmpl->cur_p; // initialized by set_logits
+    auto & cur_p = gsmpl->cur_p; // initialized by set_logits or apply_chain_logits
 
-    if (grammar_first) {
-        llama_sampler_apply(grmr, &cur_p);
-    }
+    // the grammar is checked after the chain unless it has to be applied first
+    const bool grammar_apply = grammar_first && !gsmpl->params.grammar.empty();
 
-    llama_sampler_apply(chain, &cur_p);
+    if (grammar_apply || !gsmpl->apply_chain_logits(lg.logits, lg.tokens, lg.n)) {
+        gsmpl->set_logits(lg.logits, lg.tokens, lg.n);
+
+        if (grammar_first) {
+            llama_sampler_apply(grmr, &cur_p);
+        }
+
+        llama_sampler_apply(chain, &cur_p);
+    }
 
     GGML_ASSERT(cur_p.selected != -1 && "no selected token during sampling - check your sampling configuration");
 
@@ -371,7 +456,7 @@ llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_co
 
     // resampling:
     // if the token is not valid, sample again, but first apply the grammar sampler and then the sampling chain
-    gsmpl->set_logits(ctx, idx);
+    gsmpl->set_logits(lg.logits, lg.tokens, lg.n);
 
     llama_sampler_apply(grmr,  &cur_p);
     llama_sampler_apply(chain, &cur_p);
@@ -381,6 +466,10 @@ llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_co
     return cur_p.data[cur_p.selected].id;
 }
 
+llama_token common_sampler_sample(struct common_sampler * gsmpl, struct llama_context * ctx, int idx, bool grammar_first) {
+    return common_sampler_sample_logits(gsmpl, common_sampler_get_logits(ctx, idx), grammar_first);
+}
+
 std::vector<llama_token> common_sampler_sample_and_accept_n(struct common_sampler * gsmpl, struct llama_context * ctx, const std::vector<int> & idxs, const llama_tokens & draft, bool grammar_first) {
     GGML_ASSERT(idxs.size() == draft.size() + 1 && "idxs.size() must be draft.size() + 1");
 
@@ -420,6 +509,167 @@ std::vector<llama_token> common_sampler_sample_and_accept_n(struct common_sample
     return common_sampler_sample_and_accept_n(gsmpl, ctx, idxs, draft, grammar_first);
 }
 
+// the calling thread takes part in each run, so the pool has n_threads - 1 workers
+struct common_sampler_pool {
+    common_sampler_pool(int n_threads) {
+        for (int i = 1; i < n_threads; ++i) {
+            workers.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    ~common_sampler_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv_work.notify_all();
+
+        for (auto & worker : workers) {
+            worker.join();
+        }
+    }
+
+    // call fn(i) for i in [0, n) on the workers and the calling thread
+    // the first exception thrown by fn is rethrown once all the threads are done
+    void run(int n, const std::function<void(int)> & fn) {
+        if (workers.empty() || n <= 1) {
+            for (int i = 0; i < n; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job      = &fn;
+            n_jobs   = n;
+            i_next   = 0;
+            n_active = workers.size();
+            generation++;
+        }
+        cv_work.notify_all();
+
+        work();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_done.wait(lock, [this] { return n_active == 0; });
+
+        job = nullptr;
+
+        if (error) {
+            std::exception_ptr e = nullptr;
+            std::swap(e, error);
+            lock.unlock();
+            std::rethrow_exception(e);
+        }
+    }
+
+    // an exception must not escape a worker thread, it is stored for run() and the remaining jobs are skipped
+    void work() {
+        for (int i = i_next++; i < n_jobs; i = i_next++) {
+            try {
+                (*job)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                i_next = n_jobs;
+            }
+        }
+    }
+
+    void worker_loop() {
+        uint64_t generation_cur = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_work.wait(lock, [&] { return stop || generation != generation_cur; });
+                if (stop) {
+                    return;
+                }
+                generation_cur = generation;
+            }
+
+            work();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--n_active == 0) {
+                cv_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    std::mutex              mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+
+    const std::function<void(int)> * job = nullptr;
+
+    std::exception_ptr error = nullptr;
+
+    int              n_jobs     = 0;
+    std::atomic<int> i_next     = 0;
+    size_t           n_active   = 0;
+    uint64_t         generation = 0;
+    bool             stop       = false;
+};
+
+struct common_sampler_pool * common_sampler_pool_init(int n_threads) {
+    return new common_sampler_pool(std::max(1, n_threads));
+}
+
+void common_sampler_pool_free(struct common_sampler_pool * pool) {
+    delete pool;
+}
+
+void common_sampler_pool_run(struct common_sampler_pool * pool, int n, const std::function<void(int)> & fn) {
+    pool->run(n, fn);
+}
+
+std::vector<llama_token> common_sampler_sample_and_accept_batch(struct common_sampler_pool * pool, const std::vector<common_sampler *> & gsmpls, struct llama_context * ctx, const std::vector<int> & idxs, bool grammar_first, std::vector<int64_t> * t_us) {
+    GGML_ASSERT(gsmpls.size() == idxs.size());
+
+    const int n = gsmpls.size();
+
+    // the context is only used on the calling thread
+    std::vector<common_sampler_logits> logits(n);
+    for (int i = 0; i < n; ++i) {
+        logits[i] = common_sampler_get_logits(ctx, idxs[i]);
+    }
+
+    std::vector<llama_token> result(n);
+
+    if (t_us) {
+        t_us->assign(n, 0);
+    }
+
+    const std::function<void(int)> fn = [&](int i) {
+        const int64_t t_start_us = t_us ? ggml_time_us() : 0;
+
+        result[i] = common_sampler_sample_logits(gsmpls[i], logits[i], grammar_first);
+
+        common_sampler_accept(gsmpls[i], result[i], true);
+
+        if (t_us) {
+            (*t_us)[i] = ggml_time_us() - t_start_us;
+        }
+    };
+
+    if (pool) {
+        pool->run(n, fn);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            fn(i);
+        }
+    }
+
+    return result;
+}
+
 uint32_t common_sampler_get_seed(const struct common_sampler * gsmpl) {
     return llama_sampler_get_seed(gsmpl->chain);
 }
@@ -4,6 +4,7 @@
 
 #include "common.h"
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -34,9 +35,18 @@
 
 struct common_sampler;
 
+// LRU of compiled grammars, keyed by the grammar and its triggers
+// the grammar of a sampler is cloned from the cache instead of being parsed again when the same grammar was already used
+struct common_grammar_cache;
+
+struct common_grammar_cache * common_grammar_cache_init(int32_t n_max);
+
+void common_grammar_cache_free(struct common_grammar_cache * gcache);
+
 // llama_sampler API overloads
 
-struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params);
+// gcache can be nullptr to always parse the grammar
+struct common_sampler * common_sampler_init(const struct llama_model * model, const struct common_params_sampling & params, struct common_grammar_cache * gcache = nullptr);
 
 void common_sampler_free(struct common_sampler * gsmpl);
 
@@ -81,6 +91,25 @@ std::vector<llama_token> common_sampler_sample_and_accept_n(struct common_sample
 // assume idxs == [ 0, 1, 2, ..., draft.size() ]
 std::vector<llama_token> common_sampler_sample_and_accept_n(struct common_sampler * gsmpl, struct llama_context * ctx, const llama_tokens & draft, bool grammar_first = false);
 
+// pool of threads for common_sampler_sample_and_accept_batch
+struct common_sampler_pool;
+
+struct common_sampler_pool * common_sampler_pool_init(int n_threads);
+
+void common_sampler_pool_free(struct common_sampler_pool * pool);
+
+// call fn(i) for i in [0, n) on the threads of the pool, including the calling thread
+// if fn throws, the remaining calls are skipped and the first exception is rethrown on the calling thread
+void common_sampler_pool_run(struct common_sampler_pool * pool, int n, const std::function<void(int)> & fn);
+
+// sample and accept the outputs idxs[i] of the last decode with the samplers gsmpls[i], in parallel on the threads of the pool
+//
+// each sampler is used by a single thread and has its own RNG, so the tokens do not depend on the number of threads
+// the samplers must be distinct, the pool can be nullptr to sample on the calling thread
+// if t_us is not nullptr, it is set to the time in microseconds spent sampling and accepting each output
+//
+std::vector<llama_token> common_sampler_sample_and_accept_batch(struct common_sampler_pool * pool, const std::vector<common_sampler *> & gsmpls, struct llama_context * ctx, const std::vector<int> & idxs, bool grammar_first = false, std::vector<int64_t> * t_us = nullptr);
+
 uint32_t common_sampler_get_seed(const struct common_sampler * gsmpl);
 
 // helpers
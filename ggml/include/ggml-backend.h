@@ -190,6 +190,9 @@ extern "C" {
     typedef void                         (*ggml_backend_set_n_threads_t)(ggml_backend_t backend, int n_threads);
     // Get additional buffer types provided by the device (returns a NULL-terminated array)
     typedef ggml_backend_buffer_type_t * (*ggml_backend_dev_get_extra_bufts_t)(ggml_backend_dev_t device);
+    // Create a buffer of an extra buffer type from memory that already holds the tensor data in the layout of the buffer type (e.g. repacked weights)
+    // The memory is not owned by the buffer, returns NULL if the buffer type does not support it
+    typedef ggml_backend_buffer_t        (*ggml_backend_extra_buffer_from_ptr_t)(ggml_backend_buffer_type_t buft, void * ptr, size_t size);
     // Set the abort callback for the backend
     typedef void                         (*ggml_backend_set_abort_callback_t)(ggml_backend_t backend, ggml_abort_callback abort_callback, void * abort_callback_data);
     // Get a list of feature flags supported by the backend (returns a NULL-terminated array)
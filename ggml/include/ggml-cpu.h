@@ -19,6 +19,9 @@ extern "C" {
         // abort ggml_graph_compute when true
         ggml_abort_callback abort_callback;
         void *              abort_callback_data;
+
+        // record the timings of the nodes when not NULL
+        struct ggml_cpu_profile * profile;
     };
 
     // numa strategies
@@ -28,12 +31,35 @@ extern "C" {
         GGML_NUMA_STRATEGY_ISOLATE    = 2,
         GGML_NUMA_STRATEGY_NUMACTL    = 3,
         GGML_NUMA_STRATEGY_MIRROR     = 4,
+        GGML_NUMA_STRATEGY_SPLIT      = 5,
         GGML_NUMA_STRATEGY_COUNT
     };
 
     GGML_BACKEND_API void    ggml_numa_init(enum ggml_numa_strategy numa); // call once for better performance on NUMA systems
     GGML_BACKEND_API bool    ggml_is_numa(void); // true if init detected that system has >1 NUMA node
 
+    // with GGML_NUMA_STRATEGY_SPLIT, bind the rows of a weight to the nodes of the threads that multiply them
+    // no-op with the other strategies
+    GGML_BACKEND_API void    ggml_numa_split_tensor(const struct ggml_tensor * tensor);
+
+    // per node profiling
+    // records the start and end time of each node on each thread, and the time spent waiting at the barrier after it
+    struct ggml_cpu_profile;
+
+    GGML_BACKEND_API struct ggml_cpu_profile * ggml_cpu_profile_new  (void);
+    GGML_BACKEND_API void                      ggml_cpu_profile_free (struct ggml_cpu_profile * profile);
+    GGML_BACKEND_API void                      ggml_cpu_profile_reset(struct ggml_cpu_profile * profile);
+
+    // write the recorded events in the Chrome trace event format (chrome://tracing, https://ui.perfetto.dev)
+    GGML_BACKEND_API bool ggml_cpu_profile_write_trace  (const struct ggml_cpu_profile * profile, const char * fname);
+    // print the time spent per op type and waiting at the barriers
+    GGML_BACKEND_API void ggml_cpu_profile_print_summary(const struct ggml_cpu_profile * profile);
+
+    // mul_mat tuning
+    // on first use, each mul_mat shape of the weights is computed in a few ways and the fastest is kept in the cache file
+    // also enabled by setting GGML_CPU_TUNE_CACHE to the path of the cache file, NULL = disabled (default)
+    GGML_BACKEND_API void ggml_cpu_tune_init(const char * fname);
+
     GGML_BACKEND_API struct ggml_tensor * ggml_new_i32(struct ggml_context * ctx, int32_t value);
     GGML_BACKEND_API struct ggml_tensor * ggml_new_f32(struct ggml_context * ctx, float value);
 
@@ -131,6 +157,7 @@ extern "C" {
     GGML_BACKEND_API void ggml_backend_cpu_set_n_threads     (ggml_backend_t backend_cpu, int n_threads);
     GGML_BACKEND_API void ggml_backend_cpu_set_threadpool    (ggml_backend_t backend_cpu, ggml_threadpool_t threadpool);
     GGML_BACKEND_API void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_callback abort_callback, void * abort_callback_data);
+    GGML_BACKEND_API void ggml_backend_cpu_set_profile       (ggml_backend_t backend_cpu, struct ggml_cpu_profile * profile);
 
     GGML_BACKEND_API ggml_backend_reg_t ggml_backend_cpu_reg(void);
 
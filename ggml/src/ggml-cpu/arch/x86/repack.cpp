@@ -990,6 +990,331 @@ void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
 #endif
 }
 
+void ggml_gemv_q5_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
+
+    // Shuffle masks to rearrange delta and scale values to multiply with appropriate scales
+    __m128i deltamask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+    __m128i scalemask = _mm_set_epi8(7, 7, 3, 3, 6, 6, 2, 2, 5, 5, 1, 1, 4, 4, 0, 0);
+    // Permute mask used for easier vector processing at later stages
+    __m256i finalpermutemask = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+    // Masks to extract the low nibbles and to place the high bit of the quants
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i mhb = _mm256_set1_epi8(0x10);
+
+    const block_q5_Kx8 * b_ptr_start = (const block_q5_Kx8 *)vx;
+    const block_q8_K * a_ptr_start = (const block_q8_K *)vy;
+
+    for (int64_t y = 0; y < nr; y++) {
+        const block_q8_K * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q5_Kx8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulators
+            __m256 acc_row = _mm256_setzero_ps();
+            __m256 acc_min_rows = _mm256_setzero_ps();
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 row_scale_f32 = _mm256_set1_ps((a_ptr[b].d));
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+                const __m256 col_dmin_f32 = GGML_F32Cx8_LOAD(b_ptr[b].dmin);
+
+                __m256i iacc_b = _mm256_setzero_si256();
+                __m256i iacc_min_b = _mm256_setzero_si256();
+
+                const __m256i q8sums = _mm256_loadu_si256((const __m256i * )(a_ptr[b].bsums));
+                __m256i q8s = _mm256_castsi128_si256(_mm_hadd_epi16(_mm256_castsi256_si128(q8sums), _mm256_extracti128_si256(q8sums, 1)));
+                q8s = _mm256_permute2f128_si256(q8s, q8s, 0);
+
+                // Processes two sub blocks from each Q5_K in each iteration
+                for (int sb = 0; sb < QK_K / 64; sb++) {
+                    uint32_t utmp_0[4], utmp_1[4];
+
+                    memcpy(utmp_0, b_ptr[b].scales + 24 * sb, 12);
+                    utmp_0[3] = ((utmp_0[2] >> 4) & kmask2) | (((utmp_0[1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux_0 = utmp_0[1] & kmask1;
+                    utmp_0[1] = (utmp_0[2] & kmask2) | (((utmp_0[0] >> 6) & kmask3) << 4);
+                    utmp_0[2] = uaux_0;
+                    utmp_0[0] &= kmask1;
+
+                    memcpy(utmp_1, b_ptr[b].scales + 12 + sb * 24, 12);
+                    utmp_1[3] = ((utmp_1[2] >> 4) & kmask2) | (((utmp_1[1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux_1 = utmp_1[1] & kmask1;
+                    utmp_1[1] = (utmp_1[2] & kmask2) | (((utmp_1[0] >> 6) & kmask3) << 4);
+                    utmp_1[2] = uaux_1;
+                    utmp_1[0] &= kmask1;
+
+                    const __m128i mins_and_scales_0 = _mm_set_epi32(utmp_0[3], utmp_0[2], utmp_0[1], utmp_0[0]);
+                    const __m256i scales_0 = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(mins_and_scales_0, scalemask));
+
+                    const __m128i mins_and_scales_1 = _mm_set_epi32(utmp_1[3], utmp_1[2], utmp_1[1], utmp_1[0]);
+                    const __m256i scales_1 = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(mins_and_scales_1, scalemask));
+
+                    // Mins of first and second sub block of Q5_K block are arranged side by side
+                    const __m256i mins_01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(_mm_shuffle_epi32(mins_and_scales_0, 78), _mm_shuffle_epi32(mins_and_scales_1, 78)));
+
+                    // The high bits of the two sub blocks are the bits 2 * sb and 2 * sb + 1 of qh
+                    const __m128i qh_shift = _mm_cvtsi32_si128(2 * sb);
+
+                    __m256i iacc_0 = _mm256_setzero_si256();
+                    __m256i iacc_1 = _mm256_setzero_si256();
+
+                    for (int t = 0; t < 4; t++) {
+                        const __m256i rhs_raw_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + sb * 256 + t * 64));
+                        const __m256i rhs_raw_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + sb * 256 + t * 64 + 32));
+                        const __m256i rhs_hbit_0123 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + t * 64)), qh_shift);
+                        const __m256i rhs_hbit_4567 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + t * 64 + 32)), qh_shift);
+
+                        // 5-bit quants of the first and of the second sub block
+                        const __m256i rhs_vec_0123_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_0123, 4), mhb));
+                        const __m256i rhs_vec_4567_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_4567, 4), mhb));
+                        const __m256i rhs_vec_0123_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_0123, 4), m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_0123, 3), mhb));
+                        const __m256i rhs_vec_4567_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_4567, 4), m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_4567, 3), mhb));
+
+                        const __m256i lhs_vec_0 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + sb * 64 + t * 8)));
+                        const __m256i lhs_vec_1 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + sb * 64 + 32 + t * 8)));
+
+                        // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3) with A0(0-3), then the same with the values 4-7
+                        // The 16 bit sums hold four products of 5 bit and 8 bit values, the scales are applied for each chunk of eight values
+                        const __m256i dot_0 = _mm256_add_epi16(
+                                _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_0, _mm256_shuffle_epi32(rhs_vec_4567_0, 177), 170), _mm256_shuffle_epi32(lhs_vec_0, 0)),
+                                _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_0, 177), rhs_vec_4567_0, 170), _mm256_shuffle_epi32(lhs_vec_0, 85)));
+                        const __m256i dot_1 = _mm256_add_epi16(
+                                _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_1, _mm256_shuffle_epi32(rhs_vec_4567_1, 177), 170), _mm256_shuffle_epi32(lhs_vec_1, 0)),
+                                _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_1, 177), rhs_vec_4567_1, 170), _mm256_shuffle_epi32(lhs_vec_1, 85)));
+
+                        iacc_0 = _mm256_add_epi32(iacc_0, _mm256_madd_epi16(dot_0, scales_0));
+                        iacc_1 = _mm256_add_epi32(iacc_1, _mm256_madd_epi16(dot_1, scales_1));
+                    }
+
+                    // Broadcast the bsums of the two sub blocks of the iteration of Q8_K across the vector
+                    // Multiply-Add with corresponding mins of Q5_Kx8 with bsums
+                    const __m256i q8s_sb = _mm256_shuffle_epi32(q8s, 0);
+                    const __m256i iacc_min_sb = _mm256_madd_epi16(q8s_sb, mins_01);
+                    q8s = _mm256_bsrli_epi128(q8s, 4);
+
+                    iacc_b = _mm256_add_epi32(iacc_b, _mm256_add_epi32(iacc_0, iacc_1));
+                    iacc_min_b = _mm256_add_epi32(iacc_min_b, iacc_min_sb);
+                }
+
+                acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_b), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+                acc_min_rows = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_min_b), _mm256_mul_ps(col_dmin_f32, row_scale_f32), acc_min_rows);
+            }
+
+            // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+            acc_row = _mm256_permutevar8x32_ps(acc_row, finalpermutemask);
+            _mm256_storeu_ps(s + (y * bs + x * 8), _mm256_sub_ps(acc_row, acc_min_rows));
+        }
+    }
+    return;
+#endif
+    ggml_gemv_q5_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // Shuffle masks to replicate the scales of B0-B3 and of B4-B7 over the sums of their values
+    __m128i scalemask_0123 = _mm_set_epi8(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    __m128i scalemask_4567 = _mm_set_epi8(7, 7, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4);
+    // Permute mask to restore the order of the columns after the horizontal add
+    __m256i finalpermutemask = _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+
+    // Masks to extract the low nibbles and to place the upper 2 bits of the quants
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i m2b = _mm256_set1_epi8(0x30);
+
+    const block_q6_Kx8 * b_ptr_start = (const block_q6_Kx8 *)vx;
+    const block_q8_K * a_ptr_start = (const block_q8_K *)vy;
+
+    for (int64_t y = 0; y < nr; y++) {
+        const block_q8_K * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q6_Kx8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulator
+            __m256 acc_row = _mm256_setzero_ps();
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 row_scale_f32 = _mm256_set1_ps((a_ptr[b].d));
+                const __m256 col_scale_f32 = GGML_F32Cx8_LOAD(b_ptr[b].d);
+
+                __m256i iacc_bias_b = _mm256_setzero_si256();
+
+                // The quants are stored unsigned with an offset of 32: the dot products with the offset are
+                // computed from the bsums of Q8_K, for two sub blocks of 16 values at a time
+                for (int sb = 0; sb < QK_K / 16; sb += 2) {
+                    const __m128i scales_0 = _mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8));
+                    const __m128i scales_1 = _mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8 + 8));
+                    const __m256i scales_01 = _mm256_cvtepi8_epi16(_mm_unpacklo_epi8(scales_0, scales_1));
+
+                    int32_t q8s_sb;
+                    memcpy(&q8s_sb, a_ptr[b].bsums + sb, sizeof(int32_t));
+                    iacc_bias_b = _mm256_add_epi32(iacc_bias_b, _mm256_madd_epi16(_mm256_set1_epi32(q8s_sb), scales_01));
+                }
+
+                // Sums of the products for B0-B3 and for B4-B7, two 32 bit lanes for each column
+                __m256i iacc_0123 = _mm256_setzero_si256();
+                __m256i iacc_4567 = _mm256_setzero_si256();
+
+                // Each chunk of ql holds eight values of the first half of each 128 values in the low nibbles,
+                // and the eight values 64 positions after in the high nibbles
+                for (int h = 0; h < 2; h++) {
+                    for (int p = 0; p < 2; p++) {
+                        // Two chunks make a sub block of 16 values, the 16 bit sums of their products fit in 16 bits
+                        for (int t = 0; t < 4; t += 2) {
+                            const int e0 = h * 128 + p * 32 + t * 8;
+
+                            __m256i dot_0123_0 = _mm256_setzero_si256();
+                            __m256i dot_4567_0 = _mm256_setzero_si256();
+                            __m256i dot_0123_1 = _mm256_setzero_si256();
+                            __m256i dot_4567_1 = _mm256_setzero_si256();
+
+                            for (int c = 0; c < 2; c++) {
+                                const int k = h * 8 + p * 4 + t + c;
+
+                                const __m256i rhs_raw_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + k * 64));
+                                const __m256i rhs_raw_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + k * 64 + 32));
+                                const __m256i rhs_qh_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + (h * 4 + t + c) * 64));
+                                const __m256i rhs_qh_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + (h * 4 + t + c) * 64 + 32));
+
+                                // Upper 2 bits of the values in the low and in the high nibbles of ql, moved to the bits 4-5
+                                const __m256i rhs_hbits_0123_0 = _mm256_and_si256(p ? _mm256_slli_epi16(rhs_qh_0123, 2) : _mm256_slli_epi16(rhs_qh_0123, 4), m2b);
+                                const __m256i rhs_hbits_4567_0 = _mm256_and_si256(p ? _mm256_slli_epi16(rhs_qh_4567, 2) : _mm256_slli_epi16(rhs_qh_4567, 4), m2b);
+                                const __m256i rhs_hbits_0123_1 = _mm256_and_si256(p ? _mm256_srli_epi16(rhs_qh_0123, 2) : rhs_qh_0123, m2b);
+                                const __m256i rhs_hbits_4567_1 = _mm256_and_si256(p ? _mm256_srli_epi16(rhs_qh_4567, 2) : rhs_qh_4567, m2b);
+
+                                const __m256i rhs_vec_0123_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_0123, m4b), rhs_hbits_0123_0);
+                                const __m256i rhs_vec_4567_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_4567, m4b), rhs_hbits_4567_0);
+                                const __m256i rhs_vec_0123_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_0123, 4), m4b), rhs_hbits_0123_1);
+                                const __m256i rhs_vec_4567_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_4567, 4), m4b), rhs_hbits_4567_1);
+
+                                // The eight values of A0 repeated for each of the four columns of the vectors
+                                const __m256i lhs_vec_0 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + e0 + c * 8)));
+                                const __m256i lhs_vec_1 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + e0 + c * 8 + 64)));
+
+                                dot_0123_0 = _mm256_add_epi16(dot_0123_0, _mm256_maddubs_epi16(rhs_vec_0123_0, lhs_vec_0));
+                                dot_4567_0 = _mm256_add_epi16(dot_4567_0, _mm256_maddubs_epi16(rhs_vec_4567_0, lhs_vec_0));
+                                dot_0123_1 = _mm256_add_epi16(dot_0123_1, _mm256_maddubs_epi16(rhs_vec_0123_1, lhs_vec_1));
+                                dot_4567_1 = _mm256_add_epi16(dot_4567_1, _mm256_maddubs_epi16(rhs_vec_4567_1, lhs_vec_1));
+                            }
+
+                            const __m128i scales_0 = _mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + (e0 / 16) * 8));
+                            const __m128i scales_1 = _mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + (e0 / 16 + 4) * 8));
+
+                            iacc_0123 = _mm256_add_epi32(iacc_0123, _mm256_madd_epi16(dot_0123_0, _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales_0, scalemask_0123))));
+                            iacc_4567 = _mm256_add_epi32(iacc_4567, _mm256_madd_epi16(dot_4567_0, _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales_0, scalemask_4567))));
+                            iacc_0123 = _mm256_add_epi32(iacc_0123, _mm256_madd_epi16(dot_0123_1, _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales_1, scalemask_0123))));
+                            iacc_4567 = _mm256_add_epi32(iacc_4567, _mm256_madd_epi16(dot_4567_1, _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales_1, scalemask_4567))));
+                        }
+                    }
+                }
+
+                // B0 B1 B4 B5 B2 B3 B6 B7 after the horizontal add, permuted to B0-B7
+                __m256i iacc_b = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(iacc_0123, iacc_4567), finalpermutemask);
+                iacc_b = _mm256_sub_epi32(iacc_b, _mm256_slli_epi32(iacc_bias_b, 5));
+
+                acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_b), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+            }
+
+            _mm256_storeu_ps(s + (y * bs + x * 8), acc_row);
+        }
+    }
+    return;
+#endif
+    ggml_gemv_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemv_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // Shuffle mask to rearrange the deltas in the order of the accumulator
+    __m128i changemask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+    // Permute mask used for easier vector processing at later stages
+    __m256i finalpermutemask = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+    const block_q8_0x8 * b_ptr_start = (const block_q8_0x8 *)vx;
+    const block_q8_0 * a_ptr_start = (const block_q8_0 *)vy;
+
+    for (int64_t y = 0; y < nr; y++) {
+        const block_q8_0 * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q8_0x8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulator
+            __m256 acc_row = _mm256_setzero_ps();
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, changemask);
+                const __m256 row_scale_f32 = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[b].d));
+
+                __m256i iacc = _mm256_setzero_si256();
+
+                // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3) with A0(0-3), then the same with the values 4-7
+                for (int k = 0; k < QK8_0 / 8; k++) {
+                    const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64));
+                    const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64 + 32));
+
+                    const __m256i lhs_vec = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + k * 8)));
+
+                    iacc = mul_sum_i8_pairs_acc_int32x8(iacc, _mm256_blend_epi32(rhs_vec_0123, _mm256_shuffle_epi32(rhs_vec_4567, 177), 170), _mm256_shuffle_epi32(lhs_vec, 0));
+                    iacc = mul_sum_i8_pairs_acc_int32x8(iacc, _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123, 177), rhs_vec_4567, 170), _mm256_shuffle_epi32(lhs_vec, 85));
+                }
+
+                acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
+            }
+
+            // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+            acc_row = _mm256_permutevar8x32_ps(acc_row, finalpermutemask);
+            _mm256_storeu_ps(s + (y * bs + x * 8), acc_row);
+        }
+    }
+    return;
+#endif
+    ggml_gemv_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
+
 void ggml_gemm_q4_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
     const int qk = QK8_0;
     const int nb = n / qk;
@@ -3283,3 +3608,361 @@ void ggml_gemm_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const vo
     }
 #endif
 }
+
+void ggml_gemm_q5_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
+
+    // Shuffle masks to rearrange delta and scale values to multiply with appropriate scales
+    __m128i deltamask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+    __m128i scalemask = _mm_set_epi8(7, 7, 3, 3, 6, 6, 2, 2, 5, 5, 1, 1, 4, 4, 0, 0);
+    // Permute mask used for easier vector processing at later stages
+    __m256i finalpermutemask = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+    // Masks to extract the low nibbles and to place the high bit of the quants
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i mhb = _mm256_set1_epi8(0x10);
+
+    const block_q5_Kx8 * b_ptr_start = (const block_q5_Kx8 *)vx;
+    const block_q8_Kx4 * a_ptr_start = (const block_q8_Kx4 *)vy;
+
+    // Process the rows of the LHS four at a time, each with eight interleaved block_q5_K at a time
+    for (int64_t y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q5_Kx8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulators
+            __m256 acc_rows[4];
+            __m256 acc_min_rows[4];
+            for (int m = 0; m < 4; m++) {
+                acc_rows[m] = _mm256_setzero_ps();
+                acc_min_rows[m] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+                const __m256 col_dmin_f32 = GGML_F32Cx8_LOAD(b_ptr[b].dmin);
+
+                __m256i iacc_b[4];
+                __m256i iacc_min_b[4];
+                for (int m = 0; m < 4; m++) {
+                    iacc_b[m] = _mm256_setzero_si256();
+                    iacc_min_b[m] = _mm256_setzero_si256();
+                }
+
+                // Processes two sub blocks from each Q5_K in each iteration
+                for (int sb = 0; sb < QK_K / 64; sb++) {
+                    uint32_t utmp_0[4], utmp_1[4];
+
+                    memcpy(utmp_0, b_ptr[b].scales + 24 * sb, 12);
+                    utmp_0[3] = ((utmp_0[2] >> 4) & kmask2) | (((utmp_0[1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux_0 = utmp_0[1] & kmask1;
+                    utmp_0[1] = (utmp_0[2] & kmask2) | (((utmp_0[0] >> 6) & kmask3) << 4);
+                    utmp_0[2] = uaux_0;
+                    utmp_0[0] &= kmask1;
+
+                    memcpy(utmp_1, b_ptr[b].scales + 12 + sb * 24, 12);
+                    utmp_1[3] = ((utmp_1[2] >> 4) & kmask2) | (((utmp_1[1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux_1 = utmp_1[1] & kmask1;
+                    utmp_1[1] = (utmp_1[2] & kmask2) | (((utmp_1[0] >> 6) & kmask3) << 4);
+                    utmp_1[2] = uaux_1;
+                    utmp_1[0] &= kmask1;
+
+                    const __m128i mins_and_scales_0 = _mm_set_epi32(utmp_0[3], utmp_0[2], utmp_0[1], utmp_0[0]);
+                    const __m256i scales_0 = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(mins_and_scales_0, scalemask));
+
+                    const __m128i mins_and_scales_1 = _mm_set_epi32(utmp_1[3], utmp_1[2], utmp_1[1], utmp_1[0]);
+                    const __m256i scales_1 = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(mins_and_scales_1, scalemask));
+
+                    // Mins of first and second sub block of Q5_K block are arranged side by side
+                    const __m256i mins_01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(_mm_shuffle_epi32(mins_and_scales_0, 78), _mm_shuffle_epi32(mins_and_scales_1, 78)));
+
+                    // The high bits of the two sub blocks are the bits 2 * sb and 2 * sb + 1 of qh
+                    const __m128i qh_shift = _mm_cvtsi32_si128(2 * sb);
+
+                    for (int t = 0; t < 4; t++) {
+                        const __m256i rhs_raw_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + sb * 256 + t * 64));
+                        const __m256i rhs_raw_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + sb * 256 + t * 64 + 32));
+                        const __m256i rhs_hbit_0123 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + t * 64)), qh_shift);
+                        const __m256i rhs_hbit_4567 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + t * 64 + 32)), qh_shift);
+
+                        const __m256i rhs_vec_0123_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_0123, m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_0123, 4), mhb));
+                        const __m256i rhs_vec_4567_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_4567, m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_4567, 4), mhb));
+                        const __m256i rhs_vec_0123_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_0123, 4), m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_0123, 3), mhb));
+                        const __m256i rhs_vec_4567_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_4567, 4), m4b), _mm256_and_si256(_mm256_slli_epi16(rhs_hbit_4567, 3), mhb));
+
+                        // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3), then the same with the values 4-7
+                        const __m256i rhs_mat_0_lo = _mm256_blend_epi32(rhs_vec_0123_0, _mm256_shuffle_epi32(rhs_vec_4567_0, 177), 170);
+                        const __m256i rhs_mat_0_hi = _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_0, 177), rhs_vec_4567_0, 170);
+                        const __m256i rhs_mat_1_lo = _mm256_blend_epi32(rhs_vec_0123_1, _mm256_shuffle_epi32(rhs_vec_4567_1, 177), 170);
+                        const __m256i rhs_mat_1_hi = _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_1, 177), rhs_vec_4567_1, 170);
+
+                        for (int m = 0; m < 4; m++) {
+                            const __m256i lhs_vec_0 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + sb * 256 + t * 32 + m * 8)));
+                            const __m256i lhs_vec_1 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + sb * 256 + 128 + t * 32 + m * 8)));
+
+                            const __m256i dot_0 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_mat_0_lo, _mm256_shuffle_epi32(lhs_vec_0, 0)),
+                                                                   _mm256_maddubs_epi16(rhs_mat_0_hi, _mm256_shuffle_epi32(lhs_vec_0, 85)));
+                            const __m256i dot_1 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_mat_1_lo, _mm256_shuffle_epi32(lhs_vec_1, 0)),
+                                                                   _mm256_maddubs_epi16(rhs_mat_1_hi, _mm256_shuffle_epi32(lhs_vec_1, 85)));
+
+                            iacc_b[m] = _mm256_add_epi32(iacc_b[m], _mm256_add_epi32(_mm256_madd_epi16(dot_0, scales_0), _mm256_madd_epi16(dot_1, scales_1)));
+                        }
+                    }
+
+                    // Multiply-Add the mins of the two sub blocks with the sums of the corresponding values of each row of Q8_Kx4
+                    for (int m = 0; m < 4; m++) {
+                        const int16_t * bsums = a_ptr[b].bsums + sb * 16 + m * 4;
+                        const int32_t q8s_sb = (uint16_t) (bsums[0] + bsums[1]) | ((int32_t) (bsums[2] + bsums[3]) << 16);
+                        iacc_min_b[m] = _mm256_add_epi32(iacc_min_b[m], _mm256_madd_epi16(_mm256_set1_epi32(q8s_sb), mins_01));
+                    }
+                }
+
+                for (int m = 0; m < 4; m++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d[m]);
+                    acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_b[m]), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[m]);
+                    acc_min_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_min_b[m]), _mm256_mul_ps(col_dmin_f32, row_scale_f32), acc_min_rows[m]);
+                }
+            }
+
+            // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + ((y * 4 + m) * bs + x * 8), _mm256_sub_ps(_mm256_permutevar8x32_ps(acc_rows[m], finalpermutemask), acc_min_rows[m]));
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q5_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q6_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK_K;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // Shuffle masks to rearrange delta and scale values to multiply with appropriate scales
+    __m128i deltamask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+    __m128i scalemask = _mm_set_epi8(7, 7, 3, 3, 6, 6, 2, 2, 5, 5, 1, 1, 4, 4, 0, 0);
+    __m128i colmask   = _mm_set_epi8(15, 11, 14, 10, 13, 9, 12, 8, 7, 3, 6, 2, 5, 1, 4, 0);
+    // Permute mask used for easier vector processing at later stages
+    __m256i finalpermutemask = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+    // Masks to extract the low nibbles and to place the upper 2 bits of the quants
+    const __m256i m4b = _mm256_set1_epi8(0x0F);
+    const __m256i m2b = _mm256_set1_epi8(0x30);
+
+    const block_q6_Kx8 * b_ptr_start = (const block_q6_Kx8 *)vx;
+    const block_q8_Kx4 * a_ptr_start = (const block_q8_Kx4 *)vy;
+
+    // Process the rows of the LHS four at a time, each with eight interleaved block_q6_K at a time
+    for (int64_t y = 0; y < nr / 4; y++) {
+        const block_q8_Kx4 * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q6_Kx8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulators
+            __m256 acc_rows[4];
+            for (int m = 0; m < 4; m++) {
+                acc_rows[m] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
+
+                __m256i iacc_b[4];
+                __m256i iacc_bias_b[4];
+                for (int m = 0; m < 4; m++) {
+                    iacc_b[m] = _mm256_setzero_si256();
+                    iacc_bias_b[m] = _mm256_setzero_si256();
+                }
+
+                // The quants are stored unsigned with an offset of 32: the dot products with the offset are
+                // computed from the bsums of Q8_Kx4, for two sub blocks of 16 values at a time
+                for (int sb = 0; sb < QK_K / 16; sb += 2) {
+                    const __m128i scales_0 = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8)), colmask);
+                    const __m128i scales_1 = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + sb * 8 + 8)), colmask);
+                    const __m256i scales_01 = _mm256_cvtepi8_epi16(_mm_unpacklo_epi8(scales_0, scales_1));
+
+                    for (int m = 0; m < 4; m++) {
+                        int32_t q8s_sb;
+                        memcpy(&q8s_sb, a_ptr[b].bsums + (sb / 4) * 16 + m * 4 + (sb % 4), sizeof(int32_t));
+                        iacc_bias_b[m] = _mm256_add_epi32(iacc_bias_b[m], _mm256_madd_epi16(_mm256_set1_epi32(q8s_sb), scales_01));
+                    }
+                }
+
+                // Each chunk of ql holds eight values of the first half of each 128 values in the low nibbles,
+                // and the eight values 64 positions after in the high nibbles
+                // Two chunks make a sub block of 16 values, which share the scales
+                __m256i scales_0 = _mm256_setzero_si256();
+                __m256i scales_1 = _mm256_setzero_si256();
+                for (int k = 0; k < QK_K / 16; k++) {
+                    const int h = k / 8;       // half of the super block
+                    const int p = (k / 4) % 2; // pair of bits of qh
+                    const int t = k % 4;       // chunk of qh
+
+                    const int e0 = h * 128 + p * 32 + t * 8;
+
+                    if (t % 2 == 0) {
+                        scales_0 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + (e0 / 16) * 8)), scalemask));
+                        scales_1 = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(b_ptr[b].scales + (e0 / 16 + 4) * 8)), scalemask));
+                    }
+
+                    const __m256i rhs_raw_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + k * 64));
+                    const __m256i rhs_raw_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].ql + k * 64 + 32));
+                    const __m256i rhs_qh_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + (h * 4 + t) * 64));
+                    const __m256i rhs_qh_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qh + (h * 4 + t) * 64 + 32));
+
+                    // Upper 2 bits of the values in the low and in the high nibbles of ql, moved to the bits 4-5
+                    const __m256i rhs_hbits_0123_0 = _mm256_and_si256(p ? _mm256_slli_epi16(rhs_qh_0123, 2) : _mm256_slli_epi16(rhs_qh_0123, 4), m2b);
+                    const __m256i rhs_hbits_4567_0 = _mm256_and_si256(p ? _mm256_slli_epi16(rhs_qh_4567, 2) : _mm256_slli_epi16(rhs_qh_4567, 4), m2b);
+                    const __m256i rhs_hbits_0123_1 = _mm256_and_si256(p ? _mm256_srli_epi16(rhs_qh_0123, 2) : rhs_qh_0123, m2b);
+                    const __m256i rhs_hbits_4567_1 = _mm256_and_si256(p ? _mm256_srli_epi16(rhs_qh_4567, 2) : rhs_qh_4567, m2b);
+
+                    const __m256i rhs_vec_0123_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_0123, m4b), rhs_hbits_0123_0);
+                    const __m256i rhs_vec_4567_0 = _mm256_or_si256(_mm256_and_si256(rhs_raw_vec_4567, m4b), rhs_hbits_4567_0);
+                    const __m256i rhs_vec_0123_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_0123, 4), m4b), rhs_hbits_0123_1);
+                    const __m256i rhs_vec_4567_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_4567, 4), m4b), rhs_hbits_4567_1);
+
+                    // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3), then the same with the values 4-7
+                    const __m256i rhs_mat_0_lo = _mm256_blend_epi32(rhs_vec_0123_0, _mm256_shuffle_epi32(rhs_vec_4567_0, 177), 170);
+                    const __m256i rhs_mat_0_hi = _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_0, 177), rhs_vec_4567_0, 170);
+                    const __m256i rhs_mat_1_lo = _mm256_blend_epi32(rhs_vec_0123_1, _mm256_shuffle_epi32(rhs_vec_4567_1, 177), 170);
+                    const __m256i rhs_mat_1_hi = _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_1, 177), rhs_vec_4567_1, 170);
+
+
+                    for (int m = 0; m < 4; m++) {
+                        const __m256i lhs_vec_0 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (e0 / 8) * 32 + m * 8)));
+                        const __m256i lhs_vec_1 = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + (e0 / 8 + 8) * 32 + m * 8)));
+
+                        const __m256i dot_0 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_mat_0_lo, _mm256_shuffle_epi32(lhs_vec_0, 0)),
+                                                               _mm256_maddubs_epi16(rhs_mat_0_hi, _mm256_shuffle_epi32(lhs_vec_0, 85)));
+                        const __m256i dot_1 = _mm256_add_epi16(_mm256_maddubs_epi16(rhs_mat_1_lo, _mm256_shuffle_epi32(lhs_vec_1, 0)),
+                                                               _mm256_maddubs_epi16(rhs_mat_1_hi, _mm256_shuffle_epi32(lhs_vec_1, 85)));
+
+                        iacc_b[m] = _mm256_add_epi32(iacc_b[m], _mm256_add_epi32(_mm256_madd_epi16(dot_0, scales_0), _mm256_madd_epi16(dot_1, scales_1)));
+                    }
+                }
+
+                for (int m = 0; m < 4; m++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(a_ptr[b].d[m]);
+                    const __m256i iacc = _mm256_sub_epi32(iacc_b[m], _mm256_slli_epi32(iacc_bias_b[m], 5));
+                    acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[m]);
+                }
+            }
+
+            // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + ((y * 4 + m) * bs + x * 8), _mm256_permutevar8x32_ps(acc_rows[m], finalpermutemask));
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q6_K_8x8_q8_K_generic(n, s, bs, vx, vy, nr, nc);
+}
+
+void ggml_gemm_q8_0_8x8_q8_0(int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT vx, const void * GGML_RESTRICT vy, int nr, int nc) {
+    const int qk = QK8_0;
+    const int nb = n / qk;
+    const int ncols_interleaved = 8;
+    const int blocklen = 8;
+
+    assert (n % qk == 0);
+    assert (nr % 4 == 0);
+    assert (nc % ncols_interleaved == 0);
+
+    UNUSED(nb);
+    UNUSED(ncols_interleaved);
+    UNUSED(blocklen);
+
+#if defined(__AVX2__)
+    // Shuffle mask to rearrange the deltas in the order of the accumulators
+    __m128i changemask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+    // Permute mask used for easier vector processing at later stages
+    __m256i finalpermutemask = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+    const block_q8_0x8 * b_ptr_start = (const block_q8_0x8 *)vx;
+    const block_q8_0x4 * a_ptr_start = (const block_q8_0x4 *)vy;
+
+    // Process the rows of the LHS four at a time, each with eight interleaved block_q8_0 at a time
+    for (int64_t y = 0; y < nr / 4; y++) {
+        const block_q8_0x4 * a_ptr = a_ptr_start + (y * nb);
+
+        for (int64_t x = 0; x < nc / 8; x++) {
+            const block_q8_0x8 * b_ptr = b_ptr_start + (x * nb);
+
+            // Master FP accumulators
+            __m256 acc_rows[4];
+            for (int m = 0; m < 4; m++) {
+                acc_rows[m] = _mm256_setzero_ps();
+            }
+
+            for (int64_t b = 0; b < nb; b++) {
+                const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, changemask);
+
+                __m256i iacc[4];
+                for (int m = 0; m < 4; m++) {
+                    iacc[m] = _mm256_setzero_si256();
+                }
+
+                for (int k = 0; k < QK8_0 / 8; k++) {
+                    const __m256i rhs_vec_0123 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64));
+                    const __m256i rhs_vec_4567 = _mm256_loadu_si256((const __m256i *)(b_ptr[b].qs + k * 64 + 32));
+
+                    // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3), then the same with the values 4-7
+                    const __m256i rhs_mat_lo = _mm256_blend_epi32(rhs_vec_0123, _mm256_shuffle_epi32(rhs_vec_4567, 177), 170);
+                    const __m256i rhs_mat_hi = _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123, 177), rhs_vec_4567, 170);
+
+                    for (int m = 0; m < 4; m++) {
+                        const __m256i lhs_vec = _mm256_broadcastq_epi64(_mm_loadl_epi64((const __m128i *)(a_ptr[b].qs + k * 32 + m * 8)));
+
+                        iacc[m] = mul_sum_i8_pairs_acc_int32x8(iacc[m], rhs_mat_lo, _mm256_shuffle_epi32(lhs_vec, 0));
+                        iacc[m] = mul_sum_i8_pairs_acc_int32x8(iacc[m], rhs_mat_hi, _mm256_shuffle_epi32(lhs_vec, 85));
+                    }
+                }
+
+                for (int m = 0; m < 4; m++) {
+                    const __m256 row_scale_f32 = _mm256_set1_ps(GGML_CPU_FP16_TO_FP32(a_ptr[b].d[m]));
+                    acc_rows[m] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc[m]), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_rows[m]);
+                }
+            }
+
+            // Accumulated output values permuted so as to be stored in appropriate order post accumulation
+            for (int m = 0; m < 4; m++) {
+                _mm256_storeu_ps(s + ((y * 4 + m) * bs + x * 8), _mm256_permutevar8x32_ps(acc_rows[m], finalpermutemask));
+            }
+        }
+    }
+    return;
+#endif
+    ggml_gemm_q8_0_8x8_q8_0_generic(n, s, bs, vx, vy, nr, nc);
+}
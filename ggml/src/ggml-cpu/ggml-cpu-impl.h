@@ -24,6 +24,22 @@ struct ggml_compute_params {
     void * wdata;
 
     struct ggml_threadpool * threadpool;
+
+    // position of the node in a sequence of mul_mat that share the conversion of src1 in wdata, 0 if it is the first
+    int src1_seq;
+
+    // index of the node in the graph, for its chunk counter, see ggml_compute_rows_next
+    int node_n;
+};
+
+// dynamic partitioning of the rows of a node over the threads
+// the rows are split in chunks that the threads take from a counter of the node when they are done with the previous
+// one, so that a slower thread (e.g. on an efficiency core or a preempted vCPU) does less of the work instead of
+// delaying the others at the next barrier
+struct ggml_compute_rows {
+    int64_t nr;    // number of rows
+    int64_t dr;    // rows per chunk
+    int64_t chunk; // current chunk of the thread, -1 before the first one
 };
 
 
@@ -512,6 +528,16 @@ void ggml_barrier(struct ggml_threadpool * tp);
 void ggml_threadpool_chunk_set(struct ggml_threadpool * tp, int value);
 int  ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value);
 
+// ne_row is the number of elements per row, used to keep the chunks large enough to amortize the counter
+void ggml_compute_rows_init(const struct ggml_compute_params * params, struct ggml_compute_rows * rows, int64_t nr, int64_t ne_row);
+// the rows [ir0, ir1) of the next chunk of the thread, returns false when all the chunks are taken
+bool ggml_compute_rows_next(const struct ggml_compute_params * params, struct ggml_compute_rows * rows, int64_t * ir0, int64_t * ir1);
+
+// with GGML_NUMA_STRATEGY_SPLIT, the rows [ir0, ir1) of a weight that thread ith multiplies, so that each thread only
+// reads the rows placed on its node by ggml_numa_split_tensor; the bounds are multiples of align
+// returns false if the rows should be distributed as usual
+bool ggml_numa_split_rows(int ith, int nth, int64_t nr, int64_t align, int64_t * ir0, int64_t * ir1);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,8 @@
 #include "ggml-backend-impl.h"
 #include "ggml-backend.h"
 #include "traits.h"
+#include "tune.h"
+#include "numa-split.h"
 #include "ggml-cpu-impl.h"
 #include "ggml-cpu.h"
 #include "ggml-impl.h"
@@ -431,6 +433,17 @@ typedef pthread_mutex_t    ggml_mutex_t;
 
 #endif
 
+// execution plan of a node, see ggml_graph_plan_nodes
+struct ggml_node_plan {
+    bool   barrier;    // the threads must synchronize after computing the node
+    int    n_fused;    // number of following nodes computed together with the node
+    int    src1_seq;   // see ggml_compute_params
+    size_t wdata_offs; // offset of the work buffer of the node
+    int    mm_variant; // index in ggml_mul_mat_variants, for mul_mat
+
+    atomic_int chunk;  // chunk counter of the node, see ggml_compute_rows_next
+};
+
 // Threadpool def
 struct ggml_threadpool {
     ggml_mutex_t mutex;       // mutex for cond.var
@@ -444,6 +457,10 @@ struct ggml_threadpool {
     atomic_int GGML_CACHE_ALIGN n_barrier;
     atomic_int GGML_CACHE_ALIGN n_barrier_passed;
     atomic_int GGML_CACHE_ALIGN current_chunk; // currently processing chunk during Mat_Mul, shared between all the threads.
+    atomic_int GGML_CACHE_ALIGN src1_chunk[2]; // chunk counters of the mul_mat that reuse the conversion of src1, see ggml_compute_forward_mul_mat
+
+    // src1 of the last mul_mat that converted it to vec_dot_type in the work buffer
+    const struct ggml_tensor * wdata_src1;
 
     // these are atomic as an annotation for thread-sanitizer
     atomic_bool stop;         // Used for stopping the threadpool altogether
@@ -457,6 +474,15 @@ struct ggml_threadpool {
     int32_t      prio;        // Scheduling priority
     uint32_t     poll;        // Polling level (0 - no polling)
 
+    // per node execution plan, see ggml_graph_plan_nodes
+    struct ggml_node_plan * node_plan;
+    int          n_node_plan; // allocated size of node_plan
+
+    // tuned mul_mat variant of each node of the last graph, see ggml_graph_resolve_tuned_variants
+    int        * tune_variants;
+    int          n_tune_variants; // allocated size of tune_variants
+    uint64_t     tune_hash;       // of the graph, 0 = none
+
     enum ggml_status ec;
 };
 
@@ -566,6 +592,11 @@ int ggml_threadpool_chunk_add(struct ggml_threadpool * tp, int value) {
     return atomic_fetch_add_explicit(&tp->current_chunk, value, memory_order_relaxed);
 }
 
+// chunks per thread, so that the other threads can take over the work of a slow one
+#define GGML_ROWS_CHUNKS_PER_THREAD 4
+// minimum number of elements per chunk, so that taking a chunk costs little compared to processing it
+#define GGML_ROWS_CHUNK_MIN_SIZE    4096
+
 #if defined(__gnu_linux__)
 static cpu_set_t ggml_get_numa_affinity(void) {
     cpu_set_t cpuset;
@@ -673,6 +704,83 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+static bool ggml_numa_is_split(void) {
+    return ggml_is_numa() && g_state.numa.numa_strategy == GGML_NUMA_STRATEGY_SPLIT;
+}
+
+bool ggml_numa_split_rows(int ith, int nth, int64_t nr, int64_t align, int64_t * ir0, int64_t * ir1) {
+    const int n_nodes = g_state.numa.n_nodes;
+
+    // each node needs at least one thread for its rows
+    if (!ggml_numa_is_split() || nth < n_nodes) {
+        return false;
+    }
+
+    // thread ith runs on node ith % n_nodes, see set_numa_thread_affinity
+    ggml_numa_thread_rows(n_nodes, ith, nth, nr, align, ir0, ir1);
+
+    return true;
+}
+
+// alignment of the rows of a weight that the threads multiply, see ggml_compute_forward_mul_mat and the repacked types
+static int64_t ggml_numa_split_align(const struct ggml_tensor * tensor) {
+    const int64_t align = ggml_cpu_extra_numa_split_align(tensor);
+    if (align > 0) {
+        return align;
+    }
+
+    return type_traits_cpu[tensor->type].nrows;
+}
+
+#if defined(__gnu_linux__)
+// from linux/mempolicy.h, to avoid a dependency on libnuma
+#define GGML_MPOL_BIND    2
+#define GGML_MPOL_MF_MOVE (1 << 1)
+#endif
+
+void ggml_numa_split_tensor(const struct ggml_tensor * tensor) {
+#if defined(__gnu_linux__)
+    if (!ggml_numa_is_split() || tensor->data == NULL || ggml_n_dims(tensor) < 2) {
+        return;
+    }
+
+    static bool warned = false;
+
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+
+    const int64_t align = ggml_numa_split_align(tensor);
+
+    for (int64_t i3 = 0; i3 < tensor->ne[3]; i3++) {
+        for (int64_t i2 = 0; i2 < tensor->ne[2]; i2++) {
+            const uintptr_t base = (uintptr_t) tensor->data + i2*tensor->nb[2] + i3*tensor->nb[3];
+
+            for (uint32_t n = 0; n < g_state.numa.n_nodes; n++) {
+                int64_t ir0;
+                int64_t ir1;
+                ggml_numa_node_rows(g_state.numa.n_nodes, n, tensor->ne[1], align, &ir0, &ir1);
+
+                // pages shared by the rows of two nodes are left where they are
+                const uintptr_t addr0 = GGML_PAD(base + ir0*tensor->nb[1], page_size);
+                const uintptr_t addr1 = (base + ir1*tensor->nb[1]) & ~(page_size - 1);
+                if (addr1 <= addr0) {
+                    continue;
+                }
+
+                // pages that cannot be moved (e.g. shared with the page cache of another process) are not an error
+                unsigned long nodemask = 1UL << n;
+                const long rv = syscall(SYS_mbind, (void *) addr0, addr1 - addr0, GGML_MPOL_BIND, &nodemask, sizeof(nodemask)*8, GGML_MPOL_MF_MOVE);
+                if (rv != 0 && !warned) {
+                    GGML_LOG_WARN("%s: mbind failed: %s\n", __func__, strerror(errno));
+                    warned = true;
+                }
+            }
+        }
+    }
+#else
+    UNUSED(tensor);
+#endif
+}
+
 #if defined(__ARM_ARCH)
 
 #if defined(__linux__) && defined(__aarch64__)
@@ -1205,10 +1313,28 @@ void ggml_compute_forward_mul_mat(
     const int ith = params->ith;
     const int nth = params->nth;
 
+    struct ggml_threadpool * tp = params->threadpool;
+
     enum ggml_type           const vec_dot_type         = type_traits_cpu[src0->type].vec_dot_type;
     ggml_from_float_t        const from_float           = type_traits_cpu[vec_dot_type].from_float;
     int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
 
+    // default, or the fastest for the shape when tuned, see ggml_cpu_tune_graph
+    const struct ggml_mul_mat_variant * variant = &ggml_mul_mat_variants[tp->node_plan[params->node_n].mm_variant];
+
+    // mul_mat that follow each other with the same src1 (e.g. the Q, K and V projections) convert it only once
+    // ggml_graph_plan_nodes guarantees that the nodes in between do not use the work buffer or modify src1
+    const bool src1_converted = params->src1_seq > 0 && src1->type != vec_dot_type && tp->wdata_src1 == src1;
+
+    if (ith == 0) {
+        if (params->src1_seq == 0) {
+            tp->wdata_src1 = NULL;
+        }
+        // the next mul_mat of the sequence may not have a barrier before processing the chunks, so its counter is reset
+        // here, the counters alternate so that a counter is not reset while in use
+        atomic_store_explicit(&tp->src1_chunk[(params->src1_seq + 1) % 2], nth, memory_order_relaxed);
+    }
+
     GGML_ASSERT(ne0 == ne01);
     GGML_ASSERT(ne1 == ne11);
     GGML_ASSERT(ne2 == ne12);
@@ -1235,7 +1361,7 @@ void ggml_compute_forward_mul_mat(
 
     const bool src1_cont = ggml_is_contiguous(src1);
 
-    if (src1_cont) {
+    if (src1_cont && variant->sgemm) {
         for (int64_t i13 = 0; i13 < ne13; i13++)
             for (int64_t i12 = 0; i12 < ne12; i12++)
                 if (!llamafile_sgemm(params,
@@ -1255,7 +1381,7 @@ void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
+    if (src1->type != vec_dot_type && !src1_converted) {
         char * wdata = params->wdata;
 
         const size_t nbw0 = ggml_type_size(vec_dot_type);
@@ -1292,15 +1418,23 @@ UseGgmlGemm1:;
     #endif
     }
 
-    if (ith == 0) {
+    atomic_int * chunk_counter = src1_converted ? &tp->src1_chunk[params->src1_seq % 2] : &tp->current_chunk;
+
+    if (ith == 0 && !src1_converted) {
         // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
-        atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
+        atomic_store_explicit(&tp->current_chunk, nth, memory_order_relaxed);
     }
 
-    ggml_barrier(params->threadpool);
+    if (!src1_converted) {
+        ggml_barrier(tp);
+
+        if (ith == 0 && src1->type != vec_dot_type) {
+            tp->wdata_src1 = src1;
+        }
+    }
 
 #if GGML_USE_LLAMAFILE
-    if (src1->type != vec_dot_type) {
+    if (src1->type != vec_dot_type && variant->sgemm) {
         const void* wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
         const size_t row_size = ggml_row_size(vec_dot_type, ne10);
 
@@ -1329,6 +1463,23 @@ UseGgmlGemm2:;
     // This is the size of the rest of the dimensions of the result
     const int64_t nr1 = ne1 * ne2 * ne3;
 
+    // with the split NUMA strategy, each thread multiplies the rows of the weights that are on its node
+    if (src0->buffer && ggml_backend_buffer_get_usage(src0->buffer) == GGML_BACKEND_BUFFER_USAGE_WEIGHTS) {
+        int64_t ir0_start;
+        int64_t ir0_end;
+        if (ggml_numa_split_rows(ith, nth, nr0, vec_dot_num_rows, &ir0_start, &ir0_end)) {
+            if (ir0_start < ir0_end) {
+                // same checks as below
+                int64_t num_rows_per_vec_dot = vec_dot_num_rows;
+                if ((nr0 % 2 != 0) || (ne11 % 2 != 0) || ((ir0_end - ir0_start) % 2 != 0) || (nr1 % 2 != 0)) {
+                    num_rows_per_vec_dot = 1;
+                }
+                ggml_compute_forward_mul_mat_one_chunk(params, dst, src0->type, num_rows_per_vec_dot, ir0_start, ir0_end, 0, nr1);
+            }
+            return;
+        }
+    }
+
     // Now select a reasonable chunk size.
     int chunk_size = 16;
 
@@ -1337,19 +1488,32 @@ UseGgmlGemm2:;
         chunk_size = 64;
     }
 
+    if (variant->chunk_size > 0) {
+        chunk_size = variant->chunk_size;
+    }
+
     // distribute the work across the inner or outer loop based on which one is larger
     // The number of chunks in the 0/1 dim.
     // CEIL(nr0/chunk_size)
     int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
     int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
 
-    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk it by thread.
-    //   Also, chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggml-org/llama.cpp/pull/6915
+    // If the chunking is poor for the number of threads on this setup, scrap the whole plan.  Re-chunk the larger dimension.
+    //   Chunking by thread was measured to have perform better on NUMA systems.  See https://github.com/ggml-org/llama.cpp/pull/6915
     //   In theory, chunking should be just as useful on NUMA and non NUMA systems, but testing disagreed with that.
-    if (nchunk0 * nchunk1 < nth * 4 || ggml_is_numa()) {
+    if (variant->n_chunks > 0) {
+        nchunk0 = nr0 > nr1 ? MIN(nr0, nth * variant->n_chunks) : 1;
+        nchunk1 = nr0 > nr1 ? 1 : MIN(nr1, nth * variant->n_chunks);
+    } else if (variant->n_chunks < 0) {
+        // keep the chunks of chunk_size
+    } else if (ggml_is_numa()) {
         // distribute the thread work across the inner or outer loop based on which one is larger
         nchunk0 = nr0 > nr1 ? nth : 1; // parallelize by src0 rows
         nchunk1 = nr0 > nr1 ? 1 : nth; // parallelize by src1 rows
+    } else if (nchunk0 * nchunk1 < nth * GGML_ROWS_CHUNKS_PER_THREAD) {
+        // keep a few chunks per thread, so that the faster threads can take over the work of a slower one
+        nchunk0 = nr0 > nr1 ? MIN(nr0, nth * GGML_ROWS_CHUNKS_PER_THREAD) : 1;
+        nchunk1 = nr0 > nr1 ? 1 : MIN(nr1, nth * GGML_ROWS_CHUNKS_PER_THREAD);
     }
 
     // The number of elements in each chunk
@@ -1383,41 +1547,121 @@ UseGgmlGemm2:;
             break;
         }
 
-        current_chunk = atomic_fetch_add_explicit(&params->threadpool->current_chunk, 1, memory_order_relaxed);
+        current_chunk = atomic_fetch_add_explicit(chunk_counter, 1, memory_order_relaxed);
     }
 }
 
 // ggml_compute_forward_mul_mat_id
 
-#define MMID_MATRIX_ROW(row_id, i1) matrix_rows[(row_id)*ids->ne[0]*ids->ne[1] + (i1)]
-
 struct mmid_row_mapping {
     int32_t i1;
     int32_t i2;
 };
 
+// experts with at least this many rows are multiplied with llamafile_sgemm
+#define GGML_MMID_SGEMM_MIN_ROWS 16
+
+// bytes of the results of llamafile_sgemm held in the work buffer, the rows of an expert are multiplied in chunks that fit
+#define GGML_MMID_SGEMM_DST_SIZE (16*1024*1024)
+
+// rows of the results of llamafile_sgemm that fit in the work buffer
+static int64_t ggml_mul_mat_id_sgemm_dst_rows(const struct ggml_tensor * src0, int64_t n_rows) {
+    return MIN(n_rows, MAX(GGML_MMID_SGEMM_MIN_ROWS, GGML_MMID_SGEMM_DST_SIZE/(src0->ne[1]*(int64_t) sizeof(float))));
+}
+
+// rows [ir1_start, ir1_end) of the expert a, multiplied with one call to llamafile_sgemm
+struct mmid_sgemm_piece {
+    int     a;
+    int64_t ic;
+    int64_t ir1_start;
+    int64_t ir1_end;
+};
+
+// advance to the next piece, starting from { -1 }
+// the rows of an expert that do not fit in the work buffer are split into pieces of similar sizes, so that none is too
+// small for llamafile_sgemm
+static bool ggml_mul_mat_id_sgemm_next(struct mmid_sgemm_piece * p, const int64_t * matrix_row_counts, int n_as, int64_t n_dst_rows) {
+    while (true) {
+        if (p->a >= 0) {
+            const int64_t cne1     = matrix_row_counts[p->a];
+            const int64_t n_pieces = (cne1 + n_dst_rows - 1)/n_dst_rows;
+
+            if (++p->ic < n_pieces) {
+                p->ir1_start = cne1*p->ic/n_pieces;
+                p->ir1_end   = cne1*(p->ic + 1)/n_pieces;
+                return true;
+            }
+        }
+
+        do {
+            p->a++;
+        } while (p->a < n_as && matrix_row_counts[p->a] < GGML_MMID_SGEMM_MIN_ROWS);
+
+        if (p->a >= n_as) {
+            return false;
+        }
+
+        p->ic = -1;
+    }
+}
+
+// mul_mat_id that may use llamafile_sgemm, the work buffer then holds its results, see ggml_compute_forward_mul_mat_id
+// keep in sync with the types supported by llamafile_sgemm
+static bool ggml_mul_mat_id_use_sgemm(const struct ggml_tensor * src0) {
+#if GGML_USE_LLAMAFILE
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+        case GGML_TYPE_F16:
+        case GGML_TYPE_BF16:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q4_0:
+        case GGML_TYPE_Q5_0:
+        case GGML_TYPE_IQ4_NL:
+            return true;
+        default:
+            return false;
+    }
+#else
+    GGML_UNUSED(src0);
+    return false;
+#endif
+}
+
+// number of chunks of the rows of an expert
+static void ggml_mul_mat_id_chunks(int64_t nr0, int64_t nr1, int nth, bool disable_chunking, int64_t * nchunk0, int64_t * nchunk1) {
+    int chunk_size = 16;
+    if (nr0 == 1 || nr1 == 1) {
+        chunk_size = 64;
+    }
+
+    *nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
+    *nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+
+    if (disable_chunking) {
+        *nchunk0 = nr0 > nr1 ? nth : 1;
+        *nchunk1 = nr0 > nr1 ? 1 : nth;
+    }
+}
+
 static void ggml_compute_forward_mul_mat_id_one_chunk(
     struct ggml_tensor * dst,
     const struct ggml_tensor * src0,
-    const struct ggml_tensor * src1,
-    const struct ggml_tensor * ids,
-    const int64_t cur_a,
     const int64_t ir0_start,
     const int64_t ir0_end,
     const int64_t ir1_start,
     const int64_t ir1_end,
     const char * src0_cur,
-    const struct mmid_row_mapping * matrix_rows,
-    const size_t row_size,
-    const bool src1_cont,
-    const void * wdata) {
+    const char * src1_cur,
+    const struct mmid_row_mapping * rows_cur,
+    const size_t row_size) {
 
-    GGML_TENSOR_BINARY_OP_LOCALS
+    GGML_TENSOR_LOCALS(int64_t, ne0, src0, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb0, src0, nb)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst,  nb)
 
     const enum ggml_type type = src0->type;
 
-    ggml_vec_dot_t    const vec_dot      = type_traits_cpu[type].vec_dot;
-    enum ggml_type    const vec_dot_type = type_traits_cpu[type].vec_dot_type;
+    ggml_vec_dot_t const vec_dot = type_traits_cpu[type].vec_dot;
 
     const int64_t blck_0 = 16;
     const int64_t blck_1 = 16;
@@ -1427,25 +1671,11 @@ static void ggml_compute_forward_mul_mat_id_one_chunk(
     for (int64_t iir1 = ir1_start; iir1 < ir1_end; iir1 += blck_1) {
         for (int64_t iir0 = ir0_start; iir0 < ir0_end; iir0 += blck_0) {
             for (int64_t ir1 = iir1; ir1 < iir1 + blck_1 && ir1 < ir1_end; ++ir1) {
-                const int64_t _i12 = ir1; // logical row index for this expert
-
-                struct mmid_row_mapping row_mapping = MMID_MATRIX_ROW(cur_a, _i12);
-                const int id       = row_mapping.i1; // selected expert index
+                const int64_t i1 = rows_cur[ir1].i1; // selected expert index
+                const int64_t i2 = rows_cur[ir1].i2; // row
 
-                const int64_t  i11 = id % ne11;
-                const int64_t  i12 = row_mapping.i2; // row index in src1
-
-                const int64_t  i1 = id;  // selected expert index
-                const int64_t  i2 = i12; // row
-
-                // desc: when src1 is not a contiguous memory block we have to calculate the offset using the strides
-                //       if it is, then we have either copied the data to params->wdata and made it contiguous or we are using
-                //       the original src1 data pointer, so we should index using the indices directly
-                // TODO: this is a bit of a hack, we should probably have a better way to handle this
-                const char * src1_col = (const char *) wdata +
-                    (src1_cont || src1->type != vec_dot_type
-                    ? (i11      + i12*ne11)*row_size
-                    : (i11*nb11 + i12*nb12));
+                // the rows of src1 of the expert are packed in the work buffer
+                const char * src1_col = src1_cur + ir1*row_size;
 
                 float * dst_col = (float *) ((char *) dst->data + (i1*nb1 + i2*nb2));
 
@@ -1480,9 +1710,9 @@ static void ggml_compute_forward_mul_mat_id(
     const int ith = params->ith;
     const int nth = params->nth;
 
-    const enum ggml_type type = src0->type;
+    struct ggml_threadpool * tp = params->threadpool;
 
-    const bool src1_cont = ggml_is_contiguous(src1);
+    const enum ggml_type type = src0->type;
 
     enum ggml_type    const vec_dot_type    = type_traits_cpu[type].vec_dot_type;
     ggml_from_float_t const from_float      = type_traits_cpu[vec_dot_type].from_float;
@@ -1497,152 +1727,254 @@ static void ggml_compute_forward_mul_mat_id(
     GGML_ASSERT(nb1 <= nb2);
     GGML_ASSERT(nb2 <= nb3);
 
+    GGML_ASSERT(src1->type == vec_dot_type || src1->type == GGML_TYPE_F32);
+
     // row groups
     const int n_ids = ids->ne[0]; // n_expert_used
     const int n_as  = ne02;       // n_expert
 
+    const int64_t n_rows   = ids->ne[0]*ids->ne[1]; // rows of src1 routed to the experts
+    const size_t  row_size = ggml_row_size(vec_dot_type, ne10);
+
+    const bool use_sgemm = ggml_mul_mat_id_use_sgemm(src0);
+
     void * wdata_cur = params->wdata;
 
-    if (src1->type != vec_dot_type) {
-        incr_ptr_aligned(&wdata_cur, ggml_row_size(vec_dot_type, ggml_nelements(src1)), sizeof(int64_t));
-    }
+    char * wdata_src1 = // [n_rows] rows of src1 grouped by expert, converted to vec_dot_type
+        incr_ptr_aligned(&wdata_cur, n_rows*row_size, sizeof(int64_t));
 
     int64_t * matrix_row_counts = // [n_as]
         incr_ptr_aligned(&wdata_cur, n_as*sizeof(int64_t), sizeof(int64_t));
 
-    struct mmid_row_mapping * matrix_rows = // [n_as][ids->ne[0]*ids->ne[1]]
-        incr_ptr_aligned(&wdata_cur, n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping), sizeof(int64_t));
+    int64_t * matrix_row_offs = // [n_as] first row of each expert
+        incr_ptr_aligned(&wdata_cur, n_as*sizeof(int64_t), sizeof(int64_t));
+
+    struct mmid_row_mapping * matrix_rows = // [n_rows] grouped by expert
+        incr_ptr_aligned(&wdata_cur, n_rows*sizeof(struct mmid_row_mapping), sizeof(int64_t));
 
-    char (*atomic_current_chunk)[CACHE_LINE_SIZE] = // [n_as]
-        incr_ptr_aligned(&wdata_cur, CACHE_LINE_SIZE * n_as, CACHE_LINE_SIZE);
+    const int64_t n_dst_rows = use_sgemm ? ggml_mul_mat_id_sgemm_dst_rows(src0, n_rows) : 0;
+
+    float * wdata_dst = use_sgemm ? // [n_dst_rows][ne01] results of llamafile_sgemm
+        incr_ptr_aligned(&wdata_cur, n_dst_rows*ne01*sizeof(float), CACHE_LINE_SIZE) : NULL;
 
     GGML_ASSERT(params->wsize >= (size_t)((char *) wdata_cur - (char *) params->wdata));
 
-    if (src1->type != vec_dot_type) {
-        char * wdata = params->wdata;
+    if (ith == 0) {
+        // initialize matrix_row_counts
+        memset(matrix_row_counts, 0, n_as*sizeof(int64_t));
 
-        const size_t nbw0 = ggml_type_size(vec_dot_type);
-        const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
-        const size_t nbw2 = nbw1*ne11;
-        const size_t nbw3 = nbw2*ne12;
+        for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
+            for (int id = 0; id < n_ids; ++id) {
+                const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
 
-        assert(params->wsize >= ne13*nbw3);
-        GGML_ASSERT(src1->type == GGML_TYPE_F32);
+                assert(i02 >= 0 && i02 < n_as);
 
-#if 0
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = ith; i12 < ne12; i12 += nth) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1),
-                               ne10);
-                }
-            }
-        }
-#else
-        for (int64_t i13 = 0; i13 < ne13; ++i13) {
-            for (int64_t i12 = 0; i12 < ne12; ++i12) {
-                for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    size_t bs = ggml_blck_size(vec_dot_type);
-                    int64_t ne10_block_start = (ith * ne10/bs) / nth;
-                    int64_t ne10_block_end   = ((ith + 1) * ne10/bs) / nth;
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0),
-                               (ne10_block_end - ne10_block_start) * bs);
-                }
+                matrix_row_counts[i02] += 1;
             }
         }
-#endif
-    }
 
-    if (ith == 0) {
-        // initialize matrix_row_counts
-        memset(matrix_row_counts, 0, n_as*sizeof(int64_t));
+        int64_t offs = 0;
+        for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+            matrix_row_offs[cur_a] = offs;
+            offs += matrix_row_counts[cur_a];
+            matrix_row_counts[cur_a] = 0;
+        }
 
         // group rows by src0 matrix
         for (int64_t iid1 = 0; iid1 < ids->ne[1]; ++iid1) {
             for (int id = 0; id < n_ids; ++id) {
                 const int32_t i02 = *(const int32_t *) ((const char *) ids->data + iid1*ids->nb[1] + id*ids->nb[0]);
 
-                assert(i02 >= 0 && i02 < n_as);
-
-                MMID_MATRIX_ROW(i02, matrix_row_counts[i02]) = (struct mmid_row_mapping) {id, iid1};
+                matrix_rows[matrix_row_offs[i02] + matrix_row_counts[i02]] = (struct mmid_row_mapping) {id, iid1};
                 matrix_row_counts[i02] += 1;
             }
         }
-    }
 
-    // reset current_chunk
-    for (int cur_a = ith; cur_a < n_as; cur_a += nth) {
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
-        *current_chunk_ctr = nth;
+        // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
+        atomic_store_explicit(&tp->current_chunk, nth, memory_order_relaxed);
     }
 
-    ggml_barrier(params->threadpool);
+    ggml_barrier(tp);
 
-    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
-        const int64_t cne1 = matrix_row_counts[cur_a];
+    // pack the rows of src1 of each expert, so that they can be multiplied as a contiguous matrix
+    for (int64_t ir = ith; ir < n_rows; ir += nth) {
+        const int64_t i11 = matrix_rows[ir].i1 % ne11;
+        const int64_t i12 = matrix_rows[ir].i2;
 
-        if (cne1 == 0) {
-            continue;
+        const char * src1_row = (const char *) src1->data + i11*nb11 + i12*nb12;
+
+        if (src1->type == vec_dot_type) {
+            memcpy(wdata_src1 + ir*row_size, src1_row, row_size);
+        } else {
+            from_float((const float *) src1_row, wdata_src1 + ir*row_size, ne10);
         }
+    }
 
-        const char * src0_cur = (const char *) src0->data + cur_a * nb02;
-        const void * wdata = (src1->type == vec_dot_type) ? src1->data : params->wdata;
-        const size_t row_size = ggml_row_size(vec_dot_type, ne10);
+    ggml_barrier(tp);
 
-        const int64_t nr0 = ne01;
-        const int64_t nr1 = cne1;
+    // experts with enough rows are multiplied by all the threads with llamafile_sgemm
+    // whether it supports the multiplication depends on the types and on ne00/ne01, so it is the same for all the experts
+    bool sgemm = false;
+
+#if GGML_USE_LLAMAFILE
+    if (use_sgemm) {
+        // the results of consecutive pieces are stored next to each other in the work buffer, and copied to the rows of
+        // dst when it is full - with a single fill for the batches whose results fit, e.g. during generation
+        struct mmid_sgemm_piece it    = { -1, 0, 0, 0 };
+        struct mmid_sgemm_piece first = it; // piece of the first row in the work buffer
+
+        int64_t n_buf = 0; // rows in the work buffer
+
+        bool any = false;
+
+        while (true) {
+            const bool next = ggml_mul_mat_id_sgemm_next(&it, matrix_row_counts, n_as, n_dst_rows);
+
+            if (n_buf > 0 && (!next || n_buf + it.ir1_end - it.ir1_start > n_dst_rows)) {
+                // llamafile_sgemm does not end with a barrier for all the types
+                ggml_barrier(tp);
+
+                struct mmid_sgemm_piece p = first;
+                for (int64_t ib = 0; ib < n_buf; ) {
+                    for (int64_t ir1 = p.ir1_start; ir1 < p.ir1_end; ++ir1, ++ib) {
+                        if (ib % nth != ith) {
+                            continue;
+                        }
+
+                        const struct mmid_row_mapping row_mapping = matrix_rows[matrix_row_offs[p.a] + ir1];
+
+                        memcpy((char *) dst->data + row_mapping.i1*nb1 + row_mapping.i2*nb2,
+                               wdata_dst + ib*ne01, ne01*sizeof(float));
+                    }
+                    ggml_mul_mat_id_sgemm_next(&p, matrix_row_counts, n_as, n_dst_rows);
+                }
+
+                n_buf = 0;
+
+                // the copies must be done before the next pieces overwrite the work buffer
+                // after the last piece, the barrier below is enough
+                if (next) {
+                    ggml_barrier(tp);
+                }
+            }
+
+            if (!next) {
+                break;
+            }
+
+            if (n_buf == 0) {
+                first = it;
+            }
 
-        int chunk_size = 16;
-        if (nr0 == 1 || nr1 == 1) {
-            chunk_size = 64;
+            any = true;
+
+            if (!llamafile_sgemm(params,
+                                 ne01, it.ir1_end - it.ir1_start, ne00/ggml_blck_size(type),
+                                 (const char *) src0->data + it.a*nb02,
+                                 nb01/ggml_type_size(type),
+                                 wdata_src1 + (matrix_row_offs[it.a] + it.ir1_start)*row_size,
+                                 row_size/ggml_type_size(vec_dot_type),
+                                 wdata_dst + n_buf*ne01,
+                                 ne01,
+                                 type,
+                                 vec_dot_type,
+                                 GGML_TYPE_F32)) {
+                GGML_ASSERT(!sgemm);
+                break;
+            }
+
+            sgemm  = true;
+            n_buf += it.ir1_end - it.ir1_start;
+        }
+
+        if (any) {
+            // llamafile_sgemm may have used the chunk counter
+            if (ith == 0) {
+                atomic_store_explicit(&tp->current_chunk, nth, memory_order_relaxed);
+            }
+
+            ggml_barrier(tp);
         }
+    }
+#else
+    GGML_UNUSED(wdata_dst);
+#endif
 
 #if defined(__aarch64__)
-        // disable for ARM
-        const bool disable_chunking = true;
+    // disable for ARM
+    const bool disable_chunking = true;
 #else
-        // disable for NUMA
-        const bool disable_chunking = ggml_is_numa();
+    // disable for NUMA
+    const bool disable_chunking = ggml_is_numa();
 #endif // defined(__aarch64__)
 
-        int64_t nchunk0 = (nr0 + chunk_size - 1) / chunk_size;
-        int64_t nchunk1 = (nr1 + chunk_size - 1) / chunk_size;
+    // the chunks of all the remaining experts are distributed over the threads with a single counter,
+    // so that the threads are balanced by the number of rows of each expert
+    int64_t n_chunks = 0;
+    for (int cur_a = 0; cur_a < n_as; ++cur_a) {
+        const int64_t cne1 = matrix_row_counts[cur_a];
 
-        if (nchunk0 * nchunk1 < nth * 4 || disable_chunking) {
-            nchunk0 = nr0 > nr1 ? nth : 1;
-            nchunk1 = nr0 > nr1 ? 1 : nth;
+        if (cne1 == 0 || (sgemm && cne1 >= GGML_MMID_SGEMM_MIN_ROWS)) {
+            continue;
         }
 
-        const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
-        const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
+        int64_t nchunk0, nchunk1;
+        ggml_mul_mat_id_chunks(ne01, cne1, nth, disable_chunking, &nchunk0, &nchunk1);
+        n_chunks += nchunk0*nchunk1;
+    }
 
-        int current_chunk = ith;
+    int     cur_a   = -1; // expert of the current chunk
+    int64_t chunk_0 = 0;  // first chunk of the expert
+    int64_t nchunk0 = 0;
+    int64_t nchunk1 = 0;
 
-        atomic_int * current_chunk_ctr = (atomic_int *)(atomic_current_chunk + cur_a);
+    int64_t current_chunk = ith;
 
-        while (current_chunk < nchunk0 * nchunk1) {
-            const int64_t ith0 = current_chunk % nchunk0;
-            const int64_t ith1 = current_chunk / nchunk0;
+    while (current_chunk < n_chunks) {
+        while (current_chunk >= chunk_0 + nchunk0*nchunk1) {
+            chunk_0 += nchunk0*nchunk1;
+            nchunk0  = 0;
+            nchunk1  = 0;
 
-            const int64_t ir0_start = dr0 * ith0;
-            const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
+            const int64_t cne1 = matrix_row_counts[++cur_a];
 
-            const int64_t ir1_start = dr1 * ith1;
-            const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+            if (cne1 > 0 && !(sgemm && cne1 >= GGML_MMID_SGEMM_MIN_ROWS)) {
+                ggml_mul_mat_id_chunks(ne01, cne1, nth, disable_chunking, &nchunk0, &nchunk1);
+            }
+        }
 
-            ggml_compute_forward_mul_mat_id_one_chunk(
-                dst, src0, src1, ids, cur_a,
-                ir0_start, ir0_end, ir1_start, ir1_end,
-                src0_cur, matrix_rows, row_size, src1_cont, wdata
-            );
+        const int64_t nr0 = ne01;
+        const int64_t nr1 = matrix_row_counts[cur_a];
 
-            if (nth >= nchunk0 * nchunk1) {
-                break;
-            }
+        const int64_t dr0 = (nr0 + nchunk0 - 1) / nchunk0;
+        const int64_t dr1 = (nr1 + nchunk1 - 1) / nchunk1;
+
+        const int64_t ith0 = (current_chunk - chunk_0) % nchunk0;
+        const int64_t ith1 = (current_chunk - chunk_0) / nchunk0;
+
+        const int64_t ir0_start = dr0 * ith0;
+        const int64_t ir0_end = MIN(ir0_start + dr0, nr0);
+
+        const int64_t ir1_start = dr1 * ith1;
+        const int64_t ir1_end = MIN(ir1_start + dr1, nr1);
+
+        ggml_compute_forward_mul_mat_id_one_chunk(
+            dst, src0,
+            ir0_start, ir0_end, ir1_start, ir1_end,
+            (const char *) src0->data + cur_a*nb02,
+            wdata_src1 + matrix_row_offs[cur_a]*row_size,
+            matrix_rows + matrix_row_offs[cur_a],
+            row_size
+        );
+
+        if (nth >= n_chunks) {
+            break;
+        }
 
-            current_chunk = atomic_fetch_add_explicit(current_chunk_ctr, 1, memory_order_relaxed);
+        if (disable_chunking) {
+            current_chunk += nth;
+        } else {
+            current_chunk = atomic_fetch_add_explicit(&tp->current_chunk, 1, memory_order_relaxed);
         }
     }
 }
@@ -2036,6 +2368,7 @@ static void set_numa_thread_affinity(int thread_n) {
 
     switch(g_state.numa.numa_strategy) {
         case GGML_NUMA_STRATEGY_DISTRIBUTE:
+        case GGML_NUMA_STRATEGY_SPLIT:
             // run thread on node_num thread_n / (threads per node)
             node_num = thread_n % g_state.numa.n_nodes;
             break;
@@ -2589,6 +2922,8 @@ void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
 
     const size_t workers_size = sizeof(struct ggml_compute_state) * n_threads;
     ggml_aligned_free(threadpool->workers, workers_size);
+    free(threadpool->node_plan);
+    free(threadpool->tune_variants);
     ggml_aligned_free(threadpool, sizeof(struct ggml_threadpool));
 }
 
@@ -2631,6 +2966,11 @@ void ggml_threadpool_resume(struct ggml_threadpool * threadpool) {
 #endif
 }
 
+static bool   ggml_node_is_noop(const struct ggml_tensor * node);
+static bool   ggml_node_can_share_segment(const struct ggml_tensor * node, int64_t * wdata_row);
+static bool   ggml_node_converts_src1(const struct ggml_tensor * node);
+static size_t ggml_node_src1_wdata_size(const struct ggml_tensor * node);
+
 struct ggml_cplan ggml_graph_plan(
           const struct ggml_cgraph * cgraph,
                                int   n_threads,
@@ -2650,6 +2990,9 @@ struct ggml_cplan ggml_graph_plan(
 
     int max_tasks = 1;
 
+    // offset of the work buffer of the nodes that use per-thread rows, see ggml_graph_plan_nodes
+    size_t wdata_offs = 0;
+
     // thread scheduling for the different operations + work buffer size estimation
     for (int i = 0; i < cgraph->n_nodes; i++) {
         struct ggml_tensor * node = cgraph->nodes[i];
@@ -2705,16 +3048,17 @@ struct ggml_cplan ggml_graph_plan(
                         const struct ggml_tensor * ids = node->src[2];
                         const enum ggml_type vec_dot_type = type_traits_cpu[src0->type].vec_dot_type;
                         const int n_as = src0->ne[2];
-                        // src1
-                        if (src1->type != vec_dot_type) {
-                            cur += ggml_row_size(vec_dot_type, ggml_nelements(src1)) + sizeof(int64_t);
-                        }
-                        // matrix_row_counts
-                        cur += n_as * sizeof(int64_t) + sizeof(int64_t);
+                        const int64_t n_rows = ids->ne[0]*ids->ne[1];
+                        // src1 rows grouped by expert
+                        cur += ggml_row_size(vec_dot_type, src1->ne[0])*n_rows + sizeof(int64_t);
+                        // matrix_row_counts, matrix_row_offs
+                        cur += 2*n_as*sizeof(int64_t) + sizeof(int64_t);
                         // matrix_rows
-                        cur += n_as*ids->ne[0]*ids->ne[1]*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
-                        // atomic_current_chunk
-                        cur += CACHE_LINE_SIZE*n_as + CACHE_LINE_SIZE;
+                        cur += n_rows*sizeof(struct mmid_row_mapping) + sizeof(int64_t);
+                        // results of llamafile_sgemm
+                        if (ggml_mul_mat_id_use_sgemm(src0)) {
+                            cur += ggml_mul_mat_id_sgemm_dst_rows(src0, n_rows)*src0->ne[1]*sizeof(float) + CACHE_LINE_SIZE;
+                        }
                     } break;
                 case GGML_OP_OUT_PROD:
                     {
@@ -2777,6 +3121,9 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        // tiled kernel: q rows, VKQ accumulators and KQ values of a tile + 1x head size V (per thread)
+                        cur = MAX(cur, sizeof(float)*(GGML_FA_TILE_Q*(ne10 + ne20 + GGML_FA_TILE_KV) + ne20 + CACHE_LINE_SIZE_F32)*n_tasks);
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2808,6 +3155,17 @@ struct ggml_cplan ggml_graph_plan(
             }
         }
 
+        if (!ggml_node_is_noop(node)) {
+            int64_t wdata_row;
+            if (ggml_node_converts_src1(node)) {
+                wdata_offs = ggml_node_src1_wdata_size(node);
+            } else if (!ggml_node_can_share_segment(node, &wdata_row)) {
+                wdata_offs = 0;
+            } else if (wdata_row >= 0) {
+                cur += wdata_offs;
+            }
+        }
+
         work_size = MAX(work_size, cur);
     }
 
@@ -2823,37 +3181,784 @@ struct ggml_cplan ggml_graph_plan(
     return cplan;
 }
 
-static thread_ret_t ggml_graph_compute_thread(void * data) {
-    struct ggml_compute_state * state = (struct ggml_compute_state *) data;
-    struct ggml_threadpool    * tp    = state->threadpool;
-
-    const struct ggml_cgraph * cgraph = tp->cgraph;
-    const struct ggml_cplan  * cplan  = tp->cplan;
-
-    set_numa_thread_affinity(state->ith);
+// barrier elision
+//
+// all threads compute every node of the graph, splitting the work by ith/nth, and normally synchronize after each node
+// consecutive nodes are grouped in a segment that runs without barriers in between when no node of the segment
+// reads or writes memory written by another node of the segment, and when they do not share scratch state between
+// the threads. since every thread still computes the nodes of a segment in order, the barriers inside the ops stay
+// matched and the per-thread parts of the work buffer are only reused by the same thread
 
-    struct ggml_compute_params params = {
-        /*.ith       =*/ state->ith,
-        /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
-        /*.wsize     =*/ cplan->work_size,
-        /*.wdata     =*/ cplan->work_data,
-        /*.threadpool=*/ tp,
-    };
+#define GGML_SEGMENT_MAX_RANGES 32
 
-    for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
-        struct ggml_tensor * node = cgraph->nodes[node_n];
+struct ggml_mem_range {
+    const char * p0;
+    const char * p1;
+};
 
-        ggml_compute_forward(&params, node);
+struct ggml_graph_segment {
+    struct ggml_mem_range reads [GGML_SEGMENT_MAX_RANGES];
+    struct ggml_mem_range writes[GGML_SEGMENT_MAX_RANGES];
+    int  n_reads;
+    int  n_writes;
+    int  n_nodes;
+    bool exclusive; // the segment contains a node that cannot share its segment
+    int64_t wdata_row; // row size of the per-thread work buffer used by the segment, -1 if none
+};
 
-        if (state->ith == 0 && cplan->abort_callback &&
-                cplan->abort_callback(cplan->abort_callback_data)) {
+static bool ggml_node_is_noop(const struct ggml_tensor * node) {
+    switch (node->op) {
+        case GGML_OP_NONE:
+        case GGML_OP_RESHAPE:
+        case GGML_OP_VIEW:
+        case GGML_OP_PERMUTE:
+        case GGML_OP_TRANSPOSE:
+            return true;
+        default:
+            return ggml_is_empty(node);
+    }
+}
+
+// returns false if the node may use state shared between the threads (the work buffer, the chunk counter)
+// otherwise, wdata_row is set to the size of the per-thread rows of the work buffer used by the node, or -1
+static bool ggml_node_can_share_segment(const struct ggml_tensor * node, int64_t * wdata_row) {
+    *wdata_row = -1;
+
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        const struct ggml_tensor * src = node->src[i];
+        // tensors in extra buffers may be computed by an extra buffer type
+        if (src && src->buffer && !ggml_backend_buft_is_host(src->buffer->buft)) {
+            return false;
+        }
+    }
+
+    switch (node->op) {
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+        case GGML_OP_SCALE:
+        case GGML_OP_SQR:
+        case GGML_OP_SQRT:
+        case GGML_OP_CLAMP:
+        case GGML_OP_UNARY:
+        case GGML_OP_GLU:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_L2_NORM:
+        case GGML_OP_GET_ROWS:
+        case GGML_OP_SET_ROWS:
+        case GGML_OP_CONCAT:
+            return true;
+        case GGML_OP_ADD:
+        case GGML_OP_ADD1:
+            if (ggml_is_quantized(node->src[0]->type)) {
+                *wdata_row = node->src[0]->ne[0];
+            }
+            return true;
+        case GGML_OP_CPY:
+        case GGML_OP_DUP:
+        case GGML_OP_CONT:
+            // same condition as the work size in ggml_graph_plan
+            if (ggml_is_quantized(node->type) ||
+                (node->src[0]->type == GGML_TYPE_F16  && node->src[1] && node->src[1]->type == GGML_TYPE_BF16) ||
+                (node->src[0]->type == GGML_TYPE_BF16 && node->src[1] && node->src[1]->type == GGML_TYPE_F16)) {
+                *wdata_row = node->src[0]->ne[0];
+            }
+            return true;
+        case GGML_OP_ROPE:
+        case GGML_OP_SOFT_MAX:
+            *wdata_row = node->src[0]->ne[0];
+            return true;
+        default:
+            return false;
+    }
+}
+
+static struct ggml_mem_range ggml_mem_range_of(const struct ggml_tensor * t) {
+    struct ggml_mem_range r = { (const char *) t->data, (const char *) t->data + ggml_nbytes(t) };
+    return r;
+}
+
+static bool ggml_mem_range_overlaps(const struct ggml_mem_range * ranges, int n, struct ggml_mem_range r) {
+    for (int i = 0; i < n; i++) {
+        if (r.p0 < ranges[i].p1 && ranges[i].p0 < r.p1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// try to add the node to the segment, returns false if the node needs a barrier before it
+static bool ggml_graph_segment_add(struct ggml_graph_segment * seg, const struct ggml_tensor * node) {
+    int64_t wdata_row;
+    const bool shared = ggml_node_can_share_segment(node, &wdata_row);
+
+    if (seg->n_nodes > 0) {
+        if (seg->exclusive || !shared) {
+            return false;
+        }
+        if (wdata_row >= 0 && seg->wdata_row >= 0 && wdata_row != seg->wdata_row) {
+            return false;
+        }
+
+        int n_srcs = 0;
+        for (int i = 0; i < GGML_MAX_SRC; i++) {
+            n_srcs += node->src[i] != NULL;
+        }
+        if (seg->n_reads + n_srcs > GGML_SEGMENT_MAX_RANGES || seg->n_writes + 1 > GGML_SEGMENT_MAX_RANGES) {
+            return false;
+        }
+
+        const struct ggml_mem_range dst = ggml_mem_range_of(node);
+        if (ggml_mem_range_overlaps(seg->writes, seg->n_writes, dst) ||
+            ggml_mem_range_overlaps(seg->reads,  seg->n_reads,  dst)) {
+            return false;
+        }
+        for (int i = 0; i < GGML_MAX_SRC; i++) {
+            if (node->src[i] && ggml_mem_range_overlaps(seg->writes, seg->n_writes, ggml_mem_range_of(node->src[i]))) {
+                return false;
+            }
+        }
+    }
+
+    if (!shared) {
+        seg->exclusive = true;
+    }
+    if (wdata_row >= 0) {
+        seg->wdata_row = wdata_row;
+    }
+    if (shared) {
+        for (int i = 0; i < GGML_MAX_SRC; i++) {
+            if (node->src[i]) {
+                seg->reads[seg->n_reads++] = ggml_mem_range_of(node->src[i]);
+            }
+        }
+        seg->writes[seg->n_writes++] = ggml_mem_range_of(node);
+    }
+    seg->n_nodes++;
+
+    return true;
+}
+
+// operator fusion
+//
+// short chains of row-wise ops are computed one row at a time by a single kernel, so that the intermediate rows stay
+// in cache instead of making a full pass over memory per op. the results are identical to the unfused ops
+
+static bool ggml_cpu_fusion_disabled = false;
+
+static bool ggml_is_f32_rows(const struct ggml_tensor * t) {
+    return t->type == GGML_TYPE_F32 && t->nb[0] == sizeof(float);
+}
+
+// the operand of mul that is not prev, broadcast by rows over mul
+static bool ggml_can_fuse_mul_operand(const struct ggml_tensor * mul, const struct ggml_tensor * prev) {
+    const struct ggml_tensor * w = mul->src[0] == prev ? mul->src[1] : mul->src[0];
+    return ggml_is_f32_rows(mul) && ggml_is_f32_rows(w) && w->ne[0] == mul->ne[0] && ggml_can_repeat(w, mul);
+}
+
+// returns the number of nodes following node i that are computed together with it
+static int ggml_graph_plan_fusion(const struct ggml_cgraph * cgraph, int i) {
+    const struct ggml_tensor * node = cgraph->nodes[i];
+
+    switch (node->op) {
+        case GGML_OP_ADD:
+            {
+                // add -> rms_norm [-> mul], the result of add is still written as it is usually also used by the residual
+                if (i + 1 >= cgraph->n_nodes) {
+                    return 0;
+                }
+                const struct ggml_tensor * norm = cgraph->nodes[i + 1];
+                const struct ggml_tensor * a    = node->src[0];
+                const struct ggml_tensor * b    = node->src[1];
+                if (norm->op != GGML_OP_RMS_NORM || norm->src[0] != node || node->view_src ||
+                    !ggml_is_f32_rows(node) || !ggml_is_f32_rows(a) || !ggml_is_f32_rows(b) || !ggml_is_f32_rows(norm) ||
+                    b->ne[0] != node->ne[0] || !ggml_can_repeat(b, node) || !ggml_are_same_shape(a, node) ||
+                    a->data == b->data) {
+                    return 0;
+                }
+                return 1 + ggml_graph_plan_fusion(cgraph, i + 1);
+            }
+        case GGML_OP_RMS_NORM:
+            {
+                // rms_norm -> mul
+                if (!ggml_can_fuse(cgraph, i, (const enum ggml_op[]) { GGML_OP_RMS_NORM, GGML_OP_MUL }, 2) ||
+                    !ggml_is_f32_rows(node->src[0]) || !ggml_can_fuse_mul_operand(cgraph->nodes[i + 1], node)) {
+                    return 0;
+                }
+                return 1;
+            }
+        case GGML_OP_UNARY:
+            {
+                // silu/gelu -> mul (gated linear unit), the kernel does not broadcast the operands of the mul
+                const enum ggml_unary_op op = ggml_get_unary_op(node);
+                if (op != GGML_UNARY_OP_SILU && op != GGML_UNARY_OP_GELU) {
+                    return 0;
+                }
+                if (!ggml_can_fuse(cgraph, i, (const enum ggml_op[]) { GGML_OP_UNARY, GGML_OP_MUL }, 2)) {
+                    return 0;
+                }
+                const struct ggml_tensor * mul  = cgraph->nodes[i + 1];
+                const struct ggml_tensor * gate = mul->src[0] == node ? mul->src[1] : mul->src[0];
+                if (node->src[0]->type != GGML_TYPE_F32 || gate->type != GGML_TYPE_F32 || mul->type != GGML_TYPE_F32 ||
+                    !ggml_is_contiguous_1(node->src[0]) || !ggml_is_contiguous_1(gate) || !ggml_is_contiguous_1(mul) ||
+                    !ggml_are_same_shape(node, mul) || !ggml_are_same_shape(gate, mul) || gate->data == mul->data) {
+                    return 0;
+                }
+                return 1;
+            }
+        default:
+            return 0;
+    }
+}
+
+static void ggml_compute_forward_fused(struct ggml_compute_params * params, struct ggml_tensor ** nodes, int n_fused) {
+    switch (nodes[0]->op) {
+        case GGML_OP_ADD:
+            {
+                ggml_compute_forward_fused_add_rms_norm_mul(params, nodes[0], nodes[1], n_fused > 1 ? nodes[2] : NULL);
+            } break;
+        case GGML_OP_RMS_NORM:
+            {
+                ggml_compute_forward_fused_add_rms_norm_mul(params, NULL, nodes[0], nodes[1]);
+            } break;
+        case GGML_OP_UNARY:
+            {
+                ggml_compute_forward_fused_unary_mul(params, nodes[0], nodes[1]);
+            } break;
+        default:
+            GGML_ABORT("fatal error");
+    }
+}
+
+// mul_mat computed by ggml_compute_forward_mul_mat that convert src1 to vec_dot_type in the work buffer
+static bool ggml_node_converts_src1(const struct ggml_tensor * node) {
+    if (node->op != GGML_OP_MUL_MAT) {
+        return false;
+    }
+
+    const struct ggml_tensor * src0 = node->src[0];
+    const struct ggml_tensor * src1 = node->src[1];
+
+    // extra buffer types use their own kernels
+    if (src0->buffer && !ggml_backend_buffer_is_host(src0->buffer)) {
+        return false;
+    }
+
+    return src1->type == GGML_TYPE_F32 && type_traits_cpu[src0->type].vec_dot_type != GGML_TYPE_F32;
+}
+
+// size of the conversion of src1 in the work buffer
+// the nodes that follow the mul_mat and use per-thread rows of the work buffer are given the space after it, so that
+// the conversion is kept until the next mul_mat with the same src1, see ggml_graph_plan_nodes
+static size_t ggml_node_src1_wdata_size(const struct ggml_tensor * node) {
+    const enum ggml_type vec_dot_type = type_traits_cpu[node->src[0]->type].vec_dot_type;
+
+    return GGML_PAD(ggml_row_size(vec_dot_type, ggml_nelements(node->src[1])), CACHE_LINE_SIZE);
+}
+
+void ggml_compute_rows_init(const struct ggml_compute_params * params, struct ggml_compute_rows * rows, int64_t nr, int64_t ne_row) {
+    const int64_t nth = params->nth;
+
+    int64_t dr = (nr + nth*GGML_ROWS_CHUNKS_PER_THREAD - 1)/(nth*GGML_ROWS_CHUNKS_PER_THREAD);
+    if (dr*ne_row < GGML_ROWS_CHUNK_MIN_SIZE) {
+        // small rows: larger chunks, but never fewer than one per thread
+        dr = MIN((GGML_ROWS_CHUNK_MIN_SIZE + ne_row - 1)/MAX(ne_row, 1), (nr + nth - 1)/nth);
+    }
+
+    rows->nr    = nr;
+    rows->dr    = MAX(dr, 1);
+    rows->chunk = -1;
+}
+
+bool ggml_compute_rows_next(const struct ggml_compute_params * params, struct ggml_compute_rows * rows, int64_t * ir0, int64_t * ir1) {
+    const int64_t nth    = params->nth;
+    const int64_t nchunk = (rows->nr + rows->dr - 1)/rows->dr;
+
+    if (rows->chunk < 0) {
+        // the first chunk of each thread is its own, the next ones are taken from the counter of the node
+        rows->chunk = params->ith;
+    } else if (nchunk <= nth) {
+        return false;
+    } else {
+        atomic_int * counter = &params->threadpool->node_plan[params->node_n].chunk;
+        rows->chunk = nth + atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+    }
+
+    if (rows->chunk >= nchunk) {
+        return false;
+    }
+
+    *ir0 = rows->chunk*rows->dr;
+    *ir1 = MIN(*ir0 + rows->dr, rows->nr);
+
+    return true;
+}
+
+// mm_variant: variant of all the mul_mat, -1 = the variant of each mul_mat in tuned, the default if tuned is NULL
+static void ggml_graph_plan_nodes(const struct ggml_cgraph * cgraph, struct ggml_node_plan * plan, int mm_variant, const int * tuned) {
+    struct ggml_graph_segment seg;
+    memset(&seg, 0, sizeof(seg));
+    seg.wdata_row = -1;
+
+    int prev = -1; // last node that was not a no-op
+    int mm   = -1; // last mul_mat whose conversion of src1 is still in the work buffer
+
+    size_t wdata_offs = 0; // offset of the work buffer of the nodes that use per-thread rows
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        plan[i].barrier    = false;
+        plan[i].n_fused    = 0;
+        plan[i].src1_seq   = 0;
+        plan[i].wdata_offs = 0;
+        plan[i].mm_variant = 0;
+        atomic_store_explicit(&plan[i].chunk, 0, memory_order_relaxed);
+
+        if (ggml_node_is_noop(node)) {
+            continue;
+        }
+
+        if (node->op == GGML_OP_MUL_MAT) {
+            if (mm_variant >= 0) {
+                plan[i].mm_variant = mm_variant;
+            } else if (tuned) {
+                plan[i].mm_variant = tuned[i];
+            }
+        }
+
+        const int n_fused = ggml_cpu_fusion_disabled ? 0 : ggml_graph_plan_fusion(cgraph, i);
+
+        int64_t wdata_row;
+        if (ggml_node_converts_src1(node)) {
+            const struct ggml_tensor * prev_mm = mm >= 0 ? cgraph->nodes[mm] : NULL;
+            if (prev_mm && prev_mm->src[1] == node->src[1] &&
+                type_traits_cpu[prev_mm->src[0]->type].vec_dot_type == type_traits_cpu[node->src[0]->type].vec_dot_type) {
+                plan[i].src1_seq = plan[mm].src1_seq + 1;
+            }
+            mm         = i;
+            wdata_offs = ggml_node_src1_wdata_size(node);
+        } else if (n_fused > 0 || !ggml_node_can_share_segment(node, &wdata_row)) {
+            // the node may use the whole work buffer
+            mm         = -1;
+            wdata_offs = 0;
+        } else {
+            if (mm >= 0) {
+                const struct ggml_mem_range src1 = ggml_mem_range_of(cgraph->nodes[mm]->src[1]);
+                if (ggml_mem_range_overlaps(&src1, 1, ggml_mem_range_of(node))) {
+                    mm = -1;
+                }
+            }
+            if (wdata_row >= 0) {
+                plan[i].wdata_offs = wdata_offs;
+            }
+        }
+
+        if (n_fused > 0) {
+            // fused nodes run in a segment of their own
+            if (prev >= 0) {
+                plan[prev].barrier = true;
+            }
+            plan[i].n_fused = n_fused;
+            for (int j = 1; j <= n_fused; j++) {
+                plan[i + j].barrier    = false;
+                plan[i + j].n_fused    = 0;
+                plan[i + j].src1_seq   = 0;
+                plan[i + j].wdata_offs = 0;
+                plan[i + j].mm_variant = 0;
+                atomic_store_explicit(&plan[i + j].chunk, 0, memory_order_relaxed);
+            }
+            i   += n_fused;
+            prev = i;
+
+            memset(&seg, 0, sizeof(seg));
+            seg.wdata_row = -1;
+            seg.exclusive = true;
+            seg.n_nodes   = 1;
+            continue;
+        }
+
+        if (!ggml_graph_segment_add(&seg, node)) {
+            plan[prev].barrier = true;
+
+            memset(&seg, 0, sizeof(seg));
+            seg.wdata_row = -1;
+            ggml_graph_segment_add(&seg, node);
+        }
+
+        prev = i;
+    }
+}
+
+// per node profiling
+
+struct ggml_cpu_profile_node {
+    char           name[GGML_MAX_NAME];
+    char           op[64];              // op of the node, or of each node computed together with it
+    enum ggml_type type;
+    int64_t        ne[GGML_MAX_DIMS];
+    int            graph;               // index of the graph computation
+    bool           noop;                // no events are recorded for the node
+};
+
+struct ggml_cpu_profile_event {
+    int64_t node;    // index in ggml_cpu_profile::nodes
+    int64_t t_start; // start of the computation of the node, in ns
+    int64_t t_end;   // end of the computation
+    int64_t t_sync;  // end of the barrier after the node, t_end if there is no barrier
+};
+
+struct ggml_cpu_profile_thread {
+    struct ggml_cpu_profile_event * events;
+    int64_t n_events;
+    int64_t n_alloc;
+};
+
+struct ggml_cpu_profile {
+    struct ggml_cpu_profile_node * nodes;
+    int64_t n_nodes;
+    int64_t n_alloc;
+
+    int n_graphs;
+
+    // each thread only appends to its own events
+    struct ggml_cpu_profile_thread threads[GGML_MAX_N_THREADS];
+};
+
+static inline int64_t ggml_cpu_profile_time(void) {
+#if defined(_WIN32)
+    return ggml_time_us()*1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + (int64_t)ts.tv_nsec;
+#endif
+}
+
+struct ggml_cpu_profile * ggml_cpu_profile_new(void) {
+    struct ggml_cpu_profile * profile = calloc(1, sizeof(struct ggml_cpu_profile));
+    GGML_ASSERT(profile);
+    return profile;
+}
+
+void ggml_cpu_profile_reset(struct ggml_cpu_profile * profile) {
+    profile->n_nodes  = 0;
+    profile->n_graphs = 0;
+    for (int i = 0; i < GGML_MAX_N_THREADS; i++) {
+        profile->threads[i].n_events = 0;
+    }
+}
+
+void ggml_cpu_profile_free(struct ggml_cpu_profile * profile) {
+    if (profile == NULL) {
+        return;
+    }
+    for (int i = 0; i < GGML_MAX_N_THREADS; i++) {
+        free(profile->threads[i].events);
+    }
+    free(profile->nodes);
+    free(profile);
+}
+
+// called before the threads start computing the graph
+static void ggml_cpu_profile_add_graph(struct ggml_cpu_profile * profile, const struct ggml_cgraph * cgraph, const struct ggml_node_plan * plan) {
+    if (profile->n_nodes + cgraph->n_nodes > profile->n_alloc) {
+        profile->n_alloc = MAX(2*profile->n_alloc, profile->n_nodes + cgraph->n_nodes);
+        profile->nodes   = realloc(profile->nodes, profile->n_alloc*sizeof(struct ggml_cpu_profile_node));
+        GGML_ASSERT(profile->nodes);
+    }
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        struct ggml_cpu_profile_node * pn = &profile->nodes[profile->n_nodes + i];
+
+        snprintf(pn->name, sizeof(pn->name), "%s", node->name);
+        snprintf(pn->op,   sizeof(pn->op),   "%s", ggml_op_desc(node));
+        for (int j = 1; j <= plan[i].n_fused; j++) {
+            const size_t len = strlen(pn->op);
+            snprintf(pn->op + len, sizeof(pn->op) - len, "+%s", ggml_op_desc(cgraph->nodes[i + j]));
+        }
+        pn->type  = node->type;
+        memcpy(pn->ne, node->ne, sizeof(pn->ne));
+        pn->graph = profile->n_graphs;
+        pn->noop  = ggml_node_is_noop(node);
+
+        // the nodes computed together with this one have no events of their own
+        for (int j = 1; j <= plan[i].n_fused; j++) {
+            struct ggml_cpu_profile_node * pf = &profile->nodes[profile->n_nodes + i + j];
+
+            snprintf(pf->name, sizeof(pf->name), "%s", cgraph->nodes[i + j]->name);
+            snprintf(pf->op,   sizeof(pf->op),   "%s", pn->op);
+            pf->type  = cgraph->nodes[i + j]->type;
+            memcpy(pf->ne, cgraph->nodes[i + j]->ne, sizeof(pf->ne));
+            pf->graph = profile->n_graphs;
+            pf->noop  = true;
+        }
+        i += plan[i].n_fused;
+    }
+
+    profile->n_nodes += cgraph->n_nodes;
+    profile->n_graphs++;
+}
+
+static void ggml_cpu_profile_reserve(struct ggml_cpu_profile * profile, int ith, int64_t n_events) {
+    struct ggml_cpu_profile_thread * pt = &profile->threads[ith];
+
+    if (pt->n_events + n_events > pt->n_alloc) {
+        pt->n_alloc = MAX(2*pt->n_alloc, pt->n_events + n_events);
+        pt->events  = realloc(pt->events, pt->n_alloc*sizeof(struct ggml_cpu_profile_event));
+        GGML_ASSERT(pt->events);
+    }
+}
+
+static inline void ggml_cpu_profile_add_event(struct ggml_cpu_profile * profile, int ith, int64_t node, int64_t t_start, int64_t t_end, int64_t t_sync) {
+    if (profile->nodes[node].noop) {
+        return;
+    }
+
+    struct ggml_cpu_profile_thread * pt = &profile->threads[ith];
+
+    pt->events[pt->n_events++] = (struct ggml_cpu_profile_event) { node, t_start, t_end, t_sync };
+}
+
+static void ggml_cpu_profile_write_string(FILE * f, const char * s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+            fputc(*s, f);
+        } else if ((unsigned char) *s < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char) *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+bool ggml_cpu_profile_write_trace(const struct ggml_cpu_profile * profile, const char * fname) {
+    FILE * f = ggml_fopen(fname, "w");
+    if (!f) {
+        GGML_LOG_ERROR("%s: failed to open %s\n", __func__, fname);
+        return false;
+    }
+
+    int64_t t0 = INT64_MAX;
+    for (int i = 0; i < GGML_MAX_N_THREADS; i++) {
+        const struct ggml_cpu_profile_thread * pt = &profile->threads[i];
+        for (int64_t j = 0; j < pt->n_events; j++) {
+            t0 = MIN(t0, pt->events[j].t_start);
+        }
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    bool first = true;
+    for (int i = 0; i < GGML_MAX_N_THREADS; i++) {
+        const struct ggml_cpu_profile_thread * pt = &profile->threads[i];
+        if (pt->n_events == 0) {
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", first ? "" : ",\n", i, i);
+        first = false;
+
+        for (int64_t j = 0; j < pt->n_events; j++) {
+            const struct ggml_cpu_profile_event * ev = &pt->events[j];
+            const struct ggml_cpu_profile_node  * pn = &profile->nodes[ev->node];
+
+            fprintf(f, ",\n{\"name\":");
+            ggml_cpu_profile_write_string(f, pn->name[0] ? pn->name : pn->op);
+            fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"graph\":%d,\"type\":\"%s\",\"ne\":[%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 "]}}",
+                    pn->op, i, (ev->t_start - t0)/1e3, (ev->t_end - ev->t_start)/1e3, pn->graph, ggml_type_name(pn->type),
+                    pn->ne[0], pn->ne[1], pn->ne[2], pn->ne[3]);
+
+            if (ev->t_sync > ev->t_end) {
+                fprintf(f, ",\n{\"name\":\"barrier\",\"cat\":\"barrier\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        i, (ev->t_end - t0)/1e3, (ev->t_sync - ev->t_end)/1e3);
+            }
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    return true;
+}
+
+struct ggml_cpu_profile_op {
+    const char * op;
+    int64_t      n_calls;  // number of nodes
+    int64_t      t_compute; // sum over the threads, in ns
+    int64_t      t_wait;
+};
+
+static int ggml_cpu_profile_op_cmp(const void * a, const void * b) {
+    const int64_t ta = ((const struct ggml_cpu_profile_op *) a)->t_compute;
+    const int64_t tb = ((const struct ggml_cpu_profile_op *) b)->t_compute;
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void ggml_cpu_profile_print_summary(const struct ggml_cpu_profile * profile) {
+    struct ggml_cpu_profile_op ops[256];
+    int n_ops = 0;
+
+    // op of each node, counted once per node rather than once per thread
+    int * node_op = malloc(MAX(1, profile->n_nodes)*sizeof(int));
+    GGML_ASSERT(node_op);
+    for (int64_t i = 0; i < profile->n_nodes; i++) {
+        const struct ggml_cpu_profile_node * pn = &profile->nodes[i];
+
+        node_op[i] = -1;
+        if (pn->noop) {
+            continue;
+        }
+
+        int k = 0;
+        while (k < n_ops && strcmp(ops[k].op, pn->op) != 0) {
+            k++;
+        }
+        if (k == n_ops) {
+            if (n_ops == (int) (sizeof(ops)/sizeof(ops[0]))) {
+                continue;
+            }
+            ops[n_ops++] = (struct ggml_cpu_profile_op) { pn->op, 0, 0, 0 };
+        }
+        ops[k].n_calls++;
+        node_op[i] = k;
+    }
+
+    // wall time of each graph, from the first start to the last end over the threads
+    int64_t * t_graph = calloc(2*MAX(1, profile->n_graphs), sizeof(int64_t));
+    GGML_ASSERT(t_graph);
+    for (int g = 0; g < profile->n_graphs; g++) {
+        t_graph[2*g + 0] = INT64_MAX;
+        t_graph[2*g + 1] = INT64_MIN;
+    }
+
+    int     n_threads = 0;
+    int64_t t_compute = 0;
+    int64_t t_wait    = 0;
+    for (int i = 0; i < GGML_MAX_N_THREADS; i++) {
+        const struct ggml_cpu_profile_thread * pt = &profile->threads[i];
+        if (pt->n_events > 0) {
+            n_threads = i + 1;
+        }
+        for (int64_t j = 0; j < pt->n_events; j++) {
+            const struct ggml_cpu_profile_event * ev = &pt->events[j];
+            const int g = profile->nodes[ev->node].graph;
+            const int k = node_op[ev->node];
+
+            t_graph[2*g + 0] = MIN(t_graph[2*g + 0], ev->t_start);
+            t_graph[2*g + 1] = MAX(t_graph[2*g + 1], ev->t_sync);
+
+            t_compute += ev->t_end  - ev->t_start;
+            t_wait    += ev->t_sync - ev->t_end;
+
+            if (k >= 0) {
+                ops[k].t_compute += ev->t_end  - ev->t_start;
+                ops[k].t_wait    += ev->t_sync - ev->t_end;
+            }
+        }
+    }
+
+    int64_t t_wall = 0;
+    for (int g = 0; g < profile->n_graphs; g++) {
+        if (t_graph[2*g + 1] > t_graph[2*g + 0]) {
+            t_wall += t_graph[2*g + 1] - t_graph[2*g + 0];
+        }
+    }
+
+    free(t_graph);
+    free(node_op);
+
+    qsort(ops, n_ops, sizeof(ops[0]), ggml_cpu_profile_op_cmp);
+
+    GGML_LOG_INFO("%s: %d graphs, %d threads, wall time %.3f ms\n", __func__, profile->n_graphs, n_threads, t_wall/1e6);
+    GGML_LOG_INFO("%s: %-32s %8s %12s %8s %12s %12s\n", __func__, "op", "calls", "thread ms", "%", "us/call", "wait ms");
+    for (int k = 0; k < n_ops; k++) {
+        GGML_LOG_INFO("%s: %-32s %8" PRId64 " %12.3f %7.2f%% %12.3f %12.3f\n", __func__,
+                ops[k].op, ops[k].n_calls, ops[k].t_compute/1e6, 100.0*ops[k].t_compute/MAX(1, t_compute),
+                ops[k].t_compute/1e3/MAX(1, ops[k].n_calls*n_threads), ops[k].t_wait/1e6);
+    }
+    GGML_LOG_INFO("%s: %-32s %8s %12.3f %8s %12s %12.3f (%.2f%% of the thread time)\n", __func__, "total", "",
+            t_compute/1e6, "", "", t_wait/1e6, 100.0*t_wait/MAX(1, t_compute + t_wait));
+}
+
+static thread_ret_t ggml_graph_compute_thread(void * data) {
+    struct ggml_compute_state * state = (struct ggml_compute_state *) data;
+    struct ggml_threadpool    * tp    = state->threadpool;
+
+    const struct ggml_cgraph * cgraph = tp->cgraph;
+    const struct ggml_cplan  * cplan  = tp->cplan;
+
+    struct ggml_cpu_profile * profile = cplan->profile;
+
+    // index of the first node of the graph in the profile
+    int64_t profile_node0 = 0;
+    if (profile) {
+        profile_node0 = profile->n_nodes - cgraph->n_nodes;
+        ggml_cpu_profile_reserve(profile, state->ith, cgraph->n_nodes);
+    }
+
+    set_numa_thread_affinity(state->ith);
+
+    struct ggml_compute_params params = {
+        /*.ith       =*/ state->ith,
+        /*.nth       =*/ atomic_load_explicit(&tp->n_threads_cur, memory_order_relaxed),
+        /*.wsize     =*/ cplan->work_size,
+        /*.wdata     =*/ cplan->work_data,
+        /*.threadpool=*/ tp,
+        /*.src1_seq  =*/ 0,
+        /*.node_n    =*/ 0,
+    };
+
+    for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
+        struct ggml_tensor * node = cgraph->nodes[node_n];
+
+        const int     n_fused = tp->node_plan[node_n].n_fused;
+        const int64_t node_p  = profile_node0 + node_n;
+        const int64_t t_start = profile ? ggml_cpu_profile_time() : 0;
+
+        params.src1_seq = tp->node_plan[node_n].src1_seq;
+        params.node_n   = node_n;
+        params.wdata    = (char *) cplan->work_data + tp->node_plan[node_n].wdata_offs;
+        params.wsize    = cplan->work_size - tp->node_plan[node_n].wdata_offs;
+
+        if (n_fused > 0) {
+            ggml_compute_forward_fused(&params, cgraph->nodes + node_n, n_fused);
+            node_n += n_fused;
+        } else {
+            ggml_compute_forward(&params, node);
+        }
+
+        const int64_t t_end = profile ? ggml_cpu_profile_time() : 0;
+
+        const bool last = node_n + 1 == cgraph->n_nodes;
+
+        // the abort is only checked before a barrier, so that all the threads stop at the same node
+        if (!last && !tp->node_plan[node_n].barrier) {
+            if (profile) {
+                ggml_cpu_profile_add_event(profile, state->ith, node_p, t_start, t_end, t_end);
+            }
+            continue;
+        }
+
+        if (state->ith == 0 && cplan->abort_callback &&
+                cplan->abort_callback(cplan->abort_callback_data)) {
             atomic_store_explicit(&tp->abort, node_n + 1, memory_order_relaxed);
             tp->ec    = GGML_STATUS_ABORTED;
         }
 
-        if (node_n + 1 < cgraph->n_nodes) {
+        if (!last) {
             ggml_barrier(state->threadpool);
         }
+
+        if (profile) {
+            ggml_cpu_profile_add_event(profile, state->ith, node_p, t_start, t_end, last ? t_end : ggml_cpu_profile_time());
+        }
     }
 
     ggml_barrier(state->threadpool);
@@ -3022,10 +4127,18 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
         threadpool->n_barrier        = 0;
         threadpool->n_barrier_passed = 0;
         threadpool->current_chunk    = 0;
+        threadpool->src1_chunk[0]    = 0;
+        threadpool->src1_chunk[1]    = 0;
+        threadpool->wdata_src1       = NULL;
         threadpool->stop             = false;
         threadpool->pause            = tpp->paused;
         threadpool->abort            = -1;
         threadpool->workers          = NULL;
+        threadpool->node_plan        = NULL;
+        threadpool->n_node_plan      = 0;
+        threadpool->tune_variants    = NULL;
+        threadpool->n_tune_variants  = 0;
+        threadpool->tune_hash        = 0;
         threadpool->n_threads_max    = tpp->n_threads;
         threadpool->n_threads_cur    = tpp->n_threads;
         threadpool->poll             = tpp->poll;
@@ -3080,6 +4193,36 @@ struct ggml_threadpool * ggml_threadpool_new(struct ggml_threadpool_params * tpp
 }
 
 enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan) {
+    return ggml_graph_compute_variant(cgraph, cplan, -1);
+}
+
+// the tuned variants are resolved once for the graph and reused while its mul_mat of the weights have the same shapes,
+// e.g. for the graphs of the following tokens
+static const int * ggml_graph_resolve_tuned_variants(struct ggml_threadpool * tp, const struct ggml_cgraph * cgraph, const struct ggml_cplan * cplan) {
+    const uint64_t hash = ggml_cpu_tune_graph_hash(cgraph, cplan->n_threads);
+
+    if (tp->tune_hash == hash && tp->n_tune_variants >= cgraph->n_nodes) {
+        return tp->tune_variants;
+    }
+
+    if (tp->n_tune_variants < cgraph->n_nodes) {
+        free(tp->tune_variants);
+        tp->tune_variants   = malloc(MAX(1, cgraph->n_nodes)*sizeof(int));
+        tp->n_tune_variants = cgraph->n_nodes;
+        GGML_ASSERT(tp->tune_variants);
+    }
+
+    // the benchmarks compute graphs of their own with the threadpool
+    struct ggml_cplan cplan_tune = *cplan;
+    cplan_tune.threadpool = tp;
+    ggml_cpu_tune_graph(cgraph, &cplan_tune, tp->tune_variants);
+
+    tp->tune_hash = hash;
+
+    return tp->tune_variants;
+}
+
+enum ggml_status ggml_graph_compute_variant(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan, int mm_variant) {
     ggml_cpu_init();
 
     GGML_ASSERT(cplan);
@@ -3097,14 +4240,34 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
 
         struct ggml_threadpool_params ttp = ggml_threadpool_params_default(n_threads);
         threadpool = ggml_threadpool_new_impl(&ttp, cgraph, cplan);
-    } else {
-        // Reset some of the parameters that need resetting
-        // No worker threads should be accessing the parameters below at this stage
-        threadpool->cgraph           = cgraph;
-        threadpool->cplan            = cplan;
-        threadpool->current_chunk    = 0;
-        threadpool->abort            = -1;
-        threadpool->ec               = GGML_STATUS_SUCCESS;
+    }
+
+    const int * tuned = NULL;
+    if (mm_variant < 0 && ggml_cpu_tune_enabled()) {
+        tuned = ggml_graph_resolve_tuned_variants(threadpool, cgraph, cplan);
+    }
+
+    // Reset some of the parameters that need resetting
+    // No worker threads should be accessing the parameters below at this stage
+    threadpool->cgraph           = cgraph;
+    threadpool->cplan            = cplan;
+    threadpool->current_chunk    = 0;
+    threadpool->src1_chunk[0]    = 0;
+    threadpool->src1_chunk[1]    = 0;
+    threadpool->wdata_src1       = NULL;
+    threadpool->abort            = -1;
+    threadpool->ec               = GGML_STATUS_SUCCESS;
+
+    if (threadpool->n_node_plan < cgraph->n_nodes) {
+        free(threadpool->node_plan);
+        threadpool->node_plan   = malloc(MAX(1, cgraph->n_nodes)*sizeof(struct ggml_node_plan));
+        threadpool->n_node_plan = cgraph->n_nodes;
+        GGML_ASSERT(threadpool->node_plan);
+    }
+    ggml_graph_plan_nodes(cgraph, threadpool->node_plan, mm_variant, tuned);
+
+    if (cplan->profile) {
+        ggml_cpu_profile_add_graph(cplan->profile, cgraph, threadpool->node_plan);
     }
 
 #ifdef GGML_USE_OPENMP
@@ -3542,6 +4705,12 @@ void ggml_cpu_init(void) {
 #endif
         }
 
+        ggml_cpu_fusion_disabled = getenv("GGML_CPU_DISABLE_FUSION") != NULL;
+
+        if (getenv("GGML_CPU_TUNE_CACHE")) {
+            ggml_cpu_tune_init(getenv("GGML_CPU_TUNE_CACHE"));
+        }
+
 #if defined(__ARM_ARCH)
         ggml_init_arm_arch_features();
 #endif
@@ -80,6 +80,14 @@ static bool ggml_backend_cpu_is_extra_buffer_type(ggml_backend_buffer_type_t buf
     return false;
 }
 
+static ggml_backend_buffer_t ggml_backend_cpu_extra_buffer_from_ptr(ggml_backend_buffer_type_t buft, void * ptr, size_t size) {
+    if (!ggml_backend_cpu_is_extra_buffer_type(buft) || !buft->context) {
+        return nullptr;
+    }
+    auto * extra = (ggml::cpu::extra_buffer_type *) buft->context;
+    return extra->buffer_from_ptr(buft, ptr, size);
+}
+
 // CPU backend - backend (stream)
 
 struct ggml_backend_cpu_context {
@@ -91,6 +99,8 @@ struct ggml_backend_cpu_context {
 
     ggml_abort_callback abort_callback;
     void *              abort_callback_data;
+
+    struct ggml_cpu_profile * profile;
 };
 
 static const char * ggml_backend_cpu_get_name(ggml_backend_t backend) {
@@ -143,11 +153,13 @@ static void ggml_backend_cpu_graph_plan_free(ggml_backend_t backend, ggml_backen
 }
 
 static enum ggml_status ggml_backend_cpu_graph_plan_compute(ggml_backend_t backend, ggml_backend_graph_plan_t plan) {
+    struct ggml_backend_cpu_context * cpu_ctx = (struct ggml_backend_cpu_context *)backend->context;
     struct ggml_backend_plan_cpu * cpu_plan = (struct ggml_backend_plan_cpu *)plan;
 
-    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
+    // the profile may be set or freed after the plan is created
+    cpu_plan->cplan.profile = cpu_ctx->profile;
 
-    GGML_UNUSED(backend);
+    return ggml_graph_compute(&cpu_plan->cgraph, &cpu_plan->cplan);
 }
 
 static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, struct ggml_cgraph * cgraph) {
@@ -168,6 +180,7 @@ static enum ggml_status ggml_backend_cpu_graph_compute(ggml_backend_t backend, s
 
     cplan.abort_callback      = cpu_ctx->abort_callback;
     cplan.abort_callback_data = cpu_ctx->abort_callback_data;
+    cplan.profile             = cpu_ctx->profile;
 
     return ggml_graph_compute(cgraph, &cplan);
 }
@@ -208,6 +221,7 @@ ggml_backend_t ggml_backend_cpu_init(void) {
     ctx->work_size           = 0;
     ctx->abort_callback      = NULL;
     ctx->abort_callback_data = NULL;
+    ctx->profile             = NULL;
 
     ggml_backend_t cpu_backend = new ggml_backend {
         /* .guid      = */ ggml_backend_cpu_guid(),
@@ -255,6 +269,13 @@ void ggml_backend_cpu_set_abort_callback(ggml_backend_t backend_cpu, ggml_abort_
     ctx->abort_callback_data = abort_callback_data;
 }
 
+void ggml_backend_cpu_set_profile(ggml_backend_t backend_cpu, struct ggml_cpu_profile * profile) {
+    GGML_ASSERT(ggml_backend_is_cpu(backend_cpu));
+
+    struct ggml_backend_cpu_context * ctx = (struct ggml_backend_cpu_context *)backend_cpu->context;
+    ctx->profile = profile;
+}
+
 // CPU backend - device
 
 struct ggml_backend_cpu_device_context {
@@ -623,6 +644,10 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
         ggml_backend_dev_get_extra_bufts_t fct = ggml_backend_cpu_device_get_extra_buffers_type;
         return (void *)fct;
     }
+    if (strcmp(name, "ggml_backend_extra_buffer_from_ptr") == 0) {
+        ggml_backend_extra_buffer_from_ptr_t fct = ggml_backend_cpu_extra_buffer_from_ptr;
+        return (void *)fct;
+    }
     if (strcmp(name, "ggml_backend_get_features") == 0) {
         return (void *)ggml_backend_cpu_get_features;
     }
@@ -635,6 +660,27 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_backend_cpu_is_numa") == 0) {
         return (void *)ggml_is_numa;
     }
+    if (strcmp(name, "ggml_backend_cpu_numa_split_tensor") == 0) {
+        return (void *)ggml_numa_split_tensor;
+    }
+    if (strcmp(name, "ggml_backend_cpu_tune_init") == 0) {
+        return (void *)ggml_cpu_tune_init;
+    }
+    if (strcmp(name, "ggml_backend_cpu_set_profile") == 0) {
+        return (void *)ggml_backend_cpu_set_profile;
+    }
+    if (strcmp(name, "ggml_backend_cpu_profile_new") == 0) {
+        return (void *)ggml_cpu_profile_new;
+    }
+    if (strcmp(name, "ggml_backend_cpu_profile_free") == 0) {
+        return (void *)ggml_cpu_profile_free;
+    }
+    if (strcmp(name, "ggml_backend_cpu_profile_write_trace") == 0) {
+        return (void *)ggml_cpu_profile_write_trace;
+    }
+    if (strcmp(name, "ggml_backend_cpu_profile_print_summary") == 0) {
+        return (void *)ggml_cpu_profile_print_summary;
+    }
 
     // threadpool - TODO:  move to ggml-base
     if (strcmp(name, "ggml_threadpool_new") == 0) {
@@ -0,0 +1,35 @@
+#pragma once
+
+// rows of the weights with GGML_NUMA_STRATEGY_SPLIT
+// ggml_numa_split_tensor places the rows of each node with ggml_numa_node_rows, and the threads of the node multiply
+// them with ggml_numa_thread_rows - both must use the same alignment, so that no row is multiplied on a remote node
+
+#include <stdint.h>
+
+// rows [ir0, ir1) of a matrix with nr rows that are placed on node n of n_nodes, the bounds are multiples of align
+static inline void ggml_numa_node_rows(int n_nodes, int n, int64_t nr, int64_t align, int64_t * ir0, int64_t * ir1) {
+    const int64_t r0 = (nr*n/n_nodes       + align - 1)/align*align;
+    const int64_t r1 = (nr*(n + 1)/n_nodes + align - 1)/align*align;
+
+    *ir0 = r0 < nr ? r0 : nr;
+    *ir1 = r1 < nr ? r1 : nr;
+}
+
+// rows [ir0, ir1) of a matrix with nr rows that thread ith of nth multiplies, the thread runs on node ith % n_nodes
+// requires nth >= n_nodes
+static inline void ggml_numa_thread_rows(int n_nodes, int ith, int nth, int64_t nr, int64_t align, int64_t * ir0, int64_t * ir1) {
+    const int node     = ith % n_nodes;
+    const int ith_node = ith / n_nodes;
+    const int nth_node = (nth - node + n_nodes - 1) / n_nodes;
+
+    int64_t r0;
+    int64_t r1;
+    ggml_numa_node_rows(n_nodes, node, nr, align, &r0, &r1);
+
+    const int64_t n  = r1 - r0;
+    const int64_t t0 = (n*ith_node/nth_node       + align - 1)/align*align;
+    const int64_t t1 = (n*(ith_node + 1)/nth_node + align - 1)/align*align;
+
+    *ir0 = r0 + (t0 < n ? t0 : n);
+    *ir1 = r0 + (t1 < n ? t1 : n);
+}
@@ -2591,32 +2591,29 @@ static void ggml_compute_forward_gelu_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_f32(nc,
-                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (float *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_f32(nc,
+                    (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (float *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -2630,33 +2627,30 @@ static void ggml_compute_forward_gelu_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_f16(nc,
-                (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_f16(nc,
+                    (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_CPU_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_CPU_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -2694,32 +2688,29 @@ static void ggml_compute_forward_gelu_erf_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_erf_f32(nc,
-                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (float *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_erf_f32(nc,
+                    (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (float *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -2733,33 +2724,30 @@ static void ggml_compute_forward_gelu_erf_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_erf_f16(nc,
-                (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_erf_f16(nc,
+                    (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_CPU_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_CPU_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -2797,32 +2785,29 @@ static void ggml_compute_forward_gelu_quick_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_quick_f32(nc,
-                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (float *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_quick_f32(nc,
+                    (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (float *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -2836,33 +2821,30 @@ static void ggml_compute_forward_gelu_quick_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_gelu_quick_f16(nc,
-                (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_gelu_quick_f16(nc,
+                    (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_CPU_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_CPU_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -2900,32 +2882,29 @@ static void ggml_compute_forward_silu_f32(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_silu_f32(nc,
-                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (float *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_silu_f32(nc,
+                    (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (float *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*(dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*(dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -2939,33 +2918,30 @@ static void ggml_compute_forward_silu_f16(
     assert(ggml_is_contiguous_1(dst));
     assert(ggml_are_same_shape(src0, dst));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_silu_f16(nc,
-                (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_silu_f16(nc,
+                    (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (ggml_fp16_t *) ((char *) src0->data + i1*(src0->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])))[k];
-            const float v = GGML_CPU_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])))[k];
+                const float v = GGML_CPU_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3089,33 +3065,30 @@ static void ggml_compute_forward_silu_back_f32(
     assert(ggml_are_same_shape(src1, dst));
     assert(ggml_are_same_shape(src1, grad));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1->ne[0];
     const int nr = ggml_nrows(src1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_silu_backward_f32(nc,
-                (float *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (float *) ((char *) src1->data + i1*(src1->nb[1])),
-                (float *) ((char *) grad->data + i1*(grad->nb[1])));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_silu_backward_f32(nc,
+                    (float *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (float *) ((char *) src1->data + i1*(src1->nb[1])),
+                    (float *) ((char *) grad->data + i1*(grad->nb[1])));
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3132,34 +3105,31 @@ static void ggml_compute_forward_silu_back_f16(
     assert(ggml_are_same_shape(src1, dst));
     assert(ggml_are_same_shape(src1, grad));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1->ne[0];
     const int nr = ggml_nrows(src1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_vec_silu_backward_f16(nc,
-                (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
-                (ggml_fp16_t *) ((char *) src1->data + i1*(src1->nb[1])),
-                (ggml_fp16_t *) ((char *) grad->data + i1*(grad->nb[1])));
-
-    #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_CPU_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_vec_silu_backward_f16(nc,
+                    (ggml_fp16_t *) ((char *) dst->data  + i1*( dst->nb[1])),
+                    (ggml_fp16_t *) ((char *) src1->data + i1*(src1->nb[1])),
+                    (ggml_fp16_t *) ((char *) grad->data + i1*(grad->nb[1])));
+
+        #ifndef NDEBUG
+            for (int k = 0; k < nc; k++) {
+                const float x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_CPU_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
+        #endif
         }
-    #endif
     }
 }
 
@@ -3206,9 +3176,6 @@ static void ggml_compute_forward_reglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3217,32 +3184,32 @@ static void ggml_compute_forward_reglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        float * src0_p = (float *) (src0_d + i1*src0_o);
-        float * src1_p = (float *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float * src0_p = (float *) (src0_d + i1*src0_o);
+            float * src1_p = (float *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_reglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_reglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3265,9 +3232,6 @@ static void ggml_compute_forward_reglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3276,33 +3240,33 @@ static void ggml_compute_forward_reglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
-        ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
+            ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_reglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_reglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3349,9 +3313,6 @@ static void ggml_compute_forward_geglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3360,32 +3321,32 @@ static void ggml_compute_forward_geglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        float * src0_p = (float *) (src0_d + i1*src0_o);
-        float * src1_p = (float *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float * src0_p = (float *) (src0_d + i1*src0_o);
+            float * src1_p = (float *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3408,9 +3369,6 @@ static void ggml_compute_forward_geglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3419,33 +3377,33 @@ static void ggml_compute_forward_geglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
-        ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
+            ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3492,9 +3450,6 @@ static void ggml_compute_forward_swiglu_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3503,32 +3458,32 @@ static void ggml_compute_forward_swiglu_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        float * src0_p = (float *) (src0_d + i1*src0_o);
-        float * src1_p = (float *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float * src0_p = (float *) (src0_d + i1*src0_o);
+            float * src1_p = (float *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_swiglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_swiglu_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3551,9 +3506,6 @@ static void ggml_compute_forward_swiglu_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3562,33 +3514,33 @@ static void ggml_compute_forward_swiglu_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
-        ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
+            ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_swiglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_swiglu_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3635,9 +3587,6 @@ static void ggml_compute_forward_geglu_erf_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3646,32 +3595,32 @@ static void ggml_compute_forward_geglu_erf_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        float * src0_p = (float *) (src0_d + i1*src0_o);
-        float * src1_p = (float *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float * src0_p = (float *) (src0_d + i1*src0_o);
+            float * src1_p = (float *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_erf_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_erf_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3694,9 +3643,6 @@ static void ggml_compute_forward_geglu_erf_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3705,33 +3651,33 @@ static void ggml_compute_forward_geglu_erf_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
-        ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
+            ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_erf_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_erf_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3778,9 +3724,6 @@ static void ggml_compute_forward_geglu_quick_f32(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3789,32 +3732,32 @@ static void ggml_compute_forward_geglu_quick_f32(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        float * src0_p = (float *) (src0_d + i1*src0_o);
-        float * src1_p = (float *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float * src0_p = (float *) (src0_d + i1*src0_o);
+            float * src1_p = (float *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_quick_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_quick_f32(nc, (float *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            GGML_UNUSED(x);
-            assert(!isnan(x));
-            assert(!isinf(x));
-        }
+            for (int k = 0; k < nc; k++) {
+                const float x = ((float *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                GGML_UNUSED(x);
+                assert(!isnan(x));
+                assert(!isinf(x));
+            }
 #endif
+        }
     }
 }
 
@@ -3837,9 +3780,6 @@ static void ggml_compute_forward_geglu_quick_f16(
         GGML_ASSERT(src0->type == src1->type);
     }
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src1 ? src0->ne[0] : src0->ne[0] / 2;
     const int nr = ggml_nrows(src0);
 
@@ -3848,33 +3788,33 @@ static void ggml_compute_forward_geglu_quick_f16(
 
     const int32_t swapped = ggml_get_op_params_i32(dst, 1);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
-        ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            ggml_fp16_t * src0_p = (ggml_fp16_t *) (src0_d + i1*src0_o);
+            ggml_fp16_t * src1_p = (ggml_fp16_t *) (src1_d + i1*src1_o);
 
-        if (!src1) {
-            src0_p += swapped ? nc : 0;
-            src1_p += swapped ? 0 : nc;
-        }
+            if (!src1) {
+                src0_p += swapped ? nc : 0;
+                src1_p += swapped ? 0 : nc;
+            }
 
-        ggml_vec_geglu_quick_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
+            ggml_vec_geglu_quick_f16(nc, (ggml_fp16_t *) ((char *) dst->data + i1*(dst->nb[1])), src0_p, src1_p);
 
 #ifndef NDEBUG
-        for (int k = 0; k < nc; k++) {
-            const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
-            const float v = GGML_FP16_TO_FP32(x);
-            GGML_UNUSED(v);
-            assert(!isnan(v));
-            assert(!isinf(v));
-        }
+            for (int k = 0; k < nc; k++) {
+                const ggml_fp16_t x = ((ggml_fp16_t *) ((char *) dst->data + i1*( dst->nb[1])))[k];
+                const float v = GGML_FP16_TO_FP32(x);
+                GGML_UNUSED(v);
+                assert(!isnan(v));
+                assert(!isinf(v));
+            }
 #endif
+        }
     }
 }
 
@@ -3912,9 +3852,6 @@ static void ggml_compute_forward_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
     float eps;
@@ -3922,33 +3859,40 @@ static void ggml_compute_forward_norm_f32(
 
     GGML_ASSERT(eps >= 0.0f);
 
-    // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, ne01*ne02*ne03, ne00);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)x[i00];
-                }
+    // TODO: optimize
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                float mean = sum/ne00;
+            const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+            ggml_float sum = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                sum += (ggml_float)x[i00];
+            }
 
-                ggml_float sum2 = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    float v = x[i00] - mean;
-                    y[i00] = v;
-                    sum2 += (ggml_float)(v*v);
-                }
+            float mean = sum/ne00;
 
-                float variance = sum2/ne00;
-                const float scale = 1.0f/sqrtf(variance + eps);
+            float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                ggml_vec_scale_f32(ne00, y, scale);
+            ggml_float sum2 = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                float v = x[i00] - mean;
+                y[i00] = v;
+                sum2 += (ggml_float)(v*v);
             }
+
+            float variance = sum2/ne00;
+            const float scale = 1.0f/sqrtf(variance + eps);
+
+            ggml_vec_scale_f32(ne00, y, scale);
         }
     }
 }
@@ -3983,9 +3927,6 @@ static void ggml_compute_forward_rms_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
     float eps;
@@ -3993,33 +3934,40 @@ static void ggml_compute_forward_rms_norm_f32(
 
     GGML_ASSERT(eps >= 0.0f);
 
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, ne01*ne02*ne03, ne00);
+
     // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)(x[i00] * x[i00]);
-                }
+            const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+            ggml_float sum = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                sum += (ggml_float)(x[i00] * x[i00]);
+            }
 
-                const float mean = sum/ne00;
+            const float mean = sum/ne00;
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+            float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                memcpy(y, x, ne00 * sizeof(float));
-                // for (int i00 = 0; i00 < ne00; i00++) {
-                //     y[i00] = x[i00];
-                // }
+            memcpy(y, x, ne00 * sizeof(float));
+            // for (int i00 = 0; i00 < ne00; i00++) {
+            //     y[i00] = x[i00];
+            // }
 
-                const float scale = 1.0f/sqrtf(mean + eps);
+            const float scale = 1.0f/sqrtf(mean + eps);
 
-                // if you hit this, likely you got an inf somewhere earlier
-                assert(scale > 0.0f);
+            // if you hit this, likely you got an inf somewhere earlier
+            assert(scale > 0.0f);
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
+            ggml_vec_scale_f32(ne00, y, scale);
         }
     }
 }
@@ -4652,38 +4600,35 @@ static void ggml_compute_forward_scale_f32(
     memcpy(&s, (float *) dst->op_params + 0, sizeof(float));
     memcpy(&b, (float *) dst->op_params + 1, sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
     const size_t nb01 = src0->nb[1];
 
     const size_t nb1 = dst->nb[1];
 
-    if (b == 0.0f) {
-        for (int i1 = ir0; i1 < ir1; i1++) {
-            if (dst->data != src0->data) {
-                // src0 is same shape as dst => same indices
-                // TODO: add x parameter to ggml_vec_scale_f32 and remove this memcpy
-                memcpy((char *)dst->data + i1*nb1, (char *)src0->data + i1*nb01, nc * sizeof(float));
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        if (b == 0.0f) {
+            for (int i1 = ir0; i1 < ir1; i1++) {
+                if (dst->data != src0->data) {
+                    // src0 is same shape as dst => same indices
+                    // TODO: add x parameter to ggml_vec_scale_f32 and remove this memcpy
+                    memcpy((char *)dst->data + i1*nb1, (char *)src0->data + i1*nb01, nc * sizeof(float));
+                }
+                ggml_vec_scale_f32(nc, (float *) ((char *) dst->data + i1*nb1), s);
+            }
+        } else {
+            for (int i1 = ir0; i1 < ir1; i1++) {
+                ggml_vec_mad1_f32(nc,
+                    (float *) ((char *) dst->data  + i1*nb1),
+                    (float *) ((char *) src0->data + i1*nb1),
+                    s, b);
             }
-            ggml_vec_scale_f32(nc, (float *) ((char *) dst->data + i1*nb1), s);
-        }
-    } else {
-        for (int i1 = ir0; i1 < ir1; i1++) {
-            ggml_vec_mad1_f32(nc,
-                (float *) ((char *) dst->data  + i1*nb1),
-                (float *) ((char *) src0->data + i1*nb1),
-                s, b);
         }
     }
 }
@@ -4974,27 +4919,24 @@ static void ggml_compute_forward_get_rows_q(
     assert(nb00 == ggml_type_size(type));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+            GGML_ASSERT(i01 >= 0 && i01 < ne01);
 
-        GGML_ASSERT(i01 >= 0 && i01 < ne01);
-
-        dequantize_row_q(
-                (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                     (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            dequantize_row_q(
+                    (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                         (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -5012,30 +4954,27 @@ static void ggml_compute_forward_get_rows_f16(
 
     assert(ne0  == nc);
     assert(ne02 == ne11);
-    assert(nb00 == sizeof(ggml_fp16_t));
-    assert(ggml_nrows(dst) == nr);
-
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
+    assert(nb00 == sizeof(ggml_fp16_t));
+    assert(ggml_nrows(dst) == nr);
 
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        GGML_ASSERT(i01 >= 0 && i01 < ne01);
+            GGML_ASSERT(i01 >= 0 && i01 < ne01);
 
-        ggml_cpu_fp16_to_fp32(
-            (const ggml_fp16_t*) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                       (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            ggml_cpu_fp16_to_fp32(
+                (const ggml_fp16_t*) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                           (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -5056,27 +4995,24 @@ static void ggml_compute_forward_get_rows_bf16(
     assert(nb00 == sizeof(ggml_bf16_t));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        GGML_ASSERT(i01 >= 0 && i01 < ne01);
+            GGML_ASSERT(i01 >= 0 && i01 < ne01);
 
-        ggml_cpu_bf16_to_fp32(
-            (const ggml_bf16_t *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                        (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            ggml_cpu_bf16_to_fp32(
+                (const ggml_bf16_t *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                            (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -5097,27 +5033,24 @@ static void ggml_compute_forward_get_rows_f32(
     assert(nb00 == sizeof(float));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        GGML_ASSERT(i01 >= 0 && i01 < ne01);
+            GGML_ASSERT(i01 >= 0 && i01 < ne01);
 
-        ggml_vec_cpy_f32(nc,
-                (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3),
-                (float *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03));
+            ggml_vec_cpy_f32(nc,
+                    (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3),
+                    (float *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03));
+        }
     }
 }
 
@@ -5534,7 +5467,6 @@ static void ggml_compute_forward_soft_max_f32(
     memcpy(&max_bias, (float *) dst->op_params + 1, sizeof(float));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     GGML_TENSOR_UNARY_OP_LOCALS
 
@@ -5557,61 +5489,68 @@ static void ggml_compute_forward_soft_max_f32(
 
     const bool use_f16 = (src1 && src1->type == GGML_TYPE_F16);
 
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const int64_t i11 = i01;
-                const int64_t i12 = i02%ne12;
-                const int64_t i13 = i03%ne13;
-
-                // ALiBi
-                const uint32_t h = i02; // head
-                const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
-
-                float * sp = (float *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
-                float * dp = (float *)((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
-
-                // broadcast the mask across rows
-                ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
-                float       * mp_f32 = src1 ? (float       *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
-
-                ggml_vec_cpy_f32  (ne00, wp, sp);
-                ggml_vec_scale_f32(ne00, wp, scale);
-                if (mp_f32) {
-                    if (use_f16) {
-                        for (int i = 0; i < ne00; ++i) {
-                            wp[i] += slope*GGML_CPU_FP16_TO_FP32(mp_f16[i]);
-                        }
-                    } else {
-                        for (int i = 0; i < ne00; ++i) {
-                            wp[i] += slope*mp_f32[i];
-                        }
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, ne01*ne02*ne03, ne00);
+
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+            const int64_t i11 = i01;
+            const int64_t i12 = i02%ne12;
+            const int64_t i13 = i03%ne13;
+
+            // ALiBi
+            const uint32_t h = i02; // head
+            const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+            float * sp = (float *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+            float * dp = (float *)((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+
+            // broadcast the mask across rows
+            ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
+            float       * mp_f32 = src1 ? (float       *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
+
+            ggml_vec_cpy_f32  (ne00, wp, sp);
+            ggml_vec_scale_f32(ne00, wp, scale);
+            if (mp_f32) {
+                if (use_f16) {
+                    for (int i = 0; i < ne00; ++i) {
+                        wp[i] += slope*GGML_CPU_FP16_TO_FP32(mp_f16[i]);
+                    }
+                } else {
+                    for (int i = 0; i < ne00; ++i) {
+                        wp[i] += slope*mp_f32[i];
                     }
                 }
+            }
 
 #ifndef NDEBUG
-                for (int i = 0; i < ne00; ++i) {
-                    //printf("p[%d] = %f\n", i, p[i]);
-                    assert(!isnan(wp[i]));
-                }
+            for (int i = 0; i < ne00; ++i) {
+                //printf("p[%d] = %f\n", i, p[i]);
+                assert(!isnan(wp[i]));
+            }
 #endif
 
-                float max = -INFINITY;
-                ggml_vec_max_f32(ne00, &max, wp);
+            float max = -INFINITY;
+            ggml_vec_max_f32(ne00, &max, wp);
 
-                ggml_float sum = ggml_vec_soft_max_f32(ne00, dp, wp, max);
-                assert(sum > 0.0);
+            ggml_float sum = ggml_vec_soft_max_f32(ne00, dp, wp, max);
+            assert(sum > 0.0);
 
-                sum = 1.0/sum;
-                ggml_vec_scale_f32(ne00, dp, sum);
+            sum = 1.0/sum;
+            ggml_vec_scale_f32(ne00, dp, sum);
 
 #ifndef NDEBUG
-                for (int i = 0; i < ne00; ++i) {
-                    assert(!isnan(dp[i]));
-                    assert(!isinf(dp[i]));
-                }
-#endif
+            for (int i = 0; i < ne00; ++i) {
+                assert(!isnan(dp[i]));
+                assert(!isinf(dp[i]));
             }
+#endif
         }
     }
 }
@@ -8206,6 +8145,276 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     }
 }
 
+// number of q rows of each head in a tile of ggml_compute_forward_flash_attn_ext_f16_tiled, 0 if the kernel is not used
+static int64_t ggml_flash_attn_ext_tile_rows(
+        const ggml_tensor * q,
+        const ggml_tensor * k,
+        const ggml_tensor * v,
+        int nth) {
+    // the heads of q that share a head of K/V are processed together
+    if (k->ne[2] != v->ne[2] || k->ne[3] != v->ne[3] || q->ne[2] % k->ne[2] != 0 || q->ne[3] % k->ne[3] != 0) {
+        return 0;
+    }
+
+    const int64_t rk2 = q->ne[2]/k->ne[2];
+    if (rk2 > GGML_FA_TILE_Q) {
+        return 0;
+    }
+
+    auto n_tiles = [&](int64_t nr) {
+        return q->ne[3]*k->ne[2]*((q->ne[1] + nr - 1)/nr);
+    };
+
+    // smaller tiles when there are not enough of them for all the threads
+    int64_t nr = MIN(GGML_FA_TILE_Q/rk2, q->ne[1]);
+    while (nr > 1 && n_tiles(nr) < nth) {
+        nr /= 2;
+    }
+
+    // with a single q row per tile or idle threads, the row kernel is better
+    if (nr*rk2 < 2 || n_tiles(nr) < nth) {
+        return 0;
+    }
+
+    return nr;
+}
+
+// same as ggml_compute_forward_flash_attn_ext_f16, but processes tiles of q rows against tiles of K/V rows,
+// so that K and V are loaded once per tile instead of once per q row
+static void ggml_compute_forward_flash_attn_ext_f16_tiled(
+        const ggml_compute_params * params,
+        const ggml_tensor * q,
+        const ggml_tensor * k,
+        const ggml_tensor * v,
+        const ggml_tensor * mask,
+        ggml_tensor * dst,
+        const int64_t nr) {
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+    const int64_t N  = neq1;
+
+    GGML_ASSERT(ne0 == DV);
+    GGML_ASSERT(ne2 == N);
+
+    // input tensor rows must be contiguous
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
+    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
+
+    GGML_ASSERT(neq0 == DK);
+    GGML_ASSERT(nek0 == DK);
+    GGML_ASSERT(nev0 == DV);
+
+    GGML_ASSERT(neq1 == N);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    // K and V have the same heads, see ggml_flash_attn_ext_tile_rows
+    GGML_ASSERT(nek2 == nev2 && nek3 == nev3);
+
+    // broadcast factors
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    GGML_ASSERT(rk2*nr <= GGML_FA_TILE_Q);
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    ggml_type         const k_vec_dot_type = ggml_get_type_traits_cpu(k->type)->vec_dot_type;
+    ggml_from_float_t const q_to_vec_dot   = ggml_get_type_traits_cpu(k_vec_dot_type)->from_float;
+    ggml_vec_dot_t    const kq_vec_dot     = ggml_get_type_traits_cpu(k->type)->vec_dot;
+    ggml_to_float_t   const v_to_float     = ggml_get_type_traits(v->type)->to_float;
+
+    GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
+    GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
+
+    const size_t q_row_size = ggml_row_size(k_vec_dot_type, DK);
+
+    float * VKQ32 = (float *) params->wdata + ith*(GGML_FA_TILE_Q*(DK + DV + GGML_FA_TILE_KV) + DV + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulators
+    float * KQ    =           (VKQ32 + GGML_FA_TILE_Q*DV);              // KQ values of the tile, then softmax numerators
+    float * V32   =           (KQ    + GGML_FA_TILE_Q*GGML_FA_TILE_KV); // (temporary) FP32 V row
+    char  * Q_q   = (char *)  (V32   + DV);                             // q rows converted to quantized/FP16
+
+    float M[GGML_FA_TILE_Q]; // maximum KQ value of each q row
+    float S[GGML_FA_TILE_Q]; // sum of each q row
+
+    float               slope[GGML_FA_TILE_Q];
+    const ggml_fp16_t * mp   [GGML_FA_TILE_Q];
+
+    // tiles of nr rows of the rk2 heads of q that share a head of K/V
+    const int64_t n_blk   = (neq1 + nr - 1)/nr;
+    const int64_t n_tiles = neq3*nek2*n_blk;
+
+    // tiles are assigned round-robin, so that the work saved by the causal mask is spread over the threads
+    for (int64_t it = ith; it < n_tiles; it += nth) {
+        const int64_t iq3  = it/(nek2*n_blk);
+        const int64_t ik2  = (it - iq3*nek2*n_blk)/n_blk;
+        const int64_t iq10 = (it - iq3*nek2*n_blk - ik2*n_blk)*nr;
+
+        const int64_t ik3 = iq3/rk3;
+
+        const int64_t n_rows = MIN(nr, neq1 - iq10);
+        const int64_t n_q    = rk2*n_rows;
+
+        // q row j of the tile is row iq10 + j%n_rows of head ik2*rk2 + j/n_rows
+        for (int64_t j = 0; j < n_q; ++j) {
+            const int64_t iq1 = iq10 + j%n_rows;
+            const int64_t iq2 = ik2*rk2 + j/n_rows;
+
+            const uint32_t h = iq2; // head index
+            slope[j] = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+            mp[j] = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1] + (iq2%mask->ne[2])*mask->nb[2] + (iq3%mask->ne[3])*mask->nb[3]) : NULL;
+
+            const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
+            q_to_vec_dot(pq, Q_q + j*q_row_size, DK);
+
+            M[j] = -INFINITY;
+            S[j] = 0.0f;
+        }
+
+        memset(VKQ32, 0, n_q*DV*sizeof(float));
+
+        // online softmax / attention, one tile of K/V rows at a time
+        // ref: https://arxiv.org/pdf/2112.05682.pdf
+        for (int64_t ic0 = 0; ic0 < nek1; ic0 += GGML_FA_TILE_KV) {
+            const int64_t n_kv = MIN(GGML_FA_TILE_KV, nek1 - ic0);
+
+            // KQ values, each row of K is used by all the q rows of the tile
+            bool masked = true;
+            for (int64_t ic = 0; ic < n_kv; ++ic) {
+                const char * k_data = (const char *) k->data + ((ic0 + ic)*nbk1 + ik2*nbk2 + ik3*nbk3);
+
+                for (int64_t j = 0; j < n_q; ++j) {
+                    float & s = KQ[j*GGML_FA_TILE_KV + ic];
+
+                    const float mv = mp[j] ? slope[j]*GGML_CPU_FP16_TO_FP32(mp[j][ic0 + ic]) : 0.0f;
+                    if (mv == -INFINITY) {
+                        s = -INFINITY;
+                        continue;
+                    }
+
+                    kq_vec_dot(DK, &s, 0, k_data, 0, Q_q + j*q_row_size, 0, 1);
+
+                    s = s*scale; // scale KQ value
+
+                    if (logit_softcap != 0.0f) {
+                        s = logit_softcap*tanhf(s);
+                    }
+
+                    s += mv; // apply mask
+
+                    masked = false;
+                }
+            }
+
+            if (masked) {
+                continue;
+            }
+
+            // KQ = expf(KQ - M), upon new higher max val, scale VKQ and KQ sum
+            for (int64_t j = 0; j < n_q; ++j) {
+                float * kq = KQ + j*GGML_FA_TILE_KV;
+
+                float Mt = -INFINITY;
+                ggml_vec_max_f32(n_kv, &Mt, kq);
+
+                if (Mt == -INFINITY) {
+                    memset(kq, 0, n_kv*sizeof(float));
+                    continue;
+                }
+
+                if (Mt > M[j]) {
+                    const float ms = expf(M[j] - Mt);
+
+                    ggml_vec_scale_f32(DV, VKQ32 + j*DV, ms);
+                    S[j] *= ms;
+                    M[j]  = Mt;
+                }
+
+                S[j] += (float) ggml_vec_soft_max_f32(n_kv, kq, kq, M[j]);
+            }
+
+            // VKQ += KQ*V, each row of V is converted once for all the q rows of the tile
+            for (int64_t ic = 0; ic < n_kv; ++ic) {
+                const char  * v_data = (const char *) v->data + ((ic0 + ic)*nbv1 + ik2*nbv2 + ik3*nbv3);
+                const float * v32    = NULL;
+
+                for (int64_t j = 0; j < n_q; ++j) {
+                    const float vs = KQ[j*GGML_FA_TILE_KV + ic];
+                    if (vs == 0.0f) {
+                        continue;
+                    }
+
+                    if (v32 == NULL) {
+                        if (v->type == GGML_TYPE_F32) {
+                            v32 = (const float *) v_data;
+                        } else {
+                            if (v->type == GGML_TYPE_F16) {
+                                ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) v_data, V32, DV);
+                            } else {
+                                v_to_float(v_data, V32, DV);
+                            }
+                            v32 = V32;
+                        }
+                    }
+
+                    ggml_vec_mad_f32(DV, VKQ32 + j*DV, v32, vs);
+                }
+            }
+        }
+
+        for (int64_t j = 0; j < n_q; ++j) {
+            float * VKQ = VKQ32 + j*DV;
+
+            // V /= S
+            const float S_inv = 1.0f/S[j];
+            ggml_vec_scale_f32(DV, VKQ, S_inv);
+
+            // dst indices
+            const int64_t i1 = iq10 + j%n_rows;
+            const int64_t i2 = ik2*rk2 + j/n_rows;
+            const int64_t i3 = iq3;
+
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ, nb1);
+        }
+    }
+}
+
 void ggml_compute_forward_flash_attn_ext(
         const ggml_compute_params * params,
         const ggml_tensor * q,
@@ -8218,7 +8427,12 @@ void ggml_compute_forward_flash_attn_ext(
         case GGML_PREC_F32:
             {
                 // uses F32 accumulators
-                ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                const int64_t nr = ggml_flash_attn_ext_tile_rows(q, k, v, params->nth);
+                if (nr > 0) {
+                    ggml_compute_forward_flash_attn_ext_f16_tiled(params, q, k, v, mask, dst, nr);
+                } else {
+                    ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                }
             } break;
         default:
             {
@@ -10184,3 +10398,129 @@ void ggml_compute_forward_opt_step_adamw(
             }
     }
 }
+
+// ggml_compute_forward_fused_add_rms_norm_mul
+
+// computes [add ->] rms_norm [-> mul] one row at a time, so that each row stays in cache between the steps
+// add (optional) is the input of norm and its result is still written, mul (optional) multiplies the normalized
+// rows by a broadcast operand (e.g. the norm weights) and replaces the output of norm, which is not written
+// the results are identical to the unfused ops
+void ggml_compute_forward_fused_add_rms_norm_mul(
+        const ggml_compute_params * params,
+        ggml_tensor * add,
+        ggml_tensor * norm,
+        ggml_tensor * mul) {
+
+    const ggml_tensor * src0 = norm->src[0];
+    const ggml_tensor * dst  = norm;
+
+    GGML_ASSERT(add == nullptr || src0 == add);
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    float eps;
+    memcpy(&eps, norm->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    // the operand of mul that is not the output of norm
+    const ggml_tensor * w = mul ? (mul->src[0] == norm ? mul->src[1] : mul->src[0]) : nullptr;
+    ggml_tensor       * y = mul ? mul : norm;
+
+    const int64_t nr = ne01*ne02*ne03;
+
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, ne00);
+
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+
+            float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+            if (add) {
+                const ggml_tensor * a = add->src[0];
+                const ggml_tensor * b = add->src[1];
+
+                const float * pa = (const float *) ((const char *) a->data + i01*a->nb[1] + i02*a->nb[2] + i03*a->nb[3]);
+                const float * pb = (const float *) ((const char *) b->data + (i01 % b->ne[1])*b->nb[1] + (i02 % b->ne[2])*b->nb[2] + (i03 % b->ne[3])*b->nb[3]);
+
+                ggml_vec_add_f32(ne00, x, pa, pb);
+            }
+
+            ggml_float sum = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                sum += (ggml_float)(x[i00] * x[i00]);
+            }
+
+            const float mean = sum/ne00;
+
+            float * py = (float *) ((char *) y->data + i01*y->nb[1] + i02*y->nb[2] + i03*y->nb[3]);
+
+            memcpy(py, x, ne00 * sizeof(float));
+
+            const float scale = 1.0f/sqrtf(mean + eps);
+
+            // if you hit this, likely you got an inf somewhere earlier
+            assert(scale > 0.0f);
+
+            ggml_vec_scale_f32(ne00, py, scale);
+
+            if (w) {
+                const float * pw = (const float *) ((const char *) w->data + (i01 % w->ne[1])*w->nb[1] + (i02 % w->ne[2])*w->nb[2] + (i03 % w->ne[3])*w->nb[3]);
+
+                ggml_vec_mul_f32(ne00, py, py, pw);
+            }
+        }
+    }
+}
+
+// ggml_compute_forward_fused_unary_mul
+
+// computes the activation of a gated unit and its product with the gate one row at a time
+// the output of the activation is not written, the results are identical to the unfused ops
+void ggml_compute_forward_fused_unary_mul(
+        const ggml_compute_params * params,
+        ggml_tensor * act,
+        ggml_tensor * mul) {
+
+    const ggml_tensor * src0 = act->src[0];
+    const ggml_tensor * gate = mul->src[0] == act ? mul->src[1] : mul->src[0];
+
+    assert(ggml_is_contiguous_1(src0));
+    assert(ggml_is_contiguous_1(gate));
+    assert(ggml_is_contiguous_1(mul));
+    assert(ggml_are_same_shape(src0, mul));
+    assert(ggml_are_same_shape(gate, mul));
+
+    const ggml_unary_op op = ggml_get_unary_op(act);
+
+    const int nc = src0->ne[0];
+    const int nr = ggml_nrows(src0);
+
+    ggml_compute_rows rows;
+    ggml_compute_rows_init(params, &rows, nr, nc);
+
+    int64_t ir0;
+    int64_t ir1;
+    while (ggml_compute_rows_next(params, &rows, &ir0, &ir1)) {
+        for (int i1 = ir0; i1 < ir1; i1++) {
+            float       * y = (float *)       ((char *)       mul->data  + i1*(mul->nb[1]));
+            const float * x = (const float *) ((const char *) src0->data + i1*(src0->nb[1]));
+            const float * g = (const float *) ((const char *) gate->data + i1*(gate->nb[1]));
+
+            switch (op) {
+                case GGML_UNARY_OP_SILU: ggml_vec_silu_f32(nc, y, x); break;
+                case GGML_UNARY_OP_GELU: ggml_vec_gelu_f32(nc, y, x); break;
+                default: GGML_ABORT("fatal error");
+            }
+
+            ggml_vec_mul_f32(nc, y, y, g);
+        }
+    }
+}
@@ -23,6 +23,10 @@ static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 // Work buffer size for im2col operations in CONV2D
 #define GGML_IM2COL_WORK_SIZE (16 * 1024 * 1024)
 
+// Tile sizes of the tiled flash attention kernel, in q rows and K/V rows
+#define GGML_FA_TILE_Q  32
+#define GGML_FA_TILE_KV 16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -113,6 +117,10 @@ void ggml_compute_forward_cross_entropy_loss_back(const struct ggml_compute_para
 void ggml_compute_forward_opt_step_adamw(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_mul_mat(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 
+// fused ops
+void ggml_compute_forward_fused_add_rms_norm_mul(const struct ggml_compute_params * params, struct ggml_tensor * add, struct ggml_tensor * norm, struct ggml_tensor * mul);
+void ggml_compute_forward_fused_unary_mul(const struct ggml_compute_params * params, struct ggml_tensor * act, struct ggml_tensor * mul);
+
 #ifdef __cplusplus
 }
 #endif
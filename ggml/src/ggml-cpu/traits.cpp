@@ -6,7 +6,18 @@
 namespace ggml::cpu {
 tensor_traits::~tensor_traits() {}
 
+int64_t tensor_traits::numa_split_align() const {
+    return 1;
+}
+
 extra_buffer_type::~extra_buffer_type() {}
+
+ggml_backend_buffer_t extra_buffer_type::buffer_from_ptr(ggml_backend_buffer_type_t buft, void * ptr, size_t size) {
+    GGML_UNUSED(buft);
+    GGML_UNUSED(ptr);
+    GGML_UNUSED(size);
+    return nullptr;
+}
 }  // namespace ggml::cpu
 
 bool ggml_cpu_extra_compute_forward(struct ggml_compute_params * params, struct ggml_tensor * op) {
@@ -34,3 +45,15 @@ bool ggml_cpu_extra_work_size(int n_threads, const struct ggml_tensor * op, size
     }
     return false;
 }
+
+int64_t ggml_cpu_extra_numa_split_align(const struct ggml_tensor * t) {
+    if (t->buffer == nullptr || t->extra == nullptr) {
+        return 0;
+    }
+    for (auto extra : ggml_backend_cpu_get_extra_buffers_type()) {
+        if (extra && extra->context && extra == t->buffer->buft) {
+            return ((const ggml::cpu::tensor_traits *) t->extra)->numa_split_align();
+        }
+    }
+    return 0;
+}
@@ -11,6 +11,8 @@ extern "C" {
 // return true if op part of extra "accelerator"
 bool ggml_cpu_extra_compute_forward(struct ggml_compute_params * params, struct ggml_tensor * op);
 bool ggml_cpu_extra_work_size(int n_threads, const struct ggml_tensor * op, size_t * size);
+// alignment of the rows of a weight in an extra buffer for GGML_NUMA_STRATEGY_SPLIT, 0 if not in an extra buffer
+int64_t ggml_cpu_extra_numa_split_align(const struct ggml_tensor * t);
 
 #ifdef __cplusplus
 }
@@ -22,6 +24,8 @@ class tensor_traits {
     virtual ~tensor_traits();
     virtual bool work_size(int n_threads, const struct ggml_tensor * op, size_t & size)        = 0;
     virtual bool compute_forward(struct ggml_compute_params * params, struct ggml_tensor * op) = 0;
+    // with GGML_NUMA_STRATEGY_SPLIT, the rows multiplied by each thread start at multiples of this
+    virtual int64_t numa_split_align() const;
 };
 
 class extra_buffer_type {
@@ -29,6 +33,8 @@ class extra_buffer_type {
     virtual ~extra_buffer_type();
     virtual bool            supports_op(ggml_backend_dev_t dev, const struct ggml_tensor * op) = 0;
     virtual tensor_traits * get_tensor_traits(const struct ggml_tensor * op)                   = 0;
+    // create a buffer from memory that already holds converted tensor data, the memory is not owned by the buffer
+    virtual ggml_backend_buffer_t buffer_from_ptr(ggml_backend_buffer_type_t buft, void * ptr, size_t size);
 };
 }  // namespace ggml::cpu
 
@@ -0,0 +1,366 @@
+#include "tune.h"
+
+#include "ggml-backend.h"
+#include "ggml-impl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+const struct ggml_mul_mat_variant ggml_mul_mat_variants[GGML_MUL_MAT_N_VARIANTS] = {
+    { "default",  true,  0,  0 },
+    { "vec_dot",  false, 0,  0 },
+    { "rows-1",   false, 0,  1 },
+    { "rows-2",   false, 0,  2 },
+    { "rows-8",   false, 0,  8 },
+    { "rows-16",  false, 0, 16 },
+    { "tiles-16", false, 16, -1 },
+    { "tiles-64", false, 64, -1 },
+};
+
+// the shapes are tuned by powers of 2 of the number of columns of src1, so that the batch sizes do not each need a benchmark
+struct ggml_cpu_tune_key {
+    ggml_type type0;
+    ggml_type type1;
+    int64_t   m;
+    int64_t   k;
+    int64_t   n;
+    int       n_threads;
+
+    bool operator<(const ggml_cpu_tune_key & other) const {
+        return std::tie(type0, type1, m, k, n, n_threads) < std::tie(other.type0, other.type1, other.m, other.k, other.n, other.n_threads);
+    }
+};
+
+struct ggml_cpu_tune_state {
+    std::mutex  mutex;
+    std::string fname;
+    bool        loaded = false;
+
+    std::string cpu; // the entries are only valid for the CPU that measured them
+
+    std::map<ggml_cpu_tune_key, int> variants;
+    std::vector<std::string>         lines_other; // entries of the other CPUs, kept when saving
+};
+
+static std::atomic<bool> ggml_cpu_tune_is_enabled { false };
+
+// incremented when the cache file changes, the variants resolved before are not valid anymore
+static std::atomic<uint64_t> ggml_cpu_tune_generation { 0 };
+
+static ggml_cpu_tune_state & ggml_cpu_tune_get_state() {
+    static ggml_cpu_tune_state state;
+    return state;
+}
+
+static bool ggml_cpu_tune_is_weights_mul_mat(const struct ggml_tensor * node) {
+    const struct ggml_tensor * src0 = node->src[0];
+
+    // repacked weights are computed by their buffer type
+    return node->op == GGML_OP_MUL_MAT &&
+           src0->buffer && ggml_backend_buffer_get_usage(src0->buffer) == GGML_BACKEND_BUFFER_USAGE_WEIGHTS &&
+           src0->extra == nullptr && ggml_is_contiguous(src0);
+}
+
+static ggml_cpu_tune_key ggml_cpu_tune_make_key(const struct ggml_tensor * node, int n_threads) {
+    const int64_t n = node->src[1]->ne[1]*node->src[1]->ne[2]*node->src[1]->ne[3];
+
+    int64_t n_pow2 = 1;
+    while (n_pow2 < n) {
+        n_pow2 *= 2;
+    }
+
+    return { node->src[0]->type, node->src[1]->type, node->src[0]->ne[1], node->src[0]->ne[0], n_pow2, n_threads };
+}
+
+static ggml_type ggml_cpu_tune_parse_type(const std::string & name) {
+    for (int i = 0; i < GGML_TYPE_COUNT; i++) {
+        const char * type_name = ggml_type_name((ggml_type) i);
+        if (type_name && name == type_name) {
+            return (ggml_type) i;
+        }
+    }
+    return GGML_TYPE_COUNT;
+}
+
+static int ggml_cpu_tune_parse_variant(const std::string & name) {
+    for (int i = 0; i < GGML_MUL_MAT_N_VARIANTS; i++) {
+        if (name == ggml_mul_mat_variants[i].name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// cache file: one tab separated line per shape
+// cpu, src0 type, src1 type, M, K, N, threads, variant
+static void ggml_cpu_tune_load(ggml_cpu_tune_state & state) {
+    state.loaded = true;
+    state.cpu    = ggml_backend_dev_description(ggml_backend_reg_dev_get(ggml_backend_cpu_reg(), 0));
+
+    std::ifstream f(state.fname);
+    if (!f) {
+        return;
+    }
+
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        for (std::string field; std::getline(ss, field, '\t');) {
+            fields.push_back(field);
+        }
+        if (fields.size() != 8) {
+            continue;
+        }
+        if (fields[0] != state.cpu) {
+            state.lines_other.push_back(line);
+            continue;
+        }
+
+        ggml_cpu_tune_key key;
+        key.type0     = ggml_cpu_tune_parse_type(fields[1]);
+        key.type1     = ggml_cpu_tune_parse_type(fields[2]);
+        key.m         = std::atoll(fields[3].c_str());
+        key.k         = std::atoll(fields[4].c_str());
+        key.n         = std::atoll(fields[5].c_str());
+        key.n_threads = std::atoi (fields[6].c_str());
+
+        const int variant = ggml_cpu_tune_parse_variant(fields[7]);
+
+        // entries of other versions are measured again
+        if (key.type0 == GGML_TYPE_COUNT || key.type1 == GGML_TYPE_COUNT || variant < 0) {
+            continue;
+        }
+
+        state.variants[key] = variant;
+    }
+
+    GGML_LOG_DEBUG("%s: loaded %zu tuned shapes for %s from %s\n", __func__, state.variants.size(), state.cpu.c_str(), state.fname.c_str());
+}
+
+// the entries are written to a temporary file that replaces the cache file, so that a process that is killed while
+// saving or another process that loads the cache at the same time never sees a partial file
+static void ggml_cpu_tune_save(const ggml_cpu_tune_state & state) {
+    const std::string fname_tmp = state.fname + ".tmp." + std::to_string(
+            std::hash<std::thread::id>()(std::this_thread::get_id()) ^ (size_t) std::chrono::steady_clock::now().time_since_epoch().count());
+
+    FILE * f = ggml_fopen(fname_tmp.c_str(), "w");
+    if (!f) {
+        GGML_LOG_WARN("%s: failed to open %s\n", __func__, fname_tmp.c_str());
+        return;
+    }
+
+    fprintf(f, "# ggml-cpu mul_mat tuning: cpu, src0 type, src1 type, M, K, N, threads, variant\n");
+    for (const auto & line : state.lines_other) {
+        fprintf(f, "%s\n", line.c_str());
+    }
+    for (const auto & it : state.variants) {
+        const ggml_cpu_tune_key & key = it.first;
+        fprintf(f, "%s\t%s\t%s\t%lld\t%lld\t%lld\t%d\t%s\n", state.cpu.c_str(), ggml_type_name(key.type0), ggml_type_name(key.type1),
+                (long long) key.m, (long long) key.k, (long long) key.n, key.n_threads, ggml_mul_mat_variants[it.second].name);
+    }
+
+    const bool ok = fflush(f) == 0 && !ferror(f);
+
+    fclose(f);
+
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(std::filesystem::u8path(fname_tmp), std::filesystem::u8path(state.fname), ec);
+    }
+    if (!ok || ec) {
+        GGML_LOG_WARN("%s: failed to write %s\n", __func__, state.fname.c_str());
+        std::filesystem::remove(std::filesystem::u8path(fname_tmp), ec);
+    }
+}
+
+void ggml_cpu_tune_init(const char * fname) {
+    ggml_cpu_tune_state & state = ggml_cpu_tune_get_state();
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    // the entries are loaded on first use, after the initialization of the backend
+    state.fname  = fname ? fname : "";
+    state.loaded = false;
+    state.variants.clear();
+    state.lines_other.clear();
+
+    ggml_cpu_tune_is_enabled = fname != nullptr;
+    ggml_cpu_tune_generation++;
+}
+
+bool ggml_cpu_tune_enabled(void) {
+    return ggml_cpu_tune_is_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t ggml_cpu_tune_graph_hash(const struct ggml_cgraph * cgraph, int n_threads) {
+    // FNV-1a of the values
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const auto add = [&](uint64_t v) {
+        hash = (hash ^ v)*0x100000001b3ull;
+    };
+
+    add(ggml_cpu_tune_generation.load());
+    add(n_threads);
+    add(cgraph->n_nodes);
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        if (!ggml_cpu_tune_is_weights_mul_mat(node)) {
+            continue;
+        }
+
+        const ggml_cpu_tune_key key = ggml_cpu_tune_make_key(node, n_threads);
+
+        add(i);
+        add(key.type0);
+        add(key.type1);
+        add(key.m);
+        add(key.k);
+        add(key.n);
+    }
+
+    return hash;
+}
+
+static int ggml_cpu_tune_mul_mat(const struct ggml_tensor * node, const struct ggml_cplan * cplan) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 4*ggml_tensor_overhead() + ggml_graph_overhead_custom(4, false),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+
+    // same weights, but a contiguous src1 of zeros and a dst of its own, so that the tensors of the graph are not modified
+    struct ggml_tensor * src1 = ggml_new_tensor(ctx, node->src[1]->type, GGML_MAX_DIMS, node->src[1]->ne);
+    struct ggml_tensor * dst  = ggml_mul_mat(ctx, node->src[0], src1);
+
+    std::vector<uint8_t> src1_data(ggml_nbytes(src1), 0);
+    std::vector<uint8_t> dst_data (ggml_nbytes(dst));
+    src1->data = src1_data.data();
+    dst->data  = dst_data.data();
+
+    struct ggml_cgraph * gf = ggml_new_graph_custom(ctx, 4, false);
+    ggml_build_forward_expand(gf, dst);
+
+    struct ggml_cplan cplan_mm = ggml_graph_plan(gf, cplan->n_threads, cplan->threadpool);
+
+    std::vector<uint8_t> work_data(cplan_mm.work_size);
+    cplan_mm.work_data = work_data.data();
+
+    auto compute = [&](int variant) {
+        const auto t_start = std::chrono::steady_clock::now();
+        ggml_graph_compute_variant(gf, &cplan_mm, variant);
+        return (int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count();
+    };
+
+    // warmup, also brings the weights to the cache if they fit
+    const int64_t t_warmup = compute(0);
+
+    // about 2 ms per variant, at least 2 runs
+    const int n_runs = (int) std::max<int64_t>(2, std::min<int64_t>(10, 2000000/std::max<int64_t>(1, t_warmup)));
+
+    int     best   = 0;
+    int64_t t_best = INT64_MAX;
+    for (int variant = 0; variant < GGML_MUL_MAT_N_VARIANTS; variant++) {
+#if !GGML_USE_LLAMAFILE
+        // same as the default without llamafile_sgemm
+        if (strcmp(ggml_mul_mat_variants[variant].name, "vec_dot") == 0) {
+            continue;
+        }
+#endif
+        int64_t t = INT64_MAX;
+        for (int i = 0; i < n_runs; i++) {
+            t = std::min(t, compute(variant));
+        }
+
+        GGML_LOG_DEBUG("%s: %s x %s, M = %lld, K = %lld, N = %lld: %-8s %10.3f us\n", __func__,
+                ggml_type_name(node->src[0]->type), ggml_type_name(src1->type),
+                (long long) dst->ne[0], (long long) src1->ne[0], (long long) (dst->ne[1]*dst->ne[2]*dst->ne[3]),
+                ggml_mul_mat_variants[variant].name, t/1e3);
+
+        if (t < t_best) {
+            best   = variant;
+            t_best = t;
+        }
+    }
+
+    ggml_free(ctx);
+
+    return best;
+}
+
+void ggml_cpu_tune_graph(const struct ggml_cgraph * cgraph, const struct ggml_cplan * cplan, int * variants) {
+    ggml_cpu_tune_state & state = ggml_cpu_tune_get_state();
+
+    // the shapes that are not tuned yet and the first node with each of them
+    std::map<ggml_cpu_tune_key, int> missing;
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (!state.loaded) {
+            ggml_cpu_tune_load(state);
+        }
+
+        for (int i = 0; i < cgraph->n_nodes; i++) {
+            const struct ggml_tensor * node = cgraph->nodes[i];
+
+            if (!ggml_cpu_tune_is_weights_mul_mat(node)) {
+                continue;
+            }
+
+            const ggml_cpu_tune_key key = ggml_cpu_tune_make_key(node, cplan->n_threads);
+            if (state.variants.find(key) == state.variants.end()) {
+                missing.emplace(key, i);
+            }
+        }
+    }
+
+    // the benchmarks are run without the lock, a shape tuned by another thread in the meantime is tuned again
+    std::vector<std::pair<ggml_cpu_tune_key, int>> tuned;
+    for (const auto & it : missing) {
+        tuned.emplace_back(it.first, ggml_cpu_tune_mul_mat(cgraph->nodes[it.second], cplan));
+    }
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    if (!tuned.empty()) {
+        for (const auto & it : tuned) {
+            state.variants[it.first] = it.second;
+        }
+        ggml_cpu_tune_save(state);
+    }
+
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+
+        variants[i] = 0;
+
+        if (ggml_cpu_tune_is_weights_mul_mat(node)) {
+            const auto it = state.variants.find(ggml_cpu_tune_make_key(node, cplan->n_threads));
+            if (it != state.variants.end()) {
+                variants[i] = it->second;
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ggml-cpu.h"
+#include "ggml.h"
+
+// GGML CPU internal header
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a way of computing ggml_compute_forward_mul_mat
+struct ggml_mul_mat_variant {
+    const char * name;       // name in the cache file
+    bool         sgemm;      // use llamafile_sgemm when it supports the types
+    int          chunk_size; // rows and columns of the chunks, 0 = from the shape
+    int          n_chunks;   // chunks per thread along the larger dimension, 0 = only when the chunks are too few, -1 = never
+};
+
+#define GGML_MUL_MAT_N_VARIANTS 8
+
+// the first variant is the default
+extern const struct ggml_mul_mat_variant ggml_mul_mat_variants[GGML_MUL_MAT_N_VARIANTS];
+
+bool ggml_cpu_tune_enabled(void);
+
+// hash of the mul_mat of the weights of the graph and their tuned shapes, the variants of a graph with the same hash
+// can be reused
+uint64_t ggml_cpu_tune_graph_hash(const struct ggml_cgraph * cgraph, int n_threads);
+
+// benchmark the variants for each mul_mat of the weights that is not tuned yet and save the fastest to the cache file
+// variants receives the variant of each node of the graph, the default for the nodes that are not tuned
+void ggml_cpu_tune_graph(const struct ggml_cgraph * cgraph, const struct ggml_cplan * cplan, int * variants);
+
+// implemented in ggml-cpu.c
+// compute the graph with the given variant for every mul_mat, -1 = the tuned variants
+enum ggml_status ggml_graph_compute_variant(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan, int mm_variant);
+
+#ifdef __cplusplus
+}
+#endif
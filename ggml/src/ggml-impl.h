@@ -542,4 +542,5 @@ inline bool ggml_can_fuse(const struct ggml_cgraph * cgraph, int node_idx, std::
 GGML_API size_t gguf_type_size(enum gguf_type type);
 GGML_API struct gguf_context * gguf_init_from_file_impl(FILE * file, struct gguf_init_params params);
 GGML_API void gguf_write_to_buf(const struct gguf_context * ctx, std::vector<int8_t> & buf, bool only_meta);
+GGML_API bool gguf_write_to_file_impl(const struct gguf_context * ctx, FILE * file, bool only_meta);
 #endif // __cplusplus
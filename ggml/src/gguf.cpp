@@ -3,6 +3,7 @@
 #include "ggml-impl.h"
 #include "gguf.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstddef>
 #include <cstdint>
@@ -1166,50 +1167,68 @@ void gguf_set_tensor_data(struct gguf_context * ctx, const char * name, const vo
     ctx->info[tensor_id].t.data = (void *)(uintptr_t)data; // double cast suppresses warning about casting away const
 }
 
+// writes either to a buffer in memory or directly to a file
+// when writing to a file, the tensor data is written straight from its source, without buffering the whole output
 struct gguf_writer {
-    std::vector<int8_t> & buf;
+    std::vector<int8_t> * buf  = nullptr;
+    FILE                * file = nullptr;
 
-    gguf_writer(std::vector<int8_t> & buf) : buf(buf) {}
+    size_t n_written = 0;
+    bool   ok        = true;
 
-    template <typename T>
-    void write(const T & val) const {
-        for (size_t i = 0; i < sizeof(val); ++i) {
-            buf.push_back(reinterpret_cast<const int8_t *>(&val)[i]);
+    // staging buffer for the data of tensors that are not in host memory
+    std::vector<int8_t> tmp;
+
+    gguf_writer(std::vector<int8_t> & buf) : buf(&buf), n_written(buf.size()) {}
+    gguf_writer(FILE * file) : file(file) {}
+
+    void write_bytes(const void * data, const size_t nbytes) {
+        if (nbytes == 0) {
+            return;
         }
+        if (buf) {
+            buf->insert(buf->end(), (const int8_t *) data, (const int8_t *) data + nbytes);
+        } else if (ok) {
+            ok = fwrite(data, 1, nbytes, file) == nbytes;
+        }
+        n_written += nbytes;
+    }
+
+    template <typename T>
+    void write(const T & val) {
+        write_bytes(&val, sizeof(val));
     }
 
-    void write(const std::vector<int8_t> & val) const {
-        buf.insert(buf.end(), val.begin(), val.end());
+    void write(const std::vector<int8_t> & val) {
+        write_bytes(val.data(), val.size());
     }
 
-    void write(const bool & val) const {
+    void write(const bool & val) {
         const int8_t val8 = val ? 1 : 0;
         write(val8);
     }
 
-    void write(const std::string & val) const {
+    void write(const std::string & val) {
         {
             const uint64_t n = val.length();
             write(n);
         }
-        for (size_t i = 0; i < val.length(); ++i) {
-            buf.push_back(reinterpret_cast<const int8_t *>(val.data())[i]);
-        }
+        write_bytes(val.data(), val.length());
     }
 
-    void write(const char * val) const {
+    void write(const char * val) {
         write(std::string(val));
     }
 
-    void write(const enum ggml_type & val) const {
+    void write(const enum ggml_type & val) {
         write(int32_t(val));
     }
 
-    void write(const enum gguf_type & val) const {
+    void write(const enum gguf_type & val) {
         write(int32_t(val));
     }
 
-    void write(const struct gguf_kv & kv) const {
+    void write(const struct gguf_kv & kv) {
         const uint64_t ne = kv.get_ne();
 
         write(kv.get_key());
@@ -1250,7 +1269,7 @@ struct gguf_writer {
         }
     }
 
-    void write_tensor_meta(const struct gguf_tensor_info & info) const {
+    void write_tensor_meta(const struct gguf_tensor_info & info) {
         write(info.t.name);
 
         const uint32_t n_dims = ggml_n_dims(&info.t);
@@ -1263,35 +1282,43 @@ struct gguf_writer {
         write(info.offset);
     }
 
-    void pad(const size_t alignment) const {
-        while (buf.size() % alignment != 0) {
+    void pad(const size_t alignment) {
+        while (n_written % alignment != 0) {
             const int8_t zero = 0;
             write(zero);
         }
     }
 
-    void write_tensor_data(const struct gguf_tensor_info & info, const size_t offset_data, const size_t alignment) const {
-        GGML_ASSERT(buf.size() - offset_data == info.offset);
+    void write_tensor_data(const struct gguf_tensor_info & info, const size_t offset_data, const size_t alignment) {
+        GGML_ASSERT(n_written - offset_data == info.offset);
 
         GGML_ASSERT(ggml_is_contiguous(&info.t));
-        const size_t offset = buf.size();
         const size_t nbytes = ggml_nbytes(&info.t);
 
-        buf.resize(offset + nbytes);
-        if (info.t.buffer) {
-            ggml_backend_tensor_get(&info.t, buf.data() + offset, 0, nbytes);
+        if (info.t.buffer && buf) {
+            const size_t offset = buf->size();
+            buf->resize(offset + nbytes);
+            ggml_backend_tensor_get(&info.t, buf->data() + offset, 0, nbytes);
+            n_written += nbytes;
+        } else if (info.t.buffer) {
+            // copy the data of the tensor through a bounded staging buffer
+            const size_t chunk_size = 16*1024*1024;
+            tmp.resize(std::min(nbytes, chunk_size));
+            for (size_t offs = 0; offs < nbytes; offs += chunk_size) {
+                const size_t n = std::min(nbytes - offs, chunk_size);
+                ggml_backend_tensor_get(&info.t, tmp.data(), offs, n);
+                write_bytes(tmp.data(), n);
+            }
         } else {
             GGML_ASSERT(info.t.data);
-            memcpy(buf.data() + offset, info.t.data, nbytes);
+            write_bytes(info.t.data, nbytes);
         }
 
         pad(alignment);
     }
 };
 
-void gguf_write_to_buf(const struct gguf_context * ctx, std::vector<int8_t> & buf, bool only_meta) {
-    const struct gguf_writer gw(buf);
-
+static void gguf_write(const struct gguf_context * ctx, struct gguf_writer & gw, bool only_meta) {
     const int64_t n_kv      = gguf_get_n_kv(ctx);
     const int64_t n_tensors = gguf_get_n_tensors(ctx);
 
@@ -1321,7 +1348,7 @@ void gguf_write_to_buf(const struct gguf_context * ctx, std::vector<int8_t> & bu
         return;
     }
 
-    const size_t offset_data = gw.buf.size();
+    const size_t offset_data = gw.n_written;
 
     // write tensor data
     for (int64_t i = 0; i < n_tensors; ++i) {
@@ -1329,6 +1356,17 @@ void gguf_write_to_buf(const struct gguf_context * ctx, std::vector<int8_t> & bu
     }
 }
 
+void gguf_write_to_buf(const struct gguf_context * ctx, std::vector<int8_t> & buf, bool only_meta) {
+    struct gguf_writer gw(buf);
+    gguf_write(ctx, gw, only_meta);
+}
+
+bool gguf_write_to_file_impl(const struct gguf_context * ctx, FILE * file, bool only_meta) {
+    struct gguf_writer gw(file);
+    gguf_write(ctx, gw, only_meta);
+    return gw.ok;
+}
+
 bool gguf_write_to_file(const struct gguf_context * ctx, const char * fname, bool only_meta) {
     FILE * file = ggml_fopen(fname, "wb");
 
@@ -1337,11 +1375,11 @@ bool gguf_write_to_file(const struct gguf_context * ctx, const char * fname, boo
         return false;
     }
 
-    std::vector<int8_t> buf;
-    gguf_write_to_buf(ctx, buf, only_meta);
-    const bool ok = fwrite(buf.data(), 1, buf.size(), file) == buf.size();
-    fclose(file);
-    return ok;
+    const bool ok = gguf_write_to_file_impl(ctx, file, only_meta);
+    if (!ok) {
+        GGML_LOG_ERROR("%s: failed to write GGUF data to file '%s'\n", __func__, fname);
+    }
+    return fclose(file) == 0 && ok;
 }
 
 size_t gguf_get_meta_size(const struct gguf_context * ctx) {
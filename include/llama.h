@@ -42,7 +42,7 @@
 #define LLAMA_FILE_MAGIC_GGSQ 0x67677371u // 'ggsq'
 
 #define LLAMA_SESSION_MAGIC   LLAMA_FILE_MAGIC_GGSN
-#define LLAMA_SESSION_VERSION 9
+#define LLAMA_SESSION_VERSION 10
 
 #define LLAMA_STATE_SEQ_MAGIC   LLAMA_FILE_MAGIC_GGSQ
 #define LLAMA_STATE_SEQ_VERSION 2
@@ -283,11 +283,16 @@ extern "C" {
         // override key-value pairs of the model meta data
         const struct llama_model_kv_override * kv_overrides;
 
+        // threads that load the tensors stored in CPU buffers, 0 = from the hardware concurrency (at most 8), 1 = on the calling thread
+        int32_t n_load_threads;
+
         // Keep the booleans together to avoid misalignment during copy-by-value.
         bool vocab_only;    // only load the vocabulary, no weights
         bool use_mmap;      // use mmap if possible
         bool use_mlock;     // force system to keep model in RAM
         bool check_tensors; // validate model tensor data
+        bool repack_cache;  // store the weights converted by CPU extra buffer types (e.g. repacked) next to the model and mmap them on later loads
+        bool fuse_weights;  // concatenate the Q/K/V and the gate/up projections into one weight each at load time (llama architecture)
     };
 
     // NOTE: changing the default values of parameters marked as [EXPERIMENTAL] may cause crashes or incorrect results in certain configurations
@@ -313,6 +318,10 @@ extern "C" {
         float    yarn_beta_slow;   // YaRN high correction dim
         uint32_t yarn_orig_ctx;    // YaRN original context size
         float    defrag_thold;     // defragment the KV cache if holes/size > thold, <= 0 disabled (default)
+        uint32_t kv_block_size;    // allocate the KV cache in blocks of this many cells per sequence, 0 = disabled (default)
+                                   // requires ggml_set_rows() support (LLAMA_SET_ROWS=1)
+        int32_t  n_top_k_logits;   // output only the n_top_k_logits largest logits of each row and their tokens, computed in the graph
+                                   // 1 = argmax, 0 = full rows (default); read them with llama_get_logits_top_k_ith()
 
         ggml_backend_sched_eval_callback cb_eval;
         void * cb_eval_user_data;
@@ -326,6 +335,12 @@ extern "C" {
         ggml_abort_callback abort_callback;
         void *              abort_callback_data;
 
+        // Per node profiling of the CPU backend
+        // records the timings of the first profile_n_decode calls of llama_decode(), then writes them to profile_path
+        // as a Chrome trace and prints a summary by op type
+        int32_t      profile_n_decode; // number of llama_decode() calls to profile, 0 = disabled (default)
+        const char * profile_path;     // path of the trace file, NULL = only print the summary
+
         // Keep the booleans together and at the end of the struct to avoid misalignment during copy-by-value.
         bool embeddings;  // if true, extract embeddings (together with logits)
         bool offload_kqv; // offload the KQV ops (including the KV cache) to GPU
@@ -455,6 +470,7 @@ extern "C" {
     LLAMA_API uint32_t llama_n_batch    (const struct llama_context * ctx);
     LLAMA_API uint32_t llama_n_ubatch   (const struct llama_context * ctx);
     LLAMA_API uint32_t llama_n_seq_max  (const struct llama_context * ctx);
+    LLAMA_API int32_t  llama_n_top_k_logits(const struct llama_context * ctx); // 0 = full rows of logits
 
     DEPRECATED(LLAMA_API int32_t llama_n_ctx_train(const struct llama_model * model), "use llama_model_n_ctx_train instead");
     DEPRECATED(LLAMA_API int32_t llama_n_embd     (const struct llama_model * model), "use llama_model_n_embd instead");
@@ -964,6 +980,12 @@ extern "C" {
     // returns NULL for invalid ids.
     LLAMA_API float * llama_get_logits_ith(struct llama_context * ctx, int32_t i);
 
+    // Logits of the ith token when the context is created with n_top_k_logits > 0
+    // Sets *tokens and *logits to arrays of the largest logits and their tokens, sorted by decreasing logit
+    // Returns the number of elements of the arrays, or 0 for an invalid id or without n_top_k_logits
+    // llama_get_logits() and llama_get_logits_ith() are not available in this mode
+    LLAMA_API int32_t llama_get_logits_top_k_ith(struct llama_context * ctx, int32_t i, const llama_token ** tokens, const float ** logits);
+
     // Get all output token embeddings.
     // when pooling_type == LLAMA_POOLING_TYPE_NONE or when using a generative model,
     // the embeddings for which llama_batch.logits[i] != 0 are stored contiguously
@@ -1353,9 +1375,19 @@ extern "C" {
     //    auto token = cur_p.data[cur_p.selected].id;
     //    llama_sampler_accept(smpl, token);
     //    return token;
+    // With n_top_k_logits > 0, the candidates are the top-k logits of llama_get_logits_top_k_ith()
     // Returns the sampled token
     LLAMA_API llama_token llama_sampler_sample(struct llama_sampler * smpl, struct llama_context * ctx, int32_t idx);
 
+    /// @details Apply a sampler chain to the logits of a vocabulary of n_vocab tokens without building the array of all the candidates
+    //
+    // The chain needs a top-k, the samplers before it may only change the logits of a few tokens (logit-bias, penalties),
+    // scale them (temp) or have no effect with their parameters. A single pass over the logits selects the candidates
+    // of the top-k, then the chain is applied to them as with llama_sampler_apply
+    // Returns false if the chain cannot be applied this way
+    // On success, cur_p->data points to candidates owned by the chain, valid until the next call
+    LLAMA_API bool llama_sampler_chain_apply_logits(struct llama_sampler * chain, const float * logits, int32_t n_vocab, llama_token_data_array * cur_p);
+
     // TODO: extend in the future
     //LLAMA_API void llama_decode_with_sampler(struct llama_context * ctx, struct llama_sampler * smpl, struct llama_batch batch, ...);
 
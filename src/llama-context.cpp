@@ -103,6 +103,10 @@ llama_context::llama_context(
     cparams.op_offload = params.op_offload;
     cparams.kv_unified = params.kv_unified;
 
+    cparams.kv_block_size = params.kv_block_size;
+
+    cparams.n_top_k_logits = std::max(0, std::min(params.n_top_k_logits, (int32_t) model.vocab.n_tokens()));
+
     {
         const char * LLAMA_SET_ROWS = getenv("LLAMA_SET_ROWS");
         const bool supports_set_rows = LLAMA_SET_ROWS ? (atoi(LLAMA_SET_ROWS) != 0) : false;
@@ -123,6 +127,10 @@ llama_context::llama_context(
     LLAMA_LOG_INFO("%s: causal_attn   = %d\n",   __func__, cparams.causal_attn);
     LLAMA_LOG_INFO("%s: flash_attn    = %d\n",   __func__, cparams.flash_attn);
     LLAMA_LOG_INFO("%s: kv_unified    = %s\n",   __func__, cparams.kv_unified ? "true" : "false");
+    LLAMA_LOG_INFO("%s: kv_block_size = %u\n",   __func__, cparams.kv_block_size);
+    if (cparams.n_top_k_logits > 0) {
+        LLAMA_LOG_INFO("%s: top_k_logits  = %d\n",   __func__, cparams.n_top_k_logits);
+    }
     LLAMA_LOG_INFO("%s: freq_base     = %.1f\n", __func__, cparams.rope_freq_base);
     LLAMA_LOG_INFO("%s: freq_scale    = %g\n",   __func__, cparams.rope_freq_scale);
 
@@ -184,6 +192,22 @@ llama_context::llama_context(
 
         llama_set_abort_callback(this, params.abort_callback, params.abort_callback_data);
 
+        if (params.profile_n_decode > 0) {
+            auto * reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend_cpu));
+            auto * profile_new_fn = (decltype(ggml_cpu_profile_new)        *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_profile_new");
+            auto * set_profile_fn = (decltype(ggml_backend_cpu_set_profile) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_set_profile");
+            if (profile_new_fn && set_profile_fn) {
+                profile          = profile_new_fn();
+                profile_n_decode = params.profile_n_decode;
+                profile_path     = params.profile_path ? params.profile_path : "";
+                set_profile_fn(backend_cpu, profile);
+
+                LLAMA_LOG_INFO("%s: profiling the CPU backend for %d decode calls\n", __func__, profile_n_decode);
+            } else {
+                LLAMA_LOG_WARN("%s: the CPU backend does not support profiling\n", __func__);
+            }
+        }
+
         // graph outputs buffer
         {
             // resized during inference when a batch uses more outputs
@@ -358,6 +382,9 @@ llama_context::llama_context(
 }
 
 llama_context::~llama_context() {
+    if (profile) {
+        profile_end();
+    }
     ggml_opt_free(opt_ctx);
 }
 
@@ -508,6 +535,11 @@ enum llama_pooling_type llama_context::pooling_type() const {
 }
 
 float * llama_context::get_logits() {
+    if (cparams.n_top_k_logits > 0) {
+        LLAMA_LOG_ERROR("%s: only the top-k logits are available (n_top_k_logits = %d)\n", __func__, cparams.n_top_k_logits);
+        return nullptr;
+    }
+
     return logits;
 }
 
@@ -519,6 +551,10 @@ float * llama_context::get_logits_ith(int32_t i) {
             throw std::runtime_error("no logits");
         }
 
+        if (cparams.n_top_k_logits > 0) {
+            throw std::runtime_error(format("only the top-k logits are available (n_top_k_logits = %d)", cparams.n_top_k_logits));
+        }
+
         if (i < 0) {
             j = n_outputs + i;
             if (j < 0) {
@@ -549,6 +585,49 @@ float * llama_context::get_logits_ith(int32_t i) {
     }
 }
 
+int32_t llama_context::get_logits_top_k_ith(int32_t i, const llama_token ** tokens, const float ** logits) {
+    int64_t j = -1;
+
+    try {
+        if (this->logits == nullptr || logits_ids == nullptr) {
+            throw std::runtime_error("no top-k logits");
+        }
+
+        if (i < 0) {
+            j = n_outputs + i;
+            if (j < 0) {
+                throw std::runtime_error(format("negative index out of range [0, %d)", n_outputs));
+            }
+        } else if ((size_t) i >= output_ids.size()) {
+            throw std::runtime_error(format("out of range [0, %zu)", output_ids.size()));
+        } else {
+            j = output_ids[i];
+        }
+
+        if (j < 0) {
+            throw std::runtime_error(format("batch.logits[%d] != true", i));
+        }
+        if (j >= n_outputs) {
+            // This should not happen
+            throw std::runtime_error(format("corrupt output buffer (j=%" PRId64 ", n_outputs=%d)", j, n_outputs));
+        }
+
+        const int32_t k = cparams.n_top_k_logits;
+
+        *tokens = logits_ids   + j*k;
+        *logits = this->logits + j*k;
+
+        return k;
+    } catch (const std::exception & err) {
+        LLAMA_LOG_ERROR("%s: invalid logits id %d, reason: %s\n", __func__, i, err.what());
+#ifndef NDEBUG
+        GGML_ABORT("fatal error");
+#else
+        return 0;
+#endif
+    }
+}
+
 float * llama_context::get_embeddings() {
     return embd;
 }
@@ -768,8 +847,7 @@ int llama_context::encode(const llama_batch & batch_inp) {
 
     const auto & hparams = model.hparams;
 
-    const int64_t n_embd  = hparams.n_embd;
-    const int32_t n_vocab = model.vocab.n_tokens();
+    const int64_t n_embd = hparams.n_embd;
 
     // note: during encode, we always pass the full sequence starting from pos = 0
     if (!balloc->init(batch_inp, model.vocab, nullptr, n_embd, cparams.kv_unified ? LLAMA_MAX_SEQ : cparams.n_seq_max, true)) {
@@ -828,16 +906,11 @@ int llama_context::encode(const llama_batch & batch_inp) {
         }
     }
 
-    auto * t_logits = res->get_logits();
     auto * t_embd = res->get_embd_pooled() ? res->get_embd_pooled() : res->get_embd();
 
     // extract logits
-   if (logits && t_logits) {
-        ggml_backend_t backend_res = ggml_backend_sched_get_tensor_backend(sched.get(), t_logits);
-        GGML_ASSERT(backend_res != nullptr);
-        GGML_ASSERT(logits != nullptr);
-
-        ggml_backend_tensor_get_async(backend_res, t_logits, logits, 0, n_tokens*n_vocab*sizeof(float));
+    if (logits) {
+        output_logits(res, 0, n_tokens);
     }
 
     // extract embeddings
@@ -920,7 +993,37 @@ int llama_context::encode(const llama_batch & batch_inp) {
     return 0;
 }
 
+void llama_context::profile_end() {
+    synchronize();
+
+    auto * reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend_cpu));
+    auto * set_profile_fn   = (decltype(ggml_backend_cpu_set_profile)   *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_set_profile");
+    auto * write_trace_fn   = (decltype(ggml_cpu_profile_write_trace)   *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_profile_write_trace");
+    auto * print_summary_fn = (decltype(ggml_cpu_profile_print_summary) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_profile_print_summary");
+    auto * profile_free_fn  = (decltype(ggml_cpu_profile_free)          *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_profile_free");
+
+    set_profile_fn(backend_cpu, nullptr);
+
+    print_summary_fn(profile);
+    if (!profile_path.empty() && write_trace_fn(profile, profile_path.c_str())) {
+        LLAMA_LOG_INFO("%s: wrote the trace of the CPU backend to %s\n", __func__, profile_path.c_str());
+    }
+
+    profile_free_fn(profile);
+    profile = nullptr;
+}
+
 int llama_context::decode(const llama_batch & batch_inp) {
+    const int ret = decode_impl(batch_inp);
+
+    if (profile && --profile_n_decode == 0) {
+        profile_end();
+    }
+
+    return ret;
+}
+
+int llama_context::decode_impl(const llama_batch & batch_inp) {
     GGML_ASSERT((!batch_inp.token && batch_inp.embd) || (batch_inp.token && !batch_inp.embd)); // NOLINT
 
     if (!memory) {
@@ -936,8 +1039,7 @@ int llama_context::decode(const llama_batch & batch_inp) {
     const auto & vocab   = model.vocab;
     const auto & hparams = model.hparams;
 
-    const int32_t n_vocab = vocab.n_tokens();
-    const int64_t n_embd  = hparams.n_embd;
+    const int64_t n_embd = hparams.n_embd;
 
     // when computing embeddings, all tokens are output
     const bool output_all = cparams.embeddings;
@@ -1087,7 +1189,6 @@ int llama_context::decode(const llama_batch & batch_inp) {
         //    ggml_graph_dump_dot(gf, NULL, "llama.dot");
         //}
 
-        auto * t_logits = res->get_logits();
         auto * t_embd   = cparams.embeddings ? res->get_embd() : nullptr;
 
         if (t_embd && res->get_embd_pooled()) {
@@ -1095,18 +1196,10 @@ int llama_context::decode(const llama_batch & batch_inp) {
         }
 
         // extract logits
-        if (t_logits && n_outputs > 0) {
-            ggml_backend_t backend_res = ggml_backend_sched_get_tensor_backend(sched.get(), t_logits);
-            GGML_ASSERT(backend_res != nullptr);
-            GGML_ASSERT(logits != nullptr);
-
-            float * logits_out = logits + n_outputs_prev*n_vocab;
+        if (n_outputs > 0) {
+            GGML_ASSERT(n_outputs_prev + n_outputs <= n_outputs_all);
 
-            if (n_outputs) {
-                GGML_ASSERT( n_outputs_prev + n_outputs <= n_outputs_all);
-                GGML_ASSERT((n_outputs_prev + n_outputs)*n_vocab <= (int64_t) logits_size);
-                ggml_backend_tensor_get_async(backend_res, t_logits, logits_out, 0, n_outputs*n_vocab*sizeof(float));
-            }
+            output_logits(res, n_outputs_prev, n_outputs);
         }
 
         // extract embeddings
@@ -1189,8 +1282,8 @@ int llama_context::decode(const llama_batch & batch_inp) {
         // make the outputs have the same order they had in the user-provided batch
         // note: this is mostly relevant for recurrent models atm
         if (!sorted_output) {
-            const uint32_t n_vocab = model.vocab.n_tokens();
-            const uint64_t n_embd  = model.hparams.n_embd;
+            const int64_t  n_logits = output_n_logits();
+            const uint64_t n_embd   = model.hparams.n_embd;
 
             GGML_ASSERT((size_t) n_outputs == out_ids.size());
 
@@ -1208,8 +1301,13 @@ int llama_context::decode(const llama_batch & batch_inp) {
                 }
                 std::swap(out_ids[i], out_ids[j_min]);
                 if (logits_size > 0) {
-                    for (uint32_t k = 0; k < n_vocab; k++) {
-                        std::swap(logits[i*n_vocab + k], logits[j_min*n_vocab + k]);
+                    for (int64_t k = 0; k < n_logits; k++) {
+                        std::swap(logits[i*n_logits + k], logits[j_min*n_logits + k]);
+                    }
+                }
+                if (logits_ids) {
+                    for (int64_t k = 0; k < n_logits; k++) {
+                        std::swap(logits_ids[i*n_logits + k], logits_ids[j_min*n_logits + k]);
                     }
                 }
                 if (embd_size > 0) {
@@ -1239,13 +1337,12 @@ int llama_context::decode(const llama_batch & batch_inp) {
 
 uint32_t llama_context::output_reserve(int32_t n_outputs) {
     const auto & hparams = model.hparams;
-    const auto & vocab   = model.vocab;
 
     const int64_t n_outputs_max = std::max<int64_t>(n_outputs, n_seq_max());
 
-    const auto n_batch = cparams.n_batch;
-    const auto n_vocab = vocab.n_tokens();
-    const auto n_embd  = hparams.n_embd;
+    const auto n_batch  = cparams.n_batch;
+    const auto n_logits = output_n_logits();
+    const auto n_embd   = hparams.n_embd;
 
     bool has_logits = true;
     bool has_embd   = cparams.embeddings;
@@ -1256,8 +1353,11 @@ uint32_t llama_context::output_reserve(int32_t n_outputs) {
         has_embd   = true;
     }
 
-    logits_size = has_logits ? n_vocab*n_outputs_max : 0;
-    embd_size   = has_embd   ?  n_embd*n_outputs_max : 0;
+    logits_size = has_logits ? n_logits*n_outputs_max : 0;
+    embd_size   = has_embd   ?   n_embd*n_outputs_max : 0;
+
+    // the tokens of the top-k logits
+    const size_t logits_ids_size = cparams.n_top_k_logits > 0 ? logits_size : 0;
 
     if (output_ids.empty()) {
         // init, never resized afterwards
@@ -1265,7 +1365,7 @@ uint32_t llama_context::output_reserve(int32_t n_outputs) {
     }
 
     const size_t prev_size = buf_output ? ggml_backend_buffer_get_size(buf_output.get()) : 0;
-    const size_t new_size  = (logits_size + embd_size) * sizeof(float);
+    const size_t new_size  = (logits_size + embd_size) * sizeof(float) + logits_ids_size * sizeof(llama_token);
 
     // alloc only when more than the current capacity is required
     // TODO: also consider shrinking the buffer
@@ -1277,6 +1377,7 @@ uint32_t llama_context::output_reserve(int32_t n_outputs) {
 #endif
             buf_output = nullptr;
             logits = nullptr;
+            logits_ids = nullptr;
             embd = nullptr;
         }
 
@@ -1299,6 +1400,8 @@ uint32_t llama_context::output_reserve(int32_t n_outputs) {
     logits = has_logits ? output_base               : nullptr;
     embd   = has_embd   ? output_base + logits_size : nullptr;
 
+    logits_ids = logits_ids_size > 0 ? (llama_token *) (output_base + logits_size + embd_size) : nullptr;
+
     // set all ids as invalid (negative)
     std::fill(output_ids.begin(), output_ids.end(), -1);
 
@@ -1307,6 +1410,38 @@ uint32_t llama_context::output_reserve(int32_t n_outputs) {
     return n_outputs_max;
 }
 
+int64_t llama_context::output_n_logits() const {
+    return cparams.n_top_k_logits > 0 ? cparams.n_top_k_logits : model.vocab.n_tokens();
+}
+
+void llama_context::output_logits(const llm_graph_result * res, int64_t i0, int64_t n_outputs) {
+    const bool top_k = cparams.n_top_k_logits > 0;
+
+    auto * t_logits = top_k ? res->get_logits_top_k() : res->get_logits();
+    if (!t_logits) {
+        return;
+    }
+
+    const int64_t n_logits = output_n_logits();
+
+    GGML_ASSERT(logits != nullptr);
+    GGML_ASSERT((i0 + n_outputs)*n_logits <= (int64_t) logits_size);
+
+    ggml_backend_t backend_res = ggml_backend_sched_get_tensor_backend(sched.get(), t_logits);
+    GGML_ASSERT(backend_res != nullptr);
+
+    ggml_backend_tensor_get_async(backend_res, t_logits, logits + i0*n_logits, 0, n_outputs*n_logits*sizeof(float));
+
+    if (top_k) {
+        auto * t_ids = res->get_logits_top_k_ids();
+
+        ggml_backend_t backend_ids = ggml_backend_sched_get_tensor_backend(sched.get(), t_ids);
+        GGML_ASSERT(backend_ids != nullptr);
+
+        ggml_backend_tensor_get_async(backend_ids, t_ids, logits_ids + i0*n_logits, 0, n_outputs*n_logits*sizeof(llama_token));
+    }
+}
+
 //
 // graph
 //
@@ -1778,6 +1913,12 @@ size_t llama_context::state_write_data(llama_io_write_i & io) {
         // TODO: add more model-specific info which should prevent loading the session file if not identical
     }
 
+    // write the number of logits per output, the rows hold only the top-k logits and their ids when n_top_k_logits > 0
+    {
+        const int32_t n_top_k_logits = cparams.n_top_k_logits;
+        io.write(&n_top_k_logits, sizeof(n_top_k_logits));
+    }
+
     // write output ids
     {
         LLAMA_LOG_DEBUG("%s: - writing output ids\n", __func__);
@@ -1810,13 +1951,17 @@ size_t llama_context::state_write_data(llama_io_write_i & io) {
     {
         LLAMA_LOG_DEBUG("%s: - writing logits\n", __func__);
 
-        const uint64_t logits_size = std::min((uint64_t) this->logits_size, (uint64_t) n_outputs * model.vocab.n_tokens());
+        const uint64_t logits_size = std::min((uint64_t) this->logits_size, (uint64_t) n_outputs * output_n_logits());
 
         io.write(&logits_size, sizeof(logits_size));
 
         if (logits_size) {
             io.write(logits, logits_size * sizeof(float));
         }
+
+        if (logits_size && logits_ids) {
+            io.write(logits_ids, logits_size * sizeof(llama_token));
+        }
     }
 
     // write embeddings
@@ -1857,6 +2002,16 @@ size_t llama_context::state_read_data(llama_io_read_i & io) {
         // TODO: add more info which needs to be identical but which is not verified otherwise
     }
 
+    // read the number of logits per output, checked before the outputs are modified
+    {
+        int32_t n_top_k_logits;
+        io.read_to(&n_top_k_logits, sizeof(n_top_k_logits));
+
+        if (n_top_k_logits != cparams.n_top_k_logits) {
+            throw std::runtime_error(format("the state has n_top_k_logits = %d instead of %d", n_top_k_logits, cparams.n_top_k_logits));
+        }
+    }
+
     // read output ids
     {
         LLAMA_LOG_DEBUG("%s: - reading output ids\n", __func__);
@@ -1900,6 +2055,10 @@ size_t llama_context::state_read_data(llama_io_read_i & io) {
         if (logits_size) {
             io.read_to(this->logits, logits_size * sizeof(float));
         }
+
+        if (logits_size && logits_ids) {
+            io.read_to(logits_ids, logits_size * sizeof(llama_token));
+        }
     }
 
     // read embeddings
@@ -2212,12 +2371,16 @@ llama_context_params llama_context_default_params() {
         /*.yarn_beta_slow              =*/ 1.0f,
         /*.yarn_orig_ctx               =*/ 0,
         /*.defrag_thold                =*/ -1.0f,
+        /*.kv_block_size               =*/ 0,
+        /*.n_top_k_logits              =*/ 0,
         /*.cb_eval                     =*/ nullptr,
         /*.cb_eval_user_data           =*/ nullptr,
         /*.type_k                      =*/ GGML_TYPE_F16,
         /*.type_v                      =*/ GGML_TYPE_F16,
         /*.abort_callback              =*/ nullptr,
         /*.abort_callback_data         =*/ nullptr,
+        /*.profile_n_decode            =*/ 0,
+        /*.profile_path                =*/ nullptr,
         /*.embeddings                  =*/ false,
         /*.offload_kqv                 =*/ true,
         /*.flash_attn                  =*/ false,
@@ -2295,6 +2458,10 @@ uint32_t llama_n_seq_max(const llama_context * ctx) {
     return ctx->n_seq_max();
 }
 
+int32_t llama_n_top_k_logits(const llama_context * ctx) {
+    return ctx->get_cparams().n_top_k_logits;
+}
+
 const llama_model * llama_get_model(const llama_context * ctx) {
     return &ctx->get_model();
 }
@@ -2362,6 +2529,12 @@ float * llama_get_logits(llama_context * ctx) {
     return ctx->get_logits();
 }
 
+int32_t llama_get_logits_top_k_ith(llama_context * ctx, int32_t i, const llama_token ** tokens, const float ** logits) {
+    ctx->synchronize();
+
+    return ctx->get_logits_top_k_ith(i, tokens, logits);
+}
+
 float * llama_get_logits_ith(llama_context * ctx, int32_t i) {
     ctx->synchronize();
 
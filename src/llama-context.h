@@ -56,6 +56,8 @@ struct llama_context {
     float * get_logits();
     float * get_logits_ith(int32_t i);
 
+    int32_t get_logits_top_k_ith(int32_t i, const llama_token ** tokens, const float ** logits);
+
     float * get_embeddings();
     float * get_embeddings_ith(int32_t i);
     float * get_embeddings_seq(llama_seq_id seq_id);
@@ -181,6 +183,12 @@ private:
     // Returns max number of outputs for which space was reserved.
     uint32_t output_reserve(int32_t n_outputs);
 
+    // number of logits of each output: n_vocab, or n_top_k_logits when they are selected in the graph
+    int64_t output_n_logits() const;
+
+    // copy the logits of n_outputs outputs from the graph, starting at output i0
+    void output_logits(const llm_graph_result * res, int64_t i0, int64_t n_outputs);
+
     //
     // graph
     //
@@ -213,6 +221,11 @@ private:
     size_t state_seq_write_data(llama_io_write_i & io, llama_seq_id seq_id);
     size_t state_seq_read_data (llama_io_read_i  & io, llama_seq_id seq_id);
 
+    int decode_impl(const llama_batch & batch_inp);
+
+    // print and write the recorded profile, and stop profiling
+    void profile_end();
+
     //
     // members
     //
@@ -231,8 +244,10 @@ private:
     bool memory_force_optimize = false;
 
     // decode output (2-dimensional array: [n_outputs][n_vocab])
-    size_t  logits_size = 0; // capacity (of floats) for logits
-    float * logits      = nullptr;
+    // with cparams.n_top_k_logits > 0: [n_outputs][n_top_k_logits], with the tokens of the logits in logits_ids
+    size_t        logits_size = 0; // capacity (of floats) for logits
+    float       * logits      = nullptr;
+    llama_token * logits_ids  = nullptr;
 
     // embeddings output (2-dimensional array: [n_outputs][n_embd])
     // populated only when pooling_type == LLAMA_POOLING_TYPE_NONE
@@ -264,6 +279,11 @@ private:
     ggml_abort_callback abort_callback      = nullptr;
     void *              abort_callback_data = nullptr;
 
+    // per node profiling of the CPU backend, for the next profile_n_decode calls of decode()
+    struct ggml_cpu_profile * profile          = nullptr;
+    int32_t                   profile_n_decode = 0;
+    std::string               profile_path;
+
     std::vector<std::pair<ggml_backend_t, ggml_backend_set_n_threads_t>> set_n_threads_fns;
 
     // buffer types used for the compute buffer of each backend
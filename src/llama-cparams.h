@@ -26,6 +26,10 @@ struct llama_cparams {
     float yarn_beta_slow;
     float defrag_thold;
 
+    uint32_t kv_block_size; // number of KV cells per block in paged mode (0 = disabled)
+
+    int32_t n_top_k_logits; // number of logits per output, computed with top-k in the graph (0 = full rows)
+
     bool embeddings;
     bool causal_attn;
     bool offload_kqv;
@@ -6,6 +6,9 @@
 
 #include <cmath>
 #include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
 #include <stdexcept>
 
 //
@@ -846,6 +849,7 @@ void llama_grammar_accept(struct llama_grammar * grammar, uint32_t chr) {
     }
 
     grammar->stacks = std::move(stacks_new);
+    grammar->state_key.clear();
 }
 
 llama_grammar_candidates llama_grammar_reject_candidates_for_stack(
@@ -903,6 +907,270 @@ llama_grammar_candidates llama_grammar_reject_candidates_for_stack(
     return rejects;
 }
 
+//
+// mask cache
+//
+
+// code points of each token of the vocab, decoded from a complete UTF-8 state and terminated by 0
+// they are the same for every step that does not start in the middle of a UTF-8 sequence
+struct llama_grammar_vocab_cpts {
+    std::vector<uint32_t>           code_points;
+    std::vector<size_t>             offs;
+    std::vector<llama_partial_utf8> partial_utf8;
+};
+
+// shared by the caches of all the grammars of a vocab
+static std::shared_ptr<const llama_grammar_vocab_cpts> llama_grammar_get_vocab_cpts(const llama_vocab & vocab) {
+    static std::mutex mutex;
+    static std::map<const llama_vocab *, std::weak_ptr<const llama_grammar_vocab_cpts>> vocabs;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // drop the vocabs that have no grammar anymore
+    for (auto it = vocabs.begin(); it != vocabs.end();) {
+        it = it->second.expired() && it->first != &vocab ? vocabs.erase(it) : std::next(it);
+    }
+
+    auto & entry = vocabs[&vocab];
+    if (auto cpts = entry.lock()) {
+        return cpts;
+    }
+
+    const int32_t n_vocab = vocab.n_tokens();
+
+    auto cpts = std::make_shared<llama_grammar_vocab_cpts>();
+    cpts->offs.resize(n_vocab);
+    cpts->partial_utf8.resize(n_vocab);
+
+    for (llama_token id = 0; id < n_vocab; ++id) {
+        const auto decoded = decode_utf8(vocab.token_to_piece(id), { 0, 0 });
+
+        cpts->offs[id]         = cpts->code_points.size();
+        cpts->partial_utf8[id] = decoded.second;
+        cpts->code_points.insert(cpts->code_points.end(), decoded.first.begin(), decoded.first.end());
+    }
+
+    entry = cpts;
+
+    return cpts;
+}
+
+// the masks of all the caches of the process share this budget, so that many grammars alive at the same time, e.g. in
+// the grammar cache of the server, do not multiply it
+// when a new mask does not fit, the least recently used masks of any cache are evicted
+static constexpr size_t LLAMA_GRAMMAR_CACHE_MAX_SIZE = 256*1024*1024;
+
+struct llama_grammar_cache;
+
+struct llama_grammar_cache_lru_entry {
+    llama_grammar_cache * cache;
+
+    const std::vector<uint32_t> * key; // owned by the map of the cache
+
+    size_t size; // bytes
+};
+
+// all the masks of the process, the most recently used first
+using llama_grammar_cache_lru = std::list<llama_grammar_cache_lru_entry>;
+
+// guards the masks of all the caches and the LRU list
+static std::mutex              llama_grammar_cache_mutex;
+static llama_grammar_cache_lru llama_grammar_cache_list;
+static size_t                  llama_grammar_cache_size = 0; // bytes, all the caches
+
+// the allowed tokens of a grammar state do not change, so they are computed once for the whole vocab and the
+// following applies in the same state are answered from the bitmask
+struct llama_grammar_cache {
+    std::mutex mutex; // vocab_cpts
+
+    std::shared_ptr<const llama_grammar_vocab_cpts> vocab_cpts;
+
+    struct mask_entry {
+        std::shared_ptr<const std::vector<uint64_t>> mask;
+
+        llama_grammar_cache_lru::iterator lru;
+    };
+
+    std::map<std::vector<uint32_t>, mask_entry> masks;
+
+    ~llama_grammar_cache();
+};
+
+llama_grammar_cache::~llama_grammar_cache() {
+    std::lock_guard<std::mutex> lock(llama_grammar_cache_mutex);
+
+    for (const auto & [key, entry] : masks) {
+        llama_grammar_cache_size -= entry.lru->size;
+        llama_grammar_cache_list.erase(entry.lru);
+    }
+}
+
+// the elements of the stacks point to the rules, they are keyed by their offset in the rules to be the same for the clones
+static std::vector<uint32_t> llama_grammar_state_key(const llama_grammar & grammar) {
+    using rule_offs_t = std::pair<const llama_grammar_element *, uint32_t>;
+
+    std::vector<rule_offs_t> rule_offs;
+    rule_offs.reserve(grammar.rules.size());
+
+    uint32_t offs = 0;
+    for (const auto & rule : grammar.rules) {
+        rule_offs.emplace_back(rule.data(), offs);
+        offs += rule.size();
+    }
+
+    const auto cmp = [](const rule_offs_t & a, const rule_offs_t & b) {
+        return std::less<const llama_grammar_element *>()(a.first, b.first);
+    };
+    std::sort(rule_offs.begin(), rule_offs.end(), cmp);
+
+    std::vector<std::vector<uint32_t>> stacks;
+    stacks.reserve(grammar.stacks.size());
+
+    for (const auto & stack : grammar.stacks) {
+        auto & stack_offs = stacks.emplace_back();
+        stack_offs.reserve(stack.size());
+
+        for (const auto * pos : stack) {
+            const auto it = std::upper_bound(rule_offs.begin(), rule_offs.end(), rule_offs_t(pos, 0), cmp) - 1;
+            stack_offs.push_back(it->second + (uint32_t) (pos - it->first));
+        }
+    }
+
+    // the order of the stacks does not change the allowed tokens
+    std::sort(stacks.begin(), stacks.end());
+
+    // the value of a complete UTF-8 state is the last code point, which does not matter
+    const llama_partial_utf8 & partial_utf8 = grammar.partial_utf8;
+
+    std::vector<uint32_t> key = { partial_utf8.n_remain != 0 ? partial_utf8.value : 0, (uint32_t) partial_utf8.n_remain };
+    for (const auto & stack_offs : stacks) {
+        key.push_back(stack_offs.size());
+        key.insert(key.end(), stack_offs.begin(), stack_offs.end());
+    }
+
+    return key;
+}
+
+static std::shared_ptr<const std::vector<uint64_t>> llama_grammar_compute_mask(const llama_grammar & grammar, bool allow_eog) {
+    const llama_vocab & vocab = *grammar.vocab;
+    llama_grammar_cache & cache = *grammar.cache;
+
+    const int32_t n_vocab = vocab.n_tokens();
+
+    std::shared_ptr<const llama_grammar_vocab_cpts> cpts;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        if (!cache.vocab_cpts) {
+            cache.vocab_cpts = llama_grammar_get_vocab_cpts(vocab);
+        }
+        cpts = cache.vocab_cpts;
+    }
+
+    const bool partial = grammar.partial_utf8.n_remain != 0;
+
+    std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
+    candidates_decoded.reserve(partial ? n_vocab : 0);
+
+    llama_grammar_candidates candidates_grammar;
+    candidates_grammar.reserve(n_vocab);
+
+    auto mask = std::make_shared<std::vector<uint64_t>>((n_vocab + 63)/64, 0);
+
+    for (llama_token id = 0; id < n_vocab; ++id) {
+        const std::string & piece = vocab.token_to_piece(id);
+
+        if (vocab.is_eog(id)) {
+            if (allow_eog) {
+                (*mask)[id/64] |= 1ull << (id%64);
+            }
+        } else if (piece.empty() || piece[0] == 0) {
+            continue;
+        } else if (partial) {
+            candidates_decoded.push_back(decode_utf8(piece, grammar.partial_utf8));
+            candidates_grammar.push_back({ (size_t) id, candidates_decoded.back().first.data(), candidates_decoded.back().second });
+        } else {
+            candidates_grammar.push_back({ (size_t) id, cpts->code_points.data() + cpts->offs[id], cpts->partial_utf8[id] });
+        }
+    }
+
+    for (const auto & cand : candidates_grammar) {
+        (*mask)[cand.index/64] |= 1ull << (cand.index%64);
+    }
+
+    const auto rejects = llama_grammar_reject_candidates(grammar.rules, grammar.stacks, candidates_grammar);
+    for (const auto & reject : rejects) {
+        (*mask)[reject.index/64] &= ~(1ull << (reject.index%64));
+    }
+
+    return mask;
+}
+
+// returns nullptr if the state is not cached and compute is false
+static std::shared_ptr<const std::vector<uint64_t>> llama_grammar_get_mask(const llama_grammar & grammar, bool allow_eog, bool compute) {
+    llama_grammar_cache & cache = *grammar.cache;
+
+    // the key is updated when a token is accepted, it is only built here for a state reached by other means
+    std::vector<uint32_t> key_tmp;
+    if (grammar.state_key.empty()) {
+        key_tmp = llama_grammar_state_key(grammar);
+    }
+    const std::vector<uint32_t> & key = grammar.state_key.empty() ? key_tmp : grammar.state_key;
+
+    {
+        std::lock_guard<std::mutex> lock(llama_grammar_cache_mutex);
+
+        const auto it = cache.masks.find(key);
+        if (it != cache.masks.end()) {
+            llama_grammar_cache_list.splice(llama_grammar_cache_list.begin(), llama_grammar_cache_list, it->second.lru);
+            return it->second.mask;
+        }
+    }
+
+    if (!compute) {
+        return nullptr;
+    }
+
+    auto mask = llama_grammar_compute_mask(grammar, allow_eog);
+
+    const size_t size = mask->size()*sizeof(uint64_t) + key.size()*sizeof(uint32_t);
+    if (size > LLAMA_GRAMMAR_CACHE_MAX_SIZE) {
+        return mask;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(llama_grammar_cache_mutex);
+
+        if (cache.masks.find(key) != cache.masks.end()) {
+            return mask;
+        }
+
+        while (llama_grammar_cache_size + size > LLAMA_GRAMMAR_CACHE_MAX_SIZE) {
+            const auto & lru = llama_grammar_cache_list.back();
+
+            llama_grammar_cache_size -= lru.size;
+            lru.cache->masks.erase(lru.cache->masks.find(*lru.key));
+            llama_grammar_cache_list.pop_back();
+        }
+
+        const auto it = cache.masks.emplace(key, llama_grammar_cache::mask_entry { mask, {} }).first;
+
+        llama_grammar_cache_list.push_front({ &cache, &it->first, size });
+        it->second.lru = llama_grammar_cache_list.begin();
+
+        llama_grammar_cache_size += size;
+    }
+
+    return mask;
+}
+
+// called when the state of the grammar has changed
+static void llama_grammar_update_state_key(llama_grammar & grammar) {
+    if (grammar.cache) {
+        grammar.state_key = llama_grammar_state_key(grammar);
+    }
+}
+
 ////////////////////
 
 struct llama_grammar * llama_grammar_init_impl(
@@ -960,7 +1228,7 @@ struct llama_grammar * llama_grammar_init_impl(
     // Important: vec_rules has to be moved here, not copied, because stacks contains
     // pointers to elements of vec_rules. If vec_rules were copied into llama_grammar
     // then the pointers would be invalidated when the local vec_rules goes out of scope.
-    return new llama_grammar {
+    auto * result = new llama_grammar {
         vocab,
         std::move(vec_rules),
         std::move(stacks),
@@ -970,7 +1238,13 @@ struct llama_grammar * llama_grammar_init_impl(
         /* .trigger_buffer = */   "",
         /* .trigger_tokens   = */ {},
         /* .trigger_patterns    = */ {},
+        /* .cache = */            std::make_shared<llama_grammar_cache>(),
+        /* .state_key = */        {},
     };
+
+    llama_grammar_update_state_key(*result);
+
+    return result;
 }
 
 struct llama_grammar * llama_grammar_init_impl(
@@ -1065,7 +1339,7 @@ struct llama_grammar * llama_grammar_init_impl(
     // Important: vec_rules has to be moved here, not copied, because stacks contains
     // pointers to elements of vec_rules. If vec_rules were copied into llama_grammar
     // then the pointers would be invalidated when the local vec_rules goes out of scope.
-    return new llama_grammar {
+    auto * result = new llama_grammar {
         vocab,
         std::move(vec_rules),
         std::move(stacks),
@@ -1075,7 +1349,13 @@ struct llama_grammar * llama_grammar_init_impl(
         /* .trigger_buffer = */   "",
         std::move(vec_trigger_tokens),
         std::move(vec_trigger_patterns),
+        /* .cache = */            std::make_shared<llama_grammar_cache>(),
+        /* .state_key = */        {},
     };
+
+    llama_grammar_update_state_key(*result);
+
+    return result;
 }
 
 void llama_grammar_free_impl(struct llama_grammar * grammar) {
@@ -1097,6 +1377,8 @@ struct llama_grammar * llama_grammar_clone_impl(const struct llama_grammar & gra
         grammar.trigger_buffer,
         grammar.trigger_tokens,
         grammar.trigger_patterns,
+        grammar.cache,
+        grammar.state_key,
     };
 
     // redirect elements in stacks to point to new rules
@@ -1130,6 +1412,23 @@ void llama_grammar_apply_impl(const struct llama_grammar & grammar, llama_token_
         }
     }
 
+    // most of the vocab is sampled when the grammar is applied first or to resample, the mask of the state is computed
+    // for the whole vocab then, otherwise a few candidates are checked directly unless the state is cached
+    if (grammar.cache) {
+        const bool compute = 2*cur_p->size >= (size_t) grammar.vocab->n_tokens();
+
+        const auto mask = llama_grammar_get_mask(grammar, allow_eog, compute);
+        if (mask) {
+            for (size_t i = 0; i < cur_p->size; ++i) {
+                const llama_token id = cur_p->data[i].id;
+                if (!((*mask)[id/64] & (1ull << (id%64)))) {
+                    cur_p->data[i].logit = -INFINITY;
+                }
+            }
+            return;
+        }
+    }
+
     std::vector<std::pair<std::vector<uint32_t>, llama_partial_utf8>> candidates_decoded;
     candidates_decoded.reserve(cur_p->size);
 
@@ -1226,4 +1525,6 @@ void llama_grammar_accept_str(struct llama_grammar & grammar, const std::string
     if (grammar.stacks.empty()) {
         throw std::runtime_error("Unexpected empty grammar stack after accepting piece: " + piece);
     }
+
+    llama_grammar_update_state_key(grammar);
 }
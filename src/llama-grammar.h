@@ -3,11 +3,13 @@
 #include "llama.h"
 
 #include <map>
+#include <memory>
 #include <regex>
 #include <string>
 #include <vector>
 
 struct llama_vocab;
+struct llama_grammar_cache;
 
 // grammar element type
 enum llama_gretype {
@@ -132,6 +134,11 @@ struct llama_grammar {
                              trigger_patterns;         // Regular expressions that trigger a lazy grammar. Must be a full match of the entire generated
                                                        // string, and the grammar will be given the string from the first match group onwards.
 
+    // allowed tokens of the grammar states that were already reached, shared with the clones
+    std::shared_ptr<llama_grammar_cache> cache;
+
+    // key of the current state in the cache, empty if the state changed without accepting a token
+    std::vector<uint32_t> state_key;
 };
 
 //
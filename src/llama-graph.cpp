@@ -428,6 +428,9 @@ void llm_graph_result::reset() {
     t_embd        = nullptr;
     t_embd_pooled = nullptr;
 
+    t_logits_top_k     = nullptr;
+    t_logits_top_k_ids = nullptr;
+
     inputs.clear();
 
     buf_compute_meta.resize(ggml_tensor_overhead()*max_nodes + ggml_graph_overhead_custom(max_nodes, false));
@@ -1754,6 +1757,41 @@ void llm_graph_context::build_pooling(
     ggml_build_forward_expand(gf, cur);
 }
 
+void llm_graph_context::build_top_k_logits() const {
+    ggml_tensor * logits = res->t_logits;
+
+    if (cparams.n_top_k_logits <= 0 || !logits) {
+        return;
+    }
+
+    const int64_t n_vocab   = logits->ne[0];
+    const int64_t n_outputs = logits->ne[1];
+
+    const int k = cparams.n_top_k_logits;
+
+    ggml_tensor * ids;
+    if (k == 1) {
+        ids = ggml_reshape_2d(ctx0, ggml_argmax(ctx0, logits), 1, n_outputs);
+    } else {
+        ids = ggml_cont(ctx0, ggml_top_k(ctx0, logits, k));
+    }
+    cb(ids, "result_top_k_ids", -1);
+
+    ggml_tensor * cur = ggml_get_rows(ctx0, ggml_reshape_3d(ctx0, logits, 1, n_vocab, n_outputs), ids);
+    cur = ggml_reshape_2d(ctx0, cur, k, n_outputs);
+    cb(cur, "result_top_k", -1);
+
+    // the ids are also read by the get_rows, keep them for the output
+    ggml_set_output(ids);
+    ggml_set_output(cur);
+
+    res->t_logits_top_k     = cur;
+    res->t_logits_top_k_ids = ids;
+
+    ggml_build_forward_expand(gf, ids);
+    ggml_build_forward_expand(gf, cur);
+}
+
 int32_t llama_relative_position_bucket(llama_pos x, llama_pos y, uint64_t n_buckets, bool bidirectional) {
     // TODO move to hparams if a T5 variant appears that uses a different value
     const int64_t max_distance = 128;
@@ -454,6 +454,9 @@ public:
     ggml_tensor * get_embd()        const { return t_embd; }
     ggml_tensor * get_embd_pooled() const { return t_embd_pooled; }
 
+    ggml_tensor * get_logits_top_k()     const { return t_logits_top_k; }
+    ggml_tensor * get_logits_top_k_ids() const { return t_logits_top_k_ids; }
+
     ggml_cgraph  * get_gf()  const { return gf; }
     ggml_context * get_ctx() const { return ctx_compute.get(); }
 
@@ -480,6 +483,9 @@ public:
     ggml_tensor * t_embd        = nullptr;
     ggml_tensor * t_embd_pooled = nullptr;
 
+    ggml_tensor * t_logits_top_k     = nullptr; // F32 [n_top_k_logits, n_outputs]
+    ggml_tensor * t_logits_top_k_ids = nullptr; // I32 [n_top_k_logits, n_outputs]
+
     std::vector<llm_graph_input_ptr> inputs;
 
     ggml_context_ptr ctx_compute;
@@ -765,6 +771,13 @@ struct llm_graph_context {
             ggml_tensor * cls_b,
             ggml_tensor * cls_out,
             ggml_tensor * cls_out_b) const;
+
+    //
+    // top-k logits
+    //
+
+    // keep only the cparams.n_top_k_logits largest logits of each output and their tokens
+    void build_top_k_logits() const;
 };
 
 // TODO: better name
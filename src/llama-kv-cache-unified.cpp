@@ -6,6 +6,7 @@
 #include "llama-context.h"
 
 #include <algorithm>
+#include <bitset>
 #include <cassert>
 #include <cmath>
 #include <limits>
@@ -28,9 +29,10 @@ llama_kv_cache_unified::llama_kv_cache_unified(
                  uint32_t    n_seq_max,
                  uint32_t    n_pad,
                  uint32_t    n_swa,
-           llama_swa_type    swa_type) :
+           llama_swa_type    swa_type,
+                 uint32_t    n_block) :
     model(model), hparams(model.hparams), v_trans(v_trans),
-    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), swa_type(swa_type) {
+    n_seq_max(n_seq_max), n_stream(unified ? 1 : n_seq_max), n_pad(n_pad), n_swa(n_swa), n_block(n_block), swa_type(swa_type) {
 
     GGML_ASSERT(kv_size % n_pad == 0);
 
@@ -203,6 +205,23 @@ llama_kv_cache_unified::llama_kv_cache_unified(
     if (!supports_set_rows) {
         LLAMA_LOG_WARN("%s: LLAMA_SET_ROWS=0, using old ggml_cpy() method for backwards compatibility\n", __func__);
     }
+
+    if (this->n_block > 0) {
+        if (!supports_set_rows) {
+            // the cells of a block-allocated ubatch are not continuous in general
+            LLAMA_LOG_WARN("%s: paged KV cache requires ggml_set_rows() - disabling paged mode\n", __func__);
+            this->n_block = 0;
+        } else {
+            this->n_block = std::min(this->n_block, kv_size);
+
+            LLAMA_LOG_INFO("%s: paged mode, block size = %u cells, %u blocks per stream\n",
+                    __func__, this->n_block, (kv_size + this->n_block - 1)/this->n_block);
+        }
+    }
+
+    for (uint32_t s = 0; s < n_stream; ++s) {
+        v_cells[s].set_block_size(this->n_block);
+    }
 }
 
 void llama_kv_cache_unified::clear(bool data) {
@@ -211,6 +230,8 @@ void llama_kv_cache_unified::clear(bool data) {
         v_heads[s] = 0;
     }
 
+    cc_info = {};
+
     if (data) {
         for (auto & buf : bufs) {
             ggml_backend_buffer_clear(buf.get(), 0);
@@ -279,6 +300,8 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
     if (s0 == s1) {
         // since both sequences are in the same stream, no data copy is necessary
         // we just have to update the cells meta data
+        // note: if any of the sequences later modifies the positions of the shared cells, the cells are
+        //       copied at that point (see seq_cow())
 
         auto & cells = v_cells[s0];
 
@@ -294,6 +317,8 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
             p1 = std::numeric_limits<llama_pos>::max();
         }
 
+        bool shared = false;
+
         for (uint32_t i = 0; i < cells.size(); ++i) {
             if (!cells.pos_in(i, p0, p1)) {
                 continue;
@@ -301,9 +326,17 @@ void llama_kv_cache_unified::seq_cp(llama_seq_id seq_id_src, llama_seq_id seq_id
 
             if (cells.seq_has(i, seq_id_src)) {
                 cells.seq_add(i, seq_id_dst);
+
+                shared = true;
             }
         }
 
+        // in paged mode, the new cells of both sequences go to blocks that are not shared
+        if (shared) {
+            cells.seq_block_reset(seq_id_src);
+            cells.seq_block_reset(seq_id_dst);
+        }
+
         return;
     }
 
@@ -399,6 +432,10 @@ void llama_kv_cache_unified::seq_add(llama_seq_id seq_id, llama_pos p0, llama_po
         return;
     }
 
+    if (!seq_cow(seq_id, p0, p1)) {
+        LLAMA_LOG_WARN("%s: not enough free cells for copy-on-write - the shared cells of seq %d will be shifted for all sequences\n", __func__, seq_id);
+    }
+
     for (uint32_t i = 0; i < cells.size(); ++i) {
         if (!cells.pos_in(i, p0, p1)) {
             continue;
@@ -440,6 +477,10 @@ void llama_kv_cache_unified::seq_div(llama_seq_id seq_id, llama_pos p0, llama_po
         return;
     }
 
+    if (!seq_cow(seq_id, p0, p1)) {
+        LLAMA_LOG_WARN("%s: not enough free cells for copy-on-write - the shared cells of seq %d will be divided for all sequences\n", __func__, seq_id);
+    }
+
     for (uint32_t i = 0; i < cells.size(); ++i) {
         if (!cells.pos_in(i, p0, p1)) {
             continue;
@@ -451,6 +492,96 @@ void llama_kv_cache_unified::seq_div(llama_seq_id seq_id, llama_pos p0, llama_po
     }
 }
 
+bool llama_kv_cache_unified::seq_cow(llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
+    auto & cells = v_cells[seq_to_stream[seq_id]];
+
+    // the cells that are shared with other sequences
+    std::vector<uint32_t> shared;
+
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        if (!cells.pos_in(i, p0, p1)) {
+            continue;
+        }
+
+        if (cells.seq_has(i, seq_id) && cells.seq_count(i) > 1) {
+            shared.push_back(i);
+        }
+    }
+
+    if (shared.empty()) {
+        return true;
+    }
+
+    // note: sequences share cells only within a single stream
+    GGML_ASSERT(n_stream == 1);
+
+    // the free cells that will receive the copies
+    std::vector<uint32_t> free;
+
+    free.reserve(shared.size());
+
+    if (n_block > 0) {
+        // in paged mode, the copies go to the blocks of the sequence
+        int32_t  blk  = cells.seq_block(seq_id);
+        uint32_t next = blk >= 0 ? cells.block_head(blk) : 0;
+
+        uint32_t n_taken = 0;
+
+        while (free.size() < shared.size()) {
+            const int32_t idx = cells.block_alloc(blk, next, n_taken);
+            if (idx < 0) {
+                // not enough free blocks - fallback to searching for individual cells
+                free.clear();
+                break;
+            }
+
+            free.push_back(idx);
+        }
+    }
+
+    for (uint32_t i = 0; i < cells.size() && free.size() < shared.size(); ++i) {
+        if (cells.is_empty(i)) {
+            free.push_back(i);
+        }
+    }
+
+    if (free.size() < shared.size()) {
+        return false;
+    }
+
+    LLAMA_LOG_DEBUG("%s: copy-on-write of %zu cells of seq %d\n", __func__, shared.size(), seq_id);
+
+    for (size_t k = 0; k < shared.size(); ++k) {
+        const uint32_t isrc = shared[k];
+        const uint32_t idst = free[k];
+
+        // the data in the source cell does not have the pending shift applied yet
+        // so the copy receives the same pending shift
+        llama_pos pos   = cells.pos_get(isrc);
+        llama_pos shift = cells.get_shift(isrc);
+
+        if (shift != 0) {
+            pos -= shift;
+            assert(pos >= 0);
+        }
+
+        cells.pos_set(idst, pos);
+        cells.seq_add(idst, seq_id);
+        cells.seq_block_set(seq_id, idst);
+
+        if (shift != 0) {
+            cells.pos_add(idst, shift);
+        }
+
+        cells.seq_rm(isrc, seq_id);
+
+        cc_info.isrc.push_back(isrc);
+        cc_info.idst.push_back(idst);
+    }
+
+    return true;
+}
+
 llama_pos llama_kv_cache_unified::seq_pos_min(llama_seq_id seq_id) const {
     GGML_ASSERT(seq_id >= 0 && (size_t) seq_id < seq_to_stream.size());
 
@@ -522,7 +653,9 @@ llama_memory_context_ptr llama_kv_cache_unified::init_update(llama_context * lct
 
         const auto thold = lctx->get_cparams().defrag_thold;
 
-        if (!do_defrag && thold > 0.0f) {
+        // in paged mode the fragmentation is bounded by the partially filled blocks of each sequence,
+        // so we defrag only on explicit request
+        if (!do_defrag && thold > 0.0f && n_block == 0) {
             const auto n_kv = cells.used_max_p1();
 
             // - do not defrag small contexts (i.e. < 2048 tokens)
@@ -541,7 +674,7 @@ llama_memory_context_ptr llama_kv_cache_unified::init_update(llama_context * lct
         }
     }
 
-    return std::make_unique<llama_kv_cache_unified_context>(this, lctx, do_shift, std::move(dinfo), std::move(sc_info));
+    return std::make_unique<llama_kv_cache_unified_context>(this, lctx, do_shift, std::move(dinfo), std::move(sc_info), std::move(cc_info));
 }
 
 llama_kv_cache_unified::slot_info_vec_t llama_kv_cache_unified::prepare(const std::vector<llama_ubatch> & ubatches) {
@@ -613,7 +746,7 @@ llama_kv_cache_unified::slot_info_vec_t llama_kv_cache_unified::prepare(const st
     return res;
 }
 
-bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const defrag_info & dinfo, const stream_copy_info & sc_info) {
+bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const defrag_info & dinfo, const stream_copy_info & sc_info, const cell_copy_info & cc_info) {
     bool updated = false;
 
     auto * sched = lctx->get_sched();
@@ -645,6 +778,36 @@ bool llama_kv_cache_unified::update(llama_context * lctx, bool do_shift, const d
         }
     }
 
+    if (!cc_info.empty()) {
+        LLAMA_LOG_DEBUG("%s: copying %zu KV cells\n", __func__, cc_info.isrc.size());
+
+        // each copy requires 6*n_layer tensors (see build_graph_defrag)
+        const size_t n_max_cpy = std::max<size_t>(1, (lctx->graph_max_nodes() - 2*layers.size())/(6*layers.size()));
+
+        for (size_t i0 = 0; i0 < cc_info.isrc.size(); i0 += n_max_cpy) {
+            const size_t i1 = std::min(i0 + n_max_cpy, cc_info.isrc.size());
+
+            ggml_backend_sched_reset(sched);
+
+            auto * res = lctx->get_gf_res_reserve();
+
+            res->reset();
+
+            auto * gf = build_graph_cpy(res, cc_info, i0, i1);
+            if (!ggml_backend_sched_alloc_graph(sched, gf)) {
+                LLAMA_LOG_ERROR("%s: failed to allocate compute graph for KV cell copy\n", __func__);
+                return updated;
+            }
+
+            if (lctx->graph_compute(gf, false) != GGML_STATUS_SUCCESS) {
+                LLAMA_LOG_ERROR("%s: failed to compute KV cell copy\n", __func__);
+                return updated;
+            }
+        }
+
+        updated = true;
+    }
+
     if (do_shift) {
         if (!get_can_shift()) {
             GGML_ABORT("The current KV cache / model configuration does not support K-shift");
@@ -845,6 +1008,16 @@ llama_kv_cache_unified::slot_info llama_kv_cache_unified::find_slot(const llama_
             return { };
         }
 
+        if (n_block > 0 && !cont) {
+            if (find_slot_paged(ubatch, seq_to_stream[seq_id], s*n_tokens, n_tokens, res.idxs[s])) {
+                continue;
+            }
+
+            // not enough free blocks - fallback to searching for individual cells
+            // this also allows to reuse the cells that are masked by the SWA
+            res.idxs[s].clear();
+        }
+
         uint32_t n_tested = 0;
 
         // for continuous slots, we test that all tokens in the ubatch fit, starting from the current head
@@ -928,6 +1101,43 @@ llama_kv_cache_unified::slot_info llama_kv_cache_unified::find_slot(const llama_
     return res;
 }
 
+bool llama_kv_cache_unified::find_slot_paged(
+        const llama_ubatch & ubatch, uint32_t strm, uint32_t i0, uint32_t n_tokens, slot_info::idx_vec_t & idxs) const {
+    const auto & cells = v_cells[strm];
+
+    // the cells are not modified until apply_ubatch(), so the allocation state of the ubatch is kept here:
+    //   the block of each sequence and its next cell, starting from the cursors of the cells,
+    //   and the number of free blocks that have been taken
+    int32_t  blk [LLAMA_MAX_SEQ];
+    uint32_t next[LLAMA_MAX_SEQ];
+
+    std::bitset<LLAMA_MAX_SEQ> seen;
+
+    uint32_t n_taken = 0;
+
+    idxs.reserve(n_tokens);
+
+    for (uint32_t ii = 0; ii < n_tokens; ++ii) {
+        const llama_seq_id seq_id = ubatch.seq_id[i0 + ii][0];
+
+        if (!seen.test(seq_id)) {
+            seen.set(seq_id);
+
+            blk [seq_id] = cells.seq_block(seq_id);
+            next[seq_id] = blk[seq_id] >= 0 ? cells.block_head(blk[seq_id]) : 0;
+        }
+
+        const int32_t idx = cells.block_alloc(blk[seq_id], next[seq_id], n_taken);
+        if (idx < 0) {
+            return false;
+        }
+
+        idxs.push_back(idx);
+    }
+
+    return true;
+}
+
 void llama_kv_cache_unified::apply_ubatch(const slot_info & sinfo, const llama_ubatch & ubatch) {
     // keep track of the max sequence position that we would overwrite with this ubatch
     // for non-SWA cache, this would be always empty
@@ -962,6 +1172,9 @@ void llama_kv_cache_unified::apply_ubatch(const slot_info & sinfo, const llama_u
             for (int32_t s = 0; s < ubatch.n_seq_id[i]; s++) {
                 cells.seq_add(idx, ubatch.seq_id[i][s]);
             }
+
+            // paged mode: the next tokens of the sequence are placed in the block of this cell
+            cells.seq_block_set(ubatch.seq_id[i][0], idx);
         }
     }
 
@@ -1007,6 +1220,16 @@ uint32_t llama_kv_cache_unified::get_n_stream() const {
     return n_stream;
 }
 
+uint32_t llama_kv_cache_unified::get_n_block() const {
+    return n_block;
+}
+
+const llama_kv_cells_unified & llama_kv_cache_unified::get_cells(uint32_t strm) const {
+    GGML_ASSERT(strm < v_cells.size());
+
+    return v_cells[strm];
+}
+
 bool llama_kv_cache_unified::get_has_shift() const {
     bool result = false;
 
@@ -1514,12 +1737,10 @@ ggml_cgraph * llama_kv_cache_unified::build_graph_defrag(
 
     GGML_ASSERT(n_stream == 1 && "n_stream > 1 does not support defrag");
 
-    const auto & cells = v_cells[0];
+    GGML_UNUSED(lctx);
 
     const auto & ids = dinfo.ids;
 
-    const auto & cparams = lctx->get_cparams();
-
 #if 0
     // CPU defrag
     //
@@ -1604,51 +1825,7 @@ ggml_cgraph * llama_kv_cache_unified::build_graph_defrag(
             nm++;
         }
 
-        for (const auto & layer : layers) {
-            const uint32_t il = layer.il;
-
-            const int64_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
-            const int64_t n_embd_v_gqa = hparams.n_embd_v_gqa(il);
-
-            ggml_tensor * view_k_src = ggml_view_2d(ctx, layer.k,
-                    n_embd_k_gqa, nm,
-                    ggml_row_size(layer.k->type, n_embd_k_gqa),
-                    ggml_row_size(layer.k->type, n_embd_k_gqa*i));
-
-            ggml_tensor * view_k_dst = ggml_view_2d(ctx, layer.k,
-                    n_embd_k_gqa, nm,
-                    ggml_row_size(layer.k->type, n_embd_k_gqa),
-                    ggml_row_size(layer.k->type, n_embd_k_gqa*id));
-
-            ggml_tensor * view_v_src;
-            ggml_tensor * view_v_dst;
-
-            if (cparams.flash_attn) {
-                // NOTE: the V cache is not transposed when using flash attention
-                view_v_src = ggml_view_2d(ctx, layer.v,
-                        n_embd_v_gqa, nm,
-                        ggml_row_size(layer.v->type, n_embd_v_gqa),
-                        ggml_row_size(layer.v->type, n_embd_v_gqa*i));
-
-                view_v_dst = ggml_view_2d(ctx, layer.v,
-                        n_embd_v_gqa, nm,
-                        ggml_row_size(layer.v->type, n_embd_v_gqa),
-                        ggml_row_size(layer.v->type, n_embd_v_gqa*id));
-            } else {
-                view_v_src = ggml_view_2d(ctx, layer.v,
-                        nm, n_embd_v_gqa,
-                        ggml_row_size(layer.v->type, cells.size()),
-                        ggml_row_size(layer.v->type, i));
-
-                view_v_dst = ggml_view_2d(ctx, layer.v,
-                        nm, n_embd_v_gqa,
-                        ggml_row_size(layer.v->type, cells.size()),
-                        ggml_row_size(layer.v->type, id));
-            }
-
-            ggml_build_forward_expand(gf, ggml_cpy(ctx, view_k_src, view_k_dst));
-            ggml_build_forward_expand(gf, ggml_cpy(ctx, view_v_src, view_v_dst));
-        }
+        build_cpy_cells(ctx, gf, i, id, nm);
 
         i += nm - 1;
     }
@@ -1659,6 +1836,85 @@ ggml_cgraph * llama_kv_cache_unified::build_graph_defrag(
     return gf;
 }
 
+ggml_cgraph * llama_kv_cache_unified::build_graph_cpy(
+         llm_graph_result * res,
+     const cell_copy_info & cc_info,
+                   size_t   i0,
+                   size_t   i1) const {
+    auto * ctx = res->get_ctx();
+    auto * gf  = res->get_gf();
+
+    GGML_ASSERT(n_stream == 1 && "n_stream > 1 does not support cell copies");
+
+    for (size_t i = i0; i < i1; ++i) {
+        const uint32_t isrc = cc_info.isrc[i];
+        const uint32_t idst = cc_info.idst[i];
+
+        uint32_t nm = 1;
+
+        // batch the copies of consecutive cells
+        while (i + nm < i1 && cc_info.isrc[i + nm] == isrc + nm && cc_info.idst[i + nm] == idst + nm) {
+            nm++;
+        }
+
+        build_cpy_cells(ctx, gf, isrc, idst, nm);
+
+        i += nm - 1;
+    }
+
+    return gf;
+}
+
+void llama_kv_cache_unified::build_cpy_cells(ggml_context * ctx, ggml_cgraph * gf, uint32_t isrc, uint32_t idst, uint32_t nm) const {
+    const uint32_t kv_size = get_size();
+
+    for (const auto & layer : layers) {
+        const uint32_t il = layer.il;
+
+        const int64_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
+        const int64_t n_embd_v_gqa = hparams.n_embd_v_gqa(il);
+
+        ggml_tensor * view_k_src = ggml_view_2d(ctx, layer.k,
+                n_embd_k_gqa, nm,
+                ggml_row_size(layer.k->type, n_embd_k_gqa),
+                ggml_row_size(layer.k->type, n_embd_k_gqa*isrc));
+
+        ggml_tensor * view_k_dst = ggml_view_2d(ctx, layer.k,
+                n_embd_k_gqa, nm,
+                ggml_row_size(layer.k->type, n_embd_k_gqa),
+                ggml_row_size(layer.k->type, n_embd_k_gqa*idst));
+
+        ggml_tensor * view_v_src;
+        ggml_tensor * view_v_dst;
+
+        if (!v_trans) {
+            // NOTE: the V cache is not transposed when using flash attention
+            view_v_src = ggml_view_2d(ctx, layer.v,
+                    n_embd_v_gqa, nm,
+                    ggml_row_size(layer.v->type, n_embd_v_gqa),
+                    ggml_row_size(layer.v->type, n_embd_v_gqa*isrc));
+
+            view_v_dst = ggml_view_2d(ctx, layer.v,
+                    n_embd_v_gqa, nm,
+                    ggml_row_size(layer.v->type, n_embd_v_gqa),
+                    ggml_row_size(layer.v->type, n_embd_v_gqa*idst));
+        } else {
+            view_v_src = ggml_view_2d(ctx, layer.v,
+                    nm, n_embd_v_gqa,
+                    ggml_row_size(layer.v->type, kv_size),
+                    ggml_row_size(layer.v->type, isrc));
+
+            view_v_dst = ggml_view_2d(ctx, layer.v,
+                    nm, n_embd_v_gqa,
+                    ggml_row_size(layer.v->type, kv_size),
+                    ggml_row_size(layer.v->type, idst));
+        }
+
+        ggml_build_forward_expand(gf, ggml_cpy(ctx, view_k_src, view_k_dst));
+        ggml_build_forward_expand(gf, ggml_cpy(ctx, view_v_src, view_v_dst));
+    }
+}
+
 llama_kv_cache_unified::defrag_info llama_kv_cache_unified::defrag_prepare(int32_t n_max_nodes) const {
     GGML_ASSERT(n_stream == 1 && "n_stream > 1 does not support defrag");
 
@@ -2277,8 +2533,9 @@ llama_kv_cache_unified_context::llama_kv_cache_unified_context(
         llama_context * lctx,
         bool do_shift,
         defrag_info dinfo,
-        stream_copy_info sc_info) : status(LLAMA_MEMORY_STATUS_SUCCESS), kv(kv), lctx(lctx), do_shift(do_shift), dinfo(std::move(dinfo)), sc_info(std::move(sc_info)) {
-    if (!do_shift && this->dinfo.empty() && this->sc_info.empty()) {
+        stream_copy_info sc_info,
+        cell_copy_info cc_info) : status(LLAMA_MEMORY_STATUS_SUCCESS), kv(kv), lctx(lctx), do_shift(do_shift), dinfo(std::move(dinfo)), sc_info(std::move(sc_info)), cc_info(std::move(cc_info)) {
+    if (!do_shift && this->dinfo.empty() && this->sc_info.empty() && this->cc_info.empty()) {
         status = LLAMA_MEMORY_STATUS_NO_UPDATE;
     }
 }
@@ -2306,7 +2563,7 @@ bool llama_kv_cache_unified_context::apply() {
 
     // no ubatches -> this is a KV cache update
     if (ubatches.empty()) {
-        kv->update(lctx, do_shift, dinfo, sc_info);
+        kv->update(lctx, do_shift, dinfo, sc_info, cc_info);
 
         return true;
     }
@@ -45,6 +45,19 @@ public:
         std::vector<uint32_t> sdst;
     };
 
+    // copies of the data of individual cells within a stream, used for copy-on-write of shared cells:
+    //   - the data of cell isrc[i] is copied to cell idst[i]
+    //   - the copies are applied in order
+    struct cell_copy_info {
+        bool empty() const {
+            assert(isrc.size() == idst.size());
+            return isrc.empty();
+        }
+
+        std::vector<uint32_t> isrc;
+        std::vector<uint32_t> idst;
+    };
+
     // for each ubatch, create a slot_info that contains information about where the ubatch should be inserted in the
     //   KV cells. for example, cell indices for each token, such that: token[i] -> goes to cells[idxs[i]]
     struct slot_info {
@@ -104,7 +117,8 @@ public:
                      uint32_t    n_seq_max,
                      uint32_t    n_pad,
                      uint32_t    n_swa,
-               llama_swa_type    swa_type);
+               llama_swa_type    swa_type,
+                     uint32_t    n_block = 0);
 
     ~llama_kv_cache_unified() = default;
 
@@ -146,6 +160,12 @@ public:
     uint32_t get_size()     const;
     uint32_t get_n_stream() const;
 
+    // number of cells per block in paged mode (0 - paged mode disabled)
+    uint32_t get_n_block() const;
+
+    // the cells of a stream (read-only)
+    const llama_kv_cells_unified & get_cells(uint32_t strm) const;
+
     bool get_has_shift() const;
 
     //
@@ -173,13 +193,21 @@ public:
     // return empty vector on failure
     slot_info_vec_t prepare(const std::vector<llama_ubatch> & ubatches);
 
-    bool update(llama_context * lctx, bool do_shift, const defrag_info & dinfo, const stream_copy_info & sc_info);
+    bool update(llama_context * lctx, bool do_shift, const defrag_info & dinfo, const stream_copy_info & sc_info, const cell_copy_info & cc_info);
 
     // find a slot of kv cells that can hold the ubatch
     // if cont == true, then the slot must be continuous
     // return empty slot_info on failure
     slot_info find_slot(const llama_ubatch & ubatch, bool cont) const;
 
+    // paged variant of find_slot() for a single stream:
+    //   the tokens of each sequence are placed in the free cells of the block that the sequence fills
+    //   and when it is full, a new block is taken from the list of free blocks
+    //   both are kept up to date by the cells, so no cells are searched
+    // the tokens [i0, i0 + n_tokens) of the ubatch are placed in idxs
+    // return false if there are not enough free blocks
+    bool find_slot_paged(const llama_ubatch & ubatch, uint32_t strm, uint32_t i0, uint32_t n_tokens, slot_info::idx_vec_t & idxs) const;
+
     // emplace the ubatch context into slot: [sinfo.idxs[0...ubatch.n_tokens - 1]]
     void apply_ubatch(const slot_info & sinfo, const llama_ubatch & ubatch);
 
@@ -225,6 +253,9 @@ private:
     // SWA
     const uint32_t n_swa = 0;
 
+    // paged mode: number of cells per block (0 - disabled)
+    uint32_t n_block = 0;
+
     // env: LLAMA_KV_CACHE_DEBUG
     int debug = 0;
 
@@ -249,6 +280,9 @@ private:
     // pending stream copies that will be applied during the next update
     stream_copy_info sc_info;
 
+    // pending cell copies that will be applied during the next update
+    cell_copy_info cc_info;
+
     std::vector<kv_layer> layers;
 
     // model layer id -> KV cache layer id
@@ -257,6 +291,12 @@ private:
     // return non-empty vector if cells have been moved
     defrag_info defrag_prepare(int32_t n_max_nodes) const;
 
+    // copy-on-write: the cells of seq_id with positions in [p0, p1) that are shared with other sequences
+    //   are detached - their data is copied (during the next update) to free cells that belong only to seq_id
+    // this is used before modifying the positions of the cells of a sequence in-place
+    // return false if there are not enough free cells
+    bool seq_cow(llama_seq_id seq_id, llama_pos p0, llama_pos p1);
+
     size_t total_size() const;
 
     size_t size_k_bytes() const;
@@ -282,6 +322,16 @@ private:
                   llama_context * lctx,
               const defrag_info & dinfo) const;
 
+    // build a graph for the cell copies [i0, i1) of cc_info
+    ggml_cgraph * build_graph_cpy(
+               llm_graph_result * res,
+           const cell_copy_info & cc_info,
+                         size_t   i0,
+                         size_t   i1) const;
+
+    // copy the data of cells [isrc, isrc + nm) to [idst, idst + nm) in all layers
+    void build_cpy_cells(ggml_context * ctx, ggml_cgraph * gf, uint32_t isrc, uint32_t idst, uint32_t nm) const;
+
     struct cell_ranges_t {
         uint32_t strm;
 
@@ -301,6 +351,7 @@ public:
     using slot_info_vec_t  = llama_kv_cache_unified::slot_info_vec_t;
     using defrag_info      = llama_kv_cache_unified::defrag_info;
     using stream_copy_info = llama_kv_cache_unified::stream_copy_info;
+    using cell_copy_info   = llama_kv_cache_unified::cell_copy_info;
 
     // used for errors
     llama_kv_cache_unified_context(llama_memory_status status);
@@ -315,7 +366,8 @@ public:
             llama_context * lctx,
             bool do_shift,
             defrag_info dinfo,
-            stream_copy_info sc_info);
+            stream_copy_info sc_info,
+            cell_copy_info cc_info);
 
     // used to create a batch procesing context from a batch
     llama_kv_cache_unified_context(
@@ -378,6 +430,8 @@ private:
 
     stream_copy_info sc_info;
 
+    cell_copy_info cc_info;
+
     //
     // batch processing context
     //
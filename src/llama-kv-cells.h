@@ -3,6 +3,7 @@
 #include "llama.h"
 #include "llama-cparams.h"
 
+#include <algorithm>
 #include <bitset>
 #include <cassert>
 #include <vector>
@@ -27,6 +28,8 @@ public:
         for (uint32_t s = 0; s < LLAMA_MAX_SEQ; ++s) {
             seq_pos[s].clear();
         }
+
+        reset_blocks();
     }
 
     void reset_shift() {
@@ -76,6 +79,158 @@ public:
         return has_shift;
     }
 
+    // group the cells in blocks of n consecutive cells for the paged allocation in llama_kv_cache_unified::find_slot()
+    // the blocks without any used cells are kept in a free list and each sequence has a cursor in the block that it is
+    // filling, so that taking a cell or a block does not search the cells
+    // n == 0 disables the tracking
+    void set_block_size(uint32_t n) {
+        block_size = n;
+
+        reset_blocks();
+
+        for (const auto i : used) {
+            block_inc(i);
+        }
+    }
+
+    uint32_t get_block_size() const {
+        return block_size;
+    }
+
+    uint32_t n_blocks() const {
+        return block_size == 0 ? 0 : (pos.size() + block_size - 1)/block_size;
+    }
+
+    // the index of the block that contains cell i
+    uint32_t block_of(uint32_t i) const {
+        assert(block_size > 0);
+
+        return i/block_size;
+    }
+
+    // the range of cells [block_begin(b), block_end(b)) that belong to block b
+    uint32_t block_begin(uint32_t b) const {
+        return b*block_size;
+    }
+
+    uint32_t block_end(uint32_t b) const {
+        return std::min<uint32_t>((b + 1)*block_size, pos.size());
+    }
+
+    // number of used cells in block b
+    uint32_t block_n_used(uint32_t b) const {
+        assert(b < blocks_used.size());
+
+        return blocks_used[b];
+    }
+
+    // number of blocks without any used cells
+    uint32_t n_blocks_free() const {
+        return blocks_free.size();
+    }
+
+    // the k-th of the free blocks that are taken by the next allocations, k < n_blocks_free()
+    uint32_t block_free(uint32_t k) const {
+        assert(k < blocks_free.size());
+
+        return blocks_free[blocks_free.size() - 1 - k];
+    }
+
+    // the sequence that fills block b (-1 if none)
+    llama_seq_id block_owner(uint32_t b) const {
+        assert(b < blocks_owner.size());
+
+        return blocks_owner[b];
+    }
+
+    // the first cell of block b that can be free, the cells of the block before it are used
+    uint32_t block_head(uint32_t b) const {
+        assert(b < blocks_head.size());
+
+        return blocks_head[b];
+    }
+
+    // the block that the sequence fills (-1 if none)
+    int32_t seq_block(llama_seq_id seq_id) const {
+        assert(seq_id >= 0 && seq_id < LLAMA_MAX_SEQ);
+
+        return seq_blocks[seq_id];
+    }
+
+    // the next cell of a sequence in paged mode, without modifying the cells:
+    //   blk and next are the block that the sequence fills and its next cell, initialized with seq_block() and
+    //   block_head(), and n_taken is the number of free blocks that were already taken, initialized with 0
+    // return -1 if the block of the sequence is full and there are no free blocks left
+    int32_t block_alloc(int32_t & blk, uint32_t & next, uint32_t & n_taken) const {
+        if (blk >= 0) {
+            const uint32_t end = block_end(blk);
+
+            while (next < end && !is_empty(next)) {
+                ++next;
+            }
+
+            if (next == end) {
+                blk = -1;
+            }
+        }
+
+        if (blk < 0) {
+            if (n_taken == blocks_free.size()) {
+                return -1;
+            }
+
+            blk  = block_free(n_taken++);
+            next = block_begin(blk);
+        }
+
+        return next++;
+    }
+
+    // cell i was given to the sequence: the sequence fills the block of the cell next, unless the block belongs to
+    // another sequence or is an older block of the same sequence
+    // note: call after the cell is used
+    void seq_block_set(llama_seq_id seq_id, uint32_t i) {
+        assert(seq_id >= 0 && seq_id < LLAMA_MAX_SEQ);
+
+        if (block_size == 0) {
+            return;
+        }
+
+        const uint32_t b = block_of(i);
+
+        assert(blocks_used[b] > 0);
+
+        if (blocks_owner[b] < 0) {
+            const int32_t b_last = seq_blocks[seq_id];
+
+            blocks_owner[b] = seq_id;
+            blocks_prev [b] = b_last;
+            blocks_next [b] = -1;
+
+            if (b_last >= 0) {
+                blocks_next[b_last] = b;
+            }
+
+            seq_blocks[seq_id] = b;
+        }
+
+        if (seq_blocks[seq_id] == (int32_t) b && blocks_head[b] == i) {
+            blocks_head[b] = i + 1;
+        }
+    }
+
+    // the sequence stops filling its blocks and takes a free block for its next cell
+    // used when the cells of the sequence are shared with other sequences
+    void seq_block_reset(llama_seq_id seq_id) {
+        assert(seq_id >= 0 && seq_id < LLAMA_MAX_SEQ);
+
+        if (block_size == 0) {
+            return;
+        }
+
+        seq_blocks_release(seq_id);
+    }
+
     // move cell isrc to idst (used during defrag)
     void mv(uint32_t isrc, uint32_t idst) {
         assert(isrc < pos.size());
@@ -92,8 +247,8 @@ public:
         shift[isrc] =  0;
         seq  [isrc].reset();
 
-        used.erase (isrc);
-        used.insert(idst);
+        used_erase (isrc);
+        used_insert(idst);
     }
 
     // copy the state of cells [i, i + n) (used for save/restore the state of the cells)
@@ -142,11 +297,11 @@ public:
             const auto idx = i + j;
 
             if (pos[idx] == -1 && other.pos[j] != -1) {
-                used.insert(i + j);
+                used_insert(i + j);
             }
 
             if (pos[idx] != -1 && other.pos[j] == -1) {
-                used.erase(i + j);
+                used_erase(i + j);
             }
 
             if (pos[idx] != -1) {
@@ -172,11 +327,11 @@ public:
             const auto idx = idxs[j];
 
             if (pos[idx] == -1 && other.pos[j] != -1) {
-                used.insert(idx);
+                used_insert(idx);
             }
 
             if (pos[idx] != -1 && other.pos[j] == -1) {
-                used.erase(idx);
+                used_erase(idx);
             }
 
             if (pos[idx] != -1) {
@@ -205,7 +360,7 @@ public:
         pos[i] = -1;
         shift[i] = 0;
 
-        used.erase(i);
+        used_erase(i);
     }
 
     // note: call only if the cell has seq_id
@@ -223,7 +378,7 @@ public:
             pos[i] = -1;
             shift[i] = 0;
 
-            used.erase(i);
+            used_erase(i);
 
             return true;
         }
@@ -252,7 +407,7 @@ public:
             pos[i] = -1;
             shift[i] = 0;
 
-            used.erase(i);
+            used_erase(i);
 
             return true;
         }
@@ -365,7 +520,7 @@ public:
 
         pos[i] = p;
 
-        used.insert(i);
+        used_insert(i);
     }
 
     // pos[i] = pos[i] + d
@@ -387,7 +542,7 @@ public:
             pos[i] = -1;
             shift[i] = 0;
 
-            used.erase(i);
+            used_erase(i);
 
             return true;
         }
@@ -456,6 +611,153 @@ private:
     //
     std::map<llama_pos, int> seq_pos[LLAMA_MAX_SEQ];
 
+    // number of consecutive cells per block (0 - block tracking disabled)
+    uint32_t block_size = 0;
+
+    // blocks_used[b] is the number of used cells in block b
+    std::vector<uint32_t> blocks_used;
+
+    // stack of the blocks with blocks_used[b] == 0, the top is taken first
+    // blocks_free_pos[b] is the index of block b in the stack (-1 if the block is used)
+    std::vector<uint32_t> blocks_free;
+    std::vector<int32_t>  blocks_free_pos;
+
+    // the blocks that a sequence filled are in a list that ends with its last block, seq_blocks[s]:
+    //   blocks_owner[b] is the sequence that filled block b (-1 if none)
+    //   blocks_prev [b] and blocks_next[b] are the blocks before and after block b in the list (-1 if none)
+    // an empty block is unlinked from the list, so when the last block of a sequence becomes empty, the sequence
+    // fills the previous block again
+    std::vector<llama_seq_id> blocks_owner;
+    std::vector<int32_t>      blocks_prev;
+    std::vector<int32_t>      blocks_next;
+
+    // blocks_head[b] is the first cell of block b that can be free
+    std::vector<uint32_t> blocks_head;
+
+    int32_t seq_blocks[LLAMA_MAX_SEQ];
+
+    void reset_blocks() {
+        const uint32_t nb = n_blocks();
+
+        blocks_used .assign(nb, 0);
+        blocks_owner.assign(nb, -1);
+        blocks_prev .assign(nb, -1);
+        blocks_next .assign(nb, -1);
+        blocks_head .resize(nb);
+
+        // the first blocks are on the top of the stack
+        blocks_free.clear();
+        blocks_free_pos.assign(nb, -1);
+        for (uint32_t b = nb; b-- > 0;) {
+            blocks_head[b] = block_begin(b);
+            blocks_free_push(b);
+        }
+
+        for (uint32_t s = 0; s < LLAMA_MAX_SEQ; ++s) {
+            seq_blocks[s] = -1;
+        }
+    }
+
+    void blocks_free_push(uint32_t b) {
+        assert(blocks_free_pos[b] == -1);
+
+        blocks_free_pos[b] = blocks_free.size();
+        blocks_free.push_back(b);
+    }
+
+    void blocks_free_erase(uint32_t b) {
+        assert(blocks_free_pos[b] >= 0);
+
+        const uint32_t last = blocks_free.back();
+
+        blocks_free[blocks_free_pos[b]] = last;
+        blocks_free_pos[last] = blocks_free_pos[b];
+
+        blocks_free.pop_back();
+        blocks_free_pos[b] = -1;
+    }
+
+    // the blocks of a sequence without cells are filled by other sequences
+    void seq_blocks_release(llama_seq_id s) {
+        for (int32_t b = seq_blocks[s]; b >= 0;) {
+            const int32_t b_prev = blocks_prev[b];
+
+            blocks_owner[b] = -1;
+            blocks_prev [b] = -1;
+            blocks_next [b] = -1;
+
+            b = b_prev;
+        }
+
+        seq_blocks[s] = -1;
+    }
+
+    void block_inc(uint32_t i) {
+        if (block_size == 0) {
+            return;
+        }
+
+        const uint32_t b = block_of(i);
+
+        if (blocks_used[b]++ == 0) {
+            blocks_free_erase(b);
+        }
+    }
+
+    void block_dec(uint32_t i) {
+        if (block_size == 0) {
+            return;
+        }
+
+        const uint32_t b = block_of(i);
+
+        assert(blocks_used[b] > 0);
+
+        blocks_head[b] = std::min(blocks_head[b], i);
+
+        if (--blocks_used[b] > 0) {
+            return;
+        }
+
+        // the empty block goes back to the free list
+        blocks_free_push(b);
+
+        const llama_seq_id s = blocks_owner[b];
+
+        if (s >= 0) {
+            const int32_t b_prev = blocks_prev[b];
+            const int32_t b_next = blocks_next[b];
+
+            if (b_prev >= 0) {
+                blocks_next[b_prev] = b_next;
+            }
+
+            if (b_next >= 0) {
+                blocks_prev[b_next] = b_prev;
+            } else {
+                seq_blocks[s] = b_prev;
+            }
+        }
+
+        blocks_owner[b] = -1;
+        blocks_prev [b] = -1;
+        blocks_next [b] = -1;
+    }
+
+    // helper functions for updating `used` and the block counters together:
+
+    void used_insert(uint32_t i) {
+        if (used.insert(i).second) {
+            block_inc(i);
+        }
+    }
+
+    void used_erase(uint32_t i) {
+        if (used.erase(i) > 0) {
+            block_dec(i);
+        }
+    }
+
     // helper functions for updating `seq_pos`, once cell at a time:
 
     void seq_pos_dec(llama_seq_id s, llama_pos p) {
@@ -464,6 +766,10 @@ private:
 
         if (--it->second == 0) {
             seq_pos[s].erase(it);
+
+            if (seq_pos[s].empty() && block_size > 0) {
+                seq_blocks_release(s);
+            }
         }
     }
 
@@ -2,10 +2,18 @@
 
 #include "ggml.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <future>
+#include <mutex>
+#include <thread>
 
 static const size_t kiB = 1024;
 static const size_t MiB = 1024*kiB;
@@ -501,6 +509,7 @@ llama_model_loader::llama_model_loader(
     llm_kv = LLM_KV(llm_arch_from_string(arch_name));
 
     files.emplace_back(new llama_file(fname.c_str(), "rb"));
+    fnames.emplace_back(fname);
     contexts.emplace_back(ctx);
 
     // Save tensors data offset of the main file.
@@ -569,6 +578,7 @@ llama_model_loader::llama_model_loader(
             }
 
             files.emplace_back(new llama_file(fname_split, "rb"));
+            fnames.emplace_back(fname_split);
             contexts.emplace_back(ctx);
 
             // Save tensors data offset info of the shard.
@@ -743,6 +753,10 @@ const llama_model_loader::llama_tensor_weight & llama_model_loader::require_weig
 struct ggml_tensor * llama_model_loader::get_tensor_meta(const char * name) const {
     const auto * weight = get_weight(name);
     if (!weight) {
+        const auto concat = concat_map.find(name);
+        if (concat != concat_map.end()) {
+            return concat->second.tensor;
+        }
         return nullptr;
     }
     return weight->tensor;
@@ -801,7 +815,8 @@ struct ggml_tensor * llama_model_loader::create_tensor(struct ggml_context * ctx
     if (duplicated) {
         size_data += ggml_nbytes(cur);
     } else {
-        n_created++;
+        const auto concat = concat_map.find(name);
+        n_created += concat != concat_map.end() ? concat->second.parts.size() : 1;
     }
 
     return tensor;
@@ -836,6 +851,71 @@ struct ggml_tensor * llama_model_loader::create_tensor_as_view(struct ggml_conte
     return tensor;
 }
 
+bool llama_model_loader::add_tensor_concat(const std::string & name, const std::vector<std::string> & parts) {
+    if (get_weight(name.c_str()) || concat_map.count(name)) {
+        return false;
+    }
+
+    std::vector<const llama_tensor_weight *> weights;
+    int64_t ne1 = 0;
+    for (const auto & part : parts) {
+        const auto * weight = get_weight(part.c_str());
+        if (!weight) {
+            return false;
+        }
+        const ggml_tensor * t     = weight->tensor;
+        const ggml_tensor * first = weights.empty() ? t : weights.front()->tensor;
+        if (ggml_n_dims(t) > 2 || t->type != first->type || t->ne[0] != first->ne[0]) {
+            return false;
+        }
+        weights.push_back(weight);
+        ne1 += t->ne[1];
+    }
+
+    if (weights.size() < 2) {
+        return false;
+    }
+
+    if (!ctx_concat) {
+        ggml_init_params params = {
+            /*.mem_size   =*/ ggml_tensor_overhead()*n_tensors,
+            /*.mem_buffer =*/ NULL,
+            /*.no_alloc   =*/ true,
+        };
+        ctx_concat.reset(ggml_init(params));
+        if (!ctx_concat) {
+            throw std::runtime_error(format("%s: failed to create ggml context", __func__));
+        }
+    }
+
+    ggml_tensor * tensor = ggml_new_tensor_2d(ctx_concat.get(), weights.front()->tensor->type, weights.front()->tensor->ne[0], ne1);
+    ggml_set_name(tensor, name.c_str());
+
+    concat_map.emplace(name, llama_tensor_concat{ tensor, std::move(weights) });
+
+    return true;
+}
+
+bool llama_model_loader::has_tensor_concat(struct ggml_context * ctx) const {
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (concat_map.count(ggml_get_name(cur))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<const llama_model_loader::llama_tensor_weight *> llama_model_loader::get_weight_parts(const char * name) const {
+    if (const auto * weight = get_weight(name)) {
+        return { weight };
+    }
+    const auto concat = concat_map.find(name);
+    if (concat != concat_map.end()) {
+        return concat->second.parts;
+    }
+    return {};
+}
+
 void llama_model_loader::done_getting_tensors() const {
     if (n_created != n_tensors) {
         throw std::runtime_error(format("%s: wrong number of tensors; expected %d, got %d", __func__, n_tensors, n_created));
@@ -915,6 +995,261 @@ void llama_model_loader::load_data_for(struct ggml_tensor * cur) const {
     }
 }
 
+// returns true if the tensor data of the buffer can be set from multiple threads at once
+// this is the case for host memory and for the buffers of the CPU device, which may convert the data (e.g. repacking)
+static bool llama_buffer_is_cpu(ggml_backend_buffer_t buf) {
+    if (ggml_backend_buffer_is_host(buf)) {
+        return true;
+    }
+    auto * dev = ggml_backend_buft_get_device(ggml_backend_buffer_get_type(buf));
+    return dev && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU;
+}
+
+// loads the data of tensors on a pool of worker threads
+// each worker has its own handles to the split files, so reads to different tensors and files are issued concurrently
+// and the conversions done in ggml_backend_tensor_set (e.g. weight repacking) run in parallel
+// with a single thread, the tensors are loaded on the calling thread when they are pushed
+struct llama_tensor_load_pool {
+    struct job {
+        ggml_tensor * cur;
+        const uint8_t * data; // mmap-ed source data, or nullptr to read from the file
+        uint16_t idx;
+        size_t   offs;
+
+        // weights whose rows are concatenated into cur, the other fields are unused if not nullptr
+        const std::vector<const llama_model_loader::llama_tensor_weight *> * parts = nullptr;
+    };
+
+    // the files are read in chunks of this size, so that the progress is updated and the loading can be cancelled
+    // during the reads of large tensors
+    static constexpr size_t read_chunk_size = 64*1024*1024;
+
+    // buffers that are not host memory (e.g. repacked CPU weights) are set with whole tensors that are staged in memory
+    // first - the workers stage at most this many bytes at the same time, unless a single tensor is larger
+    static constexpr size_t staging_max_size = 1024*1024*1024;
+
+    // mappings: the mmap-ed files to copy the parts of the concatenated tensors from, nullptr to read them from the files
+    llama_tensor_load_pool(const std::vector<std::string> & fnames, const llama_mmaps * mappings, bool check_tensors, int n_threads)
+        : fnames(fnames), mappings(mappings), check_tensors(check_tensors), n_threads(n_threads) {}
+
+    ~llama_tensor_load_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            jobs.clear();
+        }
+        cv_jobs.notify_all();
+        for (auto & worker : workers) {
+            worker.join();
+        }
+    }
+
+    void push(const job & j) {
+        if (n_threads <= 1) {
+            if (!error) {
+                run(j, files_main, read_buf_main);
+            }
+            return;
+        }
+        if (workers.empty()) {
+            for (int i = 0; i < n_threads; ++i) {
+                workers.emplace_back([this] { worker_loop(); });
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(j);
+            n_pending++;
+        }
+        cv_jobs.notify_one();
+    }
+
+    // wait for all jobs to finish, calling progress with the number of bytes loaded by the pool so far
+    // returns false if progress requested cancellation, in which case the remaining jobs are dropped
+    template <typename F>
+    bool wait(F && progress) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (n_pending > 0) {
+            cv_done.wait_for(lock, std::chrono::milliseconds(100));
+            lock.unlock();
+            const bool cont = progress(size_done.load());
+            lock.lock();
+            if (!cont) {
+                n_pending -= jobs.size();
+                jobs.clear();
+                cv_done.wait(lock, [this] { return n_pending == 0; });
+                return false;
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return true;
+    }
+
+    std::vector<ggml_tensor *> invalid; // tensors that failed validation, only read after wait()
+    std::atomic<size_t> size_done{0};
+
+private:
+    using files_t = std::vector<std::unique_ptr<llama_file>>;
+    using buf_t   = std::vector<no_init<uint8_t>>;
+
+    void read_chunked(llama_file & file, uint8_t * dst, size_t n_size, size_t & n_read) {
+        for (size_t offs = 0; offs < n_size; offs += read_chunk_size) {
+            const size_t n = std::min(read_chunk_size, n_size - offs);
+            file.read_raw(dst + offs, n);
+            n_read    += n;
+            size_done += n;
+        }
+    }
+
+    // buffer for the whole tensor, within the staging budget that is shared by the workers
+    uint8_t * stage_acquire(buf_t & buf, size_t n_size) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_staging.wait(lock, [&] { return staging_size == 0 || staging_size + n_size <= staging_max_size; });
+            staging_size += n_size;
+        }
+        buf.resize(n_size);
+        return (uint8_t *) buf.data();
+    }
+
+    void stage_release(buf_t & buf, size_t n_size) {
+        // a worker only keeps a buffer of the size of the chunks between the tensors
+        if (buf.size() > read_chunk_size) {
+            buf_t().swap(buf);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            staging_size -= n_size;
+        }
+        cv_staging.notify_all();
+    }
+
+    void run(const job & j, files_t & files, buf_t & read_buf) {
+        const size_t n_size = ggml_nbytes(j.cur);
+        const bool   host   = ggml_backend_buffer_is_host(j.cur->buffer);
+
+        size_t n_read = 0; // bytes already counted in size_done
+        bool valid = true;
+        try {
+            auto get_file = [&](uint16_t idx) -> llama_file & {
+                auto & file = files.at(idx);
+                if (!file) {
+                    file.reset(new llama_file(fnames.at(idx).c_str(), "rb"));
+                }
+                return *file;
+            };
+
+            if (j.data) {
+                // validation of mmap-ed data is done by the caller
+                ggml_backend_tensor_set(j.cur, j.data, 0, n_size);
+            } else {
+                uint8_t * dst = host ? (uint8_t *) j.cur->data : stage_acquire(read_buf, n_size);
+
+                try {
+                    if (j.parts) {
+                        // the parts are assembled in memory and the tensor is set at once, since the buffer types that
+                        // convert the data (e.g. repacked CPU weights) only support setting whole tensors
+                        size_t offs = 0;
+                        for (const auto * part : *j.parts) {
+                            const size_t n_part = ggml_nbytes(part->tensor);
+                            if (mappings) {
+                                memcpy(dst + offs, (const uint8_t *) mappings->at(part->idx)->addr() + part->offs, n_part);
+                            } else {
+                                auto & file = get_file(part->idx);
+                                file.seek(part->offs, SEEK_SET);
+                                read_chunked(file, dst + offs, n_part, n_read);
+                            }
+                            offs += n_part;
+                        }
+                        GGML_ASSERT(offs == n_size);
+                    } else {
+                        auto & file = get_file(j.idx);
+                        file.seek(j.offs, SEEK_SET);
+                        read_chunked(file, dst, n_size, n_read);
+                    }
+
+                    valid = !check_tensors || ggml_validate_row_data(j.cur->type, dst, n_size);
+                    if (!host) {
+                        ggml_backend_tensor_set(j.cur, dst, 0, n_size);
+                    }
+                } catch (...) {
+                    if (!host) {
+                        stage_release(read_buf, n_size);
+                    }
+                    throw;
+                }
+
+                if (!host) {
+                    stage_release(read_buf, n_size);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            // no point in loading the rest of the tensors
+            n_pending -= jobs.size();
+            jobs.clear();
+        }
+
+        size_done += n_size - n_read;
+        if (!valid) {
+            std::lock_guard<std::mutex> lock(mutex);
+            invalid.push_back(j.cur);
+        }
+    }
+
+    void worker_loop() {
+        files_t files(fnames.size());
+        buf_t   read_buf;
+
+        while (true) {
+            job j;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_jobs.wait(lock, [this] { return stop || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                j = jobs.front();
+                jobs.pop_front();
+            }
+
+            run(j, files, read_buf);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                n_pending--;
+            }
+            cv_done.notify_all();
+        }
+    }
+
+    const std::vector<std::string> & fnames;
+    const llama_mmaps * mappings;
+    const bool check_tensors;
+    const int  n_threads;
+
+    std::vector<std::thread> workers;
+
+    // used by the calling thread with a single thread
+    files_t files_main = files_t(fnames.size());
+    buf_t   read_buf_main;
+
+    std::mutex              mutex;
+    std::condition_variable cv_jobs;
+    std::condition_variable cv_done;
+    std::condition_variable cv_staging;
+    std::deque<job>         jobs;
+    size_t                  n_pending    = 0;
+    size_t                  staging_size = 0; // bytes staged by the workers
+    bool                    stop = false;
+    std::exception_ptr      error;
+};
+
 bool llama_model_loader::load_all_data(
         struct ggml_context * ctx,
         llama_buf_map & bufs,
@@ -1015,21 +1350,67 @@ bool llama_model_loader::load_all_data(
             ggml_backend_name(upload_backend));
     }
 
+    // tensors in CPU buffers are loaded by a pool of threads, the rest is loaded here
+    const int n_load_threads = this->n_load_threads > 0 ? this->n_load_threads : std::clamp<int>(std::thread::hardware_concurrency(), 1, 8);
+    llama_tensor_load_pool load_pool(fnames, use_mmap ? &mappings : nullptr, check_tensors, n_load_threads);
+    size_t size_queued = 0; // bytes handed to the pool, already counted in size_done
+
+    auto progress = [&](size_t pool_done) {
+        return progress_callback((float) (size_done - size_queued + pool_done) / size_data, progress_callback_user_data);
+    };
+
     for (struct ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
         const auto * weight = get_weight(ggml_get_name(cur));
-        if (weight == nullptr) {
+        const auto   concat = weight == nullptr ? concat_map.find(ggml_get_name(cur)) : concat_map.end();
+        if (weight == nullptr && concat == concat_map.end()) {
             // this can happen with split experts models
             continue;
         }
 
         if (progress_callback) {
-            if (!progress_callback((float) size_done / size_data, progress_callback_user_data)) {
+            if (!progress(load_pool.size_done)) {
                 return false;
             }
         }
 
         size_t n_size = ggml_nbytes(cur);
 
+        if (concat != concat_map.end()) {
+            // the parts are assembled in memory and the tensor is set at once, since the buffer types that convert the
+            // data (e.g. repacked CPU weights) only support setting whole tensors
+            GGML_ASSERT(cur->data != nullptr);
+
+            if (llama_buffer_is_cpu(cur->buffer)) {
+                load_pool.push({ cur, nullptr, 0, 0, &concat->second.parts });
+                size_queued += n_size;
+                size_done   += n_size;
+                continue;
+            }
+
+            read_buf.resize(n_size);
+            size_t offs = 0;
+            for (const auto * part : concat->second.parts) {
+                const size_t n_part = ggml_nbytes(part->tensor);
+                if (use_mmap) {
+                    memcpy(read_buf.data() + offs, (const uint8_t *) mappings.at(part->idx)->addr() + part->offs, n_part);
+                } else {
+                    const auto & file = files.at(part->idx);
+                    file->seek(part->offs, SEEK_SET);
+                    file->read_raw(read_buf.data() + offs, n_part);
+                }
+                offs += n_part;
+            }
+            GGML_ASSERT(offs == n_size);
+
+            if (check_tensors && !ggml_validate_row_data(cur->type, read_buf.data(), n_size)) {
+                throw std::runtime_error(format("tensor '%s' has invalid data", ggml_get_name(cur)));
+            }
+            ggml_backend_tensor_set(cur, read_buf.data(), 0, n_size);
+
+            size_done += n_size;
+            continue;
+        }
+
         if (use_mmap) {
             const auto & mapping = mappings.at(weight->idx);
             ggml_backend_buffer_t buf_mmap = nullptr;
@@ -1055,19 +1436,17 @@ bool llama_model_loader::load_all_data(
                 auto & mmap_used = mmaps_used[weight->idx];
                 mmap_used.first  = std::min(mmap_used.first,  weight->offs);
                 mmap_used.second = std::max(mmap_used.second, weight->offs + n_size);
+            } else if (llama_buffer_is_cpu(cur->buffer)) {
+                load_pool.push({ cur, data, weight->idx, weight->offs });
+                size_queued += n_size;
             } else {
                 ggml_backend_tensor_set(cur, data, 0, n_size);
             }
         } else {
             const auto & file = files.at(weight->idx);
-            if (ggml_backend_buffer_is_host(cur->buffer)) {
-                file->seek(weight->offs, SEEK_SET);
-                file->read_raw(cur->data, n_size);
-                if (check_tensors) {
-                    validation_result.emplace_back(std::async(std::launch::async, [cur, n_size] {
-                        return std::make_pair(cur, ggml_validate_row_data(cur->type, cur->data, n_size));
-                    }));
-                }
+            if (llama_buffer_is_cpu(cur->buffer)) {
+                load_pool.push({ cur, nullptr, weight->idx, weight->offs });
+                size_queued += n_size;
             } else {
                 // If upload_backend is valid load the tensor in chunks to pinned memory and upload the buffers asynchronously to the GPU.
                 if (upload_backend) {
@@ -1102,6 +1481,25 @@ bool llama_model_loader::load_all_data(
         size_done += n_size;
     }
 
+    if (!load_pool.wait([&](size_t pool_done) { return !progress_callback || progress(pool_done); })) {
+        return false;
+    }
+    size_queued = 0;
+
+    // with --numa split, move the rows of the weights to the nodes of the threads that multiply them
+    {
+        auto * dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+        auto * numa_split_tensor_fn = dev ? (decltype(ggml_numa_split_tensor) *)
+            ggml_backend_reg_get_proc_address(ggml_backend_dev_backend_reg(dev), "ggml_backend_cpu_numa_split_tensor") : nullptr;
+        if (numa_split_tensor_fn) {
+            for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+                if (cur->buffer && llama_buffer_is_cpu(cur->buffer)) {
+                    numa_split_tensor_fn(cur);
+                }
+            }
+        }
+    }
+
     // free temporary resources used for async uploads
     for (auto * event : events) {
         ggml_backend_event_synchronize(event);
@@ -1114,6 +1512,10 @@ bool llama_model_loader::load_all_data(
 
     // check validation results
     bool validation_failed = false;
+    for (auto * cur : load_pool.invalid) {
+        LLAMA_LOG_ERROR("%s: tensor '%s' has invalid data\n", __func__, ggml_get_name(cur));
+        validation_failed = true;
+    }
     for (auto & future : validation_result) {
         auto result = future.get();
         if (!result.second) {
@@ -1148,6 +1550,219 @@ bool llama_model_loader::load_all_data(
     return true;
 }
 
+void llama_model_loader::skip_data(struct ggml_context * ctx) {
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (!get_weight_parts(ggml_get_name(cur)).empty()) {
+            size_done += ggml_nbytes(cur);
+        }
+    }
+}
+
+//
+// repack cache
+//
+
+static const char     LLAMA_REPACK_CACHE_MAGIC[4] = { 'L', 'R', 'P', 'C' };
+static const uint32_t LLAMA_REPACK_CACHE_VERSION  = 1;
+static const size_t   LLAMA_REPACK_CACHE_ALIGN    = 4096; // start of the data, must be a multiple of the page size
+
+struct llama_repack_cache_header {
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t n_tensors;
+    uint64_t data_offs;
+    uint64_t data_size;
+};
+
+static uint64_t llama_fnv1a(uint64_t hash, const void * data, size_t size) {
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t llama_fnv1a(uint64_t hash, const std::string & str) {
+    // include the terminator so that concatenated strings cannot collide
+    return llama_fnv1a(hash, str.c_str(), str.size() + 1);
+}
+
+std::string llama_model_loader::repack_cache_path(ggml_backend_buffer_type_t buft) const {
+    std::string name = ggml_backend_buft_name(buft);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return fnames.at(0) + "." + name + ".cache";
+}
+
+uint64_t llama_model_loader::repack_cache_key(struct ggml_context * ctx, ggml_backend_buffer_type_t buft) const {
+    uint64_t key = 0xcbf29ce484222325ULL;
+
+    // the converted layout depends on the implementation and on the features of the CPU
+    key = llama_fnv1a(key, ggml_version());
+    key = llama_fnv1a(key, ggml_commit());
+    key = llama_fnv1a(key, ggml_backend_buft_name(buft));
+    if (auto * dev = ggml_backend_buft_get_device(buft)) {
+        auto * reg = ggml_backend_dev_backend_reg(dev);
+        auto * get_features = (ggml_backend_get_features_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_get_features");
+        if (get_features) {
+            for (auto * feature = get_features(reg); feature && feature->name; ++feature) {
+                key = llama_fnv1a(key, feature->name);
+                key = llama_fnv1a(key, feature->value);
+            }
+        }
+    }
+
+    // hashing the contents of the model would take as long as converting it, use the size and modification time of the files instead
+    for (size_t idx = 0; idx < files.size(); ++idx) {
+        std::error_code ec;
+        const int64_t mtime = std::filesystem::last_write_time(fnames.at(idx), ec).time_since_epoch().count();
+        const uint64_t size = files.at(idx)->size();
+        key = llama_fnv1a(key, &mtime, sizeof(mtime));
+        key = llama_fnv1a(key, &size,  sizeof(size));
+    }
+
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        key = llama_fnv1a(key, ggml_get_name(cur));
+        key = llama_fnv1a(key, &cur->type, sizeof(cur->type));
+        key = llama_fnv1a(key, cur->ne, sizeof(cur->ne));
+        for (const auto * weight : get_weight_parts(ggml_get_name(cur))) {
+            key = llama_fnv1a(key, &weight->idx,  sizeof(weight->idx));
+            key = llama_fnv1a(key, &weight->offs, sizeof(weight->offs));
+        }
+    }
+
+    return key;
+}
+
+ggml_backend_buffer_t llama_model_loader::load_repack_cache(struct ggml_context * ctx, ggml_backend_buffer_type_t buft, llama_mmaps & cache_mappings) const {
+    if (!llama_mmap::SUPPORTED) {
+        return nullptr;
+    }
+
+    auto * dev = ggml_backend_buft_get_device(buft);
+    if (!dev) {
+        return nullptr;
+    }
+    auto * buffer_from_ptr = (ggml_backend_extra_buffer_from_ptr_t)
+        ggml_backend_reg_get_proc_address(ggml_backend_dev_backend_reg(dev), "ggml_backend_extra_buffer_from_ptr");
+    if (!buffer_from_ptr) {
+        return nullptr;
+    }
+
+    const std::string path = repack_cache_path(buft);
+    if (!std::filesystem::exists(path)) {
+        return nullptr;
+    }
+
+    std::vector<ggml_tensor *> tensors;
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (cur->view_src == nullptr) {
+            tensors.push_back(cur);
+        }
+    }
+
+    std::unique_ptr<llama_mmap> mapping;
+    llama_repack_cache_header header;
+    std::vector<uint64_t> offsets;
+    try {
+        llama_file file(path.c_str(), "rb");
+        file.read_raw(&header, sizeof(header));
+        if (memcmp(header.magic, LLAMA_REPACK_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != LLAMA_REPACK_CACHE_VERSION ||
+            header.key != repack_cache_key(ctx, buft) ||
+            header.n_tensors != tensors.size() ||
+            header.data_offs % LLAMA_REPACK_CACHE_ALIGN != 0 ||
+            header.data_offs + header.data_size > file.size()) {
+            LLAMA_LOG_INFO("%s: repack cache %s is stale, it will be rebuilt\n", __func__, path.c_str());
+            return nullptr;
+        }
+        offsets.resize(header.n_tensors);
+        file.read_raw(offsets.data(), offsets.size()*sizeof(uint64_t));
+        mapping = std::make_unique<llama_mmap>(&file);
+    } catch (const std::exception & e) {
+        LLAMA_LOG_WARN("%s: failed to read repack cache %s: %s\n", __func__, path.c_str(), e.what());
+        return nullptr;
+    }
+
+    uint8_t * base = (uint8_t *) mapping->addr() + header.data_offs;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        if (offsets[i] + ggml_backend_buft_get_alloc_size(buft, tensors[i]) > header.data_size) {
+            LLAMA_LOG_WARN("%s: repack cache %s is corrupted\n", __func__, path.c_str());
+            return nullptr;
+        }
+    }
+
+    ggml_backend_buffer_t buf = buffer_from_ptr(buft, base, header.data_size);
+    if (!buf) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        if (ggml_backend_tensor_alloc(buf, tensors[i], base + offsets[i]) != GGML_STATUS_SUCCESS) {
+            ggml_backend_buffer_free(buf);
+            throw std::runtime_error(format("failed to initialize tensor '%s' from the repack cache", ggml_get_name(tensors[i])));
+        }
+    }
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (cur->view_src != nullptr) {
+            ggml_backend_view_init(cur);
+        }
+    }
+
+    LLAMA_LOG_INFO("%s: using repack cache %s (%.2f MiB)\n", __func__, path.c_str(), header.data_size/1024.0/1024.0);
+
+    cache_mappings.emplace_back(std::move(mapping));
+
+    return buf;
+}
+
+void llama_model_loader::save_repack_cache(struct ggml_context * ctx, ggml_backend_buffer_t buf) const {
+    ggml_backend_buffer_type_t buft = ggml_backend_buffer_get_type(buf);
+    const uint8_t * base = (const uint8_t *) ggml_backend_buffer_get_base(buf);
+
+    std::vector<uint64_t> offsets;
+    for (ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
+        if (cur->view_src != nullptr) {
+            continue;
+        }
+        if (cur->buffer != buf) {
+            // the tensors are spread over several buffers
+            return;
+        }
+        offsets.push_back((const uint8_t *) cur->data - base);
+    }
+
+    llama_repack_cache_header header;
+    memcpy(header.magic, LLAMA_REPACK_CACHE_MAGIC, sizeof(header.magic));
+    header.version   = LLAMA_REPACK_CACHE_VERSION;
+    header.key       = repack_cache_key(ctx, buft);
+    header.n_tensors = offsets.size();
+    header.data_offs = GGML_PAD(sizeof(header) + offsets.size()*sizeof(uint64_t), LLAMA_REPACK_CACHE_ALIGN);
+    header.data_size = ggml_backend_buffer_get_size(buf);
+
+    // write to a temporary file first so that concurrent loads never see a partial cache
+    const std::string path     = repack_cache_path(buft);
+    const std::string path_tmp = path + ".tmp";
+    try {
+        {
+            llama_file file(path_tmp.c_str(), "wb");
+            file.write_raw(&header, sizeof(header));
+            file.write_raw(offsets.data(), offsets.size()*sizeof(uint64_t));
+            const std::vector<uint8_t> pad(header.data_offs - file.tell(), 0);
+            file.write_raw(pad.data(), pad.size());
+            file.write_raw(base, header.data_size);
+        }
+        std::filesystem::rename(path_tmp, path);
+    } catch (const std::exception & e) {
+        LLAMA_LOG_WARN("%s: failed to write repack cache %s: %s\n", __func__, path.c_str(), e.what());
+        std::error_code ec;
+        std::filesystem::remove(path_tmp, ec);
+        return;
+    }
+
+    LLAMA_LOG_INFO("%s: saved repack cache %s (%.2f MiB)\n", __func__, path.c_str(), header.data_size/1024.0/1024.0);
+}
+
 std::string llama_model_loader::ftype_name() const {
     return llama_model_ftype_name(ftype);
 }
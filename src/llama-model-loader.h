@@ -44,6 +44,13 @@ struct llama_model_loader {
         }
     };
 
+    // A tensor made of the rows of several weights of the model, concatenated at load time
+    struct llama_tensor_concat {
+        ggml_tensor * tensor; // metadata of the concatenated tensor
+
+        std::vector<const llama_tensor_weight *> parts;
+    };
+
     // custom comparator to sort weights more nicely by layer
     struct weight_name_comparer {
         bool operator()(const std::string & a, const std::string & b) const {
@@ -71,13 +78,18 @@ struct llama_model_loader {
     bool use_mmap = false;
     bool check_tensors;
 
+    int n_load_threads = 0; // see llama_model_params::n_load_threads
+
     llama_files files;
+    std::vector<std::string> fnames; // paths of the split files, used to open additional handles for parallel reads
     llama_ftype ftype;
     llama_fver  fver;
 
     llama_mmaps mappings;
 
     std::map<std::string, llama_tensor_weight, weight_name_comparer> weights_map;
+    std::map<std::string, llama_tensor_concat> concat_map;
+    ggml_context_ptr ctx_concat; // metadata of the tensors in concat_map
     std::unordered_map<std::string, llama_model_kv_override> kv_overrides;
     const llama_model_tensor_buft_override * tensor_buft_overrides;
 
@@ -146,6 +158,13 @@ struct llama_model_loader {
 
     struct ggml_tensor * create_tensor_as_view(struct ggml_context * ctx, struct ggml_tensor * base, const std::string & name, const std::initializer_list<int64_t> & ne, size_t offset, bool required = true);
 
+    // make the weight `name` available as the concatenation of the rows of the weights `parts`, which are then not loaded on their own
+    // the parts must be matrices of the same type and number of columns, returns false if they are missing or cannot be concatenated
+    bool add_tensor_concat(const std::string & name, const std::vector<std::string> & parts);
+
+    // true if ctx contains tensors that are not stored as one block in the model files
+    bool has_tensor_concat(struct ggml_context * ctx) const;
+
     void done_getting_tensors() const;
 
     void init_mappings(bool prefetch = true, llama_mlocks * mlock_mmaps = nullptr);
@@ -163,7 +182,26 @@ struct llama_model_loader {
             llama_progress_callback progress_callback,
             void * progress_callback_user_data);
 
+    // account for the data of the tensors in ctx as loaded, without loading it
+    void skip_data(struct ggml_context * ctx);
+
+    // cache of the weights converted by a CPU extra buffer type (e.g. repacked), stored next to the model
+    // the cache is keyed by the model files, the tensors in ctx, the ggml version and the CPU features
+    std::string repack_cache_path(ggml_backend_buffer_type_t buft) const;
+
+    // returns a buffer over the mmap-ed cache with the tensors of ctx allocated in it, or nullptr if there is no valid cache
+    ggml_backend_buffer_t load_repack_cache(struct ggml_context * ctx, ggml_backend_buffer_type_t buft, llama_mmaps & cache_mappings) const;
+
+    // write the data of the tensors of ctx, which must be allocated in buf, to the cache
+    void save_repack_cache(struct ggml_context * ctx, ggml_backend_buffer_t buf) const;
+
     std::string ftype_name() const;
 
     void print_info() const;
+
+private:
+    uint64_t repack_cache_key(struct ggml_context * ctx, ggml_backend_buffer_type_t buft) const;
+
+    // the weights in the model files that hold the data of the tensor, empty if the tensor is not in the model files
+    std::vector<const llama_tensor_weight *> get_weight_parts(const char * name) const;
 };
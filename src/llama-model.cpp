@@ -2037,6 +2037,24 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
             return ml.create_tensor(ctx, tn, ne, flags);
         };
 
+        // weight made of the rows of the weights `parts`, either stored as such in the model or concatenated at load time
+        // when requested, returns nullptr otherwise
+        auto create_tensor_concat = [&](const LLM_TN_IMPL & tn, const std::vector<LLM_TN_IMPL> & parts, const std::initializer_list<int64_t> & ne) -> ggml_tensor * {
+            if (!ml.get_tensor_meta(tn.str().c_str())) {
+                if (!params.fuse_weights) {
+                    return nullptr;
+                }
+                std::vector<std::string> names;
+                for (const auto & part : parts) {
+                    names.push_back(part.str());
+                }
+                if (!ml.add_tensor_concat(tn.str(), names)) {
+                    return nullptr;
+                }
+            }
+            return create_tensor(tn, ne, 0);
+        };
+
         layers.resize(n_layer);
 
         // TODO: move to a separate function
@@ -2064,9 +2082,23 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
 
                         layer.attn_norm = create_tensor(tn(LLM_TENSOR_ATTN_NORM, "weight", i), {n_embd}, 0);
 
-                        layer.wq = create_tensor(tn(LLM_TENSOR_ATTN_Q,   "weight", i), {n_embd, n_embd_head_k * n_head}, 0);
-                        layer.wk = create_tensor(tn(LLM_TENSOR_ATTN_K,   "weight", i), {n_embd, n_embd_k_gqa}, 0);
-                        layer.wv = create_tensor(tn(LLM_TENSOR_ATTN_V,   "weight", i), {n_embd, n_embd_v_gqa}, 0);
+                        auto has_bias = [&](llm_tensor t) {
+                            return ml.get_tensor_meta(tn(t, "bias", i).str().c_str()) != nullptr;
+                        };
+
+                        // Q, K and V computed with one matrix multiplication, only without biases
+                        if (arch == LLM_ARCH_LLAMA &&
+                            !has_bias(LLM_TENSOR_ATTN_Q) && !has_bias(LLM_TENSOR_ATTN_K) && !has_bias(LLM_TENSOR_ATTN_V)) {
+                            layer.wqkv = create_tensor_concat(tn(LLM_TENSOR_ATTN_QKV, "weight", i),
+                                    { tn(LLM_TENSOR_ATTN_Q, "weight", i), tn(LLM_TENSOR_ATTN_K, "weight", i), tn(LLM_TENSOR_ATTN_V, "weight", i) },
+                                    {n_embd, n_embd_head_k * n_head + n_embd_k_gqa + n_embd_v_gqa});
+                        }
+
+                        if (!layer.wqkv) {
+                            layer.wq = create_tensor(tn(LLM_TENSOR_ATTN_Q,   "weight", i), {n_embd, n_embd_head_k * n_head}, 0);
+                            layer.wk = create_tensor(tn(LLM_TENSOR_ATTN_K,   "weight", i), {n_embd, n_embd_k_gqa}, 0);
+                            layer.wv = create_tensor(tn(LLM_TENSOR_ATTN_V,   "weight", i), {n_embd, n_embd_v_gqa}, 0);
+                        }
                         layer.wo = create_tensor(tn(LLM_TENSOR_ATTN_OUT, "weight", i), {n_embd_head_k * n_head, n_embd}, 0);
 
                         // optional bias tensors
@@ -2086,9 +2118,18 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
                         }
 
                         if (n_expert == 0) {
-                            layer.ffn_gate = create_tensor(tn(LLM_TENSOR_FFN_GATE, "weight", i), {n_embd,   n_ff}, 0);
+                            // gate and up computed with one matrix multiplication, only without biases
+                            if (arch == LLM_ARCH_LLAMA && !has_bias(LLM_TENSOR_FFN_GATE) && !has_bias(LLM_TENSOR_FFN_UP)) {
+                                layer.ffn_gate_up = create_tensor_concat(tn(LLM_TENSOR_FFN_GATE_UP, "weight", i),
+                                        { tn(LLM_TENSOR_FFN_GATE, "weight", i), tn(LLM_TENSOR_FFN_UP, "weight", i) },
+                                        {n_embd, 2*n_ff});
+                            }
+
+                            if (!layer.ffn_gate_up) {
+                                layer.ffn_gate = create_tensor(tn(LLM_TENSOR_FFN_GATE, "weight", i), {n_embd,   n_ff}, 0);
+                                layer.ffn_up   = create_tensor(tn(LLM_TENSOR_FFN_UP,   "weight", i), {n_embd,   n_ff}, 0);
+                            }
                             layer.ffn_down = create_tensor(tn(LLM_TENSOR_FFN_DOWN, "weight", i), {  n_ff, n_embd}, 0);
-                            layer.ffn_up   = create_tensor(tn(LLM_TENSOR_FFN_UP,   "weight", i), {n_embd,   n_ff}, 0);
 
                             // optional MLP bias
                             layer.ffn_gate_b = create_tensor(tn(LLM_TENSOR_FFN_GATE, "bias", i), {n_ff}, TENSOR_NOT_REQUIRED);
@@ -5172,6 +5213,10 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
     const size_t n_max_backend_buffer = ctx_map.size() * ml.files.size();
     pimpl->bufs.reserve(n_max_backend_buffer);
 
+    // contexts of CPU extra buffer types that use the repack cache
+    // true: the tensors were restored from the cache, false: the cache is written after loading the tensors
+    std::map<ggml_context *, bool> ctx_repack_cache;
+
     for (auto & it : ctx_map) {
         ggml_backend_buffer_type_t buft = it.first;
         ggml_context * ctx              = it.second;
@@ -5198,7 +5243,12 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
         bool buffer_from_host_ptr_supported = props.caps.buffer_from_host_ptr;
         bool is_default_buft = buft == ggml_backend_dev_buffer_type(dev);
 
-        if (ml.use_mmap && use_mmap_buffer && buffer_from_host_ptr_supported && is_default_buft) {
+        // the weights converted by CPU extra buffer types (e.g. repacked) can be restored from a cache file
+        bool use_repack_cache = params.repack_cache && !is_default_buft && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU;
+        ggml_backend_buffer_t buf_cache = use_repack_cache ? ml.load_repack_cache(ctx, buft, pimpl->mappings) : nullptr;
+
+        // the concatenated weights are not stored as one block in the files and cannot be mapped
+        if (ml.use_mmap && use_mmap_buffer && buffer_from_host_ptr_supported && is_default_buft && !ml.has_tensor_concat(ctx)) {
             for (uint32_t idx = 0; idx < ml.files.size(); idx++) {
                 // only the mmap region containing the tensors in the model is mapped to the backend buffer
                 // this is important for metal with apple silicon: if the entire model could be mapped to a metal buffer, then we could just use metal for all layers
@@ -5218,7 +5268,17 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
                 buf_map.emplace(idx, buf);
             }
         }
+        else if (buf_cache) {
+            pimpl->bufs.emplace_back(buf_cache);
+            for (uint32_t idx = 0; idx < ml.files.size(); idx++) {
+                buf_map.emplace(idx, buf_cache);
+            }
+            ctx_repack_cache[ctx] = true;
+        }
         else {
+            if (use_repack_cache) {
+                ctx_repack_cache[ctx] = false;
+            }
             ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
             if (buf == nullptr) {
                 throw std::runtime_error(format("unable to allocate %s buffer", ggml_backend_buft_name(buft)));
@@ -5275,12 +5335,25 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
     }
 
     // load tensor data
+    // the tensors restored from the repack cache are accounted first, so that the last call to load_all_data does the final cleanup
+    for (const auto & [ctx, cached] : ctx_repack_cache) {
+        if (cached) {
+            ml.skip_data(ctx);
+        }
+    }
     for (auto & it : ctx_bufs) {
         ggml_context * ctx = it.first;
         auto & bufs = it.second;
+        const auto repack_cache = ctx_repack_cache.find(ctx);
+        if (repack_cache != ctx_repack_cache.end() && repack_cache->second) {
+            continue;
+        }
         if (!ml.load_all_data(ctx, bufs, use_mlock ? &pimpl->mlock_mmaps : NULL, params.progress_callback, params.progress_callback_user_data)) {
             return false;
         }
+        if (repack_cache != ctx_repack_cache.end()) {
+            ml.save_repack_cache(ctx, bufs.at(0));
+        }
     }
 
     if (use_mmap_buffer) {
@@ -5609,30 +5682,44 @@ struct llm_build_llama : public llm_graph_context {
                 ggml_tensor * rope_factors = model.get_rope_factors(cparams, il);
 
                 // compute Q and K and RoPE them
-                ggml_tensor * Qcur = build_lora_mm(model.layers[il].wq, cur);
-                cb(Qcur, "Qcur", il);
-                if (model.layers[il].bq) {
-                    Qcur = ggml_add(ctx0, Qcur, model.layers[il].bq);
+                ggml_tensor * Qcur = nullptr;
+                ggml_tensor * Kcur = nullptr;
+                ggml_tensor * Vcur = nullptr;
+
+                if (model.layers[il].wqkv) {
+                    cur = build_lora_mm(model.layers[il].wqkv, cur);
+                    cb(cur, "wqkv", il);
+
+                    Qcur = ggml_view_3d(ctx0, cur, n_embd_head, n_head,    n_tokens, n_embd_head*sizeof(float), cur->nb[1], 0);
+                    Kcur = ggml_view_3d(ctx0, cur, n_embd_head, n_head_kv, n_tokens, n_embd_head*sizeof(float), cur->nb[1], n_embd_head*n_head*sizeof(float));
+                    Vcur = ggml_cont(ctx0, ggml_view_2d(ctx0, cur, n_embd_head*n_head_kv, n_tokens, cur->nb[1], n_embd_head*(n_head + n_head_kv)*sizeof(float)));
+                    Vcur = ggml_reshape_3d(ctx0, Vcur, n_embd_head, n_head_kv, n_tokens);
+                } else {
+                    Qcur = build_lora_mm(model.layers[il].wq, cur);
                     cb(Qcur, "Qcur", il);
-                }
+                    if (model.layers[il].bq) {
+                        Qcur = ggml_add(ctx0, Qcur, model.layers[il].bq);
+                        cb(Qcur, "Qcur", il);
+                    }
 
-                ggml_tensor * Kcur = build_lora_mm(model.layers[il].wk, cur);
-                cb(Kcur, "Kcur", il);
-                if (model.layers[il].bk) {
-                    Kcur = ggml_add(ctx0, Kcur, model.layers[il].bk);
+                    Kcur = build_lora_mm(model.layers[il].wk, cur);
                     cb(Kcur, "Kcur", il);
-                }
+                    if (model.layers[il].bk) {
+                        Kcur = ggml_add(ctx0, Kcur, model.layers[il].bk);
+                        cb(Kcur, "Kcur", il);
+                    }
 
-                ggml_tensor * Vcur = build_lora_mm(model.layers[il].wv, cur);
-                cb(Vcur, "Vcur", il);
-                if (model.layers[il].bv) {
-                    Vcur = ggml_add(ctx0, Vcur, model.layers[il].bv);
+                    Vcur = build_lora_mm(model.layers[il].wv, cur);
                     cb(Vcur, "Vcur", il);
-                }
+                    if (model.layers[il].bv) {
+                        Vcur = ggml_add(ctx0, Vcur, model.layers[il].bv);
+                        cb(Vcur, "Vcur", il);
+                    }
 
-                Qcur = ggml_reshape_3d(ctx0, Qcur, n_embd_head, n_head,    n_tokens);
-                Kcur = ggml_reshape_3d(ctx0, Kcur, n_embd_head, n_head_kv, n_tokens);
-                Vcur = ggml_reshape_3d(ctx0, Vcur, n_embd_head, n_head_kv, n_tokens);
+                    Qcur = ggml_reshape_3d(ctx0, Qcur, n_embd_head, n_head,    n_tokens);
+                    Kcur = ggml_reshape_3d(ctx0, Kcur, n_embd_head, n_head_kv, n_tokens);
+                    Vcur = ggml_reshape_3d(ctx0, Vcur, n_embd_head, n_head_kv, n_tokens);
+                }
 
                 Qcur = ggml_rope_ext(
                         ctx0, Qcur, inp_pos, rope_factors,
@@ -5672,12 +5759,21 @@ struct llm_build_llama : public llm_graph_context {
                         LLM_NORM_RMS, il);
                 cb(cur, "ffn_norm", il);
 
-                cur = build_ffn(cur,
-                        model.layers[il].ffn_up,   model.layers[il].ffn_up_b,   NULL,
-                        model.layers[il].ffn_gate, model.layers[il].ffn_gate_b, NULL,
-                        model.layers[il].ffn_down, model.layers[il].ffn_down_b, NULL,
-                        NULL,
-                        LLM_FFN_SILU, LLM_FFN_PAR, il);
+                if (model.layers[il].ffn_gate_up) {
+                    cur = build_ffn(cur,
+                            model.layers[il].ffn_gate_up, NULL, NULL,
+                            NULL,                         NULL, NULL,
+                            model.layers[il].ffn_down, model.layers[il].ffn_down_b, NULL,
+                            NULL,
+                            LLM_FFN_SWIGLU, LLM_FFN_SEQ, il);
+                } else {
+                    cur = build_ffn(cur,
+                            model.layers[il].ffn_up,   model.layers[il].ffn_up_b,   NULL,
+                            model.layers[il].ffn_gate, model.layers[il].ffn_gate_b, NULL,
+                            model.layers[il].ffn_down, model.layers[il].ffn_down_b, NULL,
+                            NULL,
+                            LLM_FFN_SILU, LLM_FFN_PAR, il);
+                }
                 cb(cur, "ffn_out", il);
             } else {
                 // MoE branch
@@ -17075,7 +17171,8 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 n_ctx_per_stream,
                                 cparams.n_seq_max,
                                 cparams.n_ubatch,
-                                padding);
+                                padding,
+                                cparams.kv_block_size);
                     } else {
                         GGML_ASSERT(!hparams.is_swa_any());
 
@@ -17091,7 +17188,8 @@ llama_memory_i * llama_model::create_memory(const llama_memory_params & params,
                                 cparams.n_seq_max,
                                 padding,
                                 hparams.n_swa,
-                                hparams.swa_type);
+                                hparams.swa_type,
+                                cparams.kv_block_size);
                     }
                 }
             }
@@ -17438,6 +17536,9 @@ ggml_cgraph * llama_model::build_graph(const llm_graph_params & params) const {
     // add on pooling layer
     llm->build_pooling(cls, cls_b, cls_out, cls_out_b);
 
+    // select the top-k of the logits
+    llm->build_top_k_logits();
+
     return llm->res->get_gf();
 }
 
@@ -17456,10 +17557,13 @@ llama_model_params llama_model_default_params() {
         /*.progress_callback           =*/ nullptr,
         /*.progress_callback_user_data =*/ nullptr,
         /*.kv_overrides                =*/ nullptr,
+        /*.n_load_threads              =*/ 0,
         /*.vocab_only                  =*/ false,
         /*.use_mmap                    =*/ true,
         /*.use_mlock                   =*/ false,
         /*.check_tensors               =*/ false,
+        /*.repack_cache                =*/ false,
+        /*.fuse_weights                =*/ false,
     };
 
 #ifdef GGML_USE_METAL
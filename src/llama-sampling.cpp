@@ -377,18 +377,45 @@ void llama_sampler_free(struct llama_sampler * smpl) {
 }
 
 llama_token llama_sampler_sample(struct llama_sampler * smpl, struct llama_context * ctx, int32_t idx) {
-    const auto * logits = llama_get_logits_ith(ctx, idx);
+    // TODO: do not allocate each time
+    std::vector<llama_token_data> cur;
 
-    const llama_model * model = llama_get_model(ctx);
-    const llama_vocab * vocab = llama_model_get_vocab(model);
+    if (llama_n_top_k_logits(ctx) > 0) {
+        // only the top-k candidates are output by the graph
+        const llama_token * tokens = nullptr;
+        const float       * logits = nullptr;
 
-    const int n_vocab = llama_vocab_n_tokens(vocab);
+        const int32_t n = llama_get_logits_top_k_ith(ctx, idx, &tokens, &logits);
 
-    // TODO: do not allocate each time
-    std::vector<llama_token_data> cur;
-    cur.reserve(n_vocab);
-    for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
-        cur.emplace_back(llama_token_data{token_id, logits[token_id], 0.0f});
+        cur.reserve(n);
+        for (int32_t i = 0; i < n; i++) {
+            cur.emplace_back(llama_token_data{tokens[i], logits[i], 0.0f});
+        }
+    } else {
+        const auto * logits = llama_get_logits_ith(ctx, idx);
+
+        const llama_model * model = llama_get_model(ctx);
+        const llama_vocab * vocab = llama_model_get_vocab(model);
+
+        const int n_vocab = llama_vocab_n_tokens(vocab);
+
+        {
+            llama_token_data_array cur_p;
+            if (llama_sampler_chain_apply_logits(smpl, logits, n_vocab, &cur_p)) {
+                GGML_ASSERT(cur_p.selected >= 0 && cur_p.selected < (int32_t) cur_p.size);
+
+                auto token = cur_p.data[cur_p.selected].id;
+
+                llama_sampler_accept(smpl, token);
+
+                return token;
+            }
+        }
+
+        cur.reserve(n_vocab);
+        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+            cur.emplace_back(llama_token_data{token_id, logits[token_id], 0.0f});
+        }
     }
 
     llama_token_data_array cur_p = {
@@ -483,10 +510,12 @@ struct llama_sampler * llama_sampler_chain_init(struct llama_sampler_chain_param
     return llama_sampler_init(
         /* .iface = */ &llama_sampler_chain_i,
         /* .ctx   = */ new llama_sampler_chain {
-            /* .params      = */ params,
-            /* .samplers    = */ {},
-            /* .t_sample_us = */ 0,
-            /* .n_sample    = */ 0,
+            /* .params       = */ params,
+            /* .samplers     = */ {},
+            /* .t_sample_us  = */ 0,
+            /* .n_sample     = */ 0,
+            /* .cur          = */ {},
+            /* .cur_modified = */ {},
         }
     );
 }
@@ -1470,6 +1499,11 @@ static void llama_sampler_grammar_reset(struct llama_sampler * smpl) {
                                                  ctx->grammar->lazy, trigger_patterns_c.data(), trigger_patterns_c.size(),
                                                  ctx->grammar->trigger_tokens.data(), ctx->grammar->trigger_tokens.size());
 
+    // same rules, the allowed tokens of the states are kept
+    if (grammar_new) {
+        grammar_new->cache = ctx->grammar->cache;
+    }
+
     llama_grammar_free_impl(ctx->grammar);
     ctx->grammar = grammar_new;
 }
@@ -2512,6 +2546,186 @@ struct llama_sampler * llama_sampler_init_infill(const struct llama_vocab * voca
     );
 }
 
+// fused chain
+
+// samplers that can be applied to the candidates selected by the top-k that follows them in a chain: they change the
+// logits of a few known tokens, scale all the logits by the same positive factor or have no effect with their parameters
+static bool llama_sampler_is_fusable(const struct llama_sampler * smpl, std::vector<llama_token> & modified) {
+    if (smpl->iface == &llama_sampler_logit_bias_i) {
+        const auto * ctx = (const llama_sampler_logit_bias *) smpl->ctx;
+        for (const auto & lb : ctx->logit_bias) {
+            modified.push_back(lb.token);
+        }
+        return true;
+    }
+
+    if (smpl->iface == &llama_sampler_penalties_i) {
+        const auto * ctx = (const llama_sampler_penalties *) smpl->ctx;
+        if ((ctx->penalty_last_n == 0) ||
+            (ctx->penalty_repeat == 1.0f && ctx->penalty_freq == 0.0f && ctx->penalty_present == 0.0f)) {
+            return true;
+        }
+        for (const auto & it : ctx->token_count) {
+            modified.push_back(it.first);
+        }
+        return true;
+    }
+
+    if (smpl->iface == &llama_sampler_top_k_i) {
+        return ((const llama_sampler_top_k *) smpl->ctx)->k <= 0;
+    }
+
+    if (smpl->iface == &llama_sampler_temp_i) {
+        return ((const llama_sampler_temp *) smpl->ctx)->temp > 0.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_temp_ext_i) {
+        const auto * ctx = (const llama_sampler_temp_ext *) smpl->ctx;
+        return ctx->delta <= 0.0f && ctx->temp > 0.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_top_p_i) {
+        return ((const llama_sampler_top_p *) smpl->ctx)->p >= 1.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_min_p_i) {
+        return ((const llama_sampler_min_p *) smpl->ctx)->p <= 0.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_typical_i) {
+        return ((const llama_sampler_typical *) smpl->ctx)->p >= 1.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_top_n_sigma_i) {
+        return ((const llama_sampler_top_n_sigma *) smpl->ctx)->n <= 0.0f;
+    }
+
+    if (smpl->iface == &llama_sampler_xtc_i) {
+        const auto * ctx = (const llama_sampler_xtc *) smpl->ctx;
+        return ctx->probability <= 0.0f || ctx->threshold > 0.5f;
+    }
+
+    if (smpl->iface == &llama_sampler_dry_i) {
+        const auto * ctx = (const llama_sampler_dry *) smpl->ctx;
+        return ctx->dry_multiplier == 0.0f || ctx->dry_base < 1.0f || ctx->dry_penalty_last_n == 0;
+    }
+
+    return false;
+}
+
+static int llama_sampler_count_gt(const float * x, int32_t n, float v) {
+    int res = 0;
+    for (int32_t j = 0; j < n; ++j) {
+        res += x[j] > v;
+    }
+    return res;
+}
+
+bool llama_sampler_chain_apply_logits(struct llama_sampler * smpl, const float * logits, int32_t n_vocab, llama_token_data_array * cur_p) {
+    if (smpl->iface != &llama_sampler_chain_i) {
+        return false;
+    }
+
+    auto * chain = (llama_sampler_chain *) smpl->ctx;
+
+    auto & cur      = chain->cur;
+    auto & modified = chain->cur_modified;
+
+    modified.clear();
+
+    // find the top-k that ends the samplers that are fused with it
+    int32_t k = 0;
+    for (const auto * s : chain->samplers) {
+        if (s->iface == &llama_sampler_top_k_i && ((const llama_sampler_top_k *) s->ctx)->k > 0) {
+            k = ((const llama_sampler_top_k *) s->ctx)->k;
+            break;
+        }
+        if (!llama_sampler_is_fusable(s, modified)) {
+            return false;
+        }
+    }
+
+    if (k == 0) {
+        return false;
+    }
+
+    std::sort(modified.begin(), modified.end());
+    modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+    modified.erase(std::remove_if(modified.begin(), modified.end(), [n_vocab](llama_token id) { return id < 0 || id >= n_vocab; }), modified.end());
+
+    // the logits of the other tokens keep their order, so their top-k are among the k + n_modified largest logits
+    const int32_t n_sel = k + (int32_t) modified.size();
+
+    // the selection only pays off when the candidates are a small part of the vocabulary
+    if ((int64_t) n_sel*8 > n_vocab) {
+        return false;
+    }
+
+    time_meas tm(chain->t_sample_us, chain->params.no_perf);
+
+    cur.resize(n_sel + modified.size());
+
+    // min-heap of the n_sel largest logits
+    const auto comp = [](const llama_token_data & a, const llama_token_data & b) {
+        return a.logit > b.logit;
+    };
+
+    int32_t i = 0;
+    for (; i < n_sel; ++i) {
+        cur[i] = llama_token_data{i, logits[i], 0.0f};
+    }
+    std::make_heap(cur.begin(), cur.begin() + n_sel, comp);
+
+    float min_sel = cur[0].logit;
+
+    // most of the logits are below the smallest candidate: count the larger ones in blocks, which the compiler
+    // vectorizes, and only look at the single logits of the blocks that have some
+    constexpr int32_t n_block = 32;
+
+    for (; i < n_vocab; i += n_block) {
+        const int32_t n = std::min(n_block, n_vocab - i);
+
+        if (llama_sampler_count_gt(logits + i, n, min_sel) == 0) {
+            continue;
+        }
+
+        for (int32_t j = 0; j < n; ++j) {
+            if (logits[i + j] > min_sel) {
+                std::pop_heap(cur.begin(), cur.begin() + n_sel, comp);
+                cur[n_sel - 1] = llama_token_data{i + j, logits[i + j], 0.0f};
+                std::push_heap(cur.begin(), cur.begin() + n_sel, comp);
+
+                min_sel = cur[0].logit;
+            }
+        }
+    }
+
+    // the modified tokens are candidates wherever their logits end up
+    size_t n_cur = 0;
+    for (int32_t j = 0; j < n_sel; ++j) {
+        if (!std::binary_search(modified.begin(), modified.end(), cur[j].id)) {
+            cur[n_cur++] = cur[j];
+        }
+    }
+    for (const llama_token id : modified) {
+        cur[n_cur++] = llama_token_data{id, logits[id], 0.0f};
+    }
+
+    *cur_p = {
+        /* .data       = */ cur.data(),
+        /* .size       = */ n_cur,
+        /* .selected   = */ -1,
+        /* .sorted     = */ false,
+    };
+
+    // the whole chain on the candidates gives the same result as on the full vocabulary
+    for (auto * s : chain->samplers) {
+        llama_sampler_apply(s, cur_p);
+    }
+
+    return true;
+}
+
 // utils
 
 uint32_t llama_sampler_get_seed(const struct llama_sampler * smpl) {
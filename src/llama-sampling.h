@@ -21,6 +21,10 @@ struct llama_sampler_chain {
     mutable int64_t t_sample_us;
 
     mutable int32_t n_sample;
+
+    // candidates selected from the logits by llama_sampler_chain_apply_logits
+    std::vector<llama_token_data> cur;
+    std::vector<llama_token>      cur_modified; // tokens whose logits are changed before the top-k
 };
 
 struct llama_sampler * llama_sampler_init_dry_testing(
@@ -94,6 +94,7 @@ static int llama_model_load(const std::string & fname, std::vector<std::string>
 
     try {
         llama_model_loader ml(fname, splits, params.use_mmap, params.check_tensors, params.kv_overrides, params.tensor_buft_overrides);
+        ml.n_load_threads = params.n_load_threads;
 
         ml.print_info();
 
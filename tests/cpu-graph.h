@@ -0,0 +1,84 @@
+#pragma once
+
+// helpers of the tests that check the graphs computed by the CPU backend against a reference computation
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+inline struct ggml_context * init_ctx(size_t mem_size) {
+    struct ggml_init_params params = {
+        /* .mem_size   = */ mem_size,
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ false,
+    };
+
+    return ggml_init(params);
+}
+
+// fills the tensor with values in [-1, 1) that depend on the seed, quantized if the type is not F32
+inline void fill_tensor(struct ggml_tensor * t, int seed) {
+    std::vector<float> data(ggml_nelements(t));
+    for (size_t j = 0; j < data.size(); j++) {
+        data[j] = (float) ((seed*31 + j*17) % 101) / 50.0f - 1.0f;
+    }
+    if (t->type == GGML_TYPE_F32) {
+        memcpy(t->data, data.data(), ggml_nbytes(t));
+    } else {
+        ggml_quantize_chunk(t->type, data.data(), t->data, 0, ggml_nrows(t), t->ne[0], NULL);
+    }
+}
+
+inline struct ggml_tensor * new_tensor(struct ggml_context * ctx, ggml_type type, std::vector<int64_t> ne, int seed) {
+    struct ggml_tensor * t = ggml_new_tensor(ctx, type, (int) ne.size(), ne.data());
+    fill_tensor(t, seed);
+    return t;
+}
+
+// data of the outputs, one after the other
+inline std::vector<uint8_t> collect(const std::vector<struct ggml_tensor *> & outs) {
+    std::vector<uint8_t> res;
+    for (auto * t : outs) {
+        res.insert(res.end(), (uint8_t *) t->data, (uint8_t *) t->data + ggml_nbytes(t));
+    }
+    return res;
+}
+
+inline std::vector<uint8_t> compute_and_collect(
+        struct ggml_cgraph * gf, const std::vector<struct ggml_tensor *> & outs, int n_threads,
+        struct ggml_cpu_profile * profile = NULL) {
+    struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads, NULL);
+    std::vector<uint8_t> work_data(cplan.work_size);
+    cplan.work_data = work_data.data();
+    cplan.profile   = profile;
+    ggml_graph_compute(gf, &cplan);
+
+    return collect(outs);
+}
+
+// same as compute_and_collect, but each node is computed in a graph of its own
+// the nodes are neither fused nor share their work data
+inline std::vector<uint8_t> compute_nodes_and_collect(
+        struct ggml_context * ctx, struct ggml_cgraph * gf, const std::vector<struct ggml_tensor *> & outs, int n_threads) {
+    struct ggml_cgraph * g1 = ggml_new_graph(ctx);
+    for (int i = 0; i < ggml_graph_n_nodes(gf); i++) {
+        ggml_graph_clear(g1);
+        ggml_graph_add_node(g1, ggml_graph_node(gf, i));
+        compute_and_collect(g1, {}, n_threads);
+    }
+    return collect(outs);
+}
+
+// normalized mean squared error of the n F32 values in res compared to those in ref
+inline double nmse(const float * res, const float * ref, int64_t n) {
+    double err = 0.0;
+    double sum = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        err += (res[i] - ref[i])*(res[i] - ref[i]);
+        sum += ref[i]*ref[i];
+    }
+    return err/sum;
+}
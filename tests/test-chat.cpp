@@ -1345,6 +1345,72 @@ static void test_template_output_parsers() {
     }
 }
 
+// parsing the prefixes of a streamed output incrementally must give the same messages as parsing them from scratch
+static void test_msg_parse_incremental() {
+    printf("[%s]\n", __func__);
+
+    struct test_case {
+        common_chat_syntax syntax;
+        std::string        input;
+    };
+
+    common_chat_syntax syntax_deepseek_r1;
+    syntax_deepseek_r1.format           = COMMON_CHAT_FORMAT_DEEPSEEK_R1;
+    syntax_deepseek_r1.reasoning_format = COMMON_REASONING_FORMAT_DEEPSEEK;
+
+    common_chat_syntax syntax_hermes_2_pro;
+    syntax_hermes_2_pro.format           = COMMON_CHAT_FORMAT_HERMES_2_PRO;
+    syntax_hermes_2_pro.reasoning_format = COMMON_REASONING_FORMAT_DEEPSEEK;
+
+    const std::vector<test_case> test_cases {
+        { {COMMON_CHAT_FORMAT_CONTENT_ONLY}, "Hello, world!\nWhat's up?" },
+        { syntax_deepseek_r1,
+            "<think>I'm\nthinking</think>Hello, world!\nWhat's up?"
+            "<｜tool▁calls▁begin｜><｜tool▁call▁begin｜>function<｜tool▁sep｜>special_function\n"
+            "```json\n"
+            "{\"arg1\": 1}\n"
+            "```<｜tool▁call▁end｜><｜tool▁calls▁end｜>" },
+        { syntax_hermes_2_pro,
+            "<think>I'm\nthinking</think>Hello, world!\nWhat's up?\n"
+            "<tool_call>\n"
+            "{\"name\": \"special_function\", \"arguments\": {\"arg1\": 1}}\n"
+            "</tool_call>" },
+        { syntax_hermes_2_pro,
+            "Some <function content <tool and {\"name\" that looks like a call\n"
+            "<function=special_function>{\"arg1\": 1}</function>" },
+    };
+
+    // some prefixes cannot be parsed, in which case both parses must fail
+    auto parse = [](const std::string & input, bool is_partial, const common_chat_syntax & syntax, common_chat_parse_state * state) {
+        common_chat_msg msg;
+        try {
+            msg = common_chat_parse(input, is_partial, syntax, state);
+        } catch (const std::exception & e) {
+            msg.content = std::string("error: ") + e.what();
+        }
+        return msg;
+    };
+
+    for (const auto & tc : test_cases) {
+        common_chat_parse_state state;
+
+        for (size_t n = 0; n <= tc.input.size(); n++) {
+            const std::string input = tc.input.substr(0, n);
+            const bool is_partial = n < tc.input.size();
+
+            assert_msg_equals(
+                parse(input, is_partial, tc.syntax, nullptr),
+                parse(input, is_partial, tc.syntax, &state));
+        }
+
+        // a modified input resets the state
+        const std::string input = tc.input.substr(0, tc.input.size() / 2);
+        assert_msg_equals(
+            parse(input, /* is_partial= */ true, tc.syntax, nullptr),
+            parse(input, /* is_partial= */ true, tc.syntax, &state));
+    }
+}
+
 static void test_msg_diffs_compute() {
     printf("[%s]\n", __func__);
     {
@@ -1465,6 +1531,7 @@ int main(int argc, char ** argv) {
 #endif
         {
             test_msg_diffs_compute();
+            test_msg_parse_incremental();
             test_msgs_oaicompat_json_conversion();
             test_tools_oaicompat_json_conversion();
             test_template_output_parsers();
@@ -0,0 +1,81 @@
+// flash attention with GQA and a causal mask, computed by the tiled kernel for a batch of queries and by the row kernel
+// for a single query, the result must match the attention computed with mul_mat and soft_max
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_flash_attn_ext(int n_threads, ggml_type type_k, int64_t n_q, float max_bias, float logit_softcap) {
+    struct ggml_context * ctx = init_ctx(64*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    const int64_t D      = 64;
+    const int64_t n_kv   = 53;
+    const int64_t n_head = 4;
+    const int64_t n_head_kv = 2;
+
+    const float scale = 1.0f/sqrtf((float) D);
+
+    struct ggml_tensor * q = new_tensor(ctx, GGML_TYPE_F32, { D, n_q,  n_head },    1);
+    struct ggml_tensor * k = new_tensor(ctx, type_k,        { D, n_kv, n_head_kv }, 2);
+    struct ggml_tensor * v = new_tensor(ctx, GGML_TYPE_F16, { D, n_kv, n_head_kv }, 3);
+
+    struct ggml_tensor * mask = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, n_kv, GGML_PAD(n_q, GGML_KQ_MASK_PAD));
+    for (int64_t i = 0; i < mask->ne[1]; i++) {
+        for (int64_t j = 0; j < n_kv; j++) {
+            const bool masked = i >= n_q || j > i + n_kv - n_q;
+            ((ggml_fp16_t *) mask->data)[i*n_kv + j] = ggml_fp32_to_fp16(masked ? -INFINITY : 0.0f);
+        }
+    }
+
+    struct ggml_tensor * fa = ggml_flash_attn_ext(ctx, q, k, v, mask, scale, max_bias, logit_softcap);
+    ggml_flash_attn_ext_set_prec(fa, GGML_PREC_F32);
+
+    struct ggml_tensor * kq = ggml_mul_mat(ctx, k, q);
+    if (logit_softcap != 0.0f) {
+        kq = ggml_scale(ctx, ggml_tanh(ctx, ggml_scale(ctx, kq, scale/logit_softcap)), logit_softcap);
+        kq = ggml_soft_max_ext(ctx, kq, mask, 1.0f, max_bias);
+    } else {
+        kq = ggml_soft_max_ext(ctx, kq, mask, scale, max_bias);
+    }
+    struct ggml_tensor * vt  = ggml_cont(ctx, ggml_transpose(ctx, ggml_cast(ctx, v, GGML_TYPE_F32)));
+    struct ggml_tensor * kqv = ggml_cont(ctx, ggml_permute(ctx, ggml_mul_mat(ctx, vt, kq), 0, 2, 1, 3));
+
+    ggml_build_forward_expand(gf, fa);
+    ggml_build_forward_expand(gf, kqv);
+
+    const int64_t n = ggml_nelements(fa);
+    GGML_ASSERT(ggml_nelements(kqv) == n);
+
+    const std::vector<uint8_t> res = compute_and_collect(gf, { fa, kqv }, n_threads);
+    const float * res_fa  = (const float *) res.data();
+    const float * res_kqv = res_fa + n;
+
+    ggml_free(ctx);
+
+    // the row kernel accumulates in F16
+    return nmse(res_fa, res_kqv, n) < 1e-5;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    for (ggml_type type_k : { GGML_TYPE_F16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0 }) {
+        for (int64_t n_q : { 1, 37 }) {
+            if (!test_flash_attn_ext(n_threads, type_k, n_q, 0.0f, 0.0f) ||
+                !test_flash_attn_ext(n_threads, type_k, n_q, 8.0f, 30.0f)) {
+                fprintf(stderr, "flash attn ext: results differ from mul_mat and soft_max, type_k %s, n_q %d\n",
+                        ggml_type_name(type_k), (int) n_q);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+// chains of row-wise ops that the CPU backend fuses into a single kernel
+// the result must match computing the nodes one at a time
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_fused_ops(int n_threads) {
+    struct ggml_context * ctx = init_ctx(64*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    std::vector<struct ggml_tensor *> outs;
+    for (int i = 0; i < 8; i++) {
+        struct ggml_tensor * a = new_tensor(ctx, GGML_TYPE_F32, { 256, 7 }, i);
+        struct ggml_tensor * b = new_tensor(ctx, GGML_TYPE_F32, { 256, 7 }, i + 100);
+        struct ggml_tensor * w = new_tensor(ctx, GGML_TYPE_F32, { 256, 1 }, i + 200);
+
+        // add -> rms_norm -> mul, with the result of add used again
+        struct ggml_tensor * x = ggml_add(ctx, a, b);
+        struct ggml_tensor * n = ggml_mul(ctx, ggml_rms_norm(ctx, x, 1e-6f), w);
+        n = ggml_add(ctx, n, x);
+
+        // add -> rms_norm, rms_norm -> mul
+        struct ggml_tensor * y = ggml_rms_norm(ctx, ggml_add(ctx, n, w), 1e-5f);
+        y = ggml_mul(ctx, ggml_rms_norm(ctx, y, 1e-6f), w);
+
+        // silu -> mul, gelu -> mul
+        struct ggml_tensor * z = ggml_mul(ctx, ggml_silu(ctx, y), n);
+        z = ggml_mul(ctx, b, ggml_gelu(ctx, z));
+
+        // silu -> mul with the output of silu broadcast over the rows of the gate, not fused
+        z = ggml_mul(ctx, z, ggml_silu(ctx, ggml_add(ctx, w, w)));
+
+        outs.push_back(z);
+        ggml_build_forward_expand(gf, z);
+    }
+
+    const std::vector<uint8_t> res_graph = compute_and_collect(gf, outs, n_threads);
+    const std::vector<uint8_t> res_nodes = compute_nodes_and_collect(ctx, gf, outs, n_threads);
+
+    ggml_free(ctx);
+
+    return res_graph == res_nodes;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    if (!test_fused_ops(n_threads)) {
+        fprintf(stderr, "fused ops: results differ from computing the nodes one at a time\n");
+        return 1;
+    }
+
+    return 0;
+}
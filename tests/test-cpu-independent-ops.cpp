@@ -0,0 +1,55 @@
+// independent small ops, some of them are computed without barriers in between
+// the result must match the single-threaded computation
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_independent_ops(int n_threads) {
+    struct ggml_context * ctx = init_ctx(256*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    std::vector<struct ggml_tensor *> outs;
+    for (int i = 0; i < 64; i++) {
+        struct ggml_tensor * a = new_tensor(ctx, GGML_TYPE_F32, { 256, 4 }, i);
+        struct ggml_tensor * b = new_tensor(ctx, GGML_TYPE_F32, { 256, 4 }, i + 100);
+
+        // chains of dependent ops, interleaved with ops on other inputs and in-place updates
+        struct ggml_tensor * x = ggml_rms_norm(ctx, a, 1e-6f);
+        struct ggml_tensor * y = ggml_silu(ctx, b);
+        x = ggml_mul(ctx, x, y);
+        x = ggml_add_inplace(ctx, x, a);
+        x = ggml_scale(ctx, ggml_reshape_1d(ctx, x, 1024), 0.5f);
+        struct ggml_tensor * z = ggml_soft_max(ctx, ggml_view_2d(ctx, x, 256, 4, 256*sizeof(float), 0));
+        z = ggml_cpy(ctx, z, ggml_new_tensor_2d(ctx, GGML_TYPE_F16, 256, 4));
+        outs.push_back(z);
+        ggml_build_forward_expand(gf, z);
+    }
+
+    std::vector<std::vector<uint8_t>> results;
+    for (int nt : { 1, n_threads }) {
+        results.push_back(compute_and_collect(gf, outs, nt));
+    }
+
+    ggml_free(ctx);
+
+    return results[0] == results[1];
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    for (int i = 0; i < 10; i++) {
+        if (!test_independent_ops(n_threads)) {
+            fprintf(stderr, "independent ops: results differ from the single-threaded computation\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
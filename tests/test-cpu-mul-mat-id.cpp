@@ -0,0 +1,80 @@
+// mul_mat_id with experts of different sizes, some of them large enough to be multiplied with llamafile_sgemm
+// the result must match the mul_mat of each row with its expert
+// with many rows, the results of llamafile_sgemm do not fit in the work buffer at once and the rows of an expert are split
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_mul_mat_id(int n_threads, ggml_type type, bool broadcast, int64_t K, int64_t M, int64_t n_tokens) {
+    const int n_as   = 8;
+    const int n_used = 2;
+
+    // the output and the references
+    struct ggml_context * ctx = init_ctx(64*1024*1024 + 3*n_used*n_tokens*(M*sizeof(float) + ggml_tensor_overhead()));
+    struct ggml_cgraph  * gf  = ggml_new_graph_custom(ctx, 4*n_used*n_tokens + 16, false);
+
+    struct ggml_tensor * as  = new_tensor(ctx, type,          { K, M, n_as }, 1);
+    struct ggml_tensor * b   = new_tensor(ctx, GGML_TYPE_F32, { K, broadcast ? 1 : n_used, n_tokens }, 2);
+    struct ggml_tensor * ids = ggml_new_tensor_2d(ctx, GGML_TYPE_I32, n_used, n_tokens);
+
+    // expert 0 gets all the tokens, the others get fewer and fewer of them
+    for (int64_t i = 0; i < n_tokens; i++) {
+        ((int32_t *) ids->data)[i*n_used + 0] = 0;
+        ((int32_t *) ids->data)[i*n_used + 1] = 1 + (i*i) % (n_as - 1);
+    }
+
+    struct ggml_tensor * out = ggml_mul_mat_id(ctx, as, b, ids);
+    ggml_build_forward_expand(gf, out);
+
+    // the output of each row followed by the references in the same order
+    std::vector<struct ggml_tensor *> outs = { out };
+    for (int64_t i = 0; i < n_tokens; i++) {
+        for (int j = 0; j < n_used; j++) {
+            const int32_t e = ((int32_t *) ids->data)[i*n_used + j];
+
+            struct ggml_tensor * a   = ggml_view_2d(ctx, as, K, M, as->nb[1], e*as->nb[2]);
+            struct ggml_tensor * row = ggml_view_1d(ctx, b, K, (broadcast ? 0 : j)*b->nb[1] + i*b->nb[2]);
+            outs.push_back(ggml_mul_mat(ctx, a, row));
+            ggml_build_forward_expand(gf, outs.back());
+        }
+    }
+
+    const std::vector<uint8_t> res = compute_and_collect(gf, outs, n_threads);
+    const float * o = (const float *) res.data();
+    const float * r = o + ggml_nelements(out);
+
+    const double err = nmse(o, r, ggml_nelements(out));
+
+    ggml_free(ctx);
+
+    return err < 1e-10;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    for (ggml_type type : { GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0, GGML_TYPE_Q4_K }) {
+        for (bool broadcast : { false, true }) {
+            if (!test_mul_mat_id(n_threads, type, broadcast, 256, 64, 40)) {
+                fprintf(stderr, "mul mat id: results differ from mul_mat, type %s, broadcast %d\n", ggml_type_name(type), broadcast);
+                return 1;
+            }
+        }
+    }
+
+    // 16 MiB of results of llamafile_sgemm are 1024 rows of 4096: expert 0 has 1100 rows and all the experts 2200
+    for (ggml_type type : { GGML_TYPE_F16, GGML_TYPE_Q8_0 }) {
+        if (!test_mul_mat_id(n_threads, type, false, 32, 4096, 1100)) {
+            fprintf(stderr, "mul mat id: results differ from mul_mat with many rows, type %s\n", ggml_type_name(type));
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+// rows of the weights with the split NUMA strategy
+// the rows placed on each node must be covered exactly by the threads of that node, and all the bounds must be multiples
+// of the alignment of the computation, so that no thread multiplies a row placed on another node
+
+#include "../ggml/src/ggml-cpu/numa-split.h"
+
+#include <cstdio>
+#include <initializer_list>
+
+static bool aligned(int64_t r, int64_t nr, int64_t align) {
+    return r % align == 0 || r == nr;
+}
+
+static bool test_numa_split(int n_nodes, int nth, int64_t nr, int64_t align) {
+    int64_t node_end = 0;
+
+    for (int n = 0; n < n_nodes; n++) {
+        int64_t r0;
+        int64_t r1;
+        ggml_numa_node_rows(n_nodes, n, nr, align, &r0, &r1);
+
+        if (r0 != node_end || r1 < r0 || !aligned(r0, nr, align) || !aligned(r1, nr, align)) {
+            fprintf(stderr, "node %d: rows [%lld, %lld) after %lld\n", n, (long long) r0, (long long) r1, (long long) node_end);
+            return false;
+        }
+        node_end = r1;
+
+        // the threads of the node, in order
+        int64_t thread_end = r0;
+        for (int ith = n; ith < nth; ith += n_nodes) {
+            int64_t ir0;
+            int64_t ir1;
+            ggml_numa_thread_rows(n_nodes, ith, nth, nr, align, &ir0, &ir1);
+
+            if (ir0 != thread_end || ir1 < ir0 || ir1 > r1 || !aligned(ir0, nr, align) || !aligned(ir1, nr, align)) {
+                fprintf(stderr, "node %d [%lld, %lld), thread %d: rows [%lld, %lld) after %lld\n",
+                        n, (long long) r0, (long long) r1, ith, (long long) ir0, (long long) ir1, (long long) thread_end);
+                return false;
+            }
+            thread_end = ir1;
+        }
+
+        if (thread_end != r1) {
+            fprintf(stderr, "node %d: rows [%lld, %lld) not covered by its threads\n", n, (long long) thread_end, (long long) r1);
+            return false;
+        }
+    }
+
+    if (node_end != nr) {
+        fprintf(stderr, "rows [%lld, %lld) not placed on any node\n", (long long) node_end, (long long) nr);
+        return false;
+    }
+
+    return true;
+}
+
+int main() {
+    for (int n_nodes : { 1, 2, 3, 4, 8 }) {
+        for (int nth = n_nodes; nth <= 4*n_nodes + 1; nth++) {
+            for (int64_t nr : { 1, 2, 7, 16, 31, 64, 100, 255, 4096, 11008, 32000 }) {
+                for (int64_t align : { 1, 2, 4, 8, 16 }) {
+                    if (!test_numa_split(n_nodes, nth, nr, align)) {
+                        fprintf(stderr, "numa split: n_nodes %d, nth %d, nr %lld, align %lld\n", n_nodes, nth, (long long) nr, (long long) align);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
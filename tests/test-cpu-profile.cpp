@@ -0,0 +1,86 @@
+// profiling the nodes must not change the results, and the trace must contain an event for each node on each thread
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static bool test_profile(int n_threads) {
+    struct ggml_context * ctx = init_ctx(64*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    struct ggml_tensor * a = new_tensor(ctx, GGML_TYPE_F32, { 256, 64 }, 0);
+    struct ggml_tensor * b = new_tensor(ctx, GGML_TYPE_F32, { 256, 64 }, 1);
+
+    struct ggml_tensor * x = ggml_rms_norm(ctx, a, 1e-6f);
+    ggml_set_name(x, "x_norm");
+    x = ggml_mul(ctx, x, b);
+    ggml_set_name(x, "x_mul");
+    x = ggml_mul_mat(ctx, b, x);
+    ggml_set_name(x, "x_mm");
+    x = ggml_soft_max(ctx, x);
+    ggml_set_name(x, "x_soft_max");
+    ggml_build_forward_expand(gf, x);
+
+    const std::string fname = (std::filesystem::temp_directory_path() / "test-cpu-profile.tmp.json").string();
+
+    struct ggml_cpu_profile * profile = ggml_cpu_profile_new();
+
+    std::vector<std::vector<uint8_t>> results;
+    for (bool use_profile : { false, true, true }) {
+        results.push_back(compute_and_collect(gf, { x }, n_threads, use_profile ? profile : NULL));
+    }
+
+    bool ok = results[0] == results[1] && results[0] == results[2];
+
+    ok = ok && ggml_cpu_profile_write_trace(profile, fname.c_str());
+    ggml_cpu_profile_free(profile);
+
+    std::string trace;
+    if (FILE * f = fopen(fname.c_str(), "rb")) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            trace.append(buf, n);
+        }
+        fclose(f);
+    }
+    remove(fname.c_str());
+
+    auto count = [&](const std::string & s) {
+        int n = 0;
+        for (size_t pos = trace.find(s); pos != std::string::npos; pos = trace.find(s, pos + 1)) {
+            n++;
+        }
+        return n;
+    };
+
+    // the rms_norm and mul nodes may be fused into a single event named after the first node
+    for (const char * name : { "\"x_norm\"", "\"x_mm\"", "\"x_soft_max\"" }) {
+        ok = ok && count(name) == 2*n_threads;
+    }
+    for (int ith = 0; ith < n_threads; ith++) {
+        ok = ok && count("\"name\":\"thread " + std::to_string(ith) + "\"") == 1;
+    }
+
+    ggml_free(ctx);
+
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    if (!test_profile(n_threads)) {
+        fprintf(stderr, "profile: results differ or the trace does not contain the nodes\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+// mul_mat of weights repacked in the CPU_REPACK buffer type, computed with the gemv kernel for a single column and the
+// gemm kernel for several columns, the result must match the mul_mat of the same weights in a CPU buffer
+// the types that are not repacked on this CPU are skipped
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static bool test_repack(int n_threads, ggml_backend_buffer_type_t buft, ggml_type type, int64_t M, int64_t N) {
+    const int64_t K = 3*256;
+
+    struct ggml_init_params params_w = {
+        /* .mem_size   = */ ggml_tensor_overhead(),
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ true,
+    };
+
+    struct ggml_context * ctx_w = ggml_init(params_w);
+
+    struct ggml_tensor * w = ggml_new_tensor_2d(ctx_w, type, K, M);
+
+    ggml_backend_buffer_t buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, buft);
+    ggml_backend_buffer_set_usage(buf_w, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+
+    if (w->extra == NULL) {
+        ggml_backend_buffer_free(buf_w);
+        ggml_free(ctx_w);
+        return true;
+    }
+
+    struct ggml_context * ctx = init_ctx(16*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    struct ggml_tensor * w_ref = new_tensor(ctx, type, { K, M }, 1);
+    ggml_backend_tensor_set(w, w_ref->data, 0, ggml_nbytes(w_ref));
+
+    struct ggml_tensor * x = new_tensor(ctx, GGML_TYPE_F32, { K, N }, 2);
+
+    struct ggml_tensor * out     = ggml_mul_mat(ctx, w,     x);
+    struct ggml_tensor * out_ref = ggml_mul_mat(ctx, w_ref, x);
+    ggml_build_forward_expand(gf, out);
+    ggml_build_forward_expand(gf, out_ref);
+
+    const std::vector<uint8_t> res = compute_and_collect(gf, { out, out_ref }, n_threads);
+    const float * o = (const float *) res.data();
+    const float * r = o + ggml_nelements(out);
+
+    const double err = nmse(o, r, ggml_nelements(out));
+
+    ggml_free(ctx);
+    ggml_backend_buffer_free(buf_w);
+    ggml_free(ctx_w);
+
+    return err < 1e-10;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    ggml_backend_buffer_type_t buft_repack = NULL;
+    {
+        ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+        auto get_extra_bufts = (ggml_backend_dev_get_extra_bufts_t)
+            ggml_backend_reg_get_proc_address(ggml_backend_dev_backend_reg(dev), "ggml_backend_dev_get_extra_bufts");
+        for (ggml_backend_buffer_type_t * buft = get_extra_bufts ? get_extra_bufts(dev) : NULL; buft && *buft; buft++) {
+            if (strcmp(ggml_backend_buft_name(*buft), "CPU_REPACK") == 0) {
+                buft_repack = *buft;
+            }
+        }
+    }
+
+    if (buft_repack == NULL) {
+        fprintf(stderr, "repack: the CPU backend has no CPU_REPACK buffer type, skipping\n");
+        return 0;
+    }
+
+    for (ggml_type type : { GGML_TYPE_Q4_0, GGML_TYPE_Q4_K, GGML_TYPE_Q5_K, GGML_TYPE_Q6_K, GGML_TYPE_Q8_0 }) {
+        for (int64_t M : { 8, 24, 64 }) {
+            for (int64_t N : { 1, 4, 11 }) {
+                if (!test_repack(n_threads, buft_repack, type, M, N)) {
+                    fprintf(stderr, "repack: results differ from the mul_mat without repacking, type %s, M %d, N %d\n",
+                            ggml_type_name(type), (int) M, (int) N);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
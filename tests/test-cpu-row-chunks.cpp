@@ -0,0 +1,65 @@
+// row-wise ops large enough to be split in several chunks per thread, that the threads take dynamically
+// independent ops share the same segment and each uses the chunk counter of its node
+// the result must match the single-threaded computation, also when the same graph is computed again
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_row_chunks(int n_threads) {
+    struct ggml_context * ctx = init_ctx(128*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    std::vector<struct ggml_tensor *> outs;
+    for (int i = 0; i < 4; i++) {
+        struct ggml_tensor * a = new_tensor(ctx, GGML_TYPE_F32, { 64, 1031 }, i);
+        struct ggml_tensor * b = new_tensor(ctx, GGML_TYPE_F32, { 64, 1031 }, i + 100);
+        struct ggml_tensor * w = new_tensor(ctx, GGML_TYPE_F32, { 64, 1 },    i + 200);
+
+        struct ggml_tensor * ids = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, 777);
+        for (int64_t j = 0; j < ids->ne[0]; j++) {
+            ((int32_t *) ids->data)[j] = (int32_t) ((j*13 + i) % 1031);
+        }
+
+        struct ggml_tensor * x = ggml_add(ctx, a, b);
+        struct ggml_tensor * y = ggml_silu(ctx, b);
+        struct ggml_tensor * n = ggml_mul(ctx, ggml_rms_norm(ctx, x, 1e-6f), w);
+        n = ggml_add(ctx, ggml_norm(ctx, n, 1e-5f), ggml_scale(ctx, y, 0.25f));
+
+        struct ggml_tensor * z = ggml_mul(ctx, ggml_gelu(ctx, n), x);
+        z = ggml_swiglu_split(ctx, z, y);
+        z = ggml_soft_max_ext(ctx, z, NULL, 0.5f, 0.0f);
+
+        outs.push_back(z);
+        outs.push_back(ggml_get_rows(ctx, n, ids));
+        ggml_build_forward_expand(gf, outs[outs.size() - 2]);
+        ggml_build_forward_expand(gf, outs[outs.size() - 1]);
+    }
+
+    std::vector<std::vector<uint8_t>> results;
+    for (int nt : { 1, n_threads, n_threads }) {
+        results.push_back(compute_and_collect(gf, outs, nt));
+    }
+
+    ggml_free(ctx);
+
+    return results[0] == results[1] && results[0] == results[2];
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    for (int i = 0; i < 10; i++) {
+        if (!test_row_chunks(n_threads)) {
+            fprintf(stderr, "row chunks: results differ from the single-threaded computation\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
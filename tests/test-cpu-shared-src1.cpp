@@ -0,0 +1,61 @@
+// mul_mat with the same src1 and small ops in between, the conversion of src1 is shared between the mul_mat
+// the result must match computing the nodes one at a time
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static bool test_shared_src1(int n_threads) {
+    struct ggml_context * ctx = init_ctx(64*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    std::vector<struct ggml_tensor *> outs;
+    for (int i = 0; i < 4; i++) {
+        struct ggml_tensor * x  = ggml_rms_norm(ctx, new_tensor(ctx, GGML_TYPE_F32, { 256, 9 }, i), 1e-6f);
+        struct ggml_tensor * wq = new_tensor(ctx, GGML_TYPE_Q4_0, { 256, 128 }, i + 100);
+        struct ggml_tensor * wk = new_tensor(ctx, GGML_TYPE_Q8_0, { 256, 64 },  i + 200);
+        struct ggml_tensor * wv = new_tensor(ctx, GGML_TYPE_Q5_1, { 256, 64 },  i + 300);
+        struct ggml_tensor * wo = new_tensor(ctx, GGML_TYPE_Q4_K, { 256, 32 },  i + 400);
+
+        // ops that use the work buffer between the mul_mat
+        struct ggml_tensor * q = ggml_soft_max(ctx, ggml_mul_mat(ctx, wq, x));
+        struct ggml_tensor * k = ggml_scale(ctx, ggml_mul_mat(ctx, wk, x), 0.5f);
+        k = ggml_cpy(ctx, k, ggml_new_tensor_2d(ctx, GGML_TYPE_F16, 64, 9));
+        struct ggml_tensor * v = ggml_soft_max(ctx, ggml_mul_mat(ctx, wv, x));
+        struct ggml_tensor * o = ggml_mul_mat(ctx, wo, x);
+
+        outs.push_back(q);
+        outs.push_back(k);
+        outs.push_back(v);
+        outs.push_back(o);
+        ggml_build_forward_expand(gf, q);
+        ggml_build_forward_expand(gf, k);
+        ggml_build_forward_expand(gf, v);
+        ggml_build_forward_expand(gf, o);
+    }
+
+    const std::vector<uint8_t> res_graph = compute_and_collect(gf, outs, n_threads);
+    const std::vector<uint8_t> res_nodes = compute_nodes_and_collect(ctx, gf, outs, n_threads);
+
+    ggml_free(ctx);
+
+    return res_graph == res_nodes;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    for (int i = 0; i < 10; i++) {
+        if (!test_shared_src1(n_threads)) {
+            fprintf(stderr, "shared src1: results differ from computing the nodes one at a time\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// mul_mat of weights with the tuning enabled
+// the benchmarks must not modify the tensors of the graph, the results must match the default computation and the
+// tuned shapes must be saved to the cache file
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include "cpu-graph.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static bool test_tune(int n_threads) {
+    const int64_t K = 256;
+    const int64_t M = 96;
+
+    struct ggml_init_params params_w = {
+        /* .mem_size   = */ 4*ggml_tensor_overhead(),
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ true,
+    };
+
+    struct ggml_context * ctx_w = ggml_init(params_w);
+
+    struct ggml_tensor * w0 = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16,  K, M);
+    struct ggml_tensor * w1 = ggml_new_tensor_2d(ctx_w, GGML_TYPE_Q8_0, K, M);
+
+    ggml_backend_buffer_t buf_w = ggml_backend_alloc_ctx_tensors_from_buft(ctx_w, ggml_backend_cpu_buffer_type());
+    ggml_backend_buffer_set_usage(buf_w, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+
+    fill_tensor(w0, 0);
+    fill_tensor(w1, 0);
+
+    struct ggml_context * ctx = init_ctx(16*1024*1024);
+    struct ggml_cgraph  * gf  = ggml_new_graph(ctx);
+
+    std::vector<struct ggml_tensor *> outs;
+    for (int64_t n : { 1, 7 }) {
+        struct ggml_tensor * x = new_tensor(ctx, GGML_TYPE_F32, { K, n }, (int) n);
+        outs.push_back(ggml_mul_mat(ctx, w0, x));
+        outs.push_back(ggml_mul_mat(ctx, w1, ggml_silu(ctx, x)));
+        ggml_build_forward_expand(gf, outs[outs.size() - 2]);
+        ggml_build_forward_expand(gf, outs[outs.size() - 1]);
+    }
+
+    const std::string fname = (std::filesystem::temp_directory_path() / "test-cpu-tune.tmp").string();
+    remove(fname.c_str());
+
+    std::vector<std::vector<uint8_t>> results;
+    for (const char * cache : { (const char *) NULL, fname.c_str(), fname.c_str() }) {
+        ggml_cpu_tune_init(cache);
+        results.push_back(compute_and_collect(gf, outs, n_threads));
+    }
+
+    // with a threadpool of its own, the tuned variants are resolved for the first graph and reused for the next ones
+    {
+        struct ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+        struct ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+
+        struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
+        std::vector<uint8_t> work_data(cplan.work_size);
+        cplan.work_data = work_data.data();
+
+        for (int i = 0; i < 2; i++) {
+            ggml_graph_compute(gf, &cplan);
+            results.push_back(collect(outs));
+        }
+
+        ggml_threadpool_free(threadpool);
+    }
+    ggml_cpu_tune_init(NULL);
+
+    bool ok = true;
+    for (size_t r = 1; r < results.size(); r++) {
+        ok = ok && nmse((const float *) results[r].data(), (const float *) results[0].data(), results[0].size()/sizeof(float)) < 1e-10;
+    }
+
+    // one entry per type and power of 2 of the number of columns
+    int n_entries = 0;
+    if (FILE * f = fopen(fname.c_str(), "r")) {
+        char line[1024];
+        while (fgets(line, sizeof(line), f)) {
+            n_entries += line[0] != '#';
+        }
+        fclose(f);
+    }
+    remove(fname.c_str());
+
+    ok = ok && n_entries == 4;
+
+    // the cache file is written to a temporary file first, which must not be left behind
+    for (const auto & entry : std::filesystem::directory_iterator(std::filesystem::temp_directory_path())) {
+        if (entry.path().filename().string().rfind("test-cpu-tune.tmp.tmp", 0) == 0) {
+            fprintf(stderr, "tune: temporary file %s left behind\n", entry.path().string().c_str());
+            ok = false;
+        }
+    }
+
+    ggml_free(ctx);
+    ggml_backend_buffer_free(buf_w);
+    ggml_free(ctx_w);
+
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    const int n_threads = argc > 1 ? std::atoi(argv[1]) : 4;
+
+    if (!test_tune(n_threads)) {
+        fprintf(stderr, "tune: results differ from the default computation or the cache file was not written\n");
+        return 1;
+    }
+
+    return 0;
+}
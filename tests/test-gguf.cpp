@@ -1100,12 +1100,27 @@ static std::pair<int, int> test_roundtrip(ggml_backend_dev_t dev, const unsigned
     GGML_ASSERT(file);
 #endif // _WIN32
 
+    // the file is written directly, the buffer is used to check that both writers produce the same output
+    std::vector<int8_t> buf;
+    gguf_write_to_buf(gguf_ctx_0, buf, only_meta);
+    GGML_ASSERT(gguf_write_to_file_impl(gguf_ctx_0, file, only_meta));
+    rewind(file);
+
+    printf("%s: same_file_and_buf: ", __func__);
     {
-        std::vector<int8_t> buf;
-        gguf_write_to_buf(gguf_ctx_0, buf, only_meta);
-        GGML_ASSERT(fwrite(buf.data(), 1, buf.size(), file) == buf.size());
+        std::vector<int8_t> buf_file(buf.size() + 1);
+        const size_t nread = fread(buf_file.data(), 1, buf_file.size(), file);
+        buf_file.resize(nread);
         rewind(file);
+
+        if (buf_file == buf) {
+            printf("\033[1;32mOK\033[0m\n");
+            npass++;
+        } else {
+            printf("\033[1;31mFAIL\033[0m\n");
+        }
     }
+    ntest++;
 
     struct ggml_context * ctx_1 = nullptr;
     struct gguf_init_params gguf_params = {
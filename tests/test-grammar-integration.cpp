@@ -3,6 +3,7 @@
 #endif
 
 #include "json-schema-to-grammar.h"
+#include "llama.h"
 
 #include "../src/unicode.h"
 #include "../src/llama-grammar.h"
@@ -10,6 +11,7 @@
 #include <nlohmann/json.hpp>
 
 #include <cassert>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -1295,7 +1297,114 @@ static void test_json_schema() {
     );
 }
 
-int main() {
+// the masks of the grammar states cached for the whole vocab must give the same logits as checking the candidates
+// the tokens are accepted one at a time, including the bytes of a multi-byte character, by a grammar and its clone
+static void test_mask_cache(const char * vocab_path) {
+    fprintf(stderr, "⚫ Testing the mask cache with the vocab %s\n", vocab_path);
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.vocab_only = true;
+
+    llama_model * model = llama_model_load_from_file(vocab_path, mparams);
+    assert(model != nullptr);
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+
+    auto find_token = [&](const std::string & piece) {
+        char buf[256];
+        for (llama_token id = 0; id < n_vocab; id++) {
+            const int32_t n = llama_token_to_piece(vocab, id, buf, sizeof(buf), 0, true);
+            if (n == (int32_t) piece.size() && piece.compare(0, n, buf, n) == 0) {
+                return id;
+            }
+        }
+        fprintf(stderr, "  ❌ no token for the piece \"%s\"\n", piece.c_str());
+        assert(false);
+        return LLAMA_TOKEN_NULL;
+    };
+
+    // "日" is accepted one byte at a time
+    const std::vector<llama_token> tokens = {
+        find_token("{"), find_token("ab"), find_token("\xE6"), find_token("\x97"), find_token("\xA5"), find_token("c"), find_token("}"),
+    };
+
+    const std::string grammar_str = R"""(root ::= "{" ([a-z] | "日" | "本")* "}")""";
+
+    llama_grammar * grammar       = llama_grammar_init_impl(vocab, grammar_str.c_str(), "root", false, nullptr, 0, nullptr, 0);
+    llama_grammar * grammar_clone = llama_grammar_clone_impl(*grammar);
+    llama_grammar * grammar_ref   = llama_grammar_clone_impl(*grammar);
+    assert(grammar->cache && grammar_clone->cache == grammar->cache);
+
+    grammar_ref->cache = nullptr;
+
+    // the logits that remain after applying the grammar to the candidates
+    auto apply = [&](const llama_grammar * g, const std::vector<llama_token> & ids) {
+        std::vector<llama_token_data> cur;
+        for (const llama_token id : ids) {
+            cur.push_back({ id, 1.0f, 0.0f });
+        }
+        llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+        llama_grammar_apply_impl(*g, &cur_p);
+
+        std::vector<bool> allowed;
+        for (const auto & td : cur) {
+            allowed.push_back(td.logit != -INFINITY);
+        }
+        return allowed;
+    };
+
+    std::vector<llama_token> ids_all(n_vocab);
+    for (llama_token id = 0; id < n_vocab; id++) {
+        ids_all[id] = id;
+    }
+
+    // a few candidates are checked with the mask once the state is cached
+    std::vector<llama_token> ids_few = tokens;
+    ids_few.push_back(llama_vocab_eos(vocab));
+
+    int n_partial = 0;
+
+    for (size_t i = 0; i <= tokens.size(); i++) {
+        const auto allowed_ref = apply(grammar_ref, ids_all);
+
+        n_partial += grammar->partial_utf8.n_remain > 0;
+
+        // the key of the state is kept up to date by accepting the tokens and is the same for the clone
+        assert(!grammar->state_key.empty() && grammar_clone->state_key == grammar->state_key);
+
+        // computed by the grammar, then found in the cache by the grammar and its clone
+        assert(apply(grammar,       ids_all) == allowed_ref);
+        assert(apply(grammar,       ids_all) == allowed_ref);
+        assert(apply(grammar_clone, ids_all) == allowed_ref);
+
+        assert(apply(grammar_clone, ids_few) == apply(grammar_ref, ids_few));
+
+        // the accepted tokens must be allowed, the end of generation only after the last one
+        if (i < tokens.size()) {
+            assert(allowed_ref[tokens[i]]);
+            assert(!allowed_ref[llama_vocab_eos(vocab)]);
+
+            llama_grammar_accept_impl(*grammar,       tokens[i]);
+            llama_grammar_accept_impl(*grammar_clone, tokens[i]);
+            llama_grammar_accept_impl(*grammar_ref,   tokens[i]);
+        } else {
+            assert(allowed_ref[llama_vocab_eos(vocab)]);
+        }
+    }
+
+    // the masks of the states in the middle of "日" were used
+    assert(n_partial == 2);
+
+    llama_grammar_free_impl(grammar_ref);
+    llama_grammar_free_impl(grammar_clone);
+    llama_grammar_free_impl(grammar);
+    llama_model_free(model);
+
+    fprintf(stderr, "  ✅︎\n");
+}
+
+int main(int argc, char ** argv) {
     fprintf(stdout, "Running grammar integration tests...\n");
     test_simple_grammar();
     test_complex_grammar();
@@ -1305,6 +1414,9 @@ int main() {
     test_failure_missing_reference();
     test_failure_left_recursion();
     test_json_schema();
+    if (argc > 1) {
+        test_mask_cache(argv[1]);
+    }
     fprintf(stdout, "All tests passed.\n");
     return 0;
 }
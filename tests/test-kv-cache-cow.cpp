@@ -0,0 +1,284 @@
+// copy-on-write of the KV cells in paged mode
+// a prefix is shared by several sequences that then write divergent tails and shift their positions - the prefix
+// cells must stay shared, the tails and the copies must go to blocks of their own sequence and the logits must match
+// a context that computes each sequence alone
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "../src/llama-kv-cache-unified.h"
+#include "../src/llama-kv-cells.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+static const int n_seq    = 4;
+static const int n_prefix = 40;
+static const int n_tail   = 8;
+static const int n_block  = 16;
+static const int n_shift  = 3;
+
+static llama_context * init_context(llama_model * model, int n_seq_max) {
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx         = 512;
+    cparams.n_batch       = 512;
+    cparams.n_seq_max     = n_seq_max;
+    cparams.kv_unified    = true;
+    cparams.kv_block_size = n_block;
+
+    return llama_init_from_model(model, cparams);
+}
+
+static llama_token tok(const llama_vocab * vocab, int i) {
+    return (100 + 37*i) % llama_vocab_n_tokens(vocab);
+}
+
+// decode tokens[i] of sequence seq_ids[i] at position pos[i], with the logits of the last token of each sequence
+static bool decode(llama_context * ctx, const std::vector<llama_token> & tokens, const std::vector<llama_pos> & pos, const std::vector<llama_seq_id> & seq_ids) {
+    llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        batch.token   [i]    = tokens[i];
+        batch.pos     [i]    = pos[i];
+        batch.n_seq_id[i]    = 1;
+        batch.seq_id  [i][0] = seq_ids[i];
+        batch.logits  [i]    = i + 1 == tokens.size() || seq_ids[i + 1] != seq_ids[i];
+    }
+    batch.n_tokens = tokens.size();
+
+    const bool ok = llama_decode(ctx, batch) == 0;
+
+    llama_batch_free(batch);
+
+    return ok;
+}
+
+static bool logits_equal(const float * a, const float * b, int32_t n_vocab) {
+    for (int32_t j = 0; j < n_vocab; j++) {
+        if (std::fabs(a[j] - b[j]) > 1e-3f*std::max(1.0f, std::fabs(b[j]))) {
+            fprintf(stderr, "logit %d: %f != %f\n", j, a[j], b[j]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the blocks with the cells of the sequence, or with the cells that are shared by n sequences if seq_id < 0
+static std::set<uint32_t> get_blocks(const llama_kv_cells_unified & cells, llama_seq_id seq_id, int n) {
+    std::set<uint32_t> res;
+
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        if (cells.is_empty(i)) {
+            continue;
+        }
+
+        if (seq_id < 0 ? (int) cells.seq_count(i) == n : cells.seq_has(i, seq_id) && cells.seq_count(i) == 1) {
+            res.insert(cells.block_of(i));
+        }
+    }
+
+    return res;
+}
+
+// the blocks of each sequence contain only its own cells
+static bool check_tails(const llama_kv_cells_unified & cells, const std::set<uint32_t> & prefix) {
+    std::set<uint32_t> seen;
+
+    for (llama_seq_id s = 0; s < n_seq; ++s) {
+        const auto blocks = get_blocks(cells, s, 1);
+
+        if (blocks.empty()) {
+            fprintf(stderr, "sequence %d has no cells of its own\n", s);
+            return false;
+        }
+
+        for (uint32_t b : blocks) {
+            if (prefix.count(b) > 0 || !seen.insert(b).second) {
+                fprintf(stderr, "block %u of sequence %d is shared\n", b, s);
+                return false;
+            }
+
+            for (uint32_t i = cells.block_begin(b); i < cells.block_end(b); ++i) {
+                if (!cells.is_empty(i) && (cells.seq_count(i) != 1 || !cells.seq_has(i, s))) {
+                    fprintf(stderr, "block %u of sequence %d has cells of other sequences\n", b, s);
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    auto * model_path = get_model_or_exit(argc, argv);
+
+    // paged mode requires ggml_set_rows()
+#ifdef _WIN32
+    _putenv_s("LLAMA_SET_ROWS", "1");
+#else
+    setenv("LLAMA_SET_ROWS", "1", 1);
+#endif
+
+    llama_backend_init();
+
+    llama_model * model = llama_model_load_from_file(model_path, llama_model_default_params());
+    if (model == nullptr) {
+        fprintf(stderr, "failed to load the model %s\n", model_path);
+        return 1;
+    }
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+
+    llama_context * ctx = init_context(model, n_seq);
+
+    llama_memory_t mem = llama_get_memory(ctx);
+
+    const auto * kv = dynamic_cast<const llama_kv_cache_unified *>(mem);
+    if (kv == nullptr || kv->get_n_block() != n_block) {
+        fprintf(stderr, "the model does not use a paged unified KV cache\n");
+        return 1;
+    }
+
+    const auto & cells = kv->get_cells(0);
+
+    int ret = 0;
+
+    // reference contexts with a single sequence
+    std::vector<llama_context *> refs;
+
+    std::vector<llama_token> prefix;
+    std::vector<llama_pos>   prefix_pos;
+    for (int i = 0; i < n_prefix; i++) {
+        prefix.push_back(tok(vocab, i));
+        prefix_pos.push_back(i);
+    }
+
+    if (!decode(ctx, prefix, prefix_pos, std::vector<llama_seq_id>(n_prefix, 0))) {
+        fprintf(stderr, "failed to decode the prefix\n");
+        return 1;
+    }
+
+    for (llama_seq_id s = 1; s < n_seq; ++s) {
+        llama_memory_seq_cp(mem, 0, s, -1, -1);
+    }
+
+    const auto blocks_prefix = get_blocks(cells, -1, n_seq);
+
+    if (blocks_prefix.size() != (n_prefix + n_block - 1)/n_block || get_blocks(cells, -1, 1).size() > 0) {
+        fprintf(stderr, "the prefix is not shared by all sequences\n");
+        ret = 1;
+    }
+
+    // divergent tails
+    {
+        std::vector<llama_token>  tokens;
+        std::vector<llama_pos>    pos;
+        std::vector<llama_seq_id> seq_ids;
+
+        for (llama_seq_id s = 0; s < n_seq && ret == 0; ++s) {
+            std::vector<llama_token> tail;
+            std::vector<llama_pos>   tail_pos;
+            for (int i = 0; i < n_tail; i++) {
+                tail.push_back(tok(vocab, n_prefix + 1000*(s + 1) + i));
+                tail_pos.push_back(n_prefix + i);
+            }
+
+            tokens .insert(tokens.end(),  tail.begin(),     tail.end());
+            pos    .insert(pos.end(),     tail_pos.begin(), tail_pos.end());
+            seq_ids.insert(seq_ids.end(), n_tail, s);
+
+            llama_context * ref = init_context(model, 1);
+            refs.push_back(ref);
+
+            if (!decode(ref, prefix, prefix_pos, std::vector<llama_seq_id>(n_prefix, 0)) ||
+                !decode(ref, tail,   tail_pos,   std::vector<llama_seq_id>(n_tail, 0))) {
+                fprintf(stderr, "failed to decode the reference of sequence %d\n", s);
+                ret = 1;
+            }
+        }
+
+        if (ret == 0 && !decode(ctx, tokens, pos, seq_ids)) {
+            fprintf(stderr, "failed to decode the tails\n");
+            ret = 1;
+        }
+
+        if (ret == 0 && (get_blocks(cells, -1, n_seq) != blocks_prefix || !check_tails(cells, blocks_prefix))) {
+            fprintf(stderr, "the tails are not in blocks of their own sequence\n");
+            ret = 1;
+        }
+
+        for (llama_seq_id s = 0; s < n_seq && ret == 0; ++s) {
+            if (!logits_equal(llama_get_logits_ith(ctx, (s + 1)*n_tail - 1), llama_get_logits_ith(refs[s], -1), n_vocab)) {
+                fprintf(stderr, "the logits of sequence %d differ after writing the tails\n", s);
+                ret = 1;
+            }
+        }
+    }
+
+    // shifting the positions of sequence 1 copies its shared cells
+    if (ret == 0) {
+        llama_memory_seq_add(mem,     1, 0, -1, n_shift);
+        llama_memory_seq_add(llama_get_memory(refs[1]), 0, 0, -1, n_shift);
+
+        if (get_blocks(cells, -1, n_seq - 1) != blocks_prefix || !check_tails(cells, blocks_prefix)) {
+            fprintf(stderr, "the copies of the prefix are not in blocks of their own sequence\n");
+            ret = 1;
+        }
+
+        for (uint32_t i = 0; i < cells.size() && ret == 0; ++i) {
+            if (blocks_prefix.count(cells.block_of(i)) > 0 && cells.seq_has(i, 1)) {
+                fprintf(stderr, "cell %u of the prefix still has sequence 1\n", i);
+                ret = 1;
+            }
+        }
+    }
+
+    // the next token of each sequence must not see any change of the prefix data
+    if (ret == 0) {
+        std::vector<llama_token>  tokens;
+        std::vector<llama_pos>    pos;
+        std::vector<llama_seq_id> seq_ids;
+
+        for (llama_seq_id s = 0; s < n_seq; ++s) {
+            const llama_token t = tok(vocab, 7*(s + 1));
+            const llama_pos   p = n_prefix + n_tail + (s == 1 ? n_shift : 0);
+
+            tokens .push_back(t);
+            pos    .push_back(p);
+            seq_ids.push_back(s);
+
+            if (!decode(refs[s], { t }, { p }, { 0 })) {
+                fprintf(stderr, "failed to decode the next token of the reference of sequence %d\n", s);
+                ret = 1;
+            }
+        }
+
+        if (ret == 0 && !decode(ctx, tokens, pos, seq_ids)) {
+            fprintf(stderr, "failed to decode the next tokens\n");
+            ret = 1;
+        }
+
+        for (llama_seq_id s = 0; s < n_seq && ret == 0; ++s) {
+            if (!logits_equal(llama_get_logits_ith(ctx, s), llama_get_logits_ith(refs[s], -1), n_vocab)) {
+                fprintf(stderr, "the logits of sequence %d differ after the copy-on-write\n", s);
+                ret = 1;
+            }
+        }
+    }
+
+    for (auto * ref : refs) {
+        llama_free(ref);
+    }
+
+    llama_free(ctx);
+    llama_model_free(model);
+    llama_backend_free();
+
+    return ret;
+}
@@ -0,0 +1,249 @@
+// paged allocation of the KV cache cells
+// many short-lived sequences grow, roll back and are removed - the blocks that they take from the free list must be
+// accounted for, never shared between the sequences and all returned to the free list at the end
+
+#include "llama.h"
+
+#include "../src/llama-batch.h"
+#include "../src/llama-kv-cache-unified.h"
+#include "../src/llama-kv-cells.h"
+#include "../src/llama-model.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+static llama_seq_id g_seq_ids[LLAMA_MAX_SEQ];
+
+// ubatch with the given (seq_id, pos) tokens, one sequence per token
+static llama_ubatch make_ubatch(const std::vector<std::pair<llama_seq_id, llama_pos>> & tokens) {
+    auto data = std::make_shared<llama_ubatch::data_t>();
+
+    data->seq_idx.resize(LLAMA_MAX_SEQ, -1);
+
+    for (const auto & [seq_id, pos] : tokens) {
+        data->token   .push_back(0);
+        data->pos     .push_back(pos);
+        data->n_seq_id.push_back(1);
+        data->seq_id  .push_back(&g_seq_ids[seq_id]);
+        data->output  .push_back(0);
+
+        if (data->seq_idx[seq_id] < 0) {
+            data->seq_idx[seq_id] = data->seq_id_unq.size();
+            data->seq_id_unq.push_back(seq_id);
+        }
+    }
+
+    const uint32_t n_tokens = tokens.size();
+
+    llama_ubatch ubatch = {
+        /*.b_equal_seqs =*/ false,
+        /*.n_tokens     =*/ n_tokens,
+        /*.n_seq_tokens =*/ 1,
+        /*.n_seqs       =*/ n_tokens,
+        /*.n_seqs_unq   =*/ (uint32_t) data->seq_id_unq.size(),
+        /*.token        =*/ data->token.data(),
+        /*.embd         =*/ nullptr,
+        /*.pos          =*/ data->pos.data(),
+        /*.n_seq_id     =*/ data->n_seq_id.data(),
+        /*.seq_id       =*/ data->seq_id.data(),
+        /*.seq_id_unq   =*/ data->seq_id_unq.data(),
+        /*.seq_idx      =*/ data->seq_idx.data(),
+        /*.output       =*/ data->output.data(),
+        /*.data         =*/ data,
+    };
+
+    return ubatch;
+}
+
+// check the block counters of the cells against the cells of the sequences with the given lengths
+static bool check_blocks(const llama_kv_cells_unified & cells, const std::vector<int> & n_len, int it) {
+    const uint32_t bs = cells.get_block_size();
+
+    uint32_t n_used = 0;
+
+    std::vector<std::set<uint32_t>> seq_blocks(n_len.size());
+
+    for (uint32_t b = 0; b < cells.n_blocks(); ++b) {
+        std::set<llama_seq_id> seqs;
+
+        uint32_t n = 0;
+        for (uint32_t i = cells.block_begin(b); i < cells.block_end(b); ++i) {
+            if (cells.is_empty(i)) {
+                continue;
+            }
+
+            n++;
+
+            const llama_seq_id seq_id = cells.seq_get(i);
+
+            seqs.insert(seq_id);
+            seq_blocks[seq_id].insert(b);
+        }
+
+        if (n != cells.block_n_used(b)) {
+            fprintf(stderr, "it %d: block %u has %u used cells, counted %u\n", it, b, n, cells.block_n_used(b));
+            return false;
+        }
+
+        if (seqs.size() > 1) {
+            fprintf(stderr, "it %d: block %u is shared by %zu sequences\n", it, b, seqs.size());
+            return false;
+        }
+
+        n_used += n > 0;
+    }
+
+    if (cells.n_blocks_free() != cells.n_blocks() - n_used) {
+        fprintf(stderr, "it %d: %u free blocks, expected %u\n", it, cells.n_blocks_free(), cells.n_blocks() - n_used);
+        return false;
+    }
+
+    for (size_t s = 0; s < n_len.size(); ++s) {
+        const uint32_t n_blocks = (n_len[s] + bs - 1)/bs;
+
+        if (seq_blocks[s].size() != n_blocks) {
+            fprintf(stderr, "it %d: sequence %zu of length %d is in %zu blocks, expected %u\n",
+                    it, s, n_len[s], seq_blocks[s].size(), n_blocks);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main() {
+    // paged mode requires ggml_set_rows()
+#ifdef _WIN32
+    _putenv_s("LLAMA_SET_ROWS", "1");
+#else
+    setenv("LLAMA_SET_ROWS", "1", 1);
+#endif
+
+    for (int s = 0; s < LLAMA_MAX_SEQ; ++s) {
+        g_seq_ids[s] = s;
+    }
+
+    llama_backend_init();
+
+    llama_model model(llama_model_default_params());
+
+    model.hparams.n_layer       = 1;
+    model.hparams.n_embd_head_k = 4;
+    model.hparams.n_embd_head_v = 4;
+    model.hparams.n_head_arr   .fill(1);
+    model.hparams.n_head_kv_arr.fill(1);
+
+    const int n_seq   = 8;
+    const int n_block = 16;
+    const int n_max   = 4*n_block;
+
+    // enough blocks for all sequences at their max length
+    const uint32_t kv_size = n_seq*n_max;
+
+    llama_kv_cache_unified kv(model, nullptr, GGML_TYPE_F16, GGML_TYPE_F16, false, false, true, kv_size, n_seq, 32, 0, LLAMA_SWA_TYPE_NONE, n_block);
+
+    if (kv.get_n_block() != n_block) {
+        fprintf(stderr, "paged mode is not enabled\n");
+        return 1;
+    }
+
+    const auto & cells = kv.get_cells(0);
+
+    std::mt19937 rng(42);
+
+    // current and final length of each sequence, 0 - not started
+    std::vector<int> n_len(n_seq, 0);
+    std::vector<int> n_end(n_seq, 0);
+
+    int n_done = 0;
+
+    for (int it = 0; it < 2000; ++it) {
+        std::vector<std::pair<llama_seq_id, llama_pos>> tokens;
+
+        for (int s = 0; s < n_seq; ++s) {
+            if (n_end[s] == 0) {
+                if (rng() % 4 != 0) {
+                    continue;
+                }
+
+                n_end[s] = 1 + rng() % n_max;
+            }
+
+            const int n = std::min<int>(1 + rng() % 8, n_end[s] - n_len[s]);
+            for (int i = 0; i < n; ++i) {
+                tokens.emplace_back(s, 0);
+            }
+        }
+
+        if (!tokens.empty()) {
+            // interleave the sequences, the positions of each sequence stay in order
+            std::shuffle(tokens.begin(), tokens.end(), rng);
+
+            for (auto & [seq_id, pos] : tokens) {
+                pos = n_len[seq_id]++;
+            }
+
+            const llama_ubatch ubatch = make_ubatch(tokens);
+
+            const auto sinfo = kv.find_slot(ubatch, false);
+            if (sinfo.empty()) {
+                fprintf(stderr, "it %d: failed to find a slot for %zu tokens\n", it, tokens.size());
+                return 1;
+            }
+
+            kv.apply_ubatch(sinfo, ubatch);
+        }
+
+        for (int s = 0; s < n_seq; ++s) {
+            if (n_len[s] == 0) {
+                continue;
+            }
+
+            const uint32_t r = rng() % 8;
+
+            if (n_len[s] == n_end[s] && r < 2) {
+                // the sequence is done
+                kv.seq_rm(s, -1, -1);
+
+                n_len[s] = 0;
+                n_end[s] = 0;
+
+                n_done++;
+            } else if (r == 2) {
+                // roll back the tail, e.g. rejected draft tokens
+                const int n = 1 + rng() % std::min(n_len[s], n_block + 4);
+
+                kv.seq_rm(s, n_len[s] - n, -1);
+
+                n_len[s] -= n;
+            }
+        }
+
+        if (!check_blocks(cells, n_len, it)) {
+            return 1;
+        }
+    }
+
+    for (int s = 0; s < n_seq; ++s) {
+        kv.seq_rm(s, -1, -1);
+
+        n_len[s] = 0;
+    }
+
+    if (!check_blocks(cells, n_len, -1) || cells.n_blocks_free() != cells.n_blocks()) {
+        fprintf(stderr, "blocks left in use after removing all sequences\n");
+        return 1;
+    }
+
+    printf("%d sequences done, %u blocks\n", n_done, cells.n_blocks());
+
+    llama_backend_free();
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Q/K/V and gate/up weights concatenated at load time
+// the concatenated weights are assembled by the threads that load the tensors, from the mmap-ed or the read files - the
+// logits must match the model with the separate weights
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "../src/llama-model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static std::vector<float> eval(const char * model_path, bool fuse_weights, bool use_mmap, bool & fused) {
+    llama_model_params mparams = llama_model_default_params();
+    mparams.fuse_weights = fuse_weights;
+    mparams.use_mmap     = use_mmap;
+
+    llama_model * model = llama_model_load_from_file(model_path, mparams);
+    if (model == nullptr) {
+        fprintf(stderr, "failed to load the model %s\n", model_path);
+        return {};
+    }
+
+    fused = !model->layers.empty() && model->layers[0].wqkv != nullptr && model->layers[0].ffn_gate_up != nullptr;
+
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx   = 128;
+    cparams.n_batch = 128;
+
+    llama_context * ctx = llama_init_from_model(model, cparams);
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+
+    std::vector<llama_token> tokens;
+    for (int i = 0; i < 32; i++) {
+        tokens.push_back((100 + 37*i) % n_vocab);
+    }
+
+    std::vector<float> logits;
+    if (llama_decode(ctx, llama_batch_get_one(tokens.data(), tokens.size())) == 0) {
+        const float * res = llama_get_logits_ith(ctx, -1);
+        logits.assign(res, res + n_vocab);
+    } else {
+        fprintf(stderr, "failed to decode\n");
+    }
+
+    llama_free(ctx);
+    llama_model_free(model);
+
+    return logits;
+}
+
+int main(int argc, char ** argv) {
+    auto * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    bool fused = false;
+    const std::vector<float> ref = eval(model_path, false, true, fused);
+    if (ref.empty() || fused) {
+        fprintf(stderr, "failed to evaluate the model with separate weights\n");
+        return 1;
+    }
+
+    int ret = 0;
+
+    for (const bool use_mmap : { true, false }) {
+        const std::vector<float> res = eval(model_path, true, use_mmap, fused);
+
+        if (!fused) {
+            // other architectures keep their separate projections
+            fprintf(stderr, "the model has no concatenated weights, skipping\n");
+            break;
+        }
+
+        if (res.size() != ref.size()) {
+            fprintf(stderr, "failed to evaluate the model with concatenated weights, use_mmap = %d\n", use_mmap);
+            ret = 1;
+            continue;
+        }
+
+        for (size_t j = 0; j < ref.size(); j++) {
+            if (std::fabs(res[j] - ref[j]) > 1e-3f*std::max(1.0f, std::fabs(ref[j]))) {
+                fprintf(stderr, "use_mmap = %d, logit %zu: %f != %f\n", use_mmap, j, res[j], ref[j]);
+                ret = 1;
+                break;
+            }
+        }
+    }
+
+    llama_backend_free();
+
+    return ret;
+}
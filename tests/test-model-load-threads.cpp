@@ -0,0 +1,63 @@
+// tensors loaded by the pool of loader threads
+// the tensors of the CPU buffers, including the repacked and the concatenated weights, must be the same as when they are
+// loaded one at a time on the calling thread
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "../src/llama-model.h"
+
+#include <cstdio>
+#include <cstring>
+
+static llama_model * load(const char * model_path, int n_load_threads) {
+    llama_model_params mparams = llama_model_default_params();
+    mparams.use_mmap       = false;
+    mparams.check_tensors  = true;
+    mparams.fuse_weights   = true;
+    mparams.n_load_threads = n_load_threads;
+
+    return llama_model_load_from_file(model_path, mparams);
+}
+
+int main(int argc, char ** argv) {
+    auto * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    llama_model * model_serial = load(model_path, 1);
+    llama_model * model_pool   = load(model_path, 4);
+    if (model_serial == nullptr || model_pool == nullptr) {
+        fprintf(stderr, "failed to load the model %s\n", model_path);
+        return 1;
+    }
+
+    const auto & tensors_serial = model_serial->tensors_by_name;
+    const auto & tensors_pool   = model_pool->tensors_by_name;
+
+    int ret = 0;
+
+    if (tensors_serial.size() != tensors_pool.size()) {
+        fprintf(stderr, "%zu tensors loaded serially, %zu by the pool\n", tensors_serial.size(), tensors_pool.size());
+        ret = 1;
+    }
+
+    for (size_t i = 0; i < tensors_serial.size() && ret == 0; i++) {
+        const ggml_tensor * a = tensors_serial[i].second;
+        const ggml_tensor * b = tensors_pool[i].second;
+
+        if (tensors_serial[i].first != tensors_pool[i].first || ggml_nbytes(a) != ggml_nbytes(b)) {
+            fprintf(stderr, "tensor %zu: %s != %s\n", i, tensors_serial[i].first.c_str(), tensors_pool[i].first.c_str());
+            ret = 1;
+        } else if (a->data == nullptr || b->data == nullptr || memcmp(a->data, b->data, ggml_nbytes(a)) != 0) {
+            fprintf(stderr, "tensor %s: the data differs\n", tensors_serial[i].first.c_str());
+            ret = 1;
+        }
+    }
+
+    llama_model_free(model_pool);
+    llama_model_free(model_serial);
+    llama_backend_free();
+
+    return ret;
+}
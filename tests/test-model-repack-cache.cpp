@@ -0,0 +1,162 @@
+// cache of the weights converted by the CPU extra buffer types (e.g. repacked)
+// the weights mmap-ed from the cache must be the same as a fresh conversion, and a cache that does not match the model
+// or is truncated must be rejected and rebuilt
+
+#include "llama.h"
+#include "get-model.h"
+
+#include "../src/llama-model.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// whether the last load used the cache
+static bool g_cache_used = false;
+
+static void log_callback(ggml_log_level level, const char * text, void * /*user_data*/) {
+    if (strstr(text, "using repack cache") != nullptr) {
+        g_cache_used = true;
+    }
+    if (level == GGML_LOG_LEVEL_ERROR) {
+        fputs(text, stderr);
+    }
+}
+
+static llama_model * load(const std::string & model_path, bool repack_cache) {
+    llama_model_params mparams = llama_model_default_params();
+    mparams.repack_cache = repack_cache;
+
+    g_cache_used = false;
+
+    return llama_model_load_from_file(model_path.c_str(), mparams);
+}
+
+// data of the tensors in the extra buffers, by name
+static std::vector<std::pair<std::string, std::vector<uint8_t>>> get_extra_data(const llama_model * model) {
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> res;
+
+    for (const auto & [name, t] : model->tensors_by_name) {
+        if (t->buffer == nullptr || ggml_backend_buffer_is_host(t->buffer)) {
+            continue;
+        }
+
+        const size_t size = ggml_backend_buft_get_alloc_size(ggml_backend_buffer_get_type(t->buffer), t);
+        res.emplace_back(name, std::vector<uint8_t>((const uint8_t *) t->data, (const uint8_t *) t->data + size));
+    }
+
+    return res;
+}
+
+// load the model with the cache and compare the converted weights with the reference
+static bool check(const std::string & model_path, const std::vector<std::pair<std::string, std::vector<uint8_t>>> & ref, bool expect_cache_used, const char * desc) {
+    llama_model * model = load(model_path, true);
+    if (model == nullptr) {
+        fprintf(stderr, "%s: failed to load the model\n", desc);
+        return false;
+    }
+
+    const bool cache_used = g_cache_used;
+    const bool equal      = get_extra_data(model) == ref;
+
+    llama_model_free(model);
+
+    if (cache_used != expect_cache_used) {
+        fprintf(stderr, "%s: the cache was %s\n", desc, cache_used ? "used" : "not used");
+        return false;
+    }
+
+    if (!equal) {
+        fprintf(stderr, "%s: the converted weights differ from a fresh conversion\n", desc);
+        return false;
+    }
+
+    return true;
+}
+
+// the cache files written next to the model
+static std::vector<fs::path> get_cache_files(const fs::path & dir) {
+    std::vector<fs::path> res;
+    for (const auto & entry : fs::directory_iterator(dir)) {
+        if (entry.path().extension() == ".cache") {
+            res.push_back(entry.path());
+        }
+    }
+    return res;
+}
+
+int main(int argc, char ** argv) {
+    auto * model_path_src = get_model_or_exit(argc, argv);
+
+    // the cache is written next to the model, use a copy of it
+    const fs::path dir = fs::temp_directory_path() / "test-model-repack-cache";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    const std::string model_path = (dir / "model.gguf").string();
+    fs::copy_file(model_path_src, model_path);
+
+    llama_log_set(log_callback, nullptr);
+    llama_backend_init();
+
+    int ret = 0;
+
+    // reference without the cache
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> ref;
+    {
+        llama_model * model = load(model_path, false);
+        if (model == nullptr) {
+            fprintf(stderr, "failed to load the model %s\n", model_path_src);
+            ret = 1;
+        } else {
+            ref = get_extra_data(model);
+            llama_model_free(model);
+        }
+    }
+
+    if (ret == 0 && ref.empty()) {
+        fprintf(stderr, "the model has no weights in the CPU extra buffers, skipping\n");
+    } else if (ret == 0) {
+        // the first load converts the weights and writes the cache, the second one uses it
+        if (!check(model_path, ref, false, "fresh") || !check(model_path, ref, true, "cache hit")) {
+            ret = 1;
+        }
+
+        const std::vector<fs::path> caches = ret == 0 ? get_cache_files(dir) : std::vector<fs::path>();
+        if (ret == 0 && caches.empty()) {
+            fprintf(stderr, "no cache file written in %s\n", dir.string().c_str());
+            ret = 1;
+        }
+
+        // a key that does not match the model, see llama_repack_cache_header
+        for (const auto & path : caches) {
+            std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+            f.seekg(8);
+            const char c = (char) f.get();
+            f.seekp(8);
+            f.put((char) (c ^ 0xff));
+        }
+        if (ret == 0 && (!check(model_path, ref, false, "stale key") || !check(model_path, ref, true, "rebuilt after stale key"))) {
+            ret = 1;
+        }
+
+        // data cut short
+        for (const auto & path : caches) {
+            fs::resize_file(path, fs::file_size(path)/2);
+        }
+        if (ret == 0 && (!check(model_path, ref, false, "truncated") || !check(model_path, ref, true, "rebuilt after truncation"))) {
+            ret = 1;
+        }
+    }
+
+    llama_backend_free();
+
+    fs::remove_all(dir);
+
+    return ret;
+}
@@ -1,13 +1,18 @@
 #include "ggml.h"
 #include "llama.h"
+#include "sampling.h"
 
 #ifdef NDEBUG
 #undef NDEBUG
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 extern struct llama_sampler * llama_sampler_init_dry_testing(int32_t context_size, float dry_multiplier, float dry_base, int32_t dry_allowed_length, int32_t dry_penalty_last_n, const std::vector<std::vector<llama_token>>& seq_breakers);
@@ -267,6 +272,162 @@ static void test_sampler_queue(const size_t n_vocab, const std::string & sampler
            samplers_sequence.c_str(), n_vocab, top_k, top_p, min_p);
 }
 
+static llama_sampler * chain_init(const std::string & samplers_sequence, int n_vocab, const std::vector<llama_token> & prev) {
+    llama_sampler * chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+
+    // raise a token from the bottom of the vocabulary and remove the largest one
+    const std::vector<llama_logit_bias> logit_bias = { { 5, 30.0f }, { prev[0], -INFINITY } };
+
+    for (auto s : samplers_sequence) {
+        switch (s) {
+            case 'b': llama_sampler_chain_add(chain, llama_sampler_init_logit_bias(n_vocab, logit_bias.size(), logit_bias.data())); break;
+            case 'r': llama_sampler_chain_add(chain, llama_sampler_init_penalties (64, 1.5f, 0.5f, 0.5f)); break;
+            case 'k': llama_sampler_chain_add(chain, llama_sampler_init_top_k     (40)); break;
+            case 'p': llama_sampler_chain_add(chain, llama_sampler_init_top_p     (0.9f, 1)); break;
+            case 'm': llama_sampler_chain_add(chain, llama_sampler_init_min_p     (0.05f, 1)); break;
+            case 't': llama_sampler_chain_add(chain, llama_sampler_init_temp      (0.8f)); break;
+            default : GGML_ABORT("Unknown sampler");
+        }
+    }
+
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(1234));
+
+    for (const llama_token id : prev) {
+        llama_sampler_accept(chain, id);
+    }
+
+    return chain;
+}
+
+static void test_chain_apply_logits(const std::string & samplers_sequence, bool fused_expected) {
+    const int n_vocab = 32000;
+
+    std::vector<float> logits(n_vocab);
+    for (int i = 0; i < n_vocab; i++) {
+        logits[i] = 10.0f*((double)(rand())/RAND_MAX - 0.5);
+    }
+
+    // the largest logits are the previous tokens of the penalties
+    std::vector<llama_token> prev(n_vocab);
+    for (int i = 0; i < n_vocab; i++) {
+        prev[i] = i;
+    }
+    std::partial_sort(prev.begin(), prev.begin() + 8, prev.end(), [&](llama_token a, llama_token b) { return logits[a] > logits[b]; });
+    prev.resize(8);
+
+    llama_sampler * chain_ref = chain_init(samplers_sequence, n_vocab, prev);
+    llama_sampler * chain     = chain_init(samplers_sequence, n_vocab, prev);
+
+    std::vector<llama_token_data> cur;
+    for (llama_token id = 0; id < n_vocab; id++) {
+        cur.emplace_back(llama_token_data{id, logits[id], 0.0f});
+    }
+    llama_token_data_array cur_p_ref = { cur.data(), cur.size(), -1, false };
+    llama_sampler_apply(chain_ref, &cur_p_ref);
+
+    llama_token_data_array cur_p;
+    const bool fused = llama_sampler_chain_apply_logits(chain, logits.data(), n_vocab, &cur_p);
+
+    GGML_ASSERT(fused == fused_expected);
+
+    if (fused) {
+        GGML_ASSERT(cur_p.size == cur_p_ref.size);
+        for (size_t i = 0; i < cur_p.size; i++) {
+            GGML_ASSERT(cur_p.data[i].id == cur_p_ref.data[i].id);
+            GGML_ASSERT(fabs(cur_p.data[i].p - cur_p_ref.data[i].p) < 1e-6);
+        }
+        GGML_ASSERT(cur_p.selected == cur_p_ref.selected);
+    }
+
+    llama_sampler_free(chain_ref);
+    llama_sampler_free(chain);
+
+    printf("Chain %6s OK with n_vocab=%05d fused=%d\n", samplers_sequence.c_str(), n_vocab, fused);
+}
+
+// each sequence is sampled by its own sampler, the tokens must not depend on the number of threads of the pool
+// the pool is used for several steps in a row, as the server does for each decode
+static void test_sampler_pool() {
+    const int n_seq   = 13;
+    const int n_vocab = 256;
+    const int n_steps = 32;
+
+    auto sample = [&](int n_threads) {
+        common_sampler_pool * pool = common_sampler_pool_init(n_threads);
+
+        std::vector<llama_sampler *> smpls(n_seq);
+        for (int i = 0; i < n_seq; i++) {
+            smpls[i] = llama_sampler_chain_init(llama_sampler_chain_default_params());
+            llama_sampler_chain_add(smpls[i], llama_sampler_init_top_k(40));
+            llama_sampler_chain_add(smpls[i], llama_sampler_init_temp(0.8f));
+            llama_sampler_chain_add(smpls[i], llama_sampler_init_dist(1234 + i));
+        }
+
+        std::vector<std::vector<llama_token>> result(n_seq);
+        for (int step = 0; step < n_steps; step++) {
+            common_sampler_pool_run(pool, n_seq, [&](int i) {
+                std::vector<llama_token_data> cur(n_vocab);
+                for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+                    cur[token_id] = { token_id, (float) ((token_id*31 + i*17 + step*7) % 101) / 10.0f, 0.0f };
+                }
+                llama_token_data_array cur_p = { cur.data(), cur.size(), -1, false };
+                llama_sampler_apply(smpls[i], &cur_p);
+                GGML_ASSERT(cur_p.selected >= 0 && cur_p.selected < (int64_t) cur_p.size);
+
+                const llama_token id = cur_p.data[cur_p.selected].id;
+                llama_sampler_accept(smpls[i], id);
+                result[i].push_back(id);
+            });
+        }
+
+        for (auto * smpl : smpls) {
+            llama_sampler_free(smpl);
+        }
+        common_sampler_pool_free(pool);
+
+        return result;
+    };
+
+    const auto result_ref = sample(1);
+    for (int n_threads : { 2, 4, 8 }) {
+        GGML_ASSERT(sample(n_threads) == result_ref);
+    }
+
+    // an exception thrown on a worker or on the calling thread is rethrown by the pool, which remains usable
+    common_sampler_pool * pool = common_sampler_pool_init(4);
+
+    const std::thread::id caller = std::this_thread::get_id();
+
+    for (bool throw_on_caller : { false, true, false, true }) {
+        std::atomic<int> n_thrown = 0;
+
+        bool caught = false;
+        try {
+            // the other threads wait for the exception, so that the throwing thread gets a job
+            common_sampler_pool_run(pool, 64, [&](int) {
+                if ((std::this_thread::get_id() == caller) == throw_on_caller) {
+                    n_thrown++;
+                    throw std::runtime_error("test");
+                }
+                while (n_thrown == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            });
+        } catch (const std::runtime_error &) {
+            caught = true;
+        }
+        GGML_ASSERT(caught && n_thrown > 0);
+
+        std::vector<int> n_calls(64, 0);
+        common_sampler_pool_run(pool, 64, [&](int i) {
+            n_calls[i]++;
+        });
+        GGML_ASSERT(std::all_of(n_calls.begin(), n_calls.end(), [](int n) { return n == 1; }));
+    }
+
+    common_sampler_pool_free(pool);
+}
+
 static void bench(llama_sampler * cnstr, const char * cnstr_name, const std::vector<llama_token_data> & data, int n_iter) {
     std::vector<llama_token_data> cur(data.size());
     std::copy(data.begin(), data.end(), cur.begin());
@@ -303,6 +464,26 @@ static void test_perf() {
     BENCH(llama_sampler_init_min_p  (0.2f, 1),                data, 32);
     BENCH(llama_sampler_init_typical(0.5f, 1),                data, 32);
     BENCH(llama_sampler_init_xtc    (1.0f, 0.1f, 1, 1),       data, 32);
+
+    // the common chain, from the array of the vocabulary and fused from the logits
+    std::vector<float> logits(n_vocab);
+    for (int i = 0; i < n_vocab; i++) {
+        logits[i] = data[i].logit;
+    }
+    const std::vector<llama_token> prev = { 0 };
+
+    llama_sampler * chain = chain_init("kpmt", n_vocab, prev);
+    BENCH(chain, data, 32);
+
+    chain = chain_init("kpmt", n_vocab, prev);
+    llama_token_data_array cur_p;
+    const int64_t t_start = ggml_time_us();
+    for (int i = 0; i < 32; i++) {
+        GGML_ASSERT(llama_sampler_chain_apply_logits(chain, logits.data(), n_vocab, &cur_p));
+    }
+    const int64_t t_end = ggml_time_us();
+    llama_sampler_free(chain);
+    printf("%-43s: %8.3f us/iter\n", "llama_sampler_chain_apply_logits(chain)", (t_end - t_start) / 32.0f);
 }
 
 int main(void) {
@@ -392,6 +573,17 @@ int main(void) {
     test_sampler_queue(10000, "mkp", 100, 0.8f, 0.1f);
     test_sampler_queue(10000, "mpk", 100, 0.8f, 0.1f);
 
+    test_chain_apply_logits("k",      true);
+    test_chain_apply_logits("kpmt",   true);
+    test_chain_apply_logits("tkpm",   true);
+    test_chain_apply_logits("bkpmt",  true);
+    test_chain_apply_logits("rbkpmt", true);
+    test_chain_apply_logits("brtkpm", true);
+    test_chain_apply_logits("pkmt",   false);
+    test_chain_apply_logits("pmt",    false);
+
+    test_sampler_pool();
+
     printf("OK\n");
 
     test_perf();
@@ -0,0 +1,152 @@
+// the top-k logits computed in the graph must match the largest logits of the full rows, for k = 1 (argmax) and k > 1
+// the state of a context with top-k logits can only be loaded in a context with the same k
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "llama.h"
+#include "get-model.h"
+
+static llama_context * init_context(llama_model * model, int32_t n_top_k_logits) {
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx          = 128;
+    cparams.n_batch        = 128;
+    cparams.n_top_k_logits = n_top_k_logits;
+
+    return llama_init_from_model(model, cparams);
+}
+
+// decode the tokens with the logits of all of them
+static bool decode(llama_context * ctx, std::vector<llama_token> & tokens) {
+    llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        batch.token   [i]    = tokens[i];
+        batch.pos     [i]    = i;
+        batch.n_seq_id[i]    = 1;
+        batch.seq_id  [i][0] = 0;
+        batch.logits  [i]    = true;
+    }
+    batch.n_tokens = tokens.size();
+
+    const bool ok = llama_decode(ctx, batch) == 0;
+
+    llama_batch_free(batch);
+
+    return ok;
+}
+
+// the ids must point to their logits in the full row, sorted by decreasing logit, and no other logit may be larger
+static bool check_row(const float * row, int32_t n_vocab, const llama_token * ids, const float * logits, int32_t k) {
+    const float eps = 1e-4f;
+
+    std::vector<bool> selected(n_vocab, false);
+    for (int32_t j = 0; j < k; j++) {
+        if (ids[j] < 0 || ids[j] >= n_vocab || selected[ids[j]]) {
+            return false;
+        }
+        selected[ids[j]] = true;
+
+        if (std::fabs(row[ids[j]] - logits[j]) > eps*std::max(1.0f, std::fabs(logits[j]))) {
+            return false;
+        }
+        if (j > 0 && logits[j] > logits[j - 1]) {
+            return false;
+        }
+    }
+
+    for (llama_token id = 0; id < n_vocab; id++) {
+        if (!selected[id] && row[id] > logits[k - 1] + eps*std::max(1.0f, std::fabs(logits[k - 1]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    auto * model_path = get_model_or_exit(argc, argv);
+
+    llama_backend_init();
+
+    llama_model * model = llama_model_load_from_file(model_path, llama_model_default_params());
+    if (model == nullptr) {
+        fprintf(stderr, "failed to load the model %s\n", model_path);
+        return 1;
+    }
+
+    const llama_vocab * vocab = llama_model_get_vocab(model);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+
+    std::vector<llama_token> tokens(64);
+    const int32_t n_tokens = llama_tokenize(vocab, "The quick brown fox jumps over the lazy dog", 43, tokens.data(), tokens.size(), true, false);
+    if (n_tokens <= 0) {
+        fprintf(stderr, "failed to tokenize the prompt\n");
+        return 1;
+    }
+    tokens.resize(n_tokens);
+
+    llama_context * ctx_full = init_context(model, 0);
+    if (ctx_full == nullptr || !decode(ctx_full, tokens)) {
+        fprintf(stderr, "failed to decode with the full rows of logits\n");
+        return 1;
+    }
+
+    for (int32_t k : { 1, 8 }) {
+        llama_context * ctx = init_context(model, k);
+        if (ctx == nullptr || !decode(ctx, tokens)) {
+            fprintf(stderr, "failed to decode with the top-%d logits\n", k);
+            return 1;
+        }
+
+        for (int32_t i = 0; i < n_tokens; i++) {
+            const llama_token * ids    = nullptr;
+            const float       * logits = nullptr;
+            if (llama_get_logits_top_k_ith(ctx, i, &ids, &logits) != k ||
+                !check_row(llama_get_logits_ith(ctx_full, i), n_vocab, ids, logits, k)) {
+                fprintf(stderr, "the top-%d logits of the output %d differ from the full row\n", k, i);
+                return 1;
+            }
+        }
+
+        // the state is restored in a context with the same k and rejected with another k
+        std::vector<uint8_t> state(llama_state_get_size(ctx));
+        state.resize(llama_state_get_data(ctx, state.data(), state.size()));
+
+        llama_context * ctx_same  = init_context(model, k);
+        llama_context * ctx_other = init_context(model, k == 1 ? 8 : 1);
+        llama_context * ctx_rows  = init_context(model, 0);
+
+        if (llama_state_set_data(ctx_same, state.data(), state.size()) != state.size()) {
+            fprintf(stderr, "failed to restore the state with the top-%d logits\n", k);
+            return 1;
+        }
+        for (int32_t i = 0; i < n_tokens; i++) {
+            const llama_token * ids    = nullptr;
+            const float       * logits = nullptr;
+            if (llama_get_logits_top_k_ith(ctx_same, i, &ids, &logits) != k ||
+                !check_row(llama_get_logits_ith(ctx_full, i), n_vocab, ids, logits, k)) {
+                fprintf(stderr, "the restored top-%d logits of the output %d differ from the full row\n", k, i);
+                return 1;
+            }
+        }
+
+        if (llama_state_set_data(ctx_other, state.data(), state.size()) != 0 ||
+            llama_state_set_data(ctx_rows,  state.data(), state.size()) != 0) {
+            fprintf(stderr, "the state with the top-%d logits was restored in a context with another k\n", k);
+            return 1;
+        }
+
+        llama_free(ctx_rows);
+        llama_free(ctx_other);
+        llama_free(ctx_same);
+        llama_free(ctx);
+    }
+
+    llama_free(ctx_full);
+    llama_model_free(model);
+    llama_backend_free();
+
+    return 0;
+}
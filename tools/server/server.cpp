@@ -6,6 +6,7 @@
 #include "json-schema-to-grammar.h"
 #include "llama.h"
 #include "log.h"
+#include "lru-cache.h"
 #include "sampling.h"
 #include "speculative.h"
 #include "mtmd.h"
@@ -24,6 +25,7 @@
 #include <cstddef>
 #include <cinttypes>
 #include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <signal.h>
@@ -117,6 +119,7 @@ struct slot_params {
     int32_t n_discard =  0; // number of tokens after n_keep that may be discarded when shifting context, 0 defaults to half
     int32_t n_predict = -1; // new tokens to predict
     int32_t n_indent  =  0; // mininum line indentation for the generated text in number of whitespace characters
+    int32_t priority  =  0; // scheduling priority, higher values are processed first and may preempt lower values
 
     int64_t t_max_prompt_ms  = -1; // TODO: implement
     int64_t t_max_predict_ms = -1; // if positive, limit the generation phase to this time limit
@@ -185,6 +188,7 @@ struct slot_params {
             {"max_tokens",                n_predict}, // User configured n_predict
             {"n_keep",                    n_keep},
             {"n_discard",                 n_discard},
+            {"priority",                  priority},
             {"ignore_eos",                sampling.ignore_eos},
             {"stream",                    stream},
             {"logit_bias",                format_logit_bias(sampling.logit_bias)},
@@ -209,10 +213,31 @@ struct slot_params {
     }
 };
 
+// LRU of the grammars converted from the JSON schemas of the requests, keyed by the schema
+// the same schemas are often sent with every request, e.g. by the tool calling clients
+struct server_schema_cache {
+    common_lru_cache<std::string, std::string> grammars; // disabled by default
+
+    // called by the HTTP threads
+    std::string to_grammar(const json & schema) {
+        const std::string key = schema.dump();
+
+        std::string grammar;
+        if (!grammars.get(key, grammar)) {
+            grammar = json_schema_to_grammar(schema);
+            grammars.put(key, grammar);
+        }
+
+        return grammar;
+    }
+};
+
 struct server_task {
     int id    = -1; // to be filled by server_queue
     int index = -1; // used when there are multiple prompts (batch request)
 
+    int64_t t_queued = -1; // time when the task was first added to the queue
+
     server_task_type type;
 
     // used by SERVER_TASK_TYPE_CANCEL
@@ -242,6 +267,7 @@ struct server_task {
     static slot_params params_from_json_cmpl(
             const llama_context * ctx,
             const common_params & params_base,
+            server_schema_cache & schema_cache,
             const json & data) {
         const llama_model * model = llama_get_model(ctx);
         const llama_vocab * vocab = llama_model_get_vocab(model);
@@ -265,6 +291,7 @@ struct server_task {
         params.n_indent         = json_value(data, "n_indent",           defaults.n_indent);
         params.n_keep           = json_value(data, "n_keep",             defaults.n_keep);
         params.n_discard        = json_value(data, "n_discard",          defaults.n_discard);
+        params.priority         = json_value(data, "priority",           defaults.priority);
       //params.t_max_prompt_ms  = json_value(data, "t_max_prompt_ms",    defaults.t_max_prompt_ms); // TODO: implement
         params.t_max_predict_ms = json_value(data, "t_max_predict_ms",   defaults.t_max_predict_ms);
         params.response_fields  = json_value(data, "response_fields",   std::vector<std::string>());
@@ -359,7 +386,7 @@ struct server_task {
             try {
                 auto schema                  = json_value(data, "json_schema", json::object());
                 SRV_DBG("JSON schema: %s\n", schema.dump(2).c_str());
-                params.sampling.grammar      = json_schema_to_grammar(schema);
+                params.sampling.grammar      = schema_cache.to_grammar(schema);
                 SRV_DBG("Converted grammar: %s\n", params.sampling.grammar.c_str());
             } catch (const std::exception & e) {
                 throw std::runtime_error(std::string("\"json_schema\": ") + e.what());
@@ -1143,6 +1170,65 @@ struct server_task_result_error : server_task_result {
     }
 };
 
+// prometheus histogram of durations in seconds, with one series per label set
+struct server_histogram {
+    struct series {
+        std::vector<uint64_t> counts; // per bucket, the last one is +Inf
+        double   sum   = 0.0;
+        uint64_t count = 0;
+    };
+
+    std::string name;
+    std::string help;
+
+    std::vector<double> bounds; // upper bounds of the buckets
+
+    std::map<std::string, series> data; // labels -> series
+
+    server_histogram(std::string name, std::string help) : name(std::move(name)), help(std::move(help)) {
+        bounds = {
+            0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0,
+        };
+    }
+
+    void observe(const std::string & labels, double value) {
+        auto & s = data[labels];
+        if (s.counts.empty()) {
+            s.counts.resize(bounds.size() + 1, 0);
+        }
+
+        const size_t i = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+
+        s.counts[i]++;
+        s.sum   += value;
+        s.count += 1;
+    }
+
+    // text exposition format: https://prometheus.io/docs/instrumenting/exposition_formats/
+    void to_prometheus(std::stringstream & out) const {
+        out << "# HELP llamacpp:" << name << " " << help << "\n"
+            << "# TYPE llamacpp:" << name << " histogram\n";
+
+        for (const auto & [labels, s] : data) {
+            const std::string sep = labels.empty() ? "" : ",";
+
+            uint64_t n = 0;
+            for (size_t i = 0; i < s.counts.size(); i++) {
+                n += s.counts[i];
+
+                const std::string le = i < bounds.size() ? string_format("%g", bounds[i]) : "+Inf";
+
+                out << "llamacpp:" << name << "_bucket{" << labels << sep << "le=\"" << le << "\"} " << n << "\n";
+            }
+
+            const std::string lb = labels.empty() ? "" : "{" + labels + "}";
+
+            out << "llamacpp:" << name << "_sum"   << lb << " " << s.sum   << "\n"
+                << "llamacpp:" << name << "_count" << lb << " " << s.count << "\n";
+        }
+    }
+};
+
 struct server_task_result_metrics : server_task_result {
     int n_idle_slots;
     int n_processing_slots;
@@ -1164,6 +1250,11 @@ struct server_task_result_metrics : server_task_result {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    uint64_t n_preempted_total      = 0;
+    uint64_t n_restore_failed_total = 0;
+
+    std::vector<server_histogram> histograms;
+
     // while we can also use std::vector<server_slot> this requires copying the slot object which can be quite messy
     // therefore, we use json to temporarily store the slot.to_json() result
     json slots_data = json::array();
@@ -1188,6 +1279,9 @@ struct server_task_result_metrics : server_task_result {
             { "n_decode_total",                  n_decode_total },
             { "n_busy_slots_total",              n_busy_slots_total },
 
+            { "n_preempted_total",               n_preempted_total },
+            { "n_restore_failed_total",          n_restore_failed_total },
+
             { "slots",                           slots_data },
         };
     }
@@ -1292,6 +1386,7 @@ struct server_slot {
     std::string  generated_text;
     llama_tokens generated_tokens;
     common_chat_msg chat_msg;
+    common_chat_parse_state chat_parse_state; // incremental parse of generated_text
 
     server_tokens cache_tokens;
 
@@ -1317,8 +1412,10 @@ struct server_slot {
     // stats
     size_t n_sent_text        = 0; // number of sent text character
 
+    int64_t t_queued = -1; // time when the task was added to the queue
     int64_t t_start_process_prompt;
     int64_t t_start_generation;
+    int64_t t_last_token = -1;
 
     double t_prompt_processing; // ms
     double t_token_generation;  // ms
@@ -1329,6 +1426,11 @@ struct server_slot {
     int32_t n_draft_total = 0;      // Total draft tokens generated
     int32_t n_draft_accepted = 0;   // Draft tokens actually accepted
 
+    // preemption - the KV cache of the slot is swapped out to host memory until there is space for it again
+    bool preempted = false;
+    int32_t n_active_preempt = 0; // number of active slots at the time of preemption
+    std::vector<uint8_t> swap_data;
+
     void reset() {
         SLT_DBG(*this, "%s", "\n");
 
@@ -1347,6 +1449,7 @@ struct server_slot {
         generated_tokens.clear();
         generated_token_probs.clear();
         chat_msg = {};
+        chat_parse_state.reset();
         json_schema = json();
         generated_tool_call_ids.clear();
 
@@ -1399,6 +1502,28 @@ struct server_slot {
         return ctx_dft && params.speculative.n_max > 0 && params.cache_prompt;
     }
 
+    // name of the endpoint that created the task, used to label the metrics
+    const char * endpoint() const {
+        switch (task_type) {
+            case SERVER_TASK_TYPE_COMPLETION:
+                switch (params.oaicompat) {
+                    case OAICOMPAT_TYPE_CHAT:       return "chat_completions";
+                    case OAICOMPAT_TYPE_COMPLETION: return "oai_completions";
+                    default:                        return "completion";
+                }
+            case SERVER_TASK_TYPE_EMBEDDING:
+                return params.oaicompat == OAICOMPAT_TYPE_EMBEDDING ? "oai_embeddings" : "embedding";
+            case SERVER_TASK_TYPE_RERANK: return "rerank";
+            case SERVER_TASK_TYPE_INFILL: return "infill";
+            default:                      return "other";
+        }
+    }
+
+    // prometheus labels of the metrics of the slot
+    std::string metrics_labels() const {
+        return string_format("slot=\"%d\",endpoint=\"%s\"", id, endpoint());
+    }
+
     void add_token(const completion_token_output & token) {
         if (!is_processing()) {
             SLT_WRN(*this, "%s", "slot is not processing\n");
@@ -1414,6 +1539,15 @@ struct server_slot {
             t_last_used = ggml_time_us();
             t_token_generation = (ggml_time_us() - t_start_generation) / 1e3;
             state = SLOT_STATE_IDLE;
+
+            if (preempted) {
+                // the KV cache of the slot has been removed from the context
+                cache_tokens.clear();
+                swap_data.clear();
+                swap_data.shrink_to_fit();
+                preempted = false;
+            }
+
             callback_on_release(id);
         }
     }
@@ -1445,7 +1579,8 @@ struct server_slot {
         auto new_msg = common_chat_parse(
             generated_text,
             /* is_partial= */ stop != STOP_TYPE_EOS,
-            params.oaicompat_chat_syntax);
+            params.oaicompat_chat_syntax,
+            &chat_parse_state);
         if (!new_msg.empty()) {
             new_msg.ensure_tool_call_ids_set(generated_tool_call_ids, gen_tool_call_id);
             chat_msg = new_msg;
@@ -1516,6 +1651,7 @@ struct server_slot {
             {"n_ctx",         n_ctx},
             {"speculative",   can_speculate()},
             {"is_processing", is_processing()},
+            {"preempted",     preempted},
             {"params",        params.to_json()},
             {"prompt",        prompt_tokens.detokenize(ctx, true)},
             {"next_token",
@@ -1531,6 +1667,76 @@ struct server_slot {
     }
 };
 
+// decides which slots take part in the next decode step and how many tokens each of them contributes
+//
+// every step has a budget of n_budget tokens. the slots that are generating contribute one token each and the rest of
+// the budget is filled with chunks of the pending prompts, so that a long prompt is interleaved with the generation of
+// the other slots instead of stalling them for whole n_batch chunks
+struct server_scheduler {
+    int32_t n_budget     = 0;    // max number of tokens per decode step
+    bool    decode_first = true; // the tokens of the generating slots count towards the budget of the step
+
+    // max size of the batch after the prompt tokens have been added to a batch of n_decode generated tokens
+    int32_t n_tokens_max(int32_t n_decode, int32_t n_batch) const {
+        if (decode_first) {
+            // always make progress with the prompts, even if the generating slots exceed the budget
+            return std::min(n_batch, std::max(n_budget, n_decode + 1));
+        }
+
+        return std::min(n_batch, n_decode + n_budget);
+    }
+
+    static bool is_before(const server_slot & a, const server_slot & b) {
+        if (a.params.priority != b.params.priority) {
+            return a.params.priority > b.params.priority;
+        }
+        return a.id_task < b.id_task;
+    }
+
+    // the order in which the pending prompts are processed - higher priority first, then in order of arrival
+    std::vector<server_slot *> order(std::vector<server_slot> & slots) const {
+        std::vector<server_slot *> res;
+        res.reserve(slots.size());
+
+        for (auto & slot : slots) {
+            res.push_back(&slot);
+        }
+
+        std::stable_sort(res.begin(), res.end(), [](const server_slot * a, const server_slot * b) {
+            return is_before(*a, *b);
+        });
+
+        return res;
+    }
+
+    // select the slot to preempt when the KV cache is full - the most recent slot with the lowest priority
+    // the first slot in the order is never preempted, so that there is always progress
+    // when the prompt of a new slot is admitted (cand), only the slots with a lower priority can be preempted
+    server_slot * get_victim(std::vector<server_slot> & slots, const server_slot * cand = nullptr) const {
+        server_slot * first = nullptr;
+        server_slot * last  = nullptr;
+
+        for (auto & slot : slots) {
+            if (!slot.is_processing() || slot.preempted || slot.state == SLOT_STATE_STARTED || &slot == cand) {
+                continue;
+            }
+
+            if (first == nullptr || is_before(slot, *first)) {
+                first = &slot;
+            }
+            if (last == nullptr || is_before(*last, slot)) {
+                last = &slot;
+            }
+        }
+
+        if (cand != nullptr) {
+            return last != nullptr && last->params.priority < cand->params.priority ? last : nullptr;
+        }
+
+        return last != first ? last : nullptr;
+    }
+};
+
 struct server_metrics {
     int64_t t_start = 0;
 
@@ -1548,10 +1754,43 @@ struct server_metrics {
     uint64_t n_decode_total     = 0;
     uint64_t n_busy_slots_total = 0;
 
+    uint64_t n_preempted_total      = 0;
+    uint64_t n_restore_failed_total = 0;
+
+    // latency distributions, labeled by slot and endpoint
+    server_histogram queue_wait        { "queue_wait_seconds",          "Time from the arrival of a task until it is assigned to a slot." };
+    server_histogram time_to_first     { "time_to_first_token_seconds", "Time from the arrival of a task until its first token is sampled." };
+    server_histogram inter_token       { "inter_token_seconds",         "Time between consecutive tokens sampled for the same task." };
+    server_histogram prefill_batch     { "prefill_batch_seconds",       "Duration of the llama_decode() calls that process prompt tokens, for each slot with prompt tokens in the call." };
+    server_histogram sampling          { "sampling_seconds",            "Time to sample a token." };
+    server_histogram detokenize        { "detokenize_seconds",          "Time to detokenize a sampled token, check the stop conditions and build the response." };
+
     void init() {
         t_start = ggml_time_us();
     }
 
+    std::vector<server_histogram> histograms() const {
+        return { queue_wait, time_to_first, inter_token, prefill_batch, sampling, detokenize };
+    }
+
+    void on_launch(const server_slot & slot) {
+        if (slot.t_queued >= 0) {
+            queue_wait.observe(slot.metrics_labels(), (ggml_time_us() - slot.t_queued) / 1e6);
+        }
+    }
+
+    void on_token(server_slot & slot, int64_t t_current) {
+        if (slot.n_decoded == 1) {
+            if (slot.t_queued >= 0) {
+                time_to_first.observe(slot.metrics_labels(), (t_current - slot.t_queued) / 1e6);
+            }
+        } else if (slot.t_last_token >= 0) {
+            inter_token.observe(slot.metrics_labels(), (t_current - slot.t_last_token) / 1e6);
+        }
+
+        slot.t_last_token = t_current;
+    }
+
     void on_prompt_eval(const server_slot & slot) {
         n_prompt_tokens_processed_total += slot.n_prompt_tokens_processed;
         n_prompt_tokens_processed       += slot.n_prompt_tokens_processed;
@@ -1566,6 +1805,20 @@ struct server_metrics {
         t_tokens_generation_total  += slot.t_token_generation;
     }
 
+    // record the duration of the decode calls that contain prompt tokens, once for each slot with prompt tokens in the call
+    void on_decode_batch(const std::vector<server_slot> & slots, const llama_batch & batch, double t_decode) {
+        std::vector<bool> observed(slots.size(), false);
+
+        for (int32_t i = 0; i < batch.n_tokens; i++) {
+            const auto & slot = slots[batch.seq_id[i][0]];
+
+            if (slot.state != SLOT_STATE_GENERATING && !observed[slot.id]) {
+                prefill_batch.observe(slot.metrics_labels(), t_decode);
+                observed[slot.id] = true;
+            }
+        }
+    }
+
     void on_decoded(const std::vector<server_slot> & slots) {
         n_decode_total++;
         for (const auto & slot : slots) {
@@ -1583,6 +1836,279 @@ struct server_metrics {
     }
 };
 
+// server-wide cache of KV states of prompts that are no longer present in any of the slots
+//
+// the states are serialized with llama_state_seq_get_data() and kept in host memory. the prompts are organized in
+// a radix tree of tokens, so the cached state with the longest common prefix with a new prompt is found in
+// O(prompt length). a prompt that is a prefix of another cached prompt is not stored, since the state of the longer
+// prompt can be used instead
+//
+// the entries are also kept in a list ordered by their last use, so the least recently used entry is evicted in O(1)
+struct server_prompt_cache {
+    struct node;
+
+    struct entry {
+        llama_tokens tokens;
+
+        std::vector<uint8_t> data;
+
+        int64_t t_last_used = 0;
+
+        node * owner = nullptr; // the node of the entry
+
+        // neighbours in the LRU list
+        entry * prev = nullptr; // more recently used
+        entry * next = nullptr; // less recently used
+    };
+
+    struct node {
+        llama_tokens edge; // tokens on the edge from the parent node
+
+        node * parent = nullptr;
+
+        // children, keyed by the first token of their edge
+        std::map<llama_token, std::unique_ptr<node>> children;
+
+        // the cached state of the prompt that ends at this node (if any)
+        std::unique_ptr<entry> ent;
+
+        // the most recently used entry in the subtree of the node
+        entry * recent = nullptr;
+    };
+
+    node root;
+
+    // the LRU list of the entries
+    entry * lru_head = nullptr; // most recently used
+    entry * lru_tail = nullptr; // least recently used
+
+    size_t size_limit = 0; // bytes
+    size_t size_total = 0; // bytes
+
+    size_t n_entries = 0;
+
+    void init(size_t limit) {
+        size_limit = limit;
+    }
+
+    bool enabled() const {
+        return size_limit > 0;
+    }
+
+    // find the cached state with the longest common prefix with the tokens and mark it as used
+    // n_match is set to the length of the common prefix
+    entry * find(const llama_tokens & tokens, size_t & n_match) {
+        entry * res = lookup(tokens, n_match);
+        if (res != nullptr) {
+            touch(res);
+        }
+
+        return res;
+    }
+
+    // same as find(), without marking the state as used
+    entry * lookup(const llama_tokens & tokens, size_t & n_match) const {
+        n_match = 0;
+
+        const node * cur = &root;
+
+        while (n_match < tokens.size()) {
+            auto it = cur->children.find(tokens[n_match]);
+            if (it == cur->children.end()) {
+                break;
+            }
+
+            const node * child = it->second.get();
+
+            size_t k = 0;
+            while (k < child->edge.size() && n_match + k < tokens.size() && child->edge[k] == tokens[n_match + k]) {
+                k++;
+            }
+
+            n_match += k;
+            cur = child;
+
+            if (k < child->edge.size()) {
+                // all entries in the subtree of the child share the first n_match tokens
+                break;
+            }
+        }
+
+        entry * res = cur->recent;
+        if (res == nullptr) {
+            n_match = 0;
+        }
+
+        return res;
+    }
+
+    void insert(llama_tokens tokens, std::vector<uint8_t> && data) {
+        if (tokens.empty() || data.empty() || data.size() > size_limit) {
+            return;
+        }
+
+        // the state of a longer prompt with the same prefix is already cached
+        {
+            size_t n_match = 0;
+            if (lookup(tokens, n_match) != nullptr && n_match == tokens.size()) {
+                return;
+            }
+        }
+
+        node * cur = &root;
+
+        size_t i = 0;
+
+        while (i < tokens.size()) {
+            auto it = cur->children.find(tokens[i]);
+            if (it == cur->children.end()) {
+                auto child = std::make_unique<node>();
+                child->edge.assign(tokens.begin() + i, tokens.end());
+                child->parent = cur;
+
+                node * tmp = child.get();
+                cur->children[tokens[i]] = std::move(child);
+                cur = tmp;
+
+                break;
+            }
+
+            node * child = it->second.get();
+
+            size_t k = 0;
+            while (k < child->edge.size() && i + k < tokens.size() && child->edge[k] == tokens[i + k]) {
+                k++;
+            }
+
+            if (k < child->edge.size()) {
+                // split the edge of the child at k
+                auto mid = std::make_unique<node>();
+                mid->edge.assign(child->edge.begin(), child->edge.begin() + k);
+                mid->parent = cur;
+                mid->recent = child->recent;
+
+                std::unique_ptr<node> old = std::move(it->second);
+                old->edge.erase(old->edge.begin(), old->edge.begin() + k);
+                old->parent = mid.get();
+
+                mid->children[old->edge[0]] = std::move(old);
+
+                it->second = std::move(mid);
+                child = it->second.get();
+            }
+
+            cur = child;
+            i  += k;
+        }
+
+        GGML_ASSERT(!cur->ent && cur->children.empty());
+
+        size_total += data.size();
+        n_entries++;
+
+        cur->ent = std::make_unique<entry>();
+        cur->ent->tokens = std::move(tokens);
+        cur->ent->data   = std::move(data);
+        cur->ent->owner  = cur;
+
+        touch(cur->ent.get());
+
+        // the entries of the ancestors are prefixes of the new entry - they are no longer needed
+        for (node * p = cur->parent; p != nullptr; p = p->parent) {
+            if (p->ent) {
+                remove(p);
+                break;
+            }
+        }
+
+        // evict the least recently used entries
+        while (size_total > size_limit) {
+            GGML_ASSERT(lru_tail != nullptr);
+
+            remove(lru_tail->owner);
+        }
+
+        SRV_INF("prompt cache: %zu entries, %.3f MiB / %.3f MiB\n", n_entries, size_total/1024.0/1024.0, size_limit/1024.0/1024.0);
+    }
+
+private:
+    void lru_unlink(entry * e) {
+        (e->prev ? e->prev->next : lru_head) = e->next;
+        (e->next ? e->next->prev : lru_tail) = e->prev;
+
+        e->prev = nullptr;
+        e->next = nullptr;
+    }
+
+    // move the entry to the front of the LRU list
+    // the entry becomes the most recently used one in the subtrees of all its ancestors
+    void touch(entry * e) {
+        if (lru_head != e) {
+            if (e->prev || e->next || lru_tail == e) {
+                lru_unlink(e);
+            }
+
+            e->next = lru_head;
+            (lru_head ? lru_head->prev : lru_tail) = e;
+            lru_head = e;
+        }
+
+        e->t_last_used = ggml_time_us();
+
+        for (node * p = e->owner; p != nullptr; p = p->parent) {
+            p->recent = e;
+        }
+    }
+
+    // remove the entry of the node and compact the tree
+    void remove(node * cur) {
+        GGML_ASSERT(cur->ent);
+
+        const entry * e = cur->ent.get();
+
+        size_total -= e->data.size();
+        n_entries--;
+
+        lru_unlink(cur->ent.get());
+
+        cur->ent.reset();
+
+        // remove the nodes that no longer lead to any entry
+        while (cur != &root && !cur->ent && cur->children.empty()) {
+            node * parent = cur->parent;
+
+            const llama_token key = cur->edge[0];
+            parent->children.erase(key); // note: this destroys cur
+
+            cur = parent;
+        }
+
+        // the ancestors that had the removed entry as the most recent one
+        for (node * p = cur; p != nullptr && p->recent == e; p = p->parent) {
+            p->recent = p->ent.get();
+
+            for (auto & it : p->children) {
+                entry * r = it.second->recent;
+                if (!p->recent || r->t_last_used > p->recent->t_last_used) {
+                    p->recent = r;
+                }
+            }
+        }
+
+        // merge a node without an entry into its only child
+        if (cur != &root && !cur->ent && cur->children.size() == 1) {
+            node * parent = cur->parent;
+
+            std::unique_ptr<node> child = std::move(cur->children.begin()->second);
+            child->edge.insert(child->edge.begin(), cur->edge.begin(), cur->edge.end());
+            child->parent = parent;
+
+            const llama_token key = cur->edge[0];
+            parent->children[key] = std::move(child); // note: this destroys cur
+        }
+    }
+};
+
 struct server_queue {
     int id = 0;
     bool running;
@@ -1608,6 +2134,9 @@ struct server_queue {
         }
         const int task_id = task.id;
         QUE_DBG("new task, id = %d, front = %d\n", task_id, front);
+        if (task.t_queued < 0) {
+            task.t_queued = ggml_time_us();
+        }
         if (front) {
             queue_tasks.push_front(std::move(task));
         } else {
@@ -1629,6 +2158,9 @@ struct server_queue {
                 cleanup_pending_task(task.id_target);
             }
             QUE_DBG("new task, id = %d/%d, front = %d\n", task.id, (int) tasks.size(), front);
+            if (task.t_queued < 0) {
+                task.t_queued = ggml_time_us();
+            }
             if (front) {
                 queue_tasks.push_front(std::move(task));
             } else {
@@ -1640,10 +2172,14 @@ struct server_queue {
     }
 
     // Add a new task, but defer until one slot is available
+    // tasks with higher priority are placed before the ones with lower priority
     void defer(server_task && task) {
         std::unique_lock<std::mutex> lock(mutex_tasks);
-        QUE_DBG("defer task, id = %d\n", task.id);
-        queue_tasks_deferred.push_back(std::move(task));
+        QUE_DBG("defer task, id = %d, priority = %d\n", task.id, task.params.priority);
+        auto it = std::find_if(queue_tasks_deferred.begin(), queue_tasks_deferred.end(), [&](const server_task & t) {
+            return t.params.priority < task.params.priority;
+        });
+        queue_tasks_deferred.insert(it, std::move(task));
         condition_tasks.notify_one();
     }
 
@@ -1901,6 +2437,12 @@ struct server_context {
 
     llama_batch batch {};
 
+    // samples the tokens of the slots in parallel
+    common_sampler_pool * smpl_pool = nullptr;
+
+    // compiled grammars of the previous requests, cloned by the samplers of the slots
+    common_grammar_cache * grammar_cache = nullptr;
+
     bool clean_kv_cache = true;
     bool add_bos_token  = true;
 
@@ -1915,6 +2457,12 @@ struct server_context {
 
     server_metrics metrics;
 
+    server_prompt_cache prompt_cache;
+
+    server_schema_cache schema_cache;
+
+    server_scheduler sched;
+
     // Necessary similarity of prompt for slot selection
     float slot_prompt_similarity = 0.0f;
 
@@ -1939,6 +2487,9 @@ struct server_context {
         }
 
         llama_batch_free(batch);
+
+        common_sampler_pool_free(smpl_pool);
+        common_grammar_cache_free(grammar_cache);
     }
 
     bool load_model(const common_params & params) {
@@ -2054,7 +2605,13 @@ struct server_context {
     }
 
     void init() {
-        const int32_t n_ctx_slot = n_ctx / params_base.n_parallel;
+        if (params_base.sched_preempt && (!params_base.kv_unified || mctx)) {
+            SRV_WRN("%s\n", "preemption requires a unified KV cache and is not supported by multimodal, it will be disabled");
+        }
+
+        // with preemption, each slot can use the entire context - the slots share the KV cells and if they run out
+        // of space, the slots with lower priority are preempted
+        const int32_t n_ctx_slot = can_preempt() ? n_ctx : n_ctx / params_base.n_parallel;
 
         SRV_INF("initializing slots, n_slots = %d\n", params_base.n_parallel);
 
@@ -2098,6 +2655,26 @@ struct server_context {
             slots.push_back(std::move(slot));
         }
 
+        if (params_base.cache_ram_mib > 0) {
+            if (mctx) {
+                SRV_WRN("%s\n", "prompt cache is not supported by multimodal, it will be disabled");
+            } else {
+                SRV_INF("prompt cache enabled, size limit = %d MiB\n", params_base.cache_ram_mib);
+
+                prompt_cache.init(size_t(params_base.cache_ram_mib)*1024*1024);
+            }
+        }
+
+        if (params_base.n_grammar_cache > 0) {
+            grammar_cache = common_grammar_cache_init(params_base.n_grammar_cache);
+            schema_cache.grammars.set_max(params_base.n_grammar_cache);
+        }
+
+        sched.n_budget     = params_base.n_sched_budget > 0 ? params_base.n_sched_budget : llama_n_batch(ctx);
+        sched.decode_first = params_base.sched_decode_first;
+
+        SRV_INF("scheduler: token budget = %d, decode first = %d\n", sched.n_budget, sched.decode_first);
+
         default_generation_settings_for_props = slots[0].to_json();
 
         // the update_slots() logic will always submit a maximum of n_batch or n_parallel tokens
@@ -2107,6 +2684,9 @@ struct server_context {
             batch = llama_batch_init(std::max(n_batch, params_base.n_parallel), 0, 1);
         }
 
+        // the threads of the decode are idle while the slots are sampled
+        smpl_pool = common_sampler_pool_init(std::min(params_base.n_parallel, params_base.cpuparams.n_threads));
+
         metrics.init();
 
         oai_parser_opt = {
@@ -2194,11 +2774,343 @@ struct server_context {
         return ret;
     }
 
+    // with a unified KV cache, the sequences of all slots live in the same KV buffer, so a prompt prefix that
+    // has already been computed by another slot can be shared instead of being computed again
+    // the KV cells of the prefix are shared between the sequences and copied only when modified (copy-on-write)
+    // returns the number of prompt tokens that are now available in the cache of the slot
+    int share_prefix_from_other_slots(server_slot & slot) {
+        if (!params_base.kv_unified || mctx || !llama_memory_can_shift(llama_get_memory(ctx))) {
+            return slot.n_past;
+        }
+
+        auto * mem = llama_get_memory(ctx);
+
+        server_slot * src = nullptr;
+
+        int n_share = slot.n_past;
+
+        for (server_slot & other : slots) {
+            if (other.id == slot.id || other.cache_tokens.empty()) {
+                continue;
+            }
+
+            // the prefix must be fully present in the cache of the other slot
+            // note: cache_tokens can contain tokens that are in the current batch and have not been decoded yet
+            if (llama_memory_seq_pos_min(mem, other.id) != 0) {
+                continue;
+            }
+
+            const int n_cached = llama_memory_seq_pos_max(mem, other.id) + 1;
+            const int n_common = std::min<int>(n_cached, other.cache_tokens.get_common_prefix(slot.prompt_tokens));
+
+            if (n_common > n_share) {
+                n_share = n_common;
+                src     = &other;
+            }
+        }
+
+        if (src == nullptr) {
+            return slot.n_past;
+        }
+
+        SLT_INF(slot, "sharing %d prompt tokens with slot %d\n", n_share, src->id);
+
+        llama_memory_seq_rm(mem, slot.id, -1, -1);
+        llama_memory_seq_cp(mem, src->id, slot.id, 0, n_share);
+
+        const llama_tokens & tokens = slot.prompt_tokens.get_text_tokens();
+
+        slot.cache_tokens.clear();
+        slot.cache_tokens.insert(llama_tokens(tokens.begin(), tokens.begin() + n_share));
+
+        return n_share;
+    }
+
+    // store the state of the slot in the prompt cache, before it is discarded to process a new prompt
+    void prompt_cache_save(const server_slot & slot) {
+        if (!prompt_cache.enabled() || slot.cache_tokens.empty()) {
+            return;
+        }
+
+        const int64_t t_start = ggml_time_us();
+
+        const size_t n_size = llama_state_seq_get_size(ctx, slot.id);
+
+        std::vector<uint8_t> data(n_size);
+
+        const size_t n_written = llama_state_seq_get_data(ctx, data.data(), data.size(), slot.id);
+        if (n_written == 0) {
+            SLT_WRN(slot, "%s", "failed to save the state to the prompt cache\n");
+            return;
+        }
+
+        data.resize(n_written);
+
+        SLT_INF(slot, "saving %d tokens to the prompt cache (%.3f MiB, %.2f ms)\n",
+                (int) slot.cache_tokens.size(), n_written/1024.0/1024.0, (ggml_time_us() - t_start)/1000.0);
+
+        prompt_cache.insert(slot.cache_tokens.get_text_tokens(), std::move(data));
+    }
+
+    // restore a state from the prompt cache, if it has a longer common prefix with the prompt than the current cache of the slot
+    // returns the number of prompt tokens that are now available in the cache of the slot
+    int prompt_cache_load(server_slot & slot) {
+        if (!prompt_cache.enabled()) {
+            return slot.n_past;
+        }
+
+        const llama_tokens & tokens = slot.prompt_tokens.get_text_tokens();
+
+        size_t n_match = 0;
+
+        const auto * ent = prompt_cache.find(tokens, n_match);
+        if (ent == nullptr || (int) n_match <= slot.n_past) {
+            return slot.n_past;
+        }
+
+        const int64_t t_start = ggml_time_us();
+
+        llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+
+        const size_t n_read = llama_state_seq_set_data(ctx, ent->data.data(), ent->data.size(), slot.id);
+        if (n_read == 0) {
+            SLT_WRN(slot, "%s", "failed to restore the state from the prompt cache\n");
+
+            llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+            slot.cache_tokens.clear();
+
+            return 0;
+        }
+
+        SLT_INF(slot, "restored %d tokens from the prompt cache (%.2f ms), n_past = %d\n",
+                (int) ent->tokens.size(), (ggml_time_us() - t_start)/1000.0, (int) n_match);
+
+        slot.cache_tokens.clear();
+        slot.cache_tokens.insert(ent->tokens);
+
+        return n_match;
+    }
+
+    // remove the KV cache of the idle slots to make space for the active ones (it is kept in the prompt cache, if enabled)
+    // returns false if there was nothing to remove
+    bool free_idle_slots() {
+        if (!can_preempt()) {
+            return false;
+        }
+
+        bool res = false;
+
+        for (auto & slot : slots) {
+            if (slot.is_processing() || slot.cache_tokens.empty()) {
+                continue;
+            }
+
+            prompt_cache_save(slot);
+
+            llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+            slot.cache_tokens.clear();
+
+            SLT_INF(slot, "%s", "removed the KV cache of the idle slot\n");
+
+            res = true;
+        }
+
+        return res;
+    }
+
+    // with a unified KV cache, the slots compete for the same KV cells and can be preempted
+    bool can_preempt() const {
+        return params_base.sched_preempt && params_base.kv_unified && !mctx;
+    }
+
+    // number of KV cells used by the slots other than the given one
+    // note: the cells that are shared by several slots are counted for each of them
+    int32_t n_kv_used_by_others(const server_slot & slot) const {
+        auto * mem = llama_get_memory(ctx);
+
+        int32_t res = 0;
+
+        for (const auto & other : slots) {
+            if (other.id == slot.id) {
+                continue;
+            }
+
+            const llama_pos pos_min = llama_memory_seq_pos_min(mem, other.id);
+            if (pos_min >= 0) {
+                res += llama_memory_seq_pos_max(mem, other.id) - pos_min + 1;
+            }
+        }
+
+        return res;
+    }
+
+    // admit the prompt of a new slot: if the rest of the prompt and the tokens already in the batch do not fit in the
+    // KV cache, remove the KV cache of the idle slots and then preempt the slots with a lower priority than the new one
+    void make_space_for_prompt(server_slot & slot) {
+        if (!can_preempt()) {
+            return;
+        }
+
+        // the cached part of the prompt is already in the KV cache of the slot
+        const int32_t n_needed = slot.n_prompt_tokens + batch.n_tokens;
+
+        while (n_kv_used_by_others(slot) + n_needed > n_ctx) {
+            if (free_idle_slots()) {
+                continue;
+            }
+
+            server_slot * victim = sched.get_victim(slots, &slot);
+            if (victim == nullptr || !preempt_slot(*victim, 0)) {
+                break;
+            }
+        }
+    }
+
+    // swap the KV cache of the slot out to host memory to make space for the tokens in batch[i0:]
+    // the tokens of the preempted slot are removed from the batch, so the decode can be retried
+    // returns false if the KV cache of the slot could not be saved
+    bool preempt_slot(server_slot & slot, int32_t i0) {
+        auto * mem = llama_get_memory(ctx);
+
+        const int64_t t_start = ggml_time_us();
+
+        // the tokens of the slot that have not been decoded yet will be submitted again after the slot is resumed
+        int32_t n_keep = llama_memory_seq_pos_max(mem, slot.id) + 1;
+
+        // the last prompt token is already decoded but its logits were not sampled, and they are not kept after the
+        // next decode - roll back one token so that it is decoded again after the slot is resumed
+        if (slot.state == SLOT_STATE_DONE_PROMPT && n_keep == slot.n_past && n_keep > 0) {
+            n_keep--;
+            llama_memory_seq_rm(mem, slot.id, n_keep, -1);
+        }
+
+        slot.swap_data.clear();
+
+        if (n_keep > 0) {
+            slot.swap_data.resize(llama_state_seq_get_size(ctx, slot.id));
+
+            const size_t n_written = llama_state_seq_get_data(ctx, slot.swap_data.data(), slot.swap_data.size(), slot.id);
+            if (n_written == 0) {
+                SLT_WRN(slot, "%s", "failed to swap out the KV cache of the slot\n");
+                slot.swap_data.clear();
+                return false;
+            }
+
+            slot.swap_data.resize(n_written);
+        }
+
+        llama_memory_seq_rm(mem, slot.id, -1, -1);
+
+        if (slot.state == SLOT_STATE_PROCESSING_PROMPT || slot.state == SLOT_STATE_DONE_PROMPT) {
+            slot.n_prompt_tokens_processed -= slot.n_past - n_keep;
+            slot.state = SLOT_STATE_PROCESSING_PROMPT;
+        }
+
+        slot.n_past  = n_keep;
+        slot.i_batch = -1;
+        slot.cache_tokens.keep_first(n_keep);
+
+        slot.preempted = true;
+
+        int32_t n_active = 0;
+        for (const auto & other : slots) {
+            n_active += other.is_processing() && !other.preempted;
+        }
+
+        slot.n_active_preempt = n_active;
+
+        // remove the tokens of the slot from the rest of the batch
+        std::vector<int32_t> idx(batch.n_tokens, -1);
+
+        int32_t n_tokens = i0;
+        for (int32_t i = i0; i < batch.n_tokens; i++) {
+            if (batch.seq_id[i][0] == slot.id) {
+                continue;
+            }
+
+            batch.token   [n_tokens]    = batch.token   [i];
+            batch.pos     [n_tokens]    = batch.pos     [i];
+            batch.n_seq_id[n_tokens]    = batch.n_seq_id[i];
+            batch.seq_id  [n_tokens][0] = batch.seq_id  [i][0];
+            batch.logits  [n_tokens]    = batch.logits  [i];
+
+            idx[i] = n_tokens++;
+        }
+
+        batch.n_tokens = n_tokens;
+
+        for (auto & other : slots) {
+            if (other.i_batch >= i0) {
+                other.i_batch = idx[other.i_batch];
+            }
+        }
+
+        metrics.n_preempted_total++;
+
+        SLT_WRN(slot, "preempted, priority = %d, n_past = %d, swapped out %.3f MiB (%.2f ms)\n",
+                slot.params.priority, slot.n_past, slot.swap_data.size()/1024.0/1024.0, (ggml_time_us() - t_start)/1000.0);
+
+        return true;
+    }
+
+    // swap the KV cache of the preempted slots back in, after some of the slots that were active at the time of the
+    // preemption have finished
+    void resume_preempted_slots() {
+        int32_t n_active = 0;
+        for (const auto & slot : slots) {
+            n_active += slot.is_processing() && !slot.preempted;
+        }
+
+        for (auto * pslot : sched.order(slots)) {
+            auto & slot = *pslot;
+
+            if (!slot.preempted || n_active >= slot.n_active_preempt) {
+                continue;
+            }
+
+            const int64_t t_start = ggml_time_us();
+
+            if (!slot.swap_data.empty()) {
+                size_t n_read = llama_state_seq_set_data(ctx, slot.swap_data.data(), slot.swap_data.size(), slot.id);
+                if (n_read == 0 && free_idle_slots()) {
+                    n_read = llama_state_seq_set_data(ctx, slot.swap_data.data(), slot.swap_data.size(), slot.id);
+                }
+
+                if (n_read == 0) {
+                    llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+
+                    metrics.n_restore_failed_total++;
+
+                    if (n_active == 0) {
+                        slot.release();
+                        send_error(slot, "failed to restore the KV cache of the preempted slot", ERROR_TYPE_SERVER);
+                        continue;
+                    }
+
+                    // not enough space yet - wait for another slot to finish
+                    slot.n_active_preempt = n_active;
+                    continue;
+                }
+            }
+
+            SLT_INF(slot, "resumed, n_past = %d, swapped in %.3f MiB (%.2f ms)\n",
+                    slot.n_past, slot.swap_data.size()/1024.0/1024.0, (ggml_time_us() - t_start)/1000.0);
+
+            slot.swap_data.clear();
+            slot.swap_data.shrink_to_fit();
+            slot.preempted = false;
+
+            n_active++;
+        }
+    }
+
     bool launch_slot_with_task(server_slot & slot, server_task && task) {
         slot.reset();
         slot.id_task       = task.id;
         slot.index         = task.index;
         slot.task_type     = task.type;
+        slot.t_queued      = task.t_queued;
+        slot.t_last_token  = -1;
         slot.params        = std::move(task.params);
         slot.prompt_tokens = std::move(task.prompt_tokens);
 
@@ -2225,7 +3137,7 @@ struct server_context {
                 common_sampler_free(slot.smpl);
             }
 
-            slot.smpl = common_sampler_init(model, slot.params.sampling);
+            slot.smpl = common_sampler_init(model, slot.params.sampling, grammar_cache);
             if (slot.smpl == nullptr) {
                 // for now, the only error that may happen here is invalid grammar
                 send_error(task, "Failed to parse grammar", ERROR_TYPE_INVALID_REQUEST);
@@ -2241,6 +3153,8 @@ struct server_context {
 
         slot.state = SLOT_STATE_STARTED;
 
+        metrics.on_launch(slot);
+
         SLT_INF(slot, "%s", "processing task\n");
 
         return true;
@@ -2408,7 +3322,6 @@ struct server_context {
 
     void populate_token_probs(const server_slot & slot, completion_token_output & result, bool post_sampling, bool special, int idx) {
         size_t n_probs = slot.params.sampling.n_probs;
-        size_t n_vocab = llama_vocab_n_tokens(vocab);
         if (post_sampling) {
             const auto * cur_p = common_sampler_get_candidates(slot.smpl);
             const size_t max_probs = cur_p->size;
@@ -2434,8 +3347,10 @@ struct server_context {
             // TODO: optimize this with min-p optimization
             std::vector<llama_token_data> cur = get_token_probabilities(ctx, idx);
 
+            const size_t n_cur = cur.size();
+
             // set probability for sampled token
-            for (size_t i = 0; i < n_vocab; i++) {
+            for (size_t i = 0; i < n_cur; i++) {
                 // set probability for sampled token
                 if (cur[i].id == result.tok) {
                     result.prob = cur[i].p;
@@ -2445,7 +3360,7 @@ struct server_context {
 
             // set probability for top n_probs tokens
             result.probs.reserve(n_probs);
-            for (size_t i = 0; i < std::min(n_vocab, n_probs); i++) {
+            for (size_t i = 0; i < std::min(n_cur, n_probs); i++) {
                 result.probs.push_back({
                     cur[i].id,
                     common_token_to_piece(ctx, cur[i].id, special),
@@ -2828,6 +3743,11 @@ struct server_context {
                     res->n_decode_total          = metrics.n_decode_total;
                     res->n_busy_slots_total      = metrics.n_busy_slots_total;
 
+                    res->n_preempted_total      = metrics.n_preempted_total;
+                    res->n_restore_failed_total = metrics.n_restore_failed_total;
+
+                    res->histograms = metrics.histograms();
+
                     if (task.metrics_reset_bucket) {
                         metrics.reset_bucket();
                     }
@@ -2981,6 +3901,8 @@ struct server_context {
             }
         }
 
+        resume_preempted_slots();
+
         {
             SRV_DBG("%s", "posting NEXT_RESPONSE\n");
 
@@ -2992,7 +3914,7 @@ struct server_context {
         // apply context-shift if needed
         // TODO: simplify and improve
         for (server_slot & slot : slots) {
-            if (slot.is_processing() && slot.n_past + 1 >= slot.n_ctx) {
+            if (slot.is_processing() && !slot.preempted && slot.n_past + 1 >= slot.n_ctx) {
                 if (!params_base.ctx_shift) {
                     // this check is redundant (for good)
                     // we should never get here, because generation should already stopped in process_token()
@@ -3047,7 +3969,7 @@ struct server_context {
 
         // frist, add sampled tokens from any ongoing sequences
         for (auto & slot : slots) {
-            if (slot.state != SLOT_STATE_GENERATING) {
+            if (slot.state != SLOT_STATE_GENERATING || slot.preempted) {
                 continue;
             }
 
@@ -3073,9 +3995,17 @@ struct server_context {
         int32_t n_batch  = llama_n_batch(ctx);
         int32_t n_ubatch = llama_n_ubatch(ctx);
 
-        // next, batch any pending prompts without exceeding n_batch
+        // next, batch any pending prompts without exceeding the token budget of the step
         if (params_base.cont_batching || batch.n_tokens == 0) {
-            for (auto & slot : slots) {
+            const int32_t n_tokens_max = sched.n_tokens_max(batch.n_tokens, n_batch);
+
+            for (auto * pslot : sched.order(slots)) {
+                auto & slot = *pslot;
+
+                if (slot.preempted) {
+                    continue;
+                }
+
                 // check if we can batch this slot with the previous one
                 if (slot.is_processing()) {
                     if (!slot_batched) {
@@ -3194,6 +4124,12 @@ struct server_context {
                                 // reuse any previously computed tokens that are common with the new prompt
                                 slot.n_past = slot.cache_tokens.get_common_prefix(prompt_tokens);
 
+                                // the part of the cache after the common prefix is about to be shifted or discarded
+                                // it is saved while the KV cache still matches the cache tokens
+                                if (slot.n_past < (int) slot.cache_tokens.size()) {
+                                    prompt_cache_save(slot);
+                                }
+
                                 // reuse chunks from the cached prompt by shifting their KV cache in the new position
                                 if (params_base.n_cache_reuse > 0) {
                                     size_t head_c = slot.n_past; // cache
@@ -3242,6 +4178,12 @@ struct server_context {
 
                                     SLT_DBG(slot, "after context reuse, new slot.n_past = %d\n", slot.n_past);
                                 }
+
+                                // reuse a longer common prefix that has been computed by another slot
+                                slot.n_past = share_prefix_from_other_slots(slot);
+
+                                // or restore it from the prompt cache
+                                slot.n_past = prompt_cache_load(slot);
                             } else {
                                 // if we don't cache the prompt, we have to remove the entire KV cache
                                 slot.n_past = 0;
@@ -3271,6 +4213,8 @@ struct server_context {
                         }
 
                         slot.n_prompt_tokens_processed = 0;
+
+                        make_space_for_prompt(slot);
                     }
 
                     if (!slot.can_split()) {
@@ -3319,7 +4263,7 @@ struct server_context {
                     }
 
                     // add prompt tokens for processing in the current batch
-                    while (slot.n_past < slot.n_prompt_tokens && batch.n_tokens < n_batch) {
+                    while (slot.n_past < slot.n_prompt_tokens && batch.n_tokens < n_tokens_max) {
                         // get next token to process
                         llama_token cur_tok = slot.prompt_tokens[slot.n_past];
                         if (cur_tok == LLAMA_TOKEN_NULL) {
@@ -3367,7 +4311,7 @@ struct server_context {
                     }
                 }
 
-                if (batch.n_tokens >= n_batch) {
+                if (batch.n_tokens >= n_tokens_max) {
                     break;
                 }
             }
@@ -3403,8 +4347,14 @@ struct server_context {
                 batch.logits   + i,
             };
 
+            const int64_t t_decode_start = ggml_time_us();
+
             const int ret = llama_decode(ctx, batch_view);
 
+            if (ret == 0) {
+                metrics.on_decode_batch(slots, batch_view, (ggml_time_us() - t_decode_start) / 1e6);
+            }
+
             metrics.on_decoded(slots);
 
             if (ret != 0) {
@@ -3412,6 +4362,13 @@ struct server_context {
                     std::string err;
 
                     if (n_batch == 1 && ret == 1) {
+                        // make space by removing the KV cache of the idle slots or by swapping out the slot with the lowest priority
+                        server_slot * victim = can_preempt() ? sched.get_victim(slots) : nullptr;
+
+                        if (free_idle_slots() || (victim && preempt_slot(*victim, i))) {
+                            continue; // continue loop of n_batch
+                        }
+
                         err = "Context size has been exceeded.";
                     }
 
@@ -3450,6 +4407,11 @@ struct server_context {
             // on successful decode, restore the original batch size
             n_batch = llama_n_batch(ctx);
 
+            // the slots that sample a token from this batch
+            std::vector<server_slot *>    slots_sample;
+            std::vector<common_sampler *> smpls_sample;
+            std::vector<int>              idxs_sample;
+
             for (auto & slot : slots) {
                 if (slot.i_batch < (int) i || slot.i_batch >= (int) (i + n_tokens)) {
                     continue; // continue loop of slots
@@ -3477,24 +4439,38 @@ struct server_context {
                     continue; // continue loop of slots
                 }
 
-                const int tok_idx = slot.i_batch - i;
-
-                llama_token id = common_sampler_sample(slot.smpl, ctx, tok_idx);
+                slots_sample.push_back(&slot);
+                smpls_sample.push_back(slot.smpl);
+                idxs_sample .push_back(slot.i_batch - i);
 
                 slot.i_batch = -1;
+            }
+
+            // time spent sampling the token of each slot
+            std::vector<int64_t> t_sample_us;
+
+            const std::vector<llama_token> ids = common_sampler_sample_and_accept_batch(smpl_pool, smpls_sample, ctx, idxs_sample, false, &t_sample_us);
 
-                common_sampler_accept(slot.smpl, id, true);
+            for (size_t j = 0; j < slots_sample.size(); ++j) {
+                auto & slot = *slots_sample[j];
+
+                const int         tok_idx = idxs_sample[j];
+                const llama_token id      = ids[j];
 
                 slot.n_decoded += 1;
 
                 const int64_t t_current = ggml_time_us();
 
+                metrics.sampling.observe(slot.metrics_labels(), t_sample_us[j] / 1e6);
+
                 if (slot.n_decoded == 1) {
                     slot.t_start_generation = t_current;
                     slot.t_prompt_processing = (slot.t_start_generation - slot.t_start_process_prompt) / 1e3;
                     metrics.on_prompt_eval(slot);
                 }
 
+                metrics.on_token(slot, t_current);
+
                 slot.t_token_generation = (t_current - slot.t_start_generation) / 1e3;
 
                 completion_token_output result;
@@ -3506,7 +4482,11 @@ struct server_context {
                     populate_token_probs(slot, result, slot.params.post_sampling_probs, params_base.special, tok_idx);
                 }
 
-                if (!process_token(result, slot)) {
+                const bool has_next = process_token(result, slot);
+
+                metrics.detokenize.observe(slot.metrics_labels(), (ggml_time_us() - t_current) / 1e6);
+
+                if (!has_next) {
                     // release slot because of stop condition
                     slot.release();
                     slot.print_timings();
@@ -3518,7 +4498,7 @@ struct server_context {
 
             // do speculative decoding
             for (auto & slot : slots) {
-                if (!slot.is_processing() || !slot.can_speculate()) {
+                if (!slot.is_processing() || slot.preempted || !slot.can_speculate()) {
                     continue;
                 }
 
@@ -3582,11 +4562,14 @@ struct server_context {
 
                 llama_decode(ctx, slot.batch_spec);
 
+                const int64_t t_sample_start = ggml_time_us();
+
                 // the accepted tokens from the speculation
                 const auto ids = common_sampler_sample_and_accept_n(slot.smpl, ctx, draft);
 
-                slot.n_past    += ids.size();
-                slot.n_decoded += ids.size();
+                metrics.sampling.observe(slot.metrics_labels(), (ggml_time_us() - t_sample_start) / 1e6);
+
+                slot.n_past += ids.size();
 
                 // update how many tokens out of those tested were accepted
                 slot.n_draft_accepted += ids.size() - 1;
@@ -3597,6 +4580,12 @@ struct server_context {
                 llama_memory_seq_rm(llama_get_memory(ctx), slot.id, slot.n_past, -1);
 
                 for (size_t i = 0; i < ids.size(); ++i) {
+                    slot.n_decoded += 1;
+
+                    const int64_t t_current = ggml_time_us();
+
+                    metrics.on_token(slot, t_current);
+
                     completion_token_output result;
 
                     result.tok          = ids[i];
@@ -3605,7 +4594,11 @@ struct server_context {
 
                     // TODO: set result.probs
 
-                    if (!process_token(result, slot)) {
+                    const bool has_next = process_token(result, slot);
+
+                    metrics.detokenize.observe(slot.metrics_labels(), (ggml_time_us() - t_current) / 1e6);
+
+                    if (!has_next) {
                         // release slot because of stop condition
                         slot.release();
                         slot.print_timings();
@@ -3945,6 +4938,14 @@ int main(int argc, char ** argv) {
                     {"name",  "n_busy_slots_per_decode"},
                     {"help",  "Average number of busy slots per llama_decode() call"},
                     {"value",  (float) res_metrics->n_busy_slots_total / std::max((float) res_metrics->n_decode_total, 1.f)}
+            }, {
+                    {"name",  "n_preempted_total"},
+                    {"help",  "Total number of slots swapped out of the KV cache to make space for other slots"},
+                    {"value",  res_metrics->n_preempted_total}
+            }, {
+                    {"name",  "n_restore_failed_total"},
+                    {"help",  "Total number of times the KV cache of a preempted slot did not fit in the KV cache yet"},
+                    {"value",  res_metrics->n_restore_failed_total}
             }}},
             {"gauge", {{
                     {"name",  "prompt_tokens_seconds"},
@@ -3982,6 +4983,10 @@ int main(int argc, char ** argv) {
             }
         }
 
+        for (const auto & hist : res_metrics->histograms) {
+            hist.to_prometheus(prometheus);
+        }
+
         res.set_header("Process-Start-Time-Unix", std::to_string(res_metrics->t_start));
 
         res.set_content(prometheus.str(), "text/plain; version=0.0.4");
@@ -4256,6 +5261,7 @@ int main(int argc, char ** argv) {
                 task.params           = server_task::params_from_json_cmpl(
                         ctx_server.ctx,
                         ctx_server.params_base,
+                        ctx_server.schema_cache,
                         data);
                 task.id_selected_slot = json_value(data, "id_slot", -1);
 
@@ -462,3 +462,55 @@ def test_cancel_request():
     time.sleep(1) # wait for HTTP_POLLING_SECONDS
     res = server.make_request("GET", "/slots")
     assert res.body[0]["is_processing"] == False
+
+
+def test_completion_with_same_json_schema():
+    global server
+    server.start()
+    # the second request reuses the cached grammar of the schema
+    contents = []
+    for _ in range(2):
+        res = server.make_request("POST", "/completion", data={
+            "prompt": "Write an example",
+            "n_predict": 16,
+            "temperature": 0.0,
+            "json_schema": {"type": "object", "properties": {"a": {"const": "42"}}, "required": ["a"]},
+        })
+        assert res.status_code == 200
+        assert match_regex("\\{\\s*\"a\"\\s*:\\s*\"42\"\\s*\\}", res.body["content"])
+        contents.append(res.body["content"])
+    assert contents[0] == contents[1]
+
+
+def test_completion_with_same_grammar_and_other_triggers():
+    global server
+    server.start()
+    def complete(data: dict) -> str:
+        res = server.make_request("POST", "/completion", data={
+            "prompt": "I believe the meaning of life is",
+            "n_predict": 5,
+            "temperature": 0.0,
+            **data,
+        })
+        assert res.status_code == 200, res.body
+        return res.body["content"]
+    unconstrained = complete({})
+    # the trigger [\s\S] fires on the first generated piece, which the grammar then has to accept
+    first = complete({"n_predict": 1})
+    grammar = "root ::= " + json.dumps(first, ensure_ascii=False) + ' "a"{4,4}'
+    constrained = first + "aaaa"
+    assert unconstrained != constrained
+    # the samplers cached for the same grammar must not be shared between the lazy and non-lazy requests
+    # nor between the requests with other triggers
+    for lazy, pattern, expected in [
+        (False, None,      constrained),
+        (True,  "zzzz",    unconstrained),
+        (True,  "[\\s\\S]", constrained),
+        (True,  "zzzz",    unconstrained),
+        (False, None,      constrained),
+    ]:
+        data = {"grammar": grammar}
+        if lazy:
+            data["grammar_lazy"] = True
+            data["grammar_triggers"] = [{"type": 2, "value": pattern}]  # COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN
+        assert complete(data) == expected
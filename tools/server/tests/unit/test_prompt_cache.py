@@ -0,0 +1,57 @@
+import pytest
+from utils import *
+
+server = ServerPreset.tinyllama2()
+
+
+@pytest.fixture(scope="module", autouse=True)
+def create_server():
+    global server
+    server = ServerPreset.tinyllama2()
+    server.n_slots = 1
+    server.temperature = 0.0
+
+
+def tokenize(content: str) -> list[int]:
+    res = server.make_request("POST", "/tokenize", data={"content": content})
+    assert res.status_code == 200
+    return res.body["tokens"]
+
+
+def complete(prompt: list[int], cache_prompt: bool = True) -> dict:
+    res = server.make_request("POST", "/completion", data={
+        "prompt": prompt,
+        "n_predict": 8,
+        "cache_prompt": cache_prompt,
+        "return_tokens": True,
+    })
+    assert res.status_code == 200
+    return res.body
+
+
+def test_prompt_cache_with_cache_reuse():
+    # the state of the slot is saved to the prompt cache before the chunks of its cache are shifted by --cache-reuse
+    global server
+    server.n_cache_reuse = 4
+    server.cache_ram = 64
+    server.start()
+
+    tokens_a = tokenize("Once upon a time, there was a little girl named Lily.")
+    tokens_b = tokenize(" She liked to play outside in the park with her friends.")
+    tokens_c = tokenize(" One day, she found a big red ball under a tree.")
+
+    # the cache of the slot is a + b + c + the generated tokens
+    res_abc = complete(tokens_a + tokens_b + tokens_c)
+    cache_tokens = tokens_a + tokens_b + tokens_c + res_abc["tokens"]
+
+    # c is shifted right after a, the unshifted state is saved to the prompt cache first
+    complete(tokens_a + tokens_c)
+
+    # the cache tokens of the slot after the shift do not match a saved state
+    n = len(tokens_a) + len(tokens_c)
+    complete(tokens_a + tokens_c + cache_tokens[n:n + 8])
+
+    # the saved state is restored, it gives the same result as when it was computed
+    res = complete(tokens_a + tokens_b + tokens_c)
+    assert res["timings"]["prompt_n"] == 1
+    assert res["content"] == res_abc["content"]
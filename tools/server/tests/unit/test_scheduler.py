@@ -0,0 +1,189 @@
+import pytest
+import requests
+import threading
+import time
+from utils import *
+
+server = ServerPreset.tinyllama2()
+
+
+@pytest.fixture(autouse=True)
+def create_server():
+    global server
+    server = ServerPreset.tinyllama2()
+    server.temperature = 0.0
+    server.server_metrics = True
+    server.server_slots = True
+    server.n_predict = None
+
+
+def prompt_tokens(n: int, offset: int = 0) -> list[int]:
+    return [100 + (offset + i*7) % 200 for i in range(n)]
+
+
+def complete(prompt: list[int], n_predict: int, priority: int = 0) -> dict:
+    res = server.make_request("POST", "/completion", data={
+        "prompt": prompt,
+        "n_predict": n_predict,
+        "ignore_eos": True,
+        "priority": priority,
+    })
+    assert res.status_code == 200
+    return res.body
+
+
+def get_metric(name: str) -> float:
+    res = requests.get(f"http://{server.server_host}:{server.server_port}/metrics")
+    assert res.status_code == 200
+    for line in res.text.splitlines():
+        if line.startswith(f"llamacpp:{name} "):
+            return float(line.split(" ")[1])
+    raise KeyError(name)
+
+
+def wait_generating(n_slots_generating: int = 1):
+    # wait until the given number of slots have sampled at least one token
+    for _ in range(1000):
+        res = server.make_request("GET", "/slots")
+        assert res.status_code == 200
+        if sum(1 for slot in res.body if slot["is_processing"] and slot["next_token"]["n_decoded"] > 0) >= n_slots_generating:
+            return
+        time.sleep(0.001)
+    raise TimeoutError("the slots did not start generating")
+
+
+class Request:
+    # a completion request that runs in a thread and records the time when it finished
+    def __init__(self, prompt: list[int], n_predict: int, priority: int = 0):
+        self.body: dict | None = None
+        self.t_end = 0.0
+        self.thread = threading.Thread(target=self.run, args=(prompt, n_predict, priority))
+        self.thread.start()
+
+    def run(self, prompt: list[int], n_predict: int, priority: int):
+        self.body = complete(prompt, n_predict, priority)
+        self.t_end = time.time()
+
+    def join(self) -> dict:
+        self.thread.join()
+        assert self.body is not None
+        return self.body
+
+
+def test_priority_order():
+    # with a single slot, the deferred requests are processed in order of priority
+    global server
+    server.n_ctx = 2048
+    server.n_slots = 1
+    server.start()
+
+    busy = Request(prompt_tokens(16), 1800)
+    wait_generating()
+
+    low  = Request(prompt_tokens(16, 1), 64, priority=0)
+    time.sleep(0.01)
+    high = Request(prompt_tokens(16, 2), 64, priority=1)
+
+    busy.join()
+    low.join()
+    high.join()
+
+    assert high.t_end < low.t_end
+
+
+def test_token_budget():
+    # the prompt is processed in chunks of at most sched_budget tokens, each in its own decode step
+    global server
+    server.n_ctx = 512
+    server.n_slots = 1
+    server.sched_budget = 16
+    server.start()
+
+    n_decode = get_metric("n_decode_total")
+
+    res = complete(prompt_tokens(200), 4)
+    assert res["timings"]["prompt_n"] == 200
+
+    assert get_metric("n_decode_total") - n_decode >= 200 // 16 + 3
+
+
+def test_preempt_and_resume():
+    # a prompt of a high priority request that does not fit in the KV cache preempts the generating low priority slot
+    # the low priority slot is resumed after the high priority request has finished, with the same result as alone
+    global server
+    server.n_ctx = 2048
+    server.n_slots = 2
+    server.kv_unified = True
+    server.sched_preempt = True
+    server.start()
+
+    prompt_low  = prompt_tokens(1100)
+    prompt_high = prompt_tokens(1000, 3)
+
+    ref = complete(prompt_low, 600)
+
+    assert get_metric("n_preempted_total") == 0
+
+    low = Request(prompt_low, 600, priority=0)
+    wait_generating()
+
+    high = Request(prompt_high, 32, priority=1)
+
+    res_high = high.join()
+    res_low  = low.join()
+
+    assert get_metric("n_preempted_total") >= 1
+    assert high.t_end < low.t_end
+
+    assert res_high["timings"]["predicted_n"] == 32
+    assert res_low["timings"]["predicted_n"] == 600
+    assert res_low["content"] == ref["content"]
+
+
+def test_restore_failed():
+    # the KV cache of the preempted slot does not fit while the larger of the two high priority requests is still
+    # generating - it is restored once that request has finished as well
+    global server
+    server.n_ctx = 2048
+    server.n_slots = 3
+    server.kv_unified = True
+    server.sched_preempt = True
+    server.start()
+
+    prompt_low = prompt_tokens(1100)
+
+    ref = complete(prompt_low, 600)
+
+    low = Request(prompt_low, 600, priority=0)
+    wait_generating()
+
+    high_short = Request(prompt_tokens(100, 3), 200, priority=1)
+    high_long  = Request(prompt_tokens(900, 5), 400, priority=1)
+
+    high_short.join()
+    high_long.join()
+    res_low = low.join()
+
+    assert get_metric("n_preempted_total") >= 1
+    assert get_metric("n_restore_failed_total") >= 1
+
+    assert res_low["timings"]["predicted_n"] == 600
+    assert res_low["content"] == ref["content"]
+
+
+def test_kv_unified_without_preempt():
+    # without --sched-preempt, the context of each slot is ctx-size / parallel, also with a unified KV cache
+    global server
+    server.n_ctx = 256
+    server.n_slots = 2
+    server.kv_unified = True
+    server.sched_preempt = False
+    server.disable_ctx_shift = True
+    server.start()
+
+    res = server.make_request("POST", "/completion", data={
+        "prompt": prompt_tokens(200),
+        "n_predict": 4,
+    })
+    assert res.status_code != 200
+    assert "context size" in res.body["error"]["message"]
@@ -66,7 +66,12 @@ class ServerProcess:
     slot_save_path: str | None = None
     id_slot: int | None = None
     cache_prompt: bool | None = None
+    n_cache_reuse: int | None = None
+    cache_ram: int | None = None
     n_slots: int | None = None
+    kv_unified: bool | None = None
+    sched_budget: int | None = None
+    sched_preempt: bool | None = None
     ctk: str | None = None
     ctv: str | None = None
     fa: bool | None = None
@@ -159,6 +164,12 @@ class ServerProcess:
             server_args.extend(["--ctx-size", self.n_ctx])
         if self.n_slots:
             server_args.extend(["--parallel", self.n_slots])
+        if self.kv_unified:
+            server_args.append("--kv-unified")
+        if self.sched_budget:
+            server_args.extend(["--sched-budget", self.sched_budget])
+        if self.sched_preempt:
+            server_args.append("--sched-preempt")
         if self.ctk:
             server_args.extend(["-ctk", self.ctk])
         if self.ctv:
@@ -167,6 +178,10 @@ class ServerProcess:
             server_args.append("-fa")
         if self.n_predict:
             server_args.extend(["--n-predict", self.n_predict])
+        if self.n_cache_reuse:
+            server_args.extend(["--cache-reuse", self.n_cache_reuse])
+        if self.cache_ram:
+            server_args.extend(["--cache-ram", self.cache_ram])
         if self.slot_save_path:
             server_args.extend(["--slot-save-path", self.slot_save_path])
         if self.n_ga:
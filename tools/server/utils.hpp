@@ -1003,16 +1003,30 @@ static std::string safe_json_to_str(const json & data) {
 
 static std::vector<llama_token_data> get_token_probabilities(llama_context * ctx, int idx) {
     std::vector<llama_token_data> cur;
-    const auto * logits = llama_get_logits_ith(ctx, idx);
 
-    const llama_model * model = llama_get_model(ctx);
-    const llama_vocab * vocab = llama_model_get_vocab(model);
+    if (llama_n_top_k_logits(ctx) > 0) {
+        // only the top-k logits are output, the probabilities are relative to those
+        const llama_token * tokens = nullptr;
+        const float       * logits = nullptr;
 
-    const int n_vocab = llama_vocab_n_tokens(vocab);
+        const int n = llama_get_logits_top_k_ith(ctx, idx, &tokens, &logits);
 
-    cur.resize(n_vocab);
-    for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
-        cur[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+        cur.resize(n);
+        for (int i = 0; i < n; i++) {
+            cur[i] = llama_token_data{tokens[i], logits[i], 0.0f};
+        }
+    } else {
+        const auto * logits = llama_get_logits_ith(ctx, idx);
+
+        const llama_model * model = llama_get_model(ctx);
+        const llama_vocab * vocab = llama_model_get_vocab(model);
+
+        const int n_vocab = llama_vocab_n_tokens(vocab);
+
+        cur.resize(n_vocab);
+        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+            cur[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+        }
     }
 
     // sort tokens by logits